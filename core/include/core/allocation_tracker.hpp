@@ -0,0 +1,572 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/symbols.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <format>
+#include <map>
+#include <new>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef RAOE_CORE_TRACK_ALLOCATIONS
+#define RAOE_CORE_TRACK_ALLOCATIONS 0
+#endif
+
+// Heap allocation tracking, for finding out who is churning the allocator.
+//
+// It's opt in twice over.  Build with RAOE_CORE_TRACK_ALLOCATIONS=1 (the CMake option of the same name), and put
+// RAOE_DEFINE_ALLOCATION_HOOKS() in exactly one .cpp of the executable; that replaces the global operator new and
+// delete.  Without the define, the hooks macro is empty and the scopes below compile to nothing.
+//
+// Every allocation is recorded against its call site: the return address of operator new, plus the innermost
+// RAOE_ALLOCATION_SCOPE("name") on that thread, since the return address is usually somewhere inside std::string.
+// Each thread counts into its own table with no locks, and snapshot() adds them all up:
+//     {
+//         RAOE_ALLOCATION_SCOPE("load textures");
+//         load_textures();
+//     }
+//     raoe::debug::allocation_tracker::snapshot().write(std::cout);
+//
+// For tests, allocations_in_scope counts what the current thread allocates while it's alive:
+//     raoe::debug::allocations_in_scope allocations;
+//     parse(line);
+//     CHECK(allocations.count() == 0);
+//
+// Each tracked block carries a 16 byte header (so a free knows its size and site, whatever thread frees it), and each
+// allocation costs a couple of relaxed atomic adds on top of malloc.
+namespace raoe::debug
+{
+    // A name for a region of code, which allocations made inside it are tagged with.  Use RAOE_ALLOCATION_SCOPE rather
+    // than making these yourself; they need to live forever.
+    struct allocation_tag
+    {
+        const char* name;
+        std::source_location location;
+    };
+
+    struct allocation_site
+    {
+        std::string function; // where operator new was called from
+        std::string tag;      // the innermost RAOE_ALLOCATION_SCOPE, if any
+        uint64 allocations = 0;
+        uint64 bytes = 0;
+        uint64 live_allocations = 0;
+        uint64 live_bytes = 0;
+        double allocations_per_second = 0;
+    };
+
+    struct allocation_report
+    {
+        uint64 allocations = 0;
+        uint64 frees = 0;
+        uint64 live_bytes = 0;
+        uint64 peak_bytes = 0;
+        double seconds = 0; // since tracking started, or the last reset()
+        std::vector<allocation_site> sites; // most allocations first
+
+        void write(std::ostream& to, std::size_t top = 20) const
+        {
+            to << std::format("{} allocations, {} frees over {:.2f}s.  {} bytes live, {} peak\n", allocations, frees,
+                              seconds, live_bytes, peak_bytes);
+            to << std::format("{:>10} {:>10} {:>12} {:>12}  {}\n", "allocs", "allocs/s", "bytes", "live bytes",
+                              "site");
+            for(std::size_t i = 0; i < std::min(top, sites.size()); i++)
+            {
+                const auto& site = sites[i];
+                to << std::format("{:>10} {:>10.0f} {:>12} {:>12}  {}{}{}\n", site.allocations,
+                                  site.allocations_per_second, site.bytes, site.live_bytes, site.function,
+                                  site.tag.empty() ? "" : " in ", site.tag);
+            }
+        }
+    };
+
+    namespace _internal
+    {
+        // One row of a thread's table.  Only the owning thread claims rows, but frees can come from any thread, and
+        // snapshots read everything, so the counters are atomics.
+        struct allocation_entry
+        {
+            std::atomic<bool> used = false;
+            const void* return_address = nullptr;
+            const allocation_tag* tag = nullptr;
+            std::atomic<uint64> allocations = 0;
+            std::atomic<uint64> bytes = 0;
+            std::atomic<uint64> frees = 0;
+            std::atomic<uint64> freed_bytes = 0;
+        };
+
+        struct allocation_table
+        {
+            static constexpr std::size_t size = 1024;
+            static constexpr std::size_t max_probe = 16;
+
+            std::atomic<allocation_table*> next = nullptr;
+            std::atomic<bool> in_use = true;
+            // Row 0 catches everything once the table is full
+            allocation_entry entries[size];
+
+            allocation_entry* find(const void* return_address, const allocation_tag* tag) noexcept
+            {
+                const auto key = reinterpret_cast<uintptr_t>(return_address) ^ (reinterpret_cast<uintptr_t>(tag) * 31);
+                std::size_t index = ((key >> 4) * 0x9E3779B97F4A7C15ull) >> 54;
+                for(std::size_t probe = 0; probe < max_probe; probe++, index = (index + 1) & (size - 1))
+                {
+                    if(index == 0)
+                    {
+                        continue;
+                    }
+                    allocation_entry& entry = entries[index];
+                    if(!entry.used.load(std::memory_order_relaxed))
+                    {
+                        entry.return_address = return_address;
+                        entry.tag = tag;
+                        entry.used.store(true, std::memory_order_release);
+                        return &entry;
+                    }
+                    if(entry.return_address == return_address && entry.tag == tag)
+                    {
+                        return &entry;
+                    }
+                }
+                return &entries[0];
+            }
+        };
+
+        // What sits in front of every tracked block
+        struct alignas(16) block_header
+        {
+            allocation_entry* entry;
+            uint64 size : 48;
+            // log2 of the distance from the start of the malloc'd block to the user's pointer, which is the header's size
+            // or the alignment, so always a power of two
+            uint64 offset_shift : 16;
+        };
+        static_assert(sizeof(block_header) == 16);
+
+        struct allocation_globals
+        {
+            std::atomic<allocation_table*> tables = nullptr;
+            std::atomic<int64> live_bytes = 0;
+            std::atomic<int64> peak_bytes = 0;
+            std::atomic<int64> start_ns = 0;
+        };
+
+        inline allocation_globals& globals() noexcept
+        {
+            // Constant initialized, so it's usable from operator new before main
+            static constinit allocation_globals instance;
+            return instance;
+        }
+
+        // Plain thread_locals only, so touching them from operator new can't allocate
+        inline thread_local allocation_table* t_table = nullptr;
+        inline thread_local const allocation_tag* t_tag = nullptr;
+        inline thread_local uint64 t_allocations = 0;
+        inline thread_local uint64 t_bytes = 0;
+
+        inline int64 now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        // Hands the thread's table back for reuse when the thread exits
+        struct table_release
+        {
+            ~table_release()
+            {
+                if(t_table != nullptr)
+                {
+                    t_table->in_use.store(false, std::memory_order_release);
+                    t_table = nullptr;
+                }
+            }
+        };
+
+        inline allocation_table* claim_table() noexcept
+        {
+            auto& g = globals();
+            int64 expected = 0;
+            g.start_ns.compare_exchange_strong(expected, now_ns(), std::memory_order_relaxed);
+
+            // Reuse one from a thread that has exited if there is one, since their counts are still wanted
+            for(auto* table = g.tables.load(std::memory_order_acquire); table != nullptr;
+                table = table->next.load(std::memory_order_relaxed))
+            {
+                bool in_use = false;
+                if(table->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+                {
+                    return table;
+                }
+            }
+
+            // malloc and placement new, not new, or this would be tracking itself
+            void* memory = std::malloc(sizeof(allocation_table));
+            if(memory == nullptr)
+            {
+                return nullptr;
+            }
+            auto* table = new(memory) allocation_table();
+            auto* head = g.tables.load(std::memory_order_relaxed);
+            do
+            {
+                table->next.store(head, std::memory_order_relaxed);
+            } while(!g.tables.compare_exchange_weak(head, table, std::memory_order_release, std::memory_order_relaxed));
+            return table;
+        }
+
+        inline allocation_entry* current_entry(const void* return_address) noexcept
+        {
+            if(t_table == nullptr)
+            {
+                // Guard against the release hook's own registration coming back through here
+                static thread_local bool claiming = false;
+                if(claiming)
+                {
+                    return nullptr;
+                }
+                claiming = true;
+                t_table = claim_table();
+                thread_local table_release release;
+                claiming = false;
+                if(t_table == nullptr)
+                {
+                    return nullptr;
+                }
+            }
+            return t_table->find(return_address, t_tag);
+        }
+
+        inline void* tracked_allocate(std::size_t size, std::size_t alignment, const void* return_address) noexcept
+        {
+            alignment = std::max<std::size_t>(alignment, alignof(block_header));
+            const std::size_t offset = std::max(sizeof(block_header), alignment);
+            const std::size_t total = (size + offset + alignment - 1) & ~(alignment - 1);
+
+            void* base = alignment <= alignof(std::max_align_t) ? std::malloc(total) : std::aligned_alloc(alignment, total);
+            if(base == nullptr)
+            {
+                return nullptr;
+            }
+            auto* user = static_cast<std::byte*>(base) + offset;
+            auto* header = reinterpret_cast<block_header*>(user) - 1;
+            header->entry = current_entry(return_address);
+            header->size = size;
+            header->offset_shift = static_cast<uint64>(std::countr_zero(offset));
+
+            t_allocations++;
+            t_bytes += size;
+            if(header->entry != nullptr)
+            {
+                header->entry->allocations.fetch_add(1, std::memory_order_relaxed);
+                header->entry->bytes.fetch_add(size, std::memory_order_relaxed);
+            }
+            auto& g = globals();
+            const int64 live = g.live_bytes.fetch_add(static_cast<int64>(size), std::memory_order_relaxed) +
+                               static_cast<int64>(size);
+            int64 peak = g.peak_bytes.load(std::memory_order_relaxed);
+            while(live > peak && !g.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            {
+            }
+            return user;
+        }
+
+        inline void tracked_free(void* pointer) noexcept
+        {
+            if(pointer == nullptr)
+            {
+                return;
+            }
+            auto* header = static_cast<block_header*>(pointer) - 1;
+            const uint64 size = header->size;
+            if(header->entry != nullptr)
+            {
+                header->entry->frees.fetch_add(1, std::memory_order_relaxed);
+                header->entry->freed_bytes.fetch_add(size, std::memory_order_relaxed);
+            }
+            globals().live_bytes.fetch_sub(static_cast<int64>(size), std::memory_order_relaxed);
+            std::free(static_cast<std::byte*>(pointer) - (std::size_t(1) << header->offset_shift));
+        }
+
+        // operator new's failure path: call the new_handler until it gives up
+        inline void* allocate_or_handle(std::size_t size, std::size_t alignment, const void* return_address,
+                                        bool nothrow)
+        {
+            while(true)
+            {
+                if(void* pointer = tracked_allocate(size == 0 ? 1 : size, alignment, return_address))
+                {
+                    return pointer;
+                }
+                std::new_handler handler = std::get_new_handler();
+                if(handler == nullptr)
+                {
+                    if(nothrow)
+                    {
+                        return nullptr;
+                    }
+                    throw std::bad_alloc();
+                }
+                handler();
+            }
+        }
+    }
+
+    class allocation_tracker
+    {
+      public:
+        // True if this build can track (RAOE_CORE_TRACK_ALLOCATIONS), not whether the hooks were installed
+        static constexpr bool compiled_in = RAOE_CORE_TRACK_ALLOCATIONS != 0;
+
+        // Adds up every thread's table.  Allocates, so call it from somewhere that doesn't mind.
+        static allocation_report snapshot()
+        {
+            allocation_report report;
+            auto& g = _internal::globals();
+            const int64 start = g.start_ns.load(std::memory_order_relaxed);
+            report.seconds = start == 0 ? 0 : static_cast<double>(_internal::now_ns() - start) / 1e9;
+            report.live_bytes = static_cast<uint64>(std::max<int64>(g.live_bytes.load(std::memory_order_relaxed), 0));
+            report.peak_bytes = static_cast<uint64>(std::max<int64>(g.peak_bytes.load(std::memory_order_relaxed), 0));
+
+            // The same site shows up in every thread that hit it
+            std::map<std::pair<const void*, const allocation_tag*>, allocation_site> merged;
+            for(auto* table = g.tables.load(std::memory_order_acquire); table != nullptr;
+                table = table->next.load(std::memory_order_relaxed))
+            {
+                for(const auto& entry : table->entries)
+                {
+                    const bool overflow = &entry == &table->entries[0];
+                    if(!overflow && !entry.used.load(std::memory_order_acquire))
+                    {
+                        continue;
+                    }
+                    const uint64 allocations = entry.allocations.load(std::memory_order_relaxed);
+                    const uint64 frees = entry.frees.load(std::memory_order_relaxed);
+                    if(allocations == 0 && frees == 0)
+                    {
+                        continue;
+                    }
+                    auto& site = merged[{entry.return_address, entry.tag}];
+                    const uint64 bytes = entry.bytes.load(std::memory_order_relaxed);
+                    const uint64 freed = entry.freed_bytes.load(std::memory_order_relaxed);
+                    site.allocations += allocations;
+                    site.bytes += bytes;
+                    site.live_allocations += allocations - std::min(allocations, frees);
+                    site.live_bytes += bytes - std::min(bytes, freed);
+                    report.allocations += allocations;
+                    report.frees += frees;
+                }
+            }
+
+            report.sites.reserve(merged.size());
+            for(auto& [key, site] : merged)
+            {
+                const auto& [address, tag] = key;
+                site.function = address == nullptr ? "(table full)" : symbol_name(address, true);
+                if(tag != nullptr)
+                {
+                    site.tag = std::format("{} ({}:{})", tag->name, tag->location.file_name(), tag->location.line());
+                }
+                site.allocations_per_second = report.seconds > 0 ? site.allocations / report.seconds : 0;
+                report.sites.push_back(std::move(site));
+            }
+            std::sort(report.sites.begin(), report.sites.end(),
+                      [](const allocation_site& a, const allocation_site& b) { return a.allocations > b.allocations; });
+            return report;
+        }
+
+        // Zeroes the per-site counts and restarts the clock.  Live bytes stay as they are, and the peak drops to
+        // them.  Blocks allocated before the reset still count as frees when they go.
+        static void reset()
+        {
+            auto& g = _internal::globals();
+            for(auto* table = g.tables.load(std::memory_order_acquire); table != nullptr;
+                table = table->next.load(std::memory_order_relaxed))
+            {
+                for(auto& entry : table->entries)
+                {
+                    entry.allocations.store(0, std::memory_order_relaxed);
+                    entry.bytes.store(0, std::memory_order_relaxed);
+                    entry.frees.store(0, std::memory_order_relaxed);
+                    entry.freed_bytes.store(0, std::memory_order_relaxed);
+                }
+            }
+            g.peak_bytes.store(g.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            g.start_ns.store(_internal::now_ns(), std::memory_order_relaxed);
+        }
+    };
+
+    // Tags allocations on this thread until it's destroyed.  Nests.
+    class allocation_scope
+    {
+      public:
+        explicit allocation_scope([[maybe_unused]] const allocation_tag& tag) noexcept
+        {
+#if RAOE_CORE_TRACK_ALLOCATIONS
+            m_previous = _internal::t_tag;
+            _internal::t_tag = &tag;
+#endif
+        }
+
+        ~allocation_scope()
+        {
+#if RAOE_CORE_TRACK_ALLOCATIONS
+            _internal::t_tag = m_previous;
+#endif
+        }
+
+        allocation_scope(const allocation_scope&) = delete;
+        allocation_scope& operator=(const allocation_scope&) = delete;
+
+      private:
+#if RAOE_CORE_TRACK_ALLOCATIONS
+        const allocation_tag* m_previous = nullptr;
+#endif
+    };
+
+    // Counts what the current thread allocates while it's alive.  Always zero when tracking is compiled out or the
+    // hooks aren't installed.
+    class allocations_in_scope
+    {
+      public:
+        allocations_in_scope() noexcept
+            : m_allocations(_internal::t_allocations)
+            , m_bytes(_internal::t_bytes)
+        {
+        }
+
+        [[nodiscard]] uint64 count() const noexcept { return _internal::t_allocations - m_allocations; }
+        [[nodiscard]] uint64 bytes() const noexcept { return _internal::t_bytes - m_bytes; }
+
+        // Reports (without terminating) if more than max allocations happened
+        bool expect_at_most(uint64 max, std::source_location location = std::source_location::current()) const
+        {
+            return raoe::ensure(count() <= max, "{} allocations in scope at {}:{}, expected at most {}", count(),
+                                location.file_name(), location.line(), max);
+        }
+
+      private:
+        uint64 m_allocations;
+        uint64 m_bytes;
+    };
+}
+
+#if RAOE_CORE_TRACK_ALLOCATIONS
+
+#define RAOE_ALLOCATION_SCOPE_CONCAT_(a, b) a##b
+#define RAOE_ALLOCATION_SCOPE_CONCAT(a, b) RAOE_ALLOCATION_SCOPE_CONCAT_(a, b)
+#define RAOE_ALLOCATION_SCOPE(name)                                                                                    \
+    static constexpr ::raoe::debug::allocation_tag RAOE_ALLOCATION_SCOPE_CONCAT(raoe_allocation_tag_, __LINE__) {     \
+        name, std::source_location::current()};                                                                        \
+    ::raoe::debug::allocation_scope RAOE_ALLOCATION_SCOPE_CONCAT(raoe_allocation_scope_, __LINE__)(                    \
+        RAOE_ALLOCATION_SCOPE_CONCAT(raoe_allocation_tag_, __LINE__))
+
+// Replaces the global allocation functions.  Exactly one .cpp per executable.
+#define RAOE_DEFINE_ALLOCATION_HOOKS()                                                                                 \
+    void* operator new(std::size_t size)                                                                               \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, alignof(std::max_align_t),                           \
+                                                            __builtin_return_address(0), false);                       \
+    }                                                                                                                  \
+    void* operator new[](std::size_t size)                                                                             \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, alignof(std::max_align_t),                           \
+                                                            __builtin_return_address(0), false);                       \
+    }                                                                                                                  \
+    void* operator new(std::size_t size, const std::nothrow_t&) noexcept                                               \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, alignof(std::max_align_t),                           \
+                                                            __builtin_return_address(0), true);                        \
+    }                                                                                                                  \
+    void* operator new[](std::size_t size, const std::nothrow_t&) noexcept                                             \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, alignof(std::max_align_t),                           \
+                                                            __builtin_return_address(0), true);                        \
+    }                                                                                                                  \
+    void* operator new(std::size_t size, std::align_val_t alignment)                                                   \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, static_cast<std::size_t>(alignment),                 \
+                                                            __builtin_return_address(0), false);                       \
+    }                                                                                                                  \
+    void* operator new[](std::size_t size, std::align_val_t alignment)                                                 \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, static_cast<std::size_t>(alignment),                 \
+                                                            __builtin_return_address(0), false);                       \
+    }                                                                                                                  \
+    void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept                   \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, static_cast<std::size_t>(alignment),                 \
+                                                            __builtin_return_address(0), true);                        \
+    }                                                                                                                  \
+    void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept                 \
+    {                                                                                                                  \
+        return ::raoe::debug::_internal::allocate_or_handle(size, static_cast<std::size_t>(alignment),                 \
+                                                            __builtin_return_address(0), true);                        \
+    }                                                                                                                  \
+    void operator delete(void* pointer) noexcept { ::raoe::debug::_internal::tracked_free(pointer); }                  \
+    void operator delete[](void* pointer) noexcept { ::raoe::debug::_internal::tracked_free(pointer); }                \
+    void operator delete(void* pointer, std::size_t) noexcept { ::raoe::debug::_internal::tracked_free(pointer); }     \
+    void operator delete[](void* pointer, std::size_t) noexcept { ::raoe::debug::_internal::tracked_free(pointer); }   \
+    void operator delete(void* pointer, std::align_val_t) noexcept { ::raoe::debug::_internal::tracked_free(pointer); }\
+    void operator delete[](void* pointer, std::align_val_t) noexcept                                                   \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept                                        \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept                                      \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete(void* pointer, const std::nothrow_t&) noexcept                                                \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete[](void* pointer, const std::nothrow_t&) noexcept                                              \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept                              \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }                                                                                                                  \
+    void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept                            \
+    {                                                                                                                  \
+        ::raoe::debug::_internal::tracked_free(pointer);                                                               \
+    }
+
+#else
+
+#define RAOE_ALLOCATION_SCOPE(name)
+#define RAOE_DEFINE_ALLOCATION_HOOKS()
+
+#endif
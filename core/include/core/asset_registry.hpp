@@ -0,0 +1,598 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/concurrent_map.hpp"
+#include "core/function_ref.hpp"
+#include "core/mapped_file.hpp"
+#include "core/types.hpp"
+#include "core/uuid.hpp"
+#include "tag/tag.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Every asset's uuid, tag and path, looked up by any of the three.
+//
+// It saves to one file that's used straight from memory when it's opened again: the records sorted by uuid, a perfect
+// hash table for each kind of key (one probe, then one compare against the record it points at), and the strings.
+// Offsets instead of pointers, so opening is a mmap and a quick check of the header and offsets, rather than scanning
+// every asset and filling three maps.
+//
+// Changes after opening go in a small overlay of hash maps that's checked first; once it's big enough everything is
+// folded into a fresh image.  Saving writes the merged result.  The fingerprint is whatever says the saved file
+// still describes what's on disk (fs::mount_fingerprint() is the usual one); open() refuses a file with a different
+// one, and then it's time to scan and rebuild.
+//     auto registry = raoe::asset_registry::open(cache, raoe::fs::mount_fingerprint());
+//     if(!registry) registry = scan_everything();
+//     auto texture = registry->find(raoe::tag("game:textures/grass"));
+namespace raoe
+{
+    namespace _internal::asset_registry_format
+    {
+        inline constexpr uint32 magic = 0x47524152; // "RARG"
+        inline constexpr uint32 version = 1;
+        inline constexpr uint32 empty_slot = ~uint32 {0};
+
+        struct header
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 size;
+            uint64 fingerprint;
+            uint32 count;
+            uint32 buckets;
+            uint32 slots;
+            uint32 string_bytes;
+        };
+
+        struct record
+        {
+            std::array<uint8, 16> id;
+            uint32 name_offset;
+            uint32 name_size;
+            uint32 path_offset;
+            uint32 path_size;
+        };
+
+        static_assert(sizeof(header) == 40 && sizeof(record) == 32, "asset_registry's file layout has padding in it");
+
+        // Where each part starts.  The uuid, tag and path tables are each a seed per bucket and an index per slot.
+        struct layout
+        {
+            std::size_t records;
+            std::size_t id_seeds;
+            std::size_t id_slots;
+            std::size_t name_seeds;
+            std::size_t name_slots;
+            std::size_t path_seeds;
+            std::size_t path_slots;
+            std::size_t strings;
+            std::size_t size;
+
+            explicit layout(const header& h)
+                : records(sizeof(header))
+                , id_seeds(records + std::size_t {h.count} * sizeof(record))
+                , id_slots(id_seeds + std::size_t {h.buckets} * 4)
+                , name_seeds(id_slots + std::size_t {h.slots} * 4)
+                , name_slots(name_seeds + std::size_t {h.buckets} * 4)
+                , path_seeds(name_slots + std::size_t {h.slots} * 4)
+                , path_slots(path_seeds + std::size_t {h.buckets} * 4)
+                , strings(path_slots + std::size_t {h.slots} * 4)
+                , size(strings + h.string_bytes)
+            {
+            }
+        };
+
+        // Hash and displace: a key's bucket comes from its hash alone, and each bucket has a seed that was picked so
+        // that all of its keys land in empty slots
+        inline uint32 bucket_of(uint64 hash, uint32 buckets) noexcept
+        {
+            return static_cast<uint32>(((hash >> 32) * buckets) >> 32);
+        }
+
+        inline uint32 slot_of(uint64 hash, uint32 seed, uint32 slots) noexcept
+        {
+            const uint64 mixed = distribute(hash ^ (seed * uint64 {0x9e3779b97f4a7c15}));
+            return static_cast<uint32>(((mixed >> 32) * slots) >> 32);
+        }
+
+        // keys are (hash, record index).  Fills in a seed for every bucket and a record index (or empty_slot) for
+        // every slot.
+        inline void build_table(const std::vector<std::pair<uint64, uint32>>& keys, std::span<uint32> seeds,
+                                std::span<uint32> slots)
+        {
+            std::ranges::fill(seeds, 0);
+            std::ranges::fill(slots, empty_slot);
+            std::vector<std::vector<uint32>> buckets(seeds.size());
+            for(uint32 k = 0; k < keys.size(); k++)
+            {
+                buckets[bucket_of(keys[k].first, static_cast<uint32>(seeds.size()))].push_back(k);
+            }
+            std::vector<uint32> order(buckets.size());
+            for(uint32 b = 0; b < order.size(); b++)
+            {
+                order[b] = b;
+            }
+            // Biggest buckets first, while there's the most room
+            std::ranges::stable_sort(order,
+                                     [&](uint32 lhs, uint32 rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+            std::vector<uint32> trial;
+            for(uint32 b : order)
+            {
+                if(buckets[b].empty())
+                {
+                    break;
+                }
+                for(uint32 seed = 0;; seed++)
+                {
+                    // Only two keys with the same 64 bit hash get here
+                    check_if(seed < (1u << 24), "asset_registry: couldn't build a perfect hash table");
+                    trial.clear();
+                    bool placed = true;
+                    for(uint32 k : buckets[b])
+                    {
+                        const uint32 slot = slot_of(keys[k].first, seed, static_cast<uint32>(slots.size()));
+                        if(slots[slot] != empty_slot || std::ranges::find(trial, slot) != trial.end())
+                        {
+                            placed = false;
+                            break;
+                        }
+                        trial.push_back(slot);
+                    }
+                    if(placed)
+                    {
+                        for(std::size_t i = 0; i < trial.size(); i++)
+                        {
+                            slots[trial[i]] = keys[buckets[b][i]].second;
+                        }
+                        seeds[b] = seed;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    class asset_registry
+    {
+        using format_header = _internal::asset_registry_format::header;
+        using format_record = _internal::asset_registry_format::record;
+        using format_layout = _internal::asset_registry_format::layout;
+
+      public:
+        // The views point into the registry, and last until the next change to it
+        struct entry
+        {
+            uuid id;
+            std::string_view name;
+            std::string_view path;
+        };
+
+        asset_registry() = default;
+        asset_registry(asset_registry&&) noexcept = default;
+        asset_registry& operator=(asset_registry&&) noexcept = default;
+
+        // nullopt if the file is missing, damaged, from another version or has a different fingerprint
+        [[nodiscard]] static std::optional<asset_registry> open(const std::filesystem::path& file, uint64 fingerprint)
+        {
+            asset_registry registry;
+            registry.m_file = mapped_file(file);
+            if(!registry.m_file.is_open() || !registry.load(registry.m_file.bytes(), fingerprint))
+            {
+                return std::nullopt;
+            }
+            return registry;
+        }
+
+        [[nodiscard]] static std::optional<asset_registry> from_bytes(std::vector<std::byte> bytes, uint64 fingerprint)
+        {
+            asset_registry registry;
+            registry.m_owned = std::move(bytes);
+            if(!registry.load(registry.m_owned, fingerprint))
+            {
+                return std::nullopt;
+            }
+            return registry;
+        }
+
+        // Adds the asset or changes its name and path.  Empty names and paths aren't indexed.  Fails (and changes
+        // nothing) if another asset already has that name or path.
+        bool insert_or_assign(const uuid& id, const tag& name, std::string_view path)
+        {
+            const std::string_view name_key = name;
+            const auto name_owner = name_key.empty() ? std::nullopt : find(name);
+            const auto path_owner = path.empty() ? std::nullopt : find_path(path);
+            if((name_owner && name_owner->id != id) || (path_owner && path_owner->id != id))
+            {
+                return false;
+            }
+
+            m_size += contains(id) ? 0 : 1;
+            unindex_change(id);
+            auto& change = m_changes[id];
+            change = changed_entry {std::string(name_key), std::string(path)};
+            if(!change->name.empty())
+            {
+                m_changed_names.emplace(change->name, id);
+            }
+            if(!change->path.empty())
+            {
+                m_changed_paths.emplace(change->path, id);
+            }
+            compact_if_needed();
+            return true;
+        }
+
+        bool erase(const uuid& id)
+        {
+            const bool in_image = find_in_image(id).has_value();
+            const bool changed = unindex_change(id);
+            if(!changed && (!in_image || m_changes.contains(id)))
+            {
+                return false;
+            }
+            // Only needs remembering if the image still has it
+            if(in_image)
+            {
+                m_changes[id] = std::nullopt;
+            }
+            else
+            {
+                m_changes.erase(id);
+            }
+            m_size--;
+            compact_if_needed();
+            return true;
+        }
+
+        [[nodiscard]] std::optional<entry> find(const uuid& id) const
+        {
+            if(!m_changes.empty())
+            {
+                if(const auto it = m_changes.find(id); it != m_changes.end())
+                {
+                    return it->second ? std::optional(entry {id, it->second->name, it->second->path}) : std::nullopt;
+                }
+            }
+            const auto index = find_in_image(id);
+            return index ? std::optional(entry_at(*index)) : std::nullopt;
+        }
+
+        [[nodiscard]] std::optional<entry> find(const tag& name) const
+        {
+            return find_key(name, m_changed_names, m_layout.name_seeds, m_layout.name_slots, &entry::name);
+        }
+
+        [[nodiscard]] std::optional<entry> find_path(std::string_view path) const
+        {
+            return find_key(path, m_changed_paths, m_layout.path_seeds, m_layout.path_slots, &entry::path);
+        }
+
+        [[nodiscard]] bool contains(const uuid& id) const { return find(id).has_value(); }
+        [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+        [[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+        [[nodiscard]] uint64 fingerprint() const noexcept { return m_header.fingerprint; }
+        // Changes sitting in the overlay, not yet folded into the image
+        [[nodiscard]] std::size_t pending_changes() const noexcept { return m_changes.size(); }
+
+        // Every asset, in no particular order
+        void for_each(function_ref<void(const entry&)> fn) const
+        {
+            for(uint32 i = 0; i < m_header.count; i++)
+            {
+                const entry e = entry_at(i);
+                if(m_changes.empty() || !m_changes.contains(e.id))
+                {
+                    fn(e);
+                }
+            }
+            for(const auto& [id, change] : m_changes)
+            {
+                if(change)
+                {
+                    fn(entry {id, change->name, change->path});
+                }
+            }
+        }
+
+        [[nodiscard]] std::vector<std::byte> serialize(uint64 fingerprint) const
+        {
+            namespace format = _internal::asset_registry_format;
+
+            std::vector<entry> entries;
+            entries.reserve(m_size);
+            std::size_t string_bytes = 0;
+            for_each([&](const entry& e) {
+                entries.push_back(e);
+                string_bytes += e.name.size() + e.path.size();
+            });
+            std::ranges::sort(entries, [](const entry& lhs, const entry& rhs) { return lhs.id < rhs.id; });
+            check_if(entries.size() < format::empty_slot && string_bytes < ~uint32 {0},
+                     "asset_registry: too big to save ({} assets, {} bytes of strings)", entries.size(), string_bytes);
+
+            format_header h {};
+            h.magic = format::magic;
+            h.version = format::version;
+            h.fingerprint = fingerprint;
+            h.count = static_cast<uint32>(entries.size());
+            // Load factor 0.8 and four keys a bucket, so seeds are quick to find
+            h.buckets = std::max<uint32>(1, (h.count + 3) / 4);
+            h.slots = h.count + h.count / 4 + 1;
+            h.string_bytes = static_cast<uint32>(string_bytes);
+            const format_layout layout(h);
+            h.size = layout.size;
+
+            std::vector<std::byte> bytes(layout.size);
+            std::memcpy(bytes.data(), &h, sizeof(h));
+            std::vector<std::pair<uint64, uint32>> ids;
+            std::vector<std::pair<uint64, uint32>> names;
+            std::vector<std::pair<uint64, uint32>> paths;
+            uint32 string_offset = 0;
+            auto add_string = [&](std::string_view text) {
+                std::memcpy(bytes.data() + layout.strings + string_offset, text.data(), text.size());
+                string_offset += static_cast<uint32>(text.size());
+                return string_offset - static_cast<uint32>(text.size());
+            };
+            for(uint32 i = 0; i < h.count; i++)
+            {
+                const entry& e = entries[i];
+                format_record r {};
+                std::ranges::copy(e.id.bytes(), r.id.begin());
+                r.name_offset = add_string(e.name);
+                r.name_size = static_cast<uint32>(e.name.size());
+                r.path_offset = add_string(e.path);
+                r.path_size = static_cast<uint32>(e.path.size());
+                std::memcpy(bytes.data() + layout.records + i * sizeof(format_record), &r, sizeof(r));
+                ids.emplace_back(stable_hash(id_key(e.id)), i);
+                if(!e.name.empty())
+                {
+                    names.emplace_back(stable_hash(e.name), i);
+                }
+                if(!e.path.empty())
+                {
+                    paths.emplace_back(stable_hash(e.path), i);
+                }
+            }
+
+            auto table = [&](std::size_t offset, std::size_t count) {
+                return std::span(reinterpret_cast<uint32*>(bytes.data() + offset), count);
+            };
+            format::build_table(ids, table(layout.id_seeds, h.buckets), table(layout.id_slots, h.slots));
+            format::build_table(names, table(layout.name_seeds, h.buckets), table(layout.name_slots, h.slots));
+            format::build_table(paths, table(layout.path_seeds, h.buckets), table(layout.path_slots, h.slots));
+            return bytes;
+        }
+
+        // Written next to the file and renamed over it, so a crash never leaves half a registry behind
+        bool save(const std::filesystem::path& file, uint64 fingerprint) const
+        {
+            const std::vector<std::byte> bytes = serialize(fingerprint);
+            std::filesystem::path temp = file;
+            temp += ".tmp";
+            {
+                std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+                if(!out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+                {
+                    return false;
+                }
+            }
+            std::error_code ec;
+            std::filesystem::rename(temp, file, ec);
+            return !ec;
+        }
+
+        // Folds the overlay into a fresh image now, rather than when it gets big
+        void compact()
+        {
+            std::vector<std::byte> bytes = serialize(m_header.fingerprint);
+            m_changes.clear();
+            m_changed_names.clear();
+            m_changed_paths.clear();
+            m_file.close();
+            m_owned = std::move(bytes);
+            check_if(load(m_owned, m_header.fingerprint), "asset_registry: compacting made a bad image");
+        }
+
+      private:
+        struct changed_entry
+        {
+            std::string name;
+            std::string path;
+        };
+
+        using key_index = std::unordered_map<std::string, uuid, _internal::transparent_hash<std::string>,
+                                             _internal::transparent_equal<std::string>>;
+
+        template <typename T>
+        [[nodiscard]] T read(std::size_t offset) const noexcept
+        {
+            T value;
+            std::memcpy(&value, m_image.data() + offset, sizeof(T));
+            return value;
+        }
+
+        [[nodiscard]] format_record record_at(uint32 index) const noexcept
+        {
+            return read<format_record>(m_layout.records + std::size_t {index} * sizeof(format_record));
+        }
+
+        [[nodiscard]] std::string_view string_at(uint32 offset, uint32 size) const noexcept
+        {
+            return {reinterpret_cast<const char*>(m_image.data() + m_layout.strings + offset), size};
+        }
+
+        [[nodiscard]] entry entry_at(uint32 index) const
+        {
+            format_record r = record_at(index);
+            return entry {uuid(std::span<uint8, 16>(r.id)), string_at(r.name_offset, r.name_size),
+                          string_at(r.path_offset, r.path_size)};
+        }
+
+        // Checks everything a lookup could trip over, so lookups themselves don't have to
+        bool load(std::span<const std::byte> bytes, uint64 fingerprint)
+        {
+            namespace format = _internal::asset_registry_format;
+
+            format_header h {};
+            if(bytes.size() < sizeof(h))
+            {
+                return false;
+            }
+            std::memcpy(&h, bytes.data(), sizeof(h));
+            if(h.magic != format::magic || h.version != format::version || h.fingerprint != fingerprint ||
+               h.size != bytes.size() || h.buckets == 0 || h.slots <= h.count || format_layout(h).size != h.size)
+            {
+                return false;
+            }
+
+            m_image = bytes;
+            m_header = h;
+            m_layout = format_layout(h);
+            std::array<uint8, 16> previous {};
+            for(uint32 i = 0; i < h.count; i++)
+            {
+                const format_record r = record_at(i);
+                if(uint64 {r.name_offset} + r.name_size > h.string_bytes ||
+                   uint64 {r.path_offset} + r.path_size > h.string_bytes || (i > 0 && r.id <= previous))
+                {
+                    return false;
+                }
+                previous = r.id;
+            }
+            for(std::size_t offset : {m_layout.id_slots, m_layout.name_slots, m_layout.path_slots})
+            {
+                for(uint32 s = 0; s < h.slots; s++)
+                {
+                    const auto index = read<uint32>(offset + s * 4);
+                    if(index != format::empty_slot && index >= h.count)
+                    {
+                        return false;
+                    }
+                }
+            }
+            m_size = h.count;
+            return true;
+        }
+
+        [[nodiscard]] static std::string_view id_key(const uuid& id) noexcept
+        {
+            return {reinterpret_cast<const char*>(id.bytes().data()), id.bytes().size()};
+        }
+
+        // The record a key's hash points at in one of the tables (which still has to be checked against the key)
+        [[nodiscard]] uint32 probe(std::size_t seeds, std::size_t slots, std::string_view key) const noexcept
+        {
+            namespace format = _internal::asset_registry_format;
+
+            const uint64 hash = stable_hash(key);
+            const auto seed = read<uint32>(seeds + format::bucket_of(hash, m_header.buckets) * 4);
+            return read<uint32>(slots + format::slot_of(hash, seed, m_header.slots) * 4);
+        }
+
+        [[nodiscard]] std::optional<uint32> find_in_image(const uuid& id) const
+        {
+            if(m_header.count == 0)
+            {
+                return std::nullopt;
+            }
+            const uint32 index = probe(m_layout.id_seeds, m_layout.id_slots, id_key(id));
+            if(index == _internal::asset_registry_format::empty_slot ||
+               std::memcmp(m_image.data() + m_layout.records + std::size_t {index} * sizeof(format_record),
+                           id.bytes().data(), 16) != 0)
+            {
+                return std::nullopt;
+            }
+            return index;
+        }
+
+        [[nodiscard]] std::optional<entry> find_key(std::string_view key, const key_index& changed,
+                                                    std::size_t seeds, std::size_t slots,
+                                                    std::string_view entry::*field) const
+        {
+            namespace format = _internal::asset_registry_format;
+
+            if(!m_changes.empty())
+            {
+                if(const auto it = changed.find(key); it != changed.end())
+                {
+                    return find(it->second);
+                }
+            }
+            if(m_header.count == 0 || key.empty())
+            {
+                return std::nullopt;
+            }
+            const uint32 index = probe(seeds, slots, key);
+            if(index == format::empty_slot)
+            {
+                return std::nullopt;
+            }
+            const entry e = entry_at(index);
+            // A key that isn't in the table still lands somewhere; and if it is, the overlay may have taken it away
+            if(e.*field != key || (!m_changes.empty() && m_changes.contains(e.id)))
+            {
+                return std::nullopt;
+            }
+            return e;
+        }
+
+        // Takes id's overlay entry (if it has a live one) out of the name and path indexes.  True if it had one.
+        bool unindex_change(const uuid& id)
+        {
+            const auto it = m_changes.find(id);
+            if(it == m_changes.end() || !it->second)
+            {
+                return false;
+            }
+            m_changed_names.erase(it->second->name);
+            m_changed_paths.erase(it->second->path);
+            return true;
+        }
+
+        void compact_if_needed()
+        {
+            if(m_changes.size() > std::max<std::size_t>(1024, m_header.count / 8))
+            {
+                compact();
+            }
+        }
+
+        mapped_file m_file;
+        std::vector<std::byte> m_owned;
+        std::span<const std::byte> m_image;
+        format_header m_header {};
+        format_layout m_layout {format_header {}};
+
+        std::unordered_map<uuid, std::optional<changed_entry>> m_changes;
+        key_index m_changed_names;
+        key_index m_changed_paths;
+        std::size_t m_size = 0;
+    };
+}
@@ -0,0 +1,1021 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/fixed.hpp"
+#include "core/function.hpp"
+#include "core/types.hpp"
+#include "core/uuid.hpp"
+#include "tag/tag.hpp"
+
+#ifdef RAOE_CORE_USE_SPDLOG
+#include "spdlog/spdlog.h"
+#else
+#include <iostream>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define RAOE_BINARY_LOG_RDTSC 1
+#endif
+
+// Binary logging with deferred formatting.
+//
+// A log call doesn't format anything.  It copies the address of its format string and source location, a timestamp,
+// and the raw bytes of its arguments into a ring buffer owned by the calling thread, and returns.  Formatting happens
+// later: either on a background thread that drains the rings into text (text_sink), or offline, by writing the rings
+// to a file (binary_sink) and running the binlog-decode tool over it.
+//     raoe::binary_log::info("loaded {} in {:.2f}ms", asset_tag, elapsed_ms);
+//
+// Arguments can be integers, floats, bools, strings (copied), uuids, tags and raoe::fixed.  If a thread's ring is full
+// the message is dropped and counted, rather than blocking the caller.
+namespace raoe::binary_log
+{
+    enum class level : uint8
+    {
+        trace,
+        debug,
+        info,
+        warn,
+        error,
+        critical,
+        off,
+    };
+
+    inline std::string_view to_string(level lvl)
+    {
+        constexpr std::string_view names[] = {"trace", "debug", "info", "warn", "error", "critical", "off"};
+        return names[static_cast<uint8>(lvl) < 7 ? static_cast<uint8>(lvl) : 6];
+    }
+
+    namespace _internal
+    {
+        enum class arg_type : uint8
+        {
+            boolean,
+            signed_int,
+            unsigned_int,
+            floating,
+            string,
+            uuid,
+            fixed,
+        };
+
+        template <typename T>
+        inline constexpr bool is_fixed = false;
+
+        template <std::integral TUnderlying, uint8 TFractionBits, std::integral TIntermediate, bool TRounding>
+        inline constexpr bool is_fixed<raoe::fixed<TUnderlying, TFractionBits, TIntermediate, TRounding>> = true;
+
+        template <typename T>
+        concept loggable = std::integral<T> || std::floating_point<T> || std::same_as<T, raoe::uuid> || is_fixed<T> ||
+                           std::convertible_to<const T&, std::string_view>;
+
+        template <typename T>
+        std::size_t encoded_size(const T& value)
+        {
+            if constexpr(std::same_as<T, bool>)
+            {
+                return 2;
+            }
+            else if constexpr(std::integral<T> || std::floating_point<T>)
+            {
+                return 1 + sizeof(uint64);
+            }
+            else if constexpr(std::same_as<T, raoe::uuid>)
+            {
+                return 1 + 16;
+            }
+            else if constexpr(is_fixed<T>)
+            {
+                return 1 + 1 + sizeof(int64);
+            }
+            else
+            {
+                return 1 + sizeof(uint32) + static_cast<std::string_view>(value).size();
+            }
+        }
+
+        inline std::byte* write_bytes(std::byte* out, const void* from, std::size_t size)
+        {
+            std::memcpy(out, from, size);
+            return out + size;
+        }
+
+        inline std::byte* write_type(std::byte* out, arg_type type)
+        {
+            *out = static_cast<std::byte>(type);
+            return out + 1;
+        }
+
+        template <typename T>
+        std::byte* encode(std::byte* out, const T& value)
+        {
+            if constexpr(std::same_as<T, bool>)
+            {
+                out = write_type(out, arg_type::boolean);
+                *out = static_cast<std::byte>(value ? 1 : 0);
+                return out + 1;
+            }
+            else if constexpr(std::signed_integral<T>)
+            {
+                const auto wide = static_cast<int64>(value);
+                return write_bytes(write_type(out, arg_type::signed_int), &wide, sizeof(wide));
+            }
+            else if constexpr(std::unsigned_integral<T>)
+            {
+                const auto wide = static_cast<uint64>(value);
+                return write_bytes(write_type(out, arg_type::unsigned_int), &wide, sizeof(wide));
+            }
+            else if constexpr(std::floating_point<T>)
+            {
+                const auto wide = static_cast<double>(value);
+                return write_bytes(write_type(out, arg_type::floating), &wide, sizeof(wide));
+            }
+            else if constexpr(std::same_as<T, raoe::uuid>)
+            {
+                return write_bytes(write_type(out, arg_type::uuid), value.bytes().data(), 16);
+            }
+            else if constexpr(is_fixed<T>)
+            {
+                out = write_type(out, arg_type::fixed);
+                *out++ = static_cast<std::byte>(T::fraction_bits);
+                const auto raw = static_cast<int64>(value.raw());
+                return write_bytes(out, &raw, sizeof(raw));
+            }
+            else
+            {
+                const auto text = static_cast<std::string_view>(value);
+                const auto length = static_cast<uint32>(text.size());
+                out = write_bytes(write_type(out, arg_type::string), &length, sizeof(length));
+                return write_bytes(out, text.data(), text.size());
+            }
+        }
+
+        // Reads one argument back out and formats it with spec (the part of the placeholder after the colon)
+        inline bool format_arg(std::span<const std::byte>& args, std::string_view spec, std::string& out)
+        {
+            if(args.empty())
+            {
+                return false;
+            }
+            const auto type = static_cast<arg_type>(args[0]);
+            args = args.subspan(1);
+
+            const std::string fmt = std::format("{{:{}}}", spec);
+            auto read = [&](void* into, std::size_t size) {
+                if(args.size() < size)
+                {
+                    return false;
+                }
+                std::memcpy(into, args.data(), size);
+                args = args.subspan(size);
+                return true;
+            };
+
+            switch(type)
+            {
+                case arg_type::boolean:
+                {
+                    uint8 value = 0;
+                    bool as_bool = false;
+                    if(!read(&value, 1))
+                    {
+                        return false;
+                    }
+                    as_bool = value != 0;
+                    out += std::vformat(fmt, std::make_format_args(as_bool));
+                    return true;
+                }
+                case arg_type::signed_int:
+                {
+                    int64 value = 0;
+                    if(!read(&value, sizeof(value)))
+                    {
+                        return false;
+                    }
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+                case arg_type::unsigned_int:
+                {
+                    uint64 value = 0;
+                    if(!read(&value, sizeof(value)))
+                    {
+                        return false;
+                    }
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+                case arg_type::floating:
+                {
+                    double value = 0;
+                    if(!read(&value, sizeof(value)))
+                    {
+                        return false;
+                    }
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+                case arg_type::string:
+                {
+                    uint32 length = 0;
+                    if(!read(&length, sizeof(length)) || args.size() < length)
+                    {
+                        return false;
+                    }
+                    std::string_view value(reinterpret_cast<const char*>(args.data()), length);
+                    args = args.subspan(length);
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+                case arg_type::uuid:
+                {
+                    std::array<uint8, 16> bytes;
+                    if(!read(bytes.data(), bytes.size()))
+                    {
+                        return false;
+                    }
+                    std::string value = std::format("{}", raoe::uuid(std::span<uint8, 16>(bytes)));
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+                case arg_type::fixed:
+                {
+                    uint8 fraction_bits = 0;
+                    int64 raw = 0;
+                    if(!read(&fraction_bits, 1) || !read(&raw, sizeof(raw)))
+                    {
+                        return false;
+                    }
+                    double value = static_cast<double>(raw) / static_cast<double>(uint64(1) << fraction_bits);
+                    out += std::vformat(fmt, std::make_format_args(value));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Formats a std::format style string with encoded arguments.  Placeholders can't be positional.
+        inline std::string format_encoded(std::string_view format, std::span<const std::byte> args)
+        {
+            std::string out;
+            out.reserve(format.size() + args.size());
+            for(std::size_t i = 0; i < format.size(); i++)
+            {
+                const char c = format[i];
+                if((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c)
+                {
+                    out.push_back(c);
+                    i++;
+                    continue;
+                }
+                if(c != '{')
+                {
+                    out.push_back(c);
+                    continue;
+                }
+
+                const std::size_t close = format.find('}', i);
+                if(close == std::string_view::npos)
+                {
+                    out.append(format.substr(i));
+                    break;
+                }
+                std::string_view spec = format.substr(i + 1, close - i - 1);
+                spec = spec.substr(spec.find(':') == std::string_view::npos ? spec.size() : spec.find(':') + 1);
+                try
+                {
+                    if(!format_arg(args, spec, out))
+                    {
+                        out.append("{?}");
+                    }
+                }
+                catch(const std::exception&)
+                {
+                    out.append("{!}");
+                }
+                i = close;
+            }
+            return out;
+        }
+
+        // Cheapest monotonic timestamp the platform has.  On x86 it's the TSC, which the sinks convert to wall clock
+        // time with the clock records they write.
+        inline uint64 ticks() noexcept
+        {
+#ifdef RAOE_BINARY_LOG_RDTSC
+            return __rdtsc();
+#else
+            return static_cast<uint64>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+        }
+
+        inline int64 unix_nanoseconds() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        }
+
+        // The format string and location of a log call, captured at compile time.  The addresses are what identify
+        // a call site, so nothing gets copied per message.
+        template <typename... Args>
+        struct format_site
+        {
+            template <std::size_t N>
+            consteval format_site(const char (&format)[N],
+                                  std::source_location location = std::source_location::current()) noexcept
+                : m_format(format)
+                , m_location(location)
+            {
+            }
+
+            const char* m_format;
+            std::source_location m_location;
+        };
+
+        // What's at the front of every message in a ring
+        struct record_header
+        {
+            uint64 ticks;
+            const char* format;
+            const char* file;
+            uint32 line;
+            level lvl;
+            uint8 arg_count;
+        };
+    }
+
+    // A single producer, single consumer ring of variable sized records.  Every thread that logs gets its own.
+    class thread_ring
+    {
+        // Each record is [uint32 total size][uint32 payload size][payload], padded to 8 bytes.
+        // A total size of 0 means the rest of the buffer is unused and the next record is at the start.
+        static constexpr std::size_t record_prefix = 2 * sizeof(uint32);
+
+      public:
+        explicit thread_ring(std::size_t capacity)
+            : m_capacity(std::bit_ceil(std::max<std::size_t>(capacity, 4096)))
+            , m_buffer(std::make_unique_for_overwrite<std::byte[]>(m_capacity))
+        {
+        }
+
+        // Producer side.  Returns nullptr (and counts a drop) if there isn't room.
+        std::byte* reserve(std::size_t payload_size) noexcept
+        {
+            const std::size_t total = (record_prefix + payload_size + 7) & ~std::size_t(7);
+            uint64 head = m_head.load(std::memory_order_relaxed);
+            const std::size_t offset = head & (m_capacity - 1);
+            const std::size_t contiguous = m_capacity - offset;
+            const std::size_t needed = total <= contiguous ? total : total + contiguous;
+
+            if(head + needed - m_cached_tail > m_capacity)
+            {
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if(head + needed - m_cached_tail > m_capacity)
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+            }
+
+            if(total > contiguous)
+            {
+                const uint32 wrap = 0;
+                std::memcpy(m_buffer.get() + offset, &wrap, sizeof(wrap));
+                head += contiguous;
+            }
+
+            std::byte* record = m_buffer.get() + (head & (m_capacity - 1));
+            const auto sizes = std::array<uint32, 2> {static_cast<uint32>(total), static_cast<uint32>(payload_size)};
+            std::memcpy(record, sizes.data(), record_prefix);
+            m_pending_head = head + total;
+            return record + record_prefix;
+        }
+
+        void commit() noexcept { m_head.store(m_pending_head, std::memory_order_release); }
+
+        // Consumer side.  Calls fn(std::span<const std::byte>) with the payload of every committed record.
+        template <typename TFunc>
+        std::size_t drain(TFunc&& fn)
+        {
+            uint64 tail = m_tail.load(std::memory_order_relaxed);
+            const uint64 head = m_head.load(std::memory_order_acquire);
+            std::size_t count = 0;
+            while(tail != head)
+            {
+                const std::size_t offset = tail & (m_capacity - 1);
+                std::array<uint32, 2> sizes;
+                std::memcpy(sizes.data(), m_buffer.get() + offset, sizeof(uint32));
+                if(sizes[0] == 0)
+                {
+                    tail += m_capacity - offset;
+                    continue;
+                }
+                std::memcpy(sizes.data(), m_buffer.get() + offset, record_prefix);
+                fn(std::span<const std::byte>(m_buffer.get() + offset + record_prefix, sizes[1]));
+                tail += sizes[0];
+                count++;
+            }
+            m_tail.store(tail, std::memory_order_release);
+            return count;
+        }
+
+        [[nodiscard]] uint64 dropped() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+        // Set by the producer when its thread exits.  Once the consumer sees it, whatever is drained after is the last
+        // of it.
+        void orphan() noexcept { m_orphaned.store(true, std::memory_order_release); }
+        [[nodiscard]] bool orphaned() const noexcept { return m_orphaned.load(std::memory_order_acquire); }
+
+      private:
+        const std::size_t m_capacity;
+        std::unique_ptr<std::byte[]> m_buffer;
+
+        // Producer owned
+        alignas(64) std::atomic<uint64> m_head = 0;
+        uint64 m_pending_head = 0;
+        uint64 m_cached_tail = 0;
+
+        // Consumer owned
+        alignas(64) std::atomic<uint64> m_tail = 0;
+        std::atomic<uint64> m_dropped = 0;
+        std::atomic<bool> m_orphaned = false;
+    };
+
+    // A message pulled out of a ring.  The views point into the ring (format and file are static strings), so they're
+    // only good for the duration of the drain callback.
+    struct message
+    {
+        uint64 ticks = 0;
+        std::string_view format;
+        std::string_view file;
+        uint32 line = 0;
+        level lvl = level::info;
+        std::span<const std::byte> args;
+
+        [[nodiscard]] std::string text() const { return _internal::format_encoded(format, args); }
+    };
+
+    // Owns every thread's ring
+    class logger
+    {
+      public:
+        static constexpr std::size_t default_ring_size = 1 << 20;
+
+        static logger& get()
+        {
+            static logger instance;
+            return instance;
+        }
+
+        [[nodiscard]] level min_level() const noexcept { return m_min_level.load(std::memory_order_relaxed); }
+        void set_min_level(level lvl) noexcept { m_min_level.store(lvl, std::memory_order_relaxed); }
+
+        // Ring size for threads that haven't logged yet
+        void set_ring_size(std::size_t bytes) noexcept { m_ring_size.store(bytes, std::memory_order_relaxed); }
+
+        thread_ring& this_thread_ring()
+        {
+            struct owner
+            {
+                std::shared_ptr<thread_ring> ring;
+                ~owner() { ring->orphan(); }
+            };
+            thread_local owner mine {add_ring()};
+            return *mine.ring;
+        }
+
+        // Pulls every message out of every ring and hands it to fn(const message&).  Each ring only has one reader, so
+        // drains are serialized here, whichever sink they come from.  Don't drain from inside fn.  Messages are in
+        // order per thread, but not across threads.
+        template <typename TFunc>
+        std::size_t drain(TFunc&& fn)
+        {
+            std::scoped_lock drain_lock(m_drain_mutex);
+            std::vector<std::shared_ptr<thread_ring>> rings;
+            {
+                std::scoped_lock lock(m_mutex);
+                rings = m_rings;
+            }
+
+            std::size_t count = 0;
+            std::vector<const thread_ring*> finished;
+            for(const auto& ring : rings)
+            {
+                // Checked first, so the drain below gets everything the thread ever logged
+                if(ring->orphaned())
+                {
+                    finished.push_back(ring.get());
+                }
+                count += ring->drain([&](std::span<const std::byte> payload) {
+                    _internal::record_header header;
+                    std::memcpy(&header, payload.data(), sizeof(header));
+                    message msg;
+                    msg.ticks = header.ticks;
+                    msg.format = header.format;
+                    msg.file = header.file;
+                    msg.line = header.line;
+                    msg.lvl = header.lvl;
+                    msg.args = payload.subspan(sizeof(header));
+                    fn(static_cast<const message&>(msg));
+                });
+            }
+
+            if(!finished.empty())
+            {
+                std::scoped_lock lock(m_mutex);
+                std::erase_if(m_rings, [&](const std::shared_ptr<thread_ring>& ring) {
+                    if(std::ranges::find(finished, ring.get()) == finished.end())
+                    {
+                        return false;
+                    }
+                    m_retired_dropped += ring->dropped();
+                    return true;
+                });
+            }
+            return count;
+        }
+
+        // One for every thread that has logged, until it exits and its ring is drained
+        [[nodiscard]] std::size_t ring_count() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_rings.size();
+        }
+
+        // Messages thrown away because a ring was full
+        [[nodiscard]] uint64 dropped() const
+        {
+            std::scoped_lock lock(m_mutex);
+            uint64 total = m_retired_dropped;
+            for(const auto& ring : m_rings)
+            {
+                total += ring->dropped();
+            }
+            return total;
+        }
+
+      private:
+        logger() = default;
+
+        std::shared_ptr<thread_ring> add_ring()
+        {
+            auto ring = std::make_shared<thread_ring>(m_ring_size.load(std::memory_order_relaxed));
+            std::scoped_lock lock(m_mutex);
+            m_rings.push_back(ring);
+            return ring;
+        }
+
+        mutable std::mutex m_mutex;
+        std::mutex m_drain_mutex;
+        // A ring outlives its thread until the next drain empties it, so whatever it logged last still gets drained
+        std::vector<std::shared_ptr<thread_ring>> m_rings;
+        // Drops counted by rings that have since been let go
+        uint64 m_retired_dropped = 0;
+        std::atomic<level> m_min_level = level::trace;
+        std::atomic<std::size_t> m_ring_size = default_ring_size;
+    };
+
+    template <_internal::loggable... Args>
+    inline void log(level lvl, _internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        logger& instance = logger::get();
+        if(lvl < instance.min_level())
+        {
+            return;
+        }
+
+        thread_ring& ring = instance.this_thread_ring();
+        const std::size_t size = sizeof(_internal::record_header) + (std::size_t(0) + ... + _internal::encoded_size(args));
+        std::byte* out = ring.reserve(size);
+        if(out == nullptr)
+        {
+            return;
+        }
+
+        const _internal::record_header header {_internal::ticks(),
+                                               site.m_format,
+                                               site.m_location.file_name(),
+                                               site.m_location.line(),
+                                               lvl,
+                                               static_cast<uint8>(sizeof...(Args))};
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        ((out = _internal::encode(out, args)), ...);
+        ring.commit();
+    }
+
+    template <_internal::loggable... Args>
+    inline void trace(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::trace, site, args...);
+    }
+
+    template <_internal::loggable... Args>
+    inline void debug(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::debug, site, args...);
+    }
+
+    template <_internal::loggable... Args>
+    inline void info(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::info, site, args...);
+    }
+
+    template <_internal::loggable... Args>
+    inline void warn(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::warn, site, args...);
+    }
+
+    template <_internal::loggable... Args>
+    inline void error(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::error, site, args...);
+    }
+
+    template <_internal::loggable... Args>
+    inline void critical(_internal::format_site<std::type_identity_t<Args>...> site, const Args&... args)
+    {
+        log(level::critical, site, args...);
+    }
+
+    // Writes messages to a stream in the binary format that binlog-decode reads.
+    //
+    // The stream starts with "RAOEBLG1", followed by records that each start with a one byte kind:
+    //     'S' site:    uint32 id, uint8 level, uint32 line, uint32 length + format, uint32 length + file
+    //     'M' message: uint32 site id, uint64 ticks, uint32 length + encoded arguments
+    //     'C' clock:   uint64 ticks, int64 unix nanoseconds
+    // A site is written the first time one of its messages is, and a clock record at the end of every drain.
+    class binary_sink
+    {
+      public:
+        static constexpr std::string_view magic = "RAOEBLG1";
+
+        explicit binary_sink(std::ostream& to)
+            : m_stream(to)
+        {
+            m_stream.write(magic.data(), static_cast<std::streamsize>(magic.size()));
+            write_clock();
+        }
+
+        // Drains the logger into the stream.  Returns the number of messages written.
+        std::size_t drain(logger& from = logger::get())
+        {
+            const std::size_t count = from.drain([this](const message& msg) { write(msg); });
+            write_clock();
+            m_stream.flush();
+            return count;
+        }
+
+      private:
+        struct site_key
+        {
+            const char* format;
+            const char* file;
+            uint32 line;
+            bool operator==(const site_key&) const = default;
+        };
+
+        struct site_hash
+        {
+            std::size_t operator()(const site_key& key) const noexcept
+            {
+                return std::hash<const void*>()(key.format) ^ (std::hash<const void*>()(key.file) << 1) ^ key.line;
+            }
+        };
+
+        template <typename T>
+        void put(const T& value)
+        {
+            m_stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void put_bytes(const void* data, std::size_t size)
+        {
+            put(static_cast<uint32>(size));
+            m_stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        }
+
+        void write(const message& msg)
+        {
+            const site_key key {msg.format.data(), msg.file.data(), msg.line};
+            auto [found, inserted] = m_sites.try_emplace(key, static_cast<uint32>(m_sites.size()));
+            if(inserted)
+            {
+                put('S');
+                put(found->second);
+                put(msg.lvl);
+                put(msg.line);
+                put_bytes(msg.format.data(), msg.format.size());
+                put_bytes(msg.file.data(), msg.file.size());
+            }
+            put('M');
+            put(found->second);
+            put(msg.ticks);
+            put_bytes(msg.args.data(), msg.args.size());
+        }
+
+        void write_clock()
+        {
+            put('C');
+            put(_internal::ticks());
+            put(_internal::unix_nanoseconds());
+        }
+
+        std::ostream& m_stream;
+        std::unordered_map<site_key, uint32, site_hash> m_sites;
+    };
+
+    // A decoded message, as produced by the decoder
+    struct decoded_message
+    {
+        int64 unix_nanoseconds = 0;
+        level lvl = level::info;
+        std::string_view file;
+        uint32 line = 0;
+        std::string text;
+    };
+
+    // Reads what binary_sink wrote.  Used by the binlog-decode tool, but it's just a class so tests can use it too.
+    class decoder
+    {
+      public:
+        // Returns false if the data doesn't start with the magic or is cut off partway through a record.  Everything
+        // up to that point is still handed to fn(const decoded_message&).
+        template <typename TFunc>
+        bool decode(std::span<const std::byte> data, TFunc&& fn)
+        {
+            if(data.size() < binary_sink::magic.size() ||
+               std::memcmp(data.data(), binary_sink::magic.data(), binary_sink::magic.size()) != 0)
+            {
+                return false;
+            }
+            data = data.subspan(binary_sink::magic.size());
+            m_sites.clear();
+            m_has_clock = false;
+
+            // Timestamps are converted with the first and last clock records, so find those first
+            if(!scan_clocks(data))
+            {
+                return false;
+            }
+
+            while(!data.empty())
+            {
+                const char kind = static_cast<char>(data[0]);
+                data = data.subspan(1);
+                if(kind == 'C')
+                {
+                    uint64 ticks;
+                    int64 unix;
+                    if(!take(data, ticks) || !take(data, unix))
+                    {
+                        return false;
+                    }
+                }
+                else if(kind == 'S')
+                {
+                    uint32 id;
+                    site entry;
+                    if(!take(data, id) || !take(data, entry.lvl) || !take(data, entry.line) ||
+                       !take_bytes(data, entry.format) || !take_bytes(data, entry.file))
+                    {
+                        return false;
+                    }
+                    m_sites[id] = std::move(entry);
+                }
+                else if(kind == 'M')
+                {
+                    uint32 id;
+                    uint64 ticks;
+                    std::string args;
+                    if(!take(data, id) || !take(data, ticks) || !take_bytes(data, args))
+                    {
+                        return false;
+                    }
+                    const auto found = m_sites.find(id);
+                    if(found == m_sites.end())
+                    {
+                        return false;
+                    }
+                    decoded_message msg;
+                    msg.unix_nanoseconds = to_unix(ticks);
+                    msg.lvl = found->second.lvl;
+                    msg.file = found->second.file;
+                    msg.line = found->second.line;
+                    msg.text = _internal::format_encoded(
+                        found->second.format,
+                        std::span<const std::byte>(reinterpret_cast<const std::byte*>(args.data()), args.size()));
+                    fn(static_cast<const decoded_message&>(msg));
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+      private:
+        struct site
+        {
+            level lvl = level::info;
+            uint32 line = 0;
+            std::string format;
+            std::string file;
+        };
+
+        struct clock
+        {
+            uint64 ticks = 0;
+            int64 unix = 0;
+        };
+
+        template <typename T>
+        static bool take(std::span<const std::byte>& data, T& out)
+        {
+            if(data.size() < sizeof(T))
+            {
+                return false;
+            }
+            std::memcpy(&out, data.data(), sizeof(T));
+            data = data.subspan(sizeof(T));
+            return true;
+        }
+
+        static bool take_bytes(std::span<const std::byte>& data, std::string& out)
+        {
+            uint32 length;
+            if(!take(data, length) || data.size() < length)
+            {
+                return false;
+            }
+            out.assign(reinterpret_cast<const char*>(data.data()), length);
+            data = data.subspan(length);
+            return true;
+        }
+
+        bool scan_clocks(std::span<const std::byte> data)
+        {
+            std::string scratch;
+            while(!data.empty())
+            {
+                const char kind = static_cast<char>(data[0]);
+                data = data.subspan(1);
+                uint32 skip32;
+                uint64 skip64;
+                uint8 skip8;
+                bool ok = true;
+                if(kind == 'C')
+                {
+                    clock c;
+                    ok = take(data, c.ticks) && take(data, c.unix);
+                    if(ok)
+                    {
+                        if(!m_has_clock)
+                        {
+                            m_first = c;
+                            m_has_clock = true;
+                        }
+                        m_last = c;
+                    }
+                }
+                else if(kind == 'S')
+                {
+                    ok = take(data, skip32) && take(data, skip8) && take(data, skip32) && take_bytes(data, scratch) &&
+                         take_bytes(data, scratch);
+                }
+                else if(kind == 'M')
+                {
+                    ok = take(data, skip32) && take(data, skip64) && take_bytes(data, scratch);
+                }
+                else
+                {
+                    ok = false;
+                }
+                if(!ok)
+                {
+                    break;
+                }
+            }
+            return m_has_clock;
+        }
+
+        [[nodiscard]] int64 to_unix(uint64 ticks) const noexcept
+        {
+            const double tick_span = static_cast<double>(m_last.ticks) - static_cast<double>(m_first.ticks);
+            const double unix_span = static_cast<double>(m_last.unix - m_first.unix);
+            const double rate = tick_span > 0 ? unix_span / tick_span : 1.0;
+            return m_first.unix +
+                   static_cast<int64>((static_cast<double>(ticks) - static_cast<double>(m_first.ticks)) * rate);
+        }
+
+        std::unordered_map<uint32, site> m_sites;
+        bool m_has_clock = false;
+        clock m_first;
+        clock m_last;
+    };
+
+    // Drains the logger on a background thread every interval (and when it's destroyed), formatting each message and
+    // passing it to a callback.  The default callback forwards to spdlog, or std::cerr without it.
+    class text_sink
+    {
+      public:
+        using callback_type = function<void(level, std::string_view text, const message&)>;
+
+        explicit text_sink(std::chrono::milliseconds interval = std::chrono::milliseconds(50),
+                           callback_type callback = default_callback())
+            : m_callback(std::move(callback))
+            , m_thread([this, interval](std::stop_token stop) { run(stop, interval); })
+        {
+        }
+
+        ~text_sink()
+        {
+            m_thread.request_stop();
+            m_wake.notify_all();
+            m_thread.join();
+            drain();
+        }
+
+        text_sink(const text_sink&) = delete;
+        text_sink& operator=(const text_sink&) = delete;
+
+        // Drains right now, on the calling thread
+        std::size_t drain()
+        {
+            return logger::get().drain([this](const message& msg) { m_callback(msg.lvl, msg.text(), msg); });
+        }
+
+        static callback_type default_callback()
+        {
+            return [](level lvl, std::string_view text, const message&) {
+#ifdef RAOE_CORE_USE_SPDLOG
+                spdlog::log(static_cast<spdlog::level::level_enum>(lvl), "{}", text);
+#else
+                std::cerr << "[" << to_string(lvl) << "] " << text << '\n';
+#endif
+            };
+        }
+
+      private:
+        void run(std::stop_token stop, std::chrono::milliseconds interval)
+        {
+            std::mutex wait_mutex;
+            while(!stop.stop_requested())
+            {
+                drain();
+                std::unique_lock lock(wait_mutex);
+                m_wake.wait_for(lock, stop, interval, [] { return false; });
+            }
+        }
+
+        callback_type m_callback;
+        std::condition_variable_any m_wake;
+        std::jthread m_thread;
+    };
+}
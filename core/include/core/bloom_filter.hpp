@@ -0,0 +1,190 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A Bloom filter: "definitely not there" or "maybe there", in a few nanoseconds and about 12 bits per item.
+//
+// It's split block style (the one Parquet and Impala use): each item lands in one 32 byte block and sets one bit in
+// each of its eight words, so a check touches half a cache line and is a handful of ands.  Inserting and checking
+// are safe from any number of threads at once (the words are relaxed atomics); whether a check sees an insert that's
+// racing it is up to the caller.  There's no erase, so anything that goes away stays a false positive until the
+// filter is rebuilt.
+//     raoe::bloom_filter known(paths.size());
+//     for(auto& p : paths) known.insert(p);
+//     if(!known.may_contain(candidate)) return false; // no need to ask the slow thing
+namespace raoe
+{
+    class bloom_filter
+    {
+        static constexpr std::size_t words_per_block = 8;
+        static constexpr std::size_t block_bits = words_per_block * 32;
+
+      public:
+        // An empty filter answers "maybe" to everything
+        bloom_filter() = default;
+
+        explicit bloom_filter(std::size_t expected_items, double false_positive_rate = 0.01)
+            : m_capacity(expected_items)
+        {
+            // The classic optimum, plus a fifth for what blocking costs
+            const double bits_per_item =
+                1.2 * -std::log(std::clamp(false_positive_rate, 1e-9, 0.5)) / (std::log(2.0) * std::log(2.0));
+            const auto bits = static_cast<std::size_t>(
+                bits_per_item * static_cast<double>(std::max<std::size_t>(expected_items, 1)));
+            m_blocks = std::max<std::size_t>(1, (bits + block_bits - 1) / block_bits);
+            m_words = std::make_unique<std::atomic<uint32>[]>(m_blocks * words_per_block);
+        }
+
+        // Puts back a filter that was saved with words()
+        bloom_filter(std::span<const uint32> words, std::size_t capacity, std::size_t inserted)
+            : m_blocks(words.size() / words_per_block)
+            , m_capacity(capacity)
+            , m_inserted(inserted)
+        {
+            check_if(words.size() % words_per_block == 0, "bloom_filter: {} words isn't a whole number of blocks",
+                     words.size());
+            m_words = std::make_unique<std::atomic<uint32>[]>(words.size());
+            for(std::size_t i = 0; i < words.size(); i++)
+            {
+                m_words[i].store(words[i], std::memory_order_relaxed);
+            }
+        }
+
+        bloom_filter(bloom_filter&& other) noexcept
+            : m_words(std::move(other.m_words))
+            , m_blocks(std::exchange(other.m_blocks, 0))
+            , m_capacity(std::exchange(other.m_capacity, 0))
+            , m_inserted(other.m_inserted.exchange(0, std::memory_order_relaxed))
+        {
+        }
+
+        bloom_filter& operator=(bloom_filter&& other) noexcept
+        {
+            m_words = std::move(other.m_words);
+            m_blocks = std::exchange(other.m_blocks, 0);
+            m_capacity = std::exchange(other.m_capacity, 0);
+            m_inserted.store(other.m_inserted.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+
+        // Takes a hash that's already well mixed in all 64 bits; the string_view overloads hash for you
+        void insert(uint64 hash) noexcept
+        {
+            if(m_blocks == 0)
+            {
+                return;
+            }
+            std::atomic<uint32>* block = block_for(hash);
+            const auto key = static_cast<uint32>(hash);
+            for(std::size_t i = 0; i < words_per_block; i++)
+            {
+                const uint32 bit = bit_for(key, i);
+                // Skip the locked or when it's already set, which is most of the time once the filter fills up
+                if((block[i].load(std::memory_order_relaxed) & bit) == 0)
+                {
+                    block[i].fetch_or(bit, std::memory_order_relaxed);
+                }
+            }
+            m_inserted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool may_contain(uint64 hash) const noexcept
+        {
+            if(m_blocks == 0)
+            {
+                return true;
+            }
+            const std::atomic<uint32>* block = block_for(hash);
+            const auto key = static_cast<uint32>(hash);
+            uint32 missing = 0;
+            for(std::size_t i = 0; i < words_per_block; i++)
+            {
+                const uint32 bit = bit_for(key, i);
+                missing |= ~block[i].load(std::memory_order_relaxed) & bit;
+            }
+            return missing == 0;
+        }
+
+        void insert(std::string_view key) noexcept { insert(hash(key)); }
+        [[nodiscard]] bool may_contain(std::string_view key) const noexcept { return may_contain(hash(key)); }
+
+        [[nodiscard]] static uint64 hash(std::string_view key) noexcept
+        {
+            return distribute(static_cast<uint64>(std::hash<std::string_view> {}(key)));
+        }
+
+        void clear() noexcept
+        {
+            for(std::size_t i = 0; i < m_blocks * words_per_block; i++)
+            {
+                m_words[i].store(0, std::memory_order_relaxed);
+            }
+            m_inserted.store(0, std::memory_order_relaxed);
+        }
+
+        // How many items it was sized for, and how many have gone in (repeats included).  Past capacity the false
+        // positive rate climbs, so that's the time to build a bigger one.
+        [[nodiscard]] std::size_t capacity() const noexcept { return m_capacity; }
+        [[nodiscard]] std::size_t inserted() const noexcept { return m_inserted.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::size_t size_in_bytes() const noexcept { return m_blocks * words_per_block * sizeof(uint32); }
+
+        // The filter's bits, for saving it alongside whatever it's a filter for.  The layout is the same everywhere
+        // (besides endianness), so a saved filter gives the same answers when it's loaded.
+        [[nodiscard]] std::vector<uint32> words() const
+        {
+            std::vector<uint32> words(m_blocks * words_per_block);
+            for(std::size_t i = 0; i < words.size(); i++)
+            {
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            }
+            return words;
+        }
+
+      private:
+        [[nodiscard]] std::atomic<uint32>* block_for(uint64 hash) const noexcept
+        {
+            // The top half picks the block (multiply and shift instead of a modulo), the bottom half the bits
+            const uint64 index = ((hash >> 32) * static_cast<uint64>(m_blocks)) >> 32;
+            return &m_words[index * words_per_block];
+        }
+
+        [[nodiscard]] static uint32 bit_for(uint32 key, std::size_t word) noexcept
+        {
+            // Odd constants from the Parquet spec, one per word
+            constexpr uint32 salts[words_per_block] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                                       0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+            return uint32 {1} << ((key * salts[word]) >> 27);
+        }
+
+        std::unique_ptr<std::atomic<uint32>[]> m_words;
+        std::size_t m_blocks = 0;
+        std::size_t m_capacity = 0;
+        std::atomic<std::size_t> m_inserted = 0;
+    };
+}
@@ -0,0 +1,1101 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include "core/check.hpp"
+#include "core/mapped_file.hpp"
+#include "core/stream.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAOE_CHUNK_STORE_USE_FSYNC 1
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Saves split into content defined chunks, so saving again only writes the chunks that changed.
+//
+// The bytes are cut wherever a rolling hash of the last 64 bytes hits a pattern (FastCDC), so the cuts follow the
+// content and not the offsets: an edit changes the chunk or two around it, even when it shifts everything after it.
+// Each chunk is stored once, known by a 128 bit hash of its bytes.  Saving appends the chunks we don't have yet to one
+// new pack file, then writes a manifest listing where every chunk of the save is.  The manifest is written to the side
+// and renamed over the old one once the pack is down, so a save is either all there or not there at all.  Reading
+// checks every chunk against its hash.
+//
+// The root is a real directory (PhysFS can't rename), so use fs::write_dir() to keep saves with everything else we
+// write.  Packs hang on to chunks no save uses any more until collect_garbage(), which also repacks packs that are
+// mostly dead.  One thread at a time, and one chunk_store per directory.
+//     raoe::chunk_store saves(raoe::fs::write_dir() / "saves");
+//     raoe::chunk_store::writer out(saves, "autosave");
+//     world.serialize(out);
+//     out.commit();
+//     raoe::chunk_store::reader in(saves, "autosave");
+namespace raoe
+{
+    namespace _internal::chunk_store_format
+    {
+        inline constexpr uint32 magic = 0x4d434152; // "RACM"
+        inline constexpr uint32 version = 1;
+        inline constexpr uint64 golden = 0x9e3779b97f4a7c15;
+
+        struct chunk_id
+        {
+            uint64 high = 0;
+            uint64 low = 0;
+
+            constexpr bool operator==(const chunk_id&) const = default;
+        };
+
+        struct chunk_id_hash
+        {
+            std::size_t operator()(const chunk_id& id) const noexcept { return static_cast<std::size_t>(id.low); }
+        };
+
+        // A manifest is the header, then a chunk per piece of the save in order
+        struct header
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 size;
+            uint64 count;
+            uint64 checksum;
+        };
+
+        struct chunk
+        {
+            chunk_id id;
+            uint64 pack;
+            uint64 offset;
+            uint64 size;
+        };
+
+        static_assert(sizeof(header) == 32 && sizeof(chunk) == 40, "chunk_store's manifest layout has padding in it");
+
+        // Not cryptographic (nobody's crafting collisions in their own save), but 128 bits, so two different chunks
+        // don't end up with the same name by accident.  Two lanes of sixteen bytes per step.
+        [[nodiscard]] inline chunk_id hash(std::span<const std::byte> bytes) noexcept
+        {
+            uint64 a = distribute(uint64 {bytes.size()} * golden);
+            uint64 b = distribute(uint64 {bytes.size()} ^ golden);
+            auto step = [&](uint64 first, uint64 second) {
+                a = distribute(a ^ first) + second;
+                b = distribute(b ^ second) + std::rotl(first, 32);
+            };
+            std::size_t i = 0;
+            for(; i + 16 <= bytes.size(); i += 16)
+            {
+                std::array<uint64, 2> words;
+                std::memcpy(words.data(), bytes.data() + i, 16);
+                step(words[0], words[1]);
+            }
+            std::array<uint64, 2> tail {};
+            if(i < bytes.size())
+            {
+                std::memcpy(tail.data(), bytes.data() + i, bytes.size() - i);
+            }
+            step(tail[0], tail[1]);
+            return {distribute(a ^ std::rotl(b, 32)), distribute(b + a)};
+        }
+
+        // FastCDC's gear table, a random number per byte value
+        inline constexpr std::array<uint64, 256> gear = [] {
+            std::array<uint64, 256> table {};
+            for(uint64 i = 0; i < table.size(); i++)
+            {
+                table[i] = distribute((i + 1) * golden);
+            }
+            return table;
+        }();
+
+        // Finds where chunks end.  Nothing is cut before min bytes; up to average it takes two more bits of the hash
+        // being zero than after it, which keeps chunks close to the average (FastCDC's normalized chunking).  The
+        // high bits are the ones that have seen the last 64 bytes.
+        class chunker
+        {
+          public:
+            chunker(std::size_t min, std::size_t average, std::size_t max)
+                : m_min(min)
+                , m_average(average)
+                , m_max(max)
+            {
+                check_if(min > 0 && min < average && average < max && std::has_single_bit(average),
+                         "chunk_store: chunk sizes must go min < average < max, with average a power of two");
+                const int bits = std::bit_width(average) - 1;
+                m_small_mask = ~uint64 {0} << (64 - std::min(bits + 2, 63));
+                m_large_mask = ~uint64 {0} << (64 - std::max(bits - 2, 1));
+            }
+
+            // How long the chunk at the start of bytes is.  Only looks at the first max bytes, so a stream can be cut
+            // as it comes in, as long as there's max bytes to look at (or it's the end).
+            [[nodiscard]] std::size_t cut(std::span<const std::byte> bytes) const noexcept
+            {
+                std::size_t size = bytes.size();
+                if(size <= m_min)
+                {
+                    return size;
+                }
+                size = std::min(size, m_max);
+                const std::size_t normal = std::min(size, m_average);
+                uint64 hash = 0;
+                std::size_t i = m_min;
+                for(; i < normal; i++)
+                {
+                    hash = (hash << 1) + gear[std::to_integer<uint8>(bytes[i])];
+                    if((hash & m_small_mask) == 0)
+                    {
+                        return i + 1;
+                    }
+                }
+                for(; i < size; i++)
+                {
+                    hash = (hash << 1) + gear[std::to_integer<uint8>(bytes[i])];
+                    if((hash & m_large_mask) == 0)
+                    {
+                        return i + 1;
+                    }
+                }
+                return size;
+            }
+
+            [[nodiscard]] std::size_t max() const noexcept { return m_max; }
+
+          private:
+            std::size_t m_min;
+            std::size_t m_average;
+            std::size_t m_max;
+            uint64 m_small_mask;
+            uint64 m_large_mask;
+        };
+
+        // Writes a file from start to end, and with sync, doesn't say it's done until it's on the disk
+        class file_writer
+        {
+          public:
+            explicit file_writer(const std::filesystem::path& path)
+#ifdef RAOE_CHUNK_STORE_USE_FSYNC
+                : m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+            {
+            }
+#else
+                : m_out(path, std::ios::binary | std::ios::trunc)
+            {
+            }
+#endif
+
+            ~file_writer() { close(false); }
+
+            file_writer(const file_writer&) = delete;
+            file_writer& operator=(const file_writer&) = delete;
+
+            bool write(std::span<const std::byte> bytes)
+            {
+#ifdef RAOE_CHUNK_STORE_USE_FSYNC
+                if(m_fd < 0)
+                {
+                    return false;
+                }
+                while(!bytes.empty())
+                {
+                    const ssize_t count = ::write(m_fd, bytes.data(), bytes.size());
+                    if(count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if(count <= 0)
+                    {
+                        return false;
+                    }
+                    bytes = bytes.subspan(static_cast<std::size_t>(count));
+                }
+                return true;
+#else
+                return static_cast<bool>(m_out.write(reinterpret_cast<const char*>(bytes.data()),
+                                                     static_cast<std::streamsize>(bytes.size())));
+#endif
+            }
+
+            bool close(bool sync)
+            {
+#ifdef RAOE_CHUNK_STORE_USE_FSYNC
+                if(m_fd < 0)
+                {
+                    return false;
+                }
+                const bool synced = !sync || ::fsync(m_fd) == 0;
+                const bool closed = ::close(m_fd) == 0;
+                m_fd = -1;
+                return synced && closed;
+#else
+                if(!m_out.is_open())
+                {
+                    return false;
+                }
+                const bool flushed = static_cast<bool>(m_out.flush());
+                m_out.close();
+                return flushed;
+#endif
+            }
+
+          private:
+#ifdef RAOE_CHUNK_STORE_USE_FSYNC
+            int m_fd = -1;
+#else
+            std::ofstream m_out;
+#endif
+        };
+
+        // So renames into the directory survive a power cut too
+        inline void sync_directory([[maybe_unused]] const std::filesystem::path& path)
+        {
+#ifdef RAOE_CHUNK_STORE_USE_FSYNC
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd >= 0)
+            {
+                ::fsync(fd);
+                ::close(fd);
+            }
+#endif
+        }
+
+        // Packs are numbered, and named by their number in hex
+        [[nodiscard]] inline std::string pack_name(uint64 pack)
+        {
+            constexpr std::string_view digits = "0123456789abcdef";
+            std::string name(16, '0');
+            for(std::size_t i = 16; i-- > 0; pack >>= 4)
+            {
+                name[i] = digits[pack & 0xf];
+            }
+            return name + ".pack";
+        }
+
+        [[nodiscard]] inline std::optional<uint64> pack_number(std::string_view name)
+        {
+            if(name.size() != 21 || !name.ends_with(".pack"))
+            {
+                return std::nullopt;
+            }
+            uint64 pack = 0;
+            for(const char c : name.substr(0, 16))
+            {
+                const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+                if(digit < 0)
+                {
+                    return std::nullopt;
+                }
+                pack = (pack << 4) | static_cast<uint64>(digit);
+            }
+            return pack;
+        }
+    }
+
+    class chunk_store
+    {
+        using chunk_id = _internal::chunk_store_format::chunk_id;
+        using chunk = _internal::chunk_store_format::chunk;
+
+      public:
+        struct options
+        {
+            // Chunks are cut somewhere between min_chunk and max_chunk bytes, usually close to average_chunk (a power
+            // of two)
+            std::size_t min_chunk = 16 * 1024;
+            std::size_t average_chunk = 64 * 1024;
+            std::size_t max_chunk = 256 * 1024;
+            // fsync the pack and manifest before a save counts as done.  Faster without, but a power cut can then take
+            // the newest save with it.
+            bool durable = true;
+        };
+
+        struct save_stats
+        {
+            uint64 size = 0;
+            std::size_t chunks = 0;
+            std::size_t new_chunks = 0;
+            // The new chunks and the manifest, which is all that saving actually wrote
+            uint64 bytes_written = 0;
+        };
+
+      private:
+        struct location
+        {
+            uint64 pack;
+            uint64 offset;
+        };
+
+        using chunk_index = std::unordered_map<chunk_id, location, _internal::chunk_store_format::chunk_id_hash>;
+
+        // A save (or a repack) as it's being written.  New chunks go into a pack that only gets its real name once
+        // it's finished.
+        struct pending
+        {
+            std::vector<chunk> chunks;
+            save_stats stats;
+            chunk_index written;
+            std::optional<_internal::chunk_store_format::file_writer> pack;
+            uint64 pack_number = 0;
+            uint64 pack_size = 0;
+            bool failed = false;
+        };
+
+        class writer_streambuf : public std::streambuf
+        {
+          public:
+            writer_streambuf(chunk_store& store, std::string_view name)
+                : m_store(&store)
+                , m_name(name)
+                , m_window(store.m_chunker.max() * 4)
+            {
+                store.check_name(name);
+                char* base = reinterpret_cast<char*>(m_window.data());
+                setp(base, base + m_window.size());
+            }
+
+            ~writer_streambuf() override
+            {
+                if(!m_committed)
+                {
+                    m_store->discard(m_save);
+                }
+            }
+
+            writer_streambuf(const writer_streambuf&) = delete;
+            writer_streambuf& operator=(const writer_streambuf&) = delete;
+
+            std::optional<save_stats> commit()
+            {
+                check_if(!m_committed, "chunk_store: a writer can only commit once");
+                m_committed = true;
+                std::span<const std::byte> rest(m_window.data(), filled());
+                while(!rest.empty())
+                {
+                    const std::size_t size = m_store->m_chunker.cut(rest);
+                    m_store->store(m_save, rest.first(size));
+                    rest = rest.subspan(size);
+                }
+                setp(nullptr, nullptr);
+                return m_store->finish(m_save, m_name);
+            }
+
+          protected:
+            int_type overflow(int_type c) override
+            {
+                if(m_committed)
+                {
+                    return traits_type::eof();
+                }
+                if(traits_type::eq_int_type(c, traits_type::eof()))
+                {
+                    return traits_type::not_eof(c);
+                }
+                drain();
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+                return c;
+            }
+
+          private:
+            [[nodiscard]] std::size_t filled() const { return static_cast<std::size_t>(pptr() - pbase()); }
+
+            // Stores every chunk whose end is settled (there's max_chunk bytes after its start to look at), and slides
+            // what's left down to the front of the window
+            void drain()
+            {
+                const std::span<const std::byte> written(m_window.data(), filled());
+                std::size_t consumed = 0;
+                while(written.size() - consumed >= m_store->m_chunker.max())
+                {
+                    const std::size_t size = m_store->m_chunker.cut(written.subspan(consumed));
+                    m_store->store(m_save, written.subspan(consumed, size));
+                    consumed += size;
+                }
+                const std::size_t left = written.size() - consumed;
+                std::memmove(m_window.data(), m_window.data() + consumed, left);
+                char* base = reinterpret_cast<char*>(m_window.data());
+                setp(base, base + m_window.size());
+                pbump(static_cast<int>(left));
+            }
+
+            chunk_store* m_store;
+            std::string m_name;
+            std::vector<std::byte> m_window;
+            pending m_save;
+            bool m_committed = false;
+        };
+
+        class reader_streambuf : public std::streambuf
+        {
+          public:
+            reader_streambuf(const chunk_store& store, std::string_view name)
+                : m_store(&store)
+            {
+                store.check_name(name);
+                if(auto chunks = store.read_manifest(store.manifest_path(name)))
+                {
+                    m_chunks = std::move(*chunks);
+                    m_offsets.reserve(m_chunks.size() + 1);
+                    uint64 offset = 0;
+                    for(const chunk& c : m_chunks)
+                    {
+                        m_offsets.push_back(offset);
+                        offset += c.size;
+                    }
+                    m_offsets.push_back(offset);
+                    m_open = true;
+                }
+            }
+
+            reader_streambuf(const reader_streambuf&) = delete;
+            reader_streambuf& operator=(const reader_streambuf&) = delete;
+
+            [[nodiscard]] bool is_open() const noexcept { return m_open; }
+            [[nodiscard]] uint64 size() const noexcept { return m_offsets.empty() ? 0 : m_offsets.back(); }
+
+            // Set by the reader, so a damaged chunk can mark the stream bad rather than look like the end of the save
+            std::istream* m_stream = nullptr;
+
+          protected:
+            int_type underflow() override
+            {
+                if(gptr() < egptr())
+                {
+                    return traits_type::to_int_type(*gptr());
+                }
+                if(m_next >= m_chunks.size() || !load(m_next))
+                {
+                    return traits_type::eof();
+                }
+                return traits_type::to_int_type(*gptr());
+            }
+
+            pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+            {
+                const uint64 current = m_position + static_cast<uint64>(gptr() - eback());
+                switch(dir)
+                {
+                    case std::ios_base::beg: return seekpos(offset, which);
+                    case std::ios_base::cur: return seekpos(static_cast<off_type>(current) + offset, which);
+                    case std::ios_base::end: return seekpos(static_cast<off_type>(size()) + offset, which);
+                    default: return pos_type(off_type(-1));
+                }
+            }
+
+            pos_type seekpos(pos_type position, std::ios_base::openmode which) override
+            {
+                const auto target = static_cast<off_type>(position);
+                if(!(which & std::ios_base::in) || target < 0 || static_cast<uint64>(target) > size())
+                {
+                    return pos_type(off_type(-1));
+                }
+                if(static_cast<uint64>(target) == size())
+                {
+                    m_next = m_chunks.size();
+                    m_position = size();
+                    setg(nullptr, nullptr, nullptr);
+                    return position;
+                }
+                const auto index = static_cast<std::size_t>(
+                    std::ranges::upper_bound(m_offsets, static_cast<uint64>(target)) - m_offsets.begin() - 1);
+                if(index + 1 != m_next || eback() == nullptr)
+                {
+                    if(!load(index))
+                    {
+                        return pos_type(off_type(-1));
+                    }
+                }
+                setg(eback(), eback() + (static_cast<uint64>(target) - m_position), egptr());
+                return position;
+            }
+
+          private:
+            bool load(std::size_t index)
+            {
+                const chunk& wanted = m_chunks[index];
+                if(wanted.pack != m_pack_number || !m_pack.is_open())
+                {
+                    m_pack = mapped_file(m_store->pack_path(wanted.pack));
+                    m_pack_number = wanted.pack;
+                }
+                const std::span<const std::byte> bytes = m_store->bytes_of(m_pack, wanted);
+                if(bytes.empty())
+                {
+                    setg(nullptr, nullptr, nullptr);
+                    if(m_stream != nullptr)
+                    {
+                        m_stream->setstate(std::ios_base::badbit);
+                    }
+                    return false;
+                }
+                char* base = const_cast<char*>(reinterpret_cast<const char*>(bytes.data()));
+                setg(base, base, base + bytes.size());
+                m_next = index + 1;
+                m_position = m_offsets[index];
+                return true;
+            }
+
+            const chunk_store* m_store;
+            std::vector<chunk> m_chunks;
+            // Where each chunk starts, and then the end
+            std::vector<uint64> m_offsets;
+            mapped_file m_pack;
+            uint64 m_pack_number = 0;
+            std::size_t m_next = 0;
+            // Where the chunk that's loaded starts
+            uint64 m_position = 0;
+            bool m_open = false;
+        };
+
+      public:
+        // Writes a save as a stream, cutting and storing chunks as they fill up.  Nothing replaces the old save until
+        // commit(); a writer that's destroyed without committing leaves it as it was.
+        class writer : private stream::_internal::streambuf_holder<writer_streambuf>, public std::ostream
+        {
+          public:
+            writer(chunk_store& store, std::string_view name)
+                : streambuf_holder(store, name)
+                , std::ostream(&m_streambuf)
+            {
+            }
+
+            // nullopt if something couldn't be written, and then the old save is still there
+            std::optional<save_stats> commit()
+            {
+                auto stats = m_streambuf.commit();
+                if(!stats)
+                {
+                    setstate(std::ios_base::badbit);
+                }
+                return stats;
+            }
+        };
+
+        // Reads a save back as a stream, a chunk at a time straight out of the mapped packs.  Fails to open if there's
+        // no such save, and goes bad if a chunk is missing or doesn't match its hash.
+        class reader : private stream::_internal::streambuf_holder<reader_streambuf>, public std::istream
+        {
+          public:
+            reader(const chunk_store& store, std::string_view name)
+                : streambuf_holder(store, name)
+                , std::istream(&m_streambuf)
+            {
+                m_streambuf.m_stream = this;
+                if(!m_streambuf.is_open())
+                {
+                    setstate(std::ios_base::failbit);
+                }
+            }
+
+            [[nodiscard]] bool is_open() const noexcept { return m_streambuf.is_open(); }
+            // Of the whole save
+            [[nodiscard]] uint64 size() const noexcept { return m_streambuf.size(); }
+        };
+
+        explicit chunk_store(std::filesystem::path root)
+            : chunk_store(std::move(root), options {})
+        {
+        }
+
+        chunk_store(std::filesystem::path root, options opts)
+            : m_root(std::move(root))
+            , m_chunker(opts.min_chunk, opts.average_chunk, opts.max_chunk)
+            , m_durable(opts.durable)
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(m_root / "packs", ec);
+            reindex();
+        }
+
+        chunk_store(const chunk_store&) = delete;
+        chunk_store& operator=(const chunk_store&) = delete;
+
+        [[nodiscard]] const std::filesystem::path& root() const noexcept { return m_root; }
+
+        // Saves bytes under name, replacing whatever was there
+        std::optional<save_stats> save(std::string_view name, std::span<const std::byte> bytes)
+        {
+            check_name(name);
+            pending save;
+            while(!bytes.empty())
+            {
+                const std::size_t size = m_chunker.cut(bytes);
+                store(save, bytes.first(size));
+                bytes = bytes.subspan(size);
+            }
+            return finish(save, name);
+        }
+
+        // The whole save, or nullopt if there's no such save or any of it is damaged
+        [[nodiscard]] std::optional<std::vector<std::byte>> load(std::string_view name) const
+        {
+            reader in(*this, name);
+            if(!in)
+            {
+                return std::nullopt;
+            }
+            std::vector<std::byte> bytes(in.size());
+            if(!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+            {
+                return std::nullopt;
+            }
+            return bytes;
+        }
+
+        [[nodiscard]] bool contains(std::string_view name) const
+        {
+            check_name(name);
+            std::error_code ec;
+            return std::filesystem::is_regular_file(manifest_path(name), ec);
+        }
+
+        // Just the manifest; its chunks go at the next collect_garbage()
+        bool erase(std::string_view name)
+        {
+            check_name(name);
+            std::error_code ec;
+            return std::filesystem::remove(manifest_path(name), ec);
+        }
+
+        // Deletes packs no save uses, copies what's still used out of packs that are more than half dead (pointing
+        // the manifests at the copy), and cleans up after saves that didn't finish, so not while a writer is open.
+        // Returns how many bytes that freed.
+        uint64 collect_garbage()
+        {
+            namespace format = _internal::chunk_store_format;
+            std::vector<std::pair<std::filesystem::path, std::vector<chunk>>> manifests;
+            for_each_manifest([&](const std::filesystem::path& path, std::vector<chunk> chunks) {
+                manifests.emplace_back(path, std::move(chunks));
+            });
+            // Counted by where a chunk is rather than what it is.  A repack that couldn't rewrite every manifest leaves
+            // the same chunk in two packs, and both of them are still used.
+            std::unordered_map<uint64, uint64> used;
+            {
+                std::unordered_map<uint64, std::unordered_set<uint64>> counted;
+                for(const auto& [path, chunks] : manifests)
+                {
+                    for(const chunk& c : chunks)
+                    {
+                        if(counted[c.pack].insert(c.offset).second)
+                        {
+                            used[c.pack] += c.size;
+                        }
+                    }
+                }
+            }
+
+            uint64 freed = 0;
+            std::vector<std::filesystem::path> doomed;
+            std::unordered_map<uint64, mapped_file> repack;
+            std::error_code ec;
+            for(const auto& file : std::filesystem::directory_iterator(m_root / "packs", ec))
+            {
+                const auto number = format::pack_number(file.path().filename().string());
+                const uint64 size = std::filesystem::file_size(file.path(), ec);
+                if(ec)
+                {
+                    continue;
+                }
+                const auto live = number ? used.find(*number) : used.end();
+                if(live == used.end())
+                {
+                    doomed.push_back(file.path());
+                    freed += size;
+                }
+                else if(live->second * 2 < size)
+                {
+                    repack.emplace(*number, mapped_file(file.path()));
+                }
+            }
+
+            if(!repack.empty())
+            {
+                pending copy;
+                chunk_index moved;
+                // Packs with a damaged chunk stay, so the save that uses it is no worse off than it was
+                std::unordered_set<uint64> damaged;
+                for(const auto& [path, chunks] : manifests)
+                {
+                    for(const chunk& c : chunks)
+                    {
+                        const auto from = repack.find(c.pack);
+                        if(from == repack.end() || moved.contains(c.id))
+                        {
+                            continue;
+                        }
+                        const std::span<const std::byte> bytes = bytes_of(from->second, c);
+                        const auto at = bytes.empty() ? std::nullopt : append(copy, bytes);
+                        if(at)
+                        {
+                            moved.emplace(c.id, *at);
+                        }
+                        else
+                        {
+                            damaged.insert(c.pack);
+                        }
+                    }
+                }
+                std::erase_if(repack, [&](const auto& pack) { return damaged.contains(pack.first); });
+                if(seal(copy))
+                {
+                    uint64 dropped = 0;
+                    for(const auto& [number, pack] : repack)
+                    {
+                        dropped += pack.size();
+                    }
+                    // Every manifest that used the old packs has to point at the copy before they can go
+                    bool rewritten = true;
+                    for(auto& [path, chunks] : manifests)
+                    {
+                        bool changed = false;
+                        for(chunk& c : chunks)
+                        {
+                            const auto to = repack.contains(c.pack) ? moved.find(c.id) : moved.end();
+                            if(to != moved.end())
+                            {
+                                c.pack = to->second.pack;
+                                c.offset = to->second.offset;
+                                changed = true;
+                            }
+                        }
+                        rewritten = rewritten && (!changed || write_manifest(path, chunks));
+                    }
+                    if(rewritten)
+                    {
+                        for(const auto& [number, pack] : repack)
+                        {
+                            doomed.push_back(pack_path(number));
+                        }
+                        freed += dropped - std::min(dropped, copy.pack_size);
+                    }
+                }
+                else
+                {
+                    discard(copy);
+                }
+            }
+
+            for(const auto& file : doomed)
+            {
+                std::filesystem::remove(file, ec);
+            }
+            reindex();
+            return freed;
+        }
+
+      private:
+        void check_name(std::string_view name) const
+        {
+            check_if(!name.empty() && name != "." && name != ".." && name.find_first_of("/\\") == std::string_view::npos,
+                     "chunk_store: '{}' isn't a plain file name", name);
+        }
+
+        [[nodiscard]] std::filesystem::path manifest_path(std::string_view name) const
+        {
+            std::filesystem::path path = m_root / name;
+            path += ".manifest";
+            return path;
+        }
+
+        [[nodiscard]] std::filesystem::path pack_path(uint64 pack) const
+        {
+            return m_root / "packs" / _internal::chunk_store_format::pack_name(pack);
+        }
+
+        // A chunk's bytes in its pack, or nothing if it's not all there or doesn't match its hash
+        [[nodiscard]] static std::span<const std::byte> bytes_of(const mapped_file& pack, const chunk& c) noexcept
+        {
+            if(c.offset > pack.size() || c.size > pack.size() - c.offset)
+            {
+                return {};
+            }
+            const std::span<const std::byte> bytes = pack.bytes().subspan(c.offset, c.size);
+            return _internal::chunk_store_format::hash(bytes) == c.id ? bytes : std::span<const std::byte> {};
+        }
+
+        [[nodiscard]] std::optional<std::vector<chunk>> read_manifest(const std::filesystem::path& path) const
+        {
+            namespace format = _internal::chunk_store_format;
+            const mapped_file file(path);
+            if(file.size() < sizeof(format::header))
+            {
+                return std::nullopt;
+            }
+            format::header header;
+            std::memcpy(&header, file.bytes().data(), sizeof(header));
+            if(header.magic != format::magic || header.version != format::version ||
+               header.count != (file.size() - sizeof(header)) / sizeof(chunk) ||
+               file.size() != sizeof(header) + header.count * sizeof(chunk) ||
+               format::hash(file.bytes().subspan(sizeof(header))).low != header.checksum)
+            {
+                return std::nullopt;
+            }
+            std::vector<chunk> chunks(header.count);
+            if(!chunks.empty())
+            {
+                std::memcpy(chunks.data(), file.bytes().data() + sizeof(header), chunks.size() * sizeof(chunk));
+            }
+            uint64 size = 0;
+            for(const chunk& c : chunks)
+            {
+                if(c.size == 0)
+                {
+                    return std::nullopt;
+                }
+                size += c.size;
+            }
+            if(size != header.size)
+            {
+                return std::nullopt;
+            }
+            return chunks;
+        }
+
+        // Written to the side and renamed over the old one.  Returns how big it was, or nullopt if it didn't work.
+        std::optional<uint64> write_manifest(const std::filesystem::path& path, std::span<const chunk> chunks) const
+        {
+            namespace format = _internal::chunk_store_format;
+            std::vector<std::byte> bytes(sizeof(format::header) + chunks.size_bytes());
+            if(!chunks.empty())
+            {
+                std::memcpy(bytes.data() + sizeof(format::header), chunks.data(), chunks.size_bytes());
+            }
+            uint64 size = 0;
+            for(const chunk& c : chunks)
+            {
+                size += c.size;
+            }
+            const format::header header {
+                format::magic,
+                format::version,
+                size,
+                chunks.size(),
+                format::hash(std::span(bytes).subspan(sizeof(format::header))).low,
+            };
+            std::memcpy(bytes.data(), &header, sizeof(header));
+
+            std::filesystem::path temp = path;
+            temp += ".tmp";
+            format::file_writer out(temp);
+            if(!out.write(bytes) || !out.close(m_durable))
+            {
+                return std::nullopt;
+            }
+            std::error_code ec;
+            std::filesystem::rename(temp, path, ec);
+            if(ec)
+            {
+                return std::nullopt;
+            }
+            if(m_durable)
+            {
+                format::sync_directory(m_root);
+            }
+            return bytes.size();
+        }
+
+        template <typename TFunc>
+        void for_each_manifest(TFunc&& func) const
+        {
+            std::error_code ec;
+            for(const auto& file : std::filesystem::directory_iterator(m_root, ec))
+            {
+                if(file.path().extension() == ".manifest")
+                {
+                    if(auto chunks = read_manifest(file.path()))
+                    {
+                        func(file.path(), std::move(*chunks));
+                    }
+                }
+            }
+        }
+
+        // Finds every chunk the manifests point at that's in a pack that's there, and the next pack number that
+        // nothing has used (so a manifest pointing at a pack that's gone can't end up pointing at a new one)
+        void reindex()
+        {
+            std::unordered_set<uint64> packs;
+            std::error_code ec;
+            for(const auto& file : std::filesystem::directory_iterator(m_root / "packs", ec))
+            {
+                std::string name = file.path().filename().string();
+                if(name.ends_with(".tmp"))
+                {
+                    name.resize(name.size() - 4);
+                }
+                if(const auto number = _internal::chunk_store_format::pack_number(name))
+                {
+                    packs.insert(*number);
+                    m_next_pack = std::max(m_next_pack, *number + 1);
+                }
+            }
+            m_known.clear();
+            for_each_manifest([&](const std::filesystem::path&, const std::vector<chunk>& chunks) {
+                for(const chunk& c : chunks)
+                {
+                    m_next_pack = std::max(m_next_pack, c.pack + 1);
+                    if(packs.contains(c.pack))
+                    {
+                        m_known.emplace(c.id, location {c.pack, c.offset});
+                    }
+                }
+            });
+        }
+
+        // Puts bytes on the end of the pending pack, starting one if this is the first
+        std::optional<location> append(pending& save, std::span<const std::byte> bytes)
+        {
+            if(save.failed)
+            {
+                return std::nullopt;
+            }
+            if(!save.pack)
+            {
+                save.pack_number = m_next_pack++;
+                std::filesystem::path temp = pack_path(save.pack_number);
+                temp += ".tmp";
+                save.pack.emplace(temp);
+            }
+            if(!save.pack->write(bytes))
+            {
+                save.failed = true;
+                return std::nullopt;
+            }
+            const location at {save.pack_number, save.pack_size};
+            save.pack_size += bytes.size();
+            return at;
+        }
+
+        // Finishes the pending pack and gives it its real name
+        bool seal(pending& save)
+        {
+            if(save.failed)
+            {
+                return false;
+            }
+            if(!save.pack)
+            {
+                return true;
+            }
+            const std::filesystem::path path = pack_path(save.pack_number);
+            std::filesystem::path temp = path;
+            temp += ".tmp";
+            std::error_code ec;
+            if(save.pack->close(m_durable))
+            {
+                std::filesystem::rename(temp, path, ec);
+            }
+            else
+            {
+                ec = std::make_error_code(std::errc::io_error);
+            }
+            if(ec)
+            {
+                save.failed = true;
+                return false;
+            }
+            save.pack.reset();
+            if(m_durable)
+            {
+                _internal::chunk_store_format::sync_directory(m_root / "packs");
+            }
+            return true;
+        }
+
+        void discard(pending& save)
+        {
+            if(save.pack)
+            {
+                save.pack->close(false);
+                save.pack.reset();
+                std::filesystem::path temp = pack_path(save.pack_number);
+                temp += ".tmp";
+                std::error_code ec;
+                std::filesystem::remove(temp, ec);
+            }
+        }
+
+        // Adds a chunk to the save, and writes it if we don't have it already
+        void store(pending& save, std::span<const std::byte> bytes)
+        {
+            const chunk_id id = _internal::chunk_store_format::hash(bytes);
+            save.stats.size += bytes.size();
+            save.stats.chunks++;
+            location at {};
+            if(const auto known = m_known.find(id); known != m_known.end())
+            {
+                at = known->second;
+            }
+            else if(const auto written = save.written.find(id); written != save.written.end())
+            {
+                at = written->second;
+            }
+            else if(const auto appended = append(save, bytes))
+            {
+                at = *appended;
+                save.written.emplace(id, at);
+                save.stats.new_chunks++;
+                save.stats.bytes_written += bytes.size();
+            }
+            save.chunks.push_back(chunk {id, at.pack, at.offset, bytes.size()});
+        }
+
+        std::optional<save_stats> finish(pending& save, std::string_view name)
+        {
+            if(!seal(save))
+            {
+                discard(save);
+                return std::nullopt;
+            }
+            const auto manifest_size = write_manifest(manifest_path(name), save.chunks);
+            if(!manifest_size)
+            {
+                return std::nullopt;
+            }
+            // Only now are they really there
+            m_known.merge(save.written);
+            save.stats.bytes_written += *manifest_size;
+            return save.stats;
+        }
+
+        std::filesystem::path m_root;
+        _internal::chunk_store_format::chunker m_chunker;
+        bool m_durable;
+        // Where every chunk we have is
+        chunk_index m_known;
+        uint64 m_next_pack = 0;
+    };
+}
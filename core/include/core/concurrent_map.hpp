@@ -0,0 +1,398 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/sync.hpp"
+#include "core/types.hpp"
+
+#include <bit>
+#include <concepts>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A hash map that lots of threads can use at once, for global caches (tag -> asset, path -> parsed file...).
+//
+// It's split into shards by hash, each an unordered_map behind its own reader/writer lock, so threads only collide
+// when they hit the same shard, and lookups in a shard share it.  Values come out by copy (or through visit()), since
+// a reference could be erased out from under you; for big values, store a shared_ptr.
+//     raoe::concurrent_map<raoe::tag, std::shared_ptr<texture>> textures;
+//     auto texture = textures.find_or_emplace_with(name, [&] { return load_texture(name); });
+//
+// Keys that are strings underneath (std::string, raoe::tag, raoe::fs::path) can be looked up with a std::string_view,
+// without building a key.  For tags that has to be the full "prefix:identifier" form.
+namespace raoe
+{
+    namespace _internal
+    {
+        template <typename K>
+        concept string_like_key = std::convertible_to<const K&, std::string_view> || requires(const K& key) {
+            { key.string_view() } -> std::convertible_to<std::string_view>;
+        };
+
+        template <string_like_key K>
+        std::string_view key_view(const K& key) noexcept
+        {
+            if constexpr(std::convertible_to<const K&, std::string_view>)
+            {
+                return static_cast<std::string_view>(key);
+            }
+            else
+            {
+                return key.string_view();
+            }
+        }
+
+        // Hashes and compares string like keys through their string_view, so the map can be searched with one
+        template <typename K>
+        struct transparent_hash : std::hash<K>
+        {
+        };
+
+        template <string_like_key K>
+        struct transparent_hash<K>
+        {
+            using is_transparent = void;
+            template <string_like_key Q>
+            std::size_t operator()(const Q& key) const noexcept
+            {
+                return std::hash<std::string_view> {}(key_view(key));
+            }
+        };
+
+        template <typename K>
+        struct transparent_equal : std::equal_to<K>
+        {
+        };
+
+        template <string_like_key K>
+        struct transparent_equal<K>
+        {
+            using is_transparent = void;
+            template <string_like_key A, string_like_key B>
+            bool operator()(const A& a, const B& b) const noexcept
+            {
+                return key_view(a) == key_view(b);
+            }
+        };
+    }
+
+    template <typename K, typename V, typename Hash = _internal::transparent_hash<K>,
+              typename KeyEqual = _internal::transparent_equal<K>>
+    class concurrent_map
+    {
+        using map_type = std::unordered_map<K, V, Hash, KeyEqual>;
+
+        // What find() and friends accept: the key, or anything the hash and equality are transparent over
+        template <typename Q>
+        static constexpr bool lookup_key =
+            std::same_as<std::remove_cvref_t<Q>, K> ||
+            (requires { typename Hash::is_transparent; typename KeyEqual::is_transparent; } &&
+             std::is_invocable_r_v<std::size_t, const Hash&, const Q&>);
+
+      public:
+        // shard_count is rounded up to a power of two; 0 picks 4 per hardware thread, and at least 16.  Giving it a name
+        // instruments every shard's lock under that name (see sync.hpp).
+        explicit concurrent_map(std::size_t shard_count = 0, std::string_view name = {})
+        {
+            if(shard_count == 0)
+            {
+                shard_count = std::max<std::size_t>(16, std::thread::hardware_concurrency() * 4);
+            }
+            shard_count = std::bit_ceil(shard_count);
+            m_shift = 64 - std::countr_zero(shard_count);
+            m_shards = std::make_unique<shard[]>(shard_count);
+            m_shard_count = shard_count;
+            if(!name.empty())
+            {
+                for(std::size_t i = 0; i < shard_count; i++)
+                {
+                    std::destroy_at(&m_shards[i].lock);
+                    std::construct_at(&m_shards[i].lock, name);
+                }
+            }
+        }
+
+        concurrent_map(const concurrent_map&) = delete;
+        concurrent_map& operator=(const concurrent_map&) = delete;
+
+        template <typename Q>
+            requires lookup_key<Q>
+        [[nodiscard]] std::optional<V> find(const Q& key) const
+        {
+            const shard& s = shard_for(key);
+            std::shared_lock lock(s.lock);
+            if(auto it = s.map.find(key); it != s.map.end())
+            {
+                return it->second;
+            }
+            return std::nullopt;
+        }
+
+        template <typename Q>
+            requires lookup_key<Q>
+        [[nodiscard]] bool contains(const Q& key) const
+        {
+            const shard& s = shard_for(key);
+            std::shared_lock lock(s.lock);
+            return s.map.contains(key);
+        }
+
+        // Calls fn(const V&) under the shard's shared lock, if the key is there.  Don't touch the map from fn.
+        template <typename Q, typename TFunc>
+            requires lookup_key<Q>
+        bool visit(const Q& key, TFunc&& fn) const
+        {
+            const shard& s = shard_for(key);
+            std::shared_lock lock(s.lock);
+            if(auto it = s.map.find(key); it != s.map.end())
+            {
+                std::invoke(fn, std::as_const(it->second));
+                return true;
+            }
+            return false;
+        }
+
+        // Calls fn(V&) under the shard's exclusive lock, if the key is there
+        template <typename Q, typename TFunc>
+            requires lookup_key<Q>
+        bool update(const Q& key, TFunc&& fn)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            if(auto it = s.map.find(key); it != s.map.end())
+            {
+                std::invoke(fn, it->second);
+                return true;
+            }
+            return false;
+        }
+
+        // The value for key, constructing it from args if it isn't there.  V is only ever constructed by the thread
+        // that actually inserts it, so racing callers get the same value and nothing is built and thrown away.
+        // The bool is true if this call inserted it.
+        template <typename KArg, typename... Args>
+            requires lookup_key<KArg>
+        std::pair<V, bool> find_or_emplace(KArg&& key, Args&&... args)
+        {
+            shard& s = shard_for(key);
+            {
+                std::shared_lock lock(s.lock);
+                if(auto it = s.map.find(key); it != s.map.end())
+                {
+                    return {it->second, false};
+                }
+            }
+            std::scoped_lock lock(s.lock);
+            auto [it, inserted] = s.map.try_emplace(K(std::forward<KArg>(key)), std::forward<Args>(args)...);
+            return {it->second, inserted};
+        }
+
+        // Like find_or_emplace, but the value comes from factory(), which is called at most once per key.  It runs
+        // outside the shard's lock, so it can be slow (load a file...); other threads asking for the same key wait for
+        // it, and everyone else carries on.
+        template <typename KArg, typename TFactory>
+            requires lookup_key<KArg> && std::convertible_to<std::invoke_result_t<TFactory&>, V>
+        V find_or_emplace_with(KArg&& key, TFactory&& factory)
+        {
+            shard& s = shard_for(key);
+            {
+                std::shared_lock lock(s.lock);
+                if(auto it = s.map.find(key); it != s.map.end())
+                {
+                    return it->second;
+                }
+            }
+            std::promise<V> made;
+            std::shared_future<V> other;
+            const K* building_key = nullptr;
+            {
+                std::scoped_lock lock(s.lock);
+                if(auto it = s.map.find(key); it != s.map.end())
+                {
+                    return it->second;
+                }
+                if(auto it = s.building.find(key); it != s.building.end())
+                {
+                    other = it->second;
+                }
+                else
+                {
+                    // Nodes don't move when the table grows, so the key can be found again by reference
+                    building_key =
+                        &s.building.try_emplace(K(std::forward<KArg>(key)), made.get_future().share()).first->first;
+                }
+            }
+            if(building_key == nullptr)
+            {
+                return other.get();
+            }
+
+            V value = std::invoke(factory);
+            {
+                std::scoped_lock lock(s.lock);
+                auto node = s.building.extract(s.building.find(*building_key));
+                // Something may have put it in the map meanwhile, and that wins like it would have if it came after us
+                value = s.map.try_emplace(std::move(node.key()), std::move(value)).first->second;
+            }
+            made.set_value(value);
+            return value;
+        }
+
+        // Keys that can't be looked up as they are get turned into a K first
+        template <typename KArg, typename... Args>
+            requires(!lookup_key<KArg> && std::constructible_from<K, KArg>)
+        std::pair<V, bool> find_or_emplace(KArg&& key, Args&&... args)
+        {
+            return find_or_emplace(K(std::forward<KArg>(key)), std::forward<Args>(args)...);
+        }
+
+        template <typename KArg, typename TFactory>
+            requires(!lookup_key<KArg> && std::constructible_from<K, KArg>)
+        V find_or_emplace_with(KArg&& key, TFactory&& factory)
+        {
+            return find_or_emplace_with(K(std::forward<KArg>(key)), std::forward<TFactory>(factory));
+        }
+
+        // True if the key was new.  The key is only copied into the map if it wasn't there already.
+        template <typename KArg, typename VArg>
+            requires lookup_key<KArg>
+        bool insert_or_assign(KArg&& key, VArg&& value)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            if(auto it = s.map.find(key); it != s.map.end())
+            {
+                it->second = std::forward<VArg>(value);
+                return false;
+            }
+            s.map.emplace(K(std::forward<KArg>(key)), std::forward<VArg>(value));
+            return true;
+        }
+
+        template <typename KArg, typename VArg>
+            requires(!lookup_key<KArg> && std::constructible_from<K, KArg>)
+        bool insert_or_assign(KArg&& key, VArg&& value)
+        {
+            return insert_or_assign(K(std::forward<KArg>(key)), std::forward<VArg>(value));
+        }
+
+        template <typename Q>
+            requires lookup_key<Q>
+        bool erase(const Q& key)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            if(auto it = s.map.find(key); it != s.map.end())
+            {
+                s.map.erase(it);
+                return true;
+            }
+            return false;
+        }
+
+        // Exact only if nobody is writing at the same time
+        [[nodiscard]] std::size_t size() const
+        {
+            std::size_t total = 0;
+            for(std::size_t i = 0; i < m_shard_count; i++)
+            {
+                std::shared_lock lock(m_shards[i].lock);
+                total += m_shards[i].map.size();
+            }
+            return total;
+        }
+
+        [[nodiscard]] bool empty() const { return size() == 0; }
+
+        void clear()
+        {
+            for(std::size_t i = 0; i < m_shard_count; i++)
+            {
+                std::scoped_lock lock(m_shards[i].lock);
+                m_shards[i].map.clear();
+            }
+        }
+
+        // Calls fn(const K&, const V&) for everything, one shard at a time under that shard's shared lock.  Each shard
+        // is consistent, but writes to other shards can land while it runs.
+        template <typename TFunc>
+        void for_each(TFunc&& fn) const
+        {
+            for(std::size_t i = 0; i < m_shard_count; i++)
+            {
+                std::shared_lock lock(m_shards[i].lock);
+                for(const auto& [key, value] : m_shards[i].map)
+                {
+                    std::invoke(fn, key, value);
+                }
+            }
+        }
+
+        // A copy of everything, for iterating without holding any locks.  Same consistency as for_each.
+        [[nodiscard]] std::vector<std::pair<K, V>> snapshot() const
+        {
+            std::vector<std::pair<K, V>> result;
+            result.reserve(size());
+            for_each([&](const K& key, const V& value) { result.emplace_back(key, value); });
+            return result;
+        }
+
+        [[nodiscard]] std::size_t shard_count() const noexcept { return m_shard_count; }
+
+      private:
+        // Own cache line each, so threads on neighbouring shards don't fight over the lock word
+        struct alignas(64) shard
+        {
+            mutable sync::rw_spinlock lock;
+            map_type map;
+            // Keys find_or_emplace_with is making a value for, outside the lock
+            std::unordered_map<K, std::shared_future<V>, Hash, KeyEqual> building;
+        };
+
+        // The map buckets by the low bits of the hash, so shards take the top bits of a scrambled copy
+        template <typename Q>
+        std::size_t shard_index(const Q& key) const
+        {
+            const uint64 hash = static_cast<uint64>(Hash {}(key)) * 0x9E3779B97F4A7C15ull;
+            return m_shift == 64 ? 0 : static_cast<std::size_t>(hash >> m_shift);
+        }
+
+        template <typename Q>
+        shard& shard_for(const Q& key)
+        {
+            return m_shards[shard_index(key)];
+        }
+
+        template <typename Q>
+        const shard& shard_for(const Q& key) const
+        {
+            return m_shards[shard_index(key)];
+        }
+
+        std::unique_ptr<shard[]> m_shards;
+        std::size_t m_shard_count = 0;
+        uint32 m_shift = 64;
+    };
+}
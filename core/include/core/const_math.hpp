@@ -15,14 +15,309 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 */
 #pragma once
 
+#include <array>
+#include <bit>
 #include <concepts>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
 
+// constexpr math.
+// These are meant for building tables and constants at compile time, not for replacing <cmath> at runtime.  They are
+// accurate to within a few ulp for reasonable inputs, but the trig functions lose precision for very large arguments.
 namespace raoe
 {
+    // Exponentiation by squaring.  Negative exponents are supported for floating point bases.
     template <typename T, std::integral U>
         requires std::is_arithmetic_v<T>
-    consteval T pow(T base, U exponent)
+    constexpr T pow(T base, U exponent)
     {
-        return exponent == 0 ? 1 : base * pow(base, exponent - 1);
+        if constexpr(std::is_signed_v<U>)
+        {
+            if(exponent < 0)
+            {
+                if constexpr(std::is_floating_point_v<T>)
+                {
+                    // Negated unsigned, since -min isn't representable.  Cast back after, since int8 and int16 exponents
+                    // get promoted to int on the way and would stay negative.
+                    using unsigned_t = std::make_unsigned_t<U>;
+                    return T(1) / pow(base, static_cast<unsigned_t>(0u - static_cast<unsigned_t>(exponent)));
+                }
+                else
+                {
+                    return T(0);
+                }
+            }
+        }
+
+        auto remaining = static_cast<std::make_unsigned_t<U>>(exponent);
+        T result = T(1);
+        while(remaining != 0)
+        {
+            if(remaining & 1u)
+            {
+                result *= base;
+            }
+            remaining >>= 1;
+            if(remaining != 0)
+            {
+                base *= base;
+            }
+        }
+        return result;
+    }
+
+    // floor(log2(value)).  value must be non-zero.
+    template <std::unsigned_integral T>
+    constexpr int ilog2(T value) noexcept
+    {
+        return std::bit_width(value) - 1;
+    }
+
+    // floor(sqrt(value)), exact for every input
+    template <std::unsigned_integral T>
+    constexpr T isqrt(T value) noexcept
+    {
+        if(value < 2)
+        {
+            return value;
+        }
+
+        // Start from a power of two that is guaranteed to be >= the root, then Newton's method converges from above
+        T estimate = T(1) << ((std::bit_width(value) + 1) / 2);
+        while(true)
+        {
+            const T next = (estimate + value / estimate) / 2;
+            if(next >= estimate)
+            {
+                return estimate;
+            }
+            estimate = next;
+        }
+    }
+
+    namespace _internal
+    {
+        template <std::floating_point T>
+        inline constexpr T ln2 = T(0.693147180559945309417232121458176568L);
+
+        template <std::floating_point T>
+        inline constexpr T pi = T(3.141592653589793238462643383279502884L);
+
+        // Splits value into mantissa in [1, 2) and a power of two exponent.  value must be finite and positive.
+        template <std::floating_point T>
+        constexpr std::pair<T, int> frexp2(T value) noexcept
+        {
+            int exponent = 0;
+            while(value >= T(2))
+            {
+                value /= T(2);
+                exponent++;
+            }
+            while(value < T(1))
+            {
+                value *= T(2);
+                exponent--;
+            }
+            return {value, exponent};
+        }
+
+        // sin and cos taylor series, valid for |x| <= pi/4
+        template <std::floating_point T>
+        constexpr T sin_series(T x) noexcept
+        {
+            const T x2 = x * x;
+            T term = x;
+            T sum = x;
+            for(int n = 1; n < 14; n++)
+            {
+                term *= -x2 / static_cast<T>((2 * n) * (2 * n + 1));
+                sum += term;
+            }
+            return sum;
+        }
+
+        template <std::floating_point T>
+        constexpr T cos_series(T x) noexcept
+        {
+            const T x2 = x * x;
+            T term = T(1);
+            T sum = T(1);
+            for(int n = 1; n < 14; n++)
+            {
+                term *= -x2 / static_cast<T>((2 * n - 1) * (2 * n));
+                sum += term;
+            }
+            return sum;
+        }
+
+        // Reduces x into [-pi/4, pi/4], returning the reduced value and which quadrant it came from
+        template <std::floating_point T>
+        constexpr std::pair<T, int> reduce_quadrant(T x) noexcept
+        {
+            using wide_t = long double;
+            const wide_t half_pi = pi<wide_t> / 2;
+            const wide_t quadrant = static_cast<wide_t>(static_cast<long long>(
+                (static_cast<wide_t>(x) / half_pi) + (x < T(0) ? wide_t(-0.5) : wide_t(0.5))));
+            const wide_t reduced = static_cast<wide_t>(x) - quadrant * half_pi;
+            return {static_cast<T>(reduced), static_cast<int>(static_cast<long long>(quadrant) & 3)};
+        }
+    }
+
+    template <std::floating_point T>
+    constexpr T sqrt(T value) noexcept
+    {
+        if(value != value || value < T(0))
+        {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        if(value == T(0) || value == std::numeric_limits<T>::infinity())
+        {
+            return value;
+        }
+
+        // Newton's method, starting from 2^(exponent / 2) so it only needs a handful of iterations
+        const auto [mantissa, exponent] = _internal::frexp2(value);
+        T guess = pow(T(2), exponent / 2) * mantissa;
+        for(int iteration = 0; iteration < 64; iteration++)
+        {
+            const T next = (guess + value / guess) / T(2);
+            if(next == guess)
+            {
+                break;
+            }
+            guess = next;
+        }
+        return guess;
+    }
+
+    template <std::floating_point T>
+    constexpr T exp(T value) noexcept
+    {
+        if(value != value)
+        {
+            return value;
+        }
+        if(value > T(std::numeric_limits<T>::max_exponent) * _internal::ln2<T>)
+        {
+            return std::numeric_limits<T>::infinity();
+        }
+        if(value < T(std::numeric_limits<T>::min_exponent - std::numeric_limits<T>::digits) * _internal::ln2<T>)
+        {
+            return T(0);
+        }
+
+        // exp(x) = 2^k * exp(r), where |r| <= ln2/2
+        const long long k =
+            static_cast<long long>(value / _internal::ln2<T> + (value < T(0) ? T(-0.5) : T(0.5)));
+        const T r = value - static_cast<T>(k) * _internal::ln2<T>;
+
+        T term = T(1);
+        T sum = T(1);
+        for(int n = 1; n < 30 && sum + term != sum; n++)
+        {
+            term *= r / static_cast<T>(n);
+            sum += term;
+        }
+
+        // Apply the power of two in two halves so huge/tiny k don't overflow the intermediate
+        const T half_scale = pow(T(2), k / 2);
+        return sum * half_scale * half_scale * pow(T(2), k - 2 * (k / 2));
+    }
+
+    // Natural log
+    template <std::floating_point T>
+    constexpr T log(T value) noexcept
+    {
+        if(value != value || value < T(0))
+        {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        if(value == T(0))
+        {
+            return -std::numeric_limits<T>::infinity();
+        }
+        if(value == std::numeric_limits<T>::infinity())
+        {
+            return value;
+        }
+
+        auto [mantissa, exponent] = _internal::frexp2(value);
+        // Center the mantissa around 1 so the series converges quickly
+        if(mantissa > T(1.4142135623730950488L))
+        {
+            mantissa /= T(2);
+            exponent++;
+        }
+
+        // log(m) = 2 * atanh((m - 1) / (m + 1))
+        const T s = (mantissa - T(1)) / (mantissa + T(1));
+        const T s2 = s * s;
+        T term = s;
+        T sum = s;
+        for(int n = 3; n < 80; n += 2)
+        {
+            term *= s2;
+            const T next = sum + term / static_cast<T>(n);
+            if(next == sum)
+            {
+                break;
+            }
+            sum = next;
+        }
+        return T(2) * sum + static_cast<T>(exponent) * _internal::ln2<T>;
+    }
+
+    template <std::floating_point T>
+    constexpr T sin(T value) noexcept
+    {
+        if(value != value || value == std::numeric_limits<T>::infinity() ||
+           value == -std::numeric_limits<T>::infinity())
+        {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        const auto [reduced, quadrant] = _internal::reduce_quadrant(value);
+        switch(quadrant)
+        {
+            case 0: return _internal::sin_series(reduced);
+            case 1: return _internal::cos_series(reduced);
+            case 2: return -_internal::sin_series(reduced);
+            default: return -_internal::cos_series(reduced);
+        }
+    }
+
+    template <std::floating_point T>
+    constexpr T cos(T value) noexcept
+    {
+        if(value != value || value == std::numeric_limits<T>::infinity() ||
+           value == -std::numeric_limits<T>::infinity())
+        {
+            return std::numeric_limits<T>::quiet_NaN();
+        }
+        const auto [reduced, quadrant] = _internal::reduce_quadrant(value);
+        switch(quadrant)
+        {
+            case 0: return _internal::cos_series(reduced);
+            case 1: return -_internal::sin_series(reduced);
+            case 2: return -_internal::cos_series(reduced);
+            default: return _internal::sin_series(reduced);
+        }
+    }
+
+    // Builds a std::array of N elements where element i is fn(i).
+    // Call it from a constexpr context to bake lookup tables into the binary, eg:
+    //     constexpr auto sin_table = raoe::make_table<256>([](std::size_t i) { return raoe::sin(i * 0.0245436926); });
+    template <std::size_t N, typename TFunc>
+        requires std::invocable<TFunc, std::size_t>
+    constexpr auto make_table(TFunc&& fn)
+    {
+        using value_t = std::remove_cvref_t<std::invoke_result_t<TFunc, std::size_t>>;
+        std::array<value_t, N> table {};
+        for(std::size_t i = 0; i < N; i++)
+        {
+            table[i] = fn(i);
+        }
+        return table;
     }
 }
@@ -0,0 +1,471 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/from_string.hpp"
+#include "core/simd_scan.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// CSV and TSV tables.
+//
+// The reader works in two stages, like simdcsv.  Stage one walks the input 64 bytes at a time and builds bitmasks of
+// the quotes, delimiters and newlines in each block.  A prefix xor of the quote mask gives every byte that is inside a
+// quoted field, and anything left in the delimiter/newline masks after that is a real separator.  Their positions go
+// into an index.  Stage two cuts rows out of the index as std::string_view cells, without looking at the bytes again.
+//
+// Cells are views into the input (or the reader's buffer when streaming) and are only valid until the next row is
+// read.  Quoted cells have their quotes removed, and cells with "" escapes are unescaped into a per-row scratch buffer.
+namespace raoe::csv
+{
+    struct dialect
+    {
+        char delimiter = ',';
+        char quote = '"';
+        // Lines with nothing on them are skipped rather than returned as a row with one empty cell
+        bool skip_blank_lines = true;
+    };
+
+    inline constexpr dialect comma_separated {};
+    inline constexpr dialect tab_separated {.delimiter = '\t'};
+
+    class reader
+    {
+      public:
+        static constexpr std::size_t default_block_size = 1 << 20;
+
+        // Reads a table that is already in memory.  Nothing is copied; cells point into buffer.
+        explicit reader(std::string_view buffer, dialect format = {})
+            : m_format(format)
+            , m_data(buffer.data())
+            , m_end(buffer.size())
+        {
+        }
+
+        explicit reader(std::span<const std::byte> buffer, dialect format = {})
+            : reader(std::string_view(reinterpret_cast<const char*>(buffer.data()), buffer.size()), format)
+        {
+        }
+
+        // Reads a table from a stream, a block at a time.  A row that straddles two blocks is moved to the front of the
+        // buffer and indexed again once the next block is in.
+        explicit reader(std::istream& from, dialect format = {}, std::size_t block_size = default_block_size)
+            : m_format(format)
+            , m_stream(from.rdbuf())
+            , m_storage(std::max(block_size, simd::block_size))
+        {
+        }
+
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+
+        // Gets the next row.  Returns false once the input is exhausted.
+        bool next(std::span<const std::string_view>& row)
+        {
+            while(true)
+            {
+                if(take_row(false))
+                {
+                    if(is_blank())
+                    {
+                        continue;
+                    }
+                    row = m_cells;
+                    m_row_number++;
+                    return true;
+                }
+
+                if(m_scan < m_end)
+                {
+                    index_window();
+                    continue;
+                }
+
+                if(refill())
+                {
+                    continue;
+                }
+
+                // Out of input.  Whatever is left is the last row, which didn't end with a newline.
+                if(m_row_start < m_end && take_row(true) && !is_blank())
+                {
+                    row = m_cells;
+                    m_row_number++;
+                    return true;
+                }
+                return false;
+            }
+        }
+
+        // Number of rows returned so far, including the header if read_header() was called
+        [[nodiscard]] std::size_t row_number() const noexcept { return m_row_number; }
+
+        // Reads the next row as the header, so columns can be looked up by name
+        std::span<const std::string> read_header()
+        {
+            m_header.clear();
+            std::span<const std::string_view> row;
+            if(next(row))
+            {
+                m_header.assign(row.begin(), row.end());
+            }
+            return m_header;
+        }
+
+        [[nodiscard]] std::optional<std::size_t> column_index(std::string_view name) const
+        {
+            const auto found = std::find(m_header.begin(), m_header.end(), name);
+            if(found == m_header.end())
+            {
+                return std::nullopt;
+            }
+            return static_cast<std::size_t>(found - m_header.begin());
+        }
+
+        class iterator
+        {
+          public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::span<const std::string_view>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const value_type*;
+            using reference = const value_type&;
+
+            iterator() = default;
+            explicit iterator(reader* from)
+                : m_reader(from)
+            {
+                ++(*this);
+            }
+
+            reference operator*() const { return m_row; }
+            pointer operator->() const { return &m_row; }
+
+            iterator& operator++()
+            {
+                if(m_reader != nullptr && !m_reader->next(m_row))
+                {
+                    m_reader = nullptr;
+                }
+                return *this;
+            }
+
+            void operator++(int) { ++(*this); }
+
+            bool operator==(std::default_sentinel_t) const { return m_reader == nullptr; }
+
+          private:
+            reader* m_reader = nullptr;
+            value_type m_row;
+        };
+
+        // for(auto row : reader) { ... }
+        iterator begin() { return iterator(this); }
+        std::default_sentinel_t end() { return std::default_sentinel; }
+
+      private:
+        // Separators are stored as their offset, with the top bit set if they end a row
+        static constexpr uint64 row_end_flag = uint64(1) << 63;
+        // How much input stage one indexes before stage two takes rows out of it.  Small enough that the index stays in
+        // cache, big enough that we aren't bouncing between the two stages constantly.
+        static constexpr std::size_t window_size = 64 * 1024;
+
+        // Stage one.  Indexes the separators in the next window of input.
+        void index_window()
+        {
+            const std::size_t window_end = std::min(m_end, m_scan + window_size);
+            while(m_scan < window_end)
+            {
+                const std::size_t available = m_end - m_scan;
+                uint64 quotes;
+                uint64 separators;
+                uint64 newlines;
+                if(available >= simd::block_size)
+                {
+                    classify(simd::block64(m_data + m_scan), quotes, separators, newlines);
+                }
+                else
+                {
+                    // Last bit of input.  Pad it out to a whole block, and throw away anything the padding matched.
+                    const simd::padded_block padded(m_data + m_scan, available, '\0');
+                    classify(simd::block64(padded.data()), quotes, separators, newlines);
+                    const uint64 valid = (uint64(1) << available) - 1;
+                    quotes &= valid;
+                    separators &= valid;
+                    newlines &= valid;
+                }
+
+                // Everything between an opening quote and a closing quote, carrying over from the last block if we
+                // ended inside one.  "" escapes toggle twice, so they don't change anything.
+                const uint64 quoted = simd::prefix_xor(quotes) ^ m_quote_carry;
+                m_quote_carry = static_cast<uint64>(static_cast<int64>(quoted) >> 63);
+
+                const uint64 row_ends = newlines & ~quoted;
+                const uint64 base = m_scan;
+                simd::for_each_bit((separators | newlines) & ~quoted, [&](uint32 bit) {
+                    const uint64 flag = ((row_ends >> bit) & 1) != 0 ? row_end_flag : 0;
+                    m_separators.push_back((base + bit) | flag);
+                });
+
+                m_scan += std::min(available, simd::block_size);
+            }
+        }
+
+        void classify(const simd::block64& block, uint64& quotes, uint64& separators, uint64& newlines) const
+        {
+            quotes = block.eq(m_format.quote);
+            separators = block.eq(m_format.delimiter);
+            newlines = block.eq('\n');
+        }
+
+        // Stage two.  Cuts the next row out of the index.  If at_end is set, a row without a newline is taken too.
+        bool take_row(bool at_end)
+        {
+            std::size_t last = m_separator_read;
+            while(last < m_separators.size() && (m_separators[last] & row_end_flag) == 0)
+            {
+                last++;
+            }
+
+            std::size_t row_end;
+            std::size_t next_separator;
+            if(last < m_separators.size())
+            {
+                row_end = static_cast<std::size_t>(m_separators[last] & ~row_end_flag);
+                next_separator = last + 1;
+            }
+            else if(at_end)
+            {
+                row_end = m_end;
+                next_separator = last;
+            }
+            else
+            {
+                return false;
+            }
+
+            // Unescaped cells never get longer, so reserving the row's length means the views into m_scratch stay
+            // valid while we append to it.
+            m_scratch.clear();
+            m_scratch.reserve(row_end - m_row_start);
+            m_cells.clear();
+
+            std::size_t cell_start = m_row_start;
+            for(std::size_t i = m_separator_read; i < last; i++)
+            {
+                const auto position = static_cast<std::size_t>(m_separators[i]);
+                m_cells.push_back(clean(std::string_view(m_data + cell_start, position - cell_start)));
+                cell_start = position + 1;
+            }
+
+            std::string_view last_cell(m_data + cell_start, row_end - cell_start);
+            if(last_cell.ends_with('\r'))
+            {
+                last_cell.remove_suffix(1);
+            }
+            m_cells.push_back(clean(last_cell));
+
+            m_row_start = std::min(row_end + 1, m_end);
+            m_separator_read = next_separator;
+            if(m_separator_read == m_separators.size())
+            {
+                m_separators.clear();
+                m_separator_read = 0;
+            }
+            m_blank = m_cells.size() == 1 && last_cell.empty();
+            return true;
+        }
+
+        bool is_blank() const noexcept { return m_format.skip_blank_lines && m_blank; }
+
+        // Strips the quotes off of a quoted cell and collapses "" into "
+        std::string_view clean(std::string_view cell)
+        {
+            const char quote = m_format.quote;
+            if(cell.empty() || cell.front() != quote)
+            {
+                return cell;
+            }
+
+            cell.remove_prefix(1);
+            if(cell.ends_with(quote))
+            {
+                cell.remove_suffix(1);
+            }
+            if(cell.find(quote) == std::string_view::npos)
+            {
+                return cell;
+            }
+
+            const std::size_t start = m_scratch.size();
+            for(std::size_t i = 0; i < cell.size(); i++)
+            {
+                m_scratch.push_back(cell[i]);
+                if(cell[i] == quote && i + 1 < cell.size() && cell[i + 1] == quote)
+                {
+                    i++;
+                }
+            }
+            return std::string_view(m_scratch).substr(start);
+        }
+
+        // Moves the unfinished row to the front of the buffer and reads another block after it.  The unfinished row is
+        // indexed again from scratch, which is cheap and means we never have to patch up stale offsets.
+        bool refill()
+        {
+            if(m_stream == nullptr || m_eof)
+            {
+                return false;
+            }
+
+            const std::size_t partial = m_end - m_row_start;
+            if(partial > 0 && m_row_start > 0)
+            {
+                std::memmove(m_storage.data(), m_storage.data() + m_row_start, partial);
+            }
+            m_row_start = 0;
+            m_end = partial;
+            m_scan = 0;
+            m_quote_carry = 0;
+            m_separators.clear();
+            m_separator_read = 0;
+
+            // One row is bigger than a whole block
+            if(m_end == m_storage.size())
+            {
+                m_storage.resize(m_storage.size() * 2);
+            }
+
+            const std::streamsize read = m_stream->sgetn(m_storage.data() + m_end,
+                                                         static_cast<std::streamsize>(m_storage.size() - m_end));
+            m_data = m_storage.data();
+            if(read <= 0)
+            {
+                m_eof = true;
+                // The leftovers still need indexing so the last row can be cut out of them
+                index_all();
+                return false;
+            }
+            m_end += static_cast<std::size_t>(read);
+            return true;
+        }
+
+        void index_all()
+        {
+            while(m_scan < m_end)
+            {
+                index_window();
+            }
+        }
+
+        dialect m_format;
+        std::streambuf* m_stream = nullptr;
+        std::vector<char> m_storage;
+        const char* m_data = nullptr;
+        std::size_t m_end = 0;
+        // Next byte stage one will look at
+        std::size_t m_scan = 0;
+        // All ones if the last indexed block ended inside a quoted field
+        uint64 m_quote_carry = 0;
+        std::vector<uint64> m_separators;
+        std::size_t m_separator_read = 0;
+        std::size_t m_row_start = 0;
+        std::size_t m_row_number = 0;
+        bool m_blank = false;
+        bool m_eof = false;
+        std::vector<std::string_view> m_cells;
+        std::string m_scratch;
+        std::vector<std::string> m_header;
+    };
+
+    // Converts the leading cells of a row into values, in order, with raoe::from_string.
+    // Returns false if the row is too short or any cell didn't parse.
+    template <typename... Ts>
+    bool parse_row(std::span<const std::string_view> row, Ts&... values)
+    {
+        if(row.size() < sizeof...(Ts))
+        {
+            return false;
+        }
+        std::size_t cell = 0;
+        return (from_string(row[cell++], values) && ...);
+    }
+
+    struct column_result
+    {
+        // Rows read from the table
+        std::size_t rows = 0;
+        // Cells that were missing or didn't parse.  Their slot in the output is value initialized.
+        std::size_t failed = 0;
+    };
+
+    namespace _internal
+    {
+        template <typename T>
+        void read_cell(std::span<const std::string_view> row, std::size_t column, T& out, column_result& result)
+        {
+            if(column >= row.size() || !from_string(row[column], out))
+            {
+                out = T {};
+                result.failed++;
+            }
+        }
+
+        template <typename... Ts, std::size_t... TIndices>
+        void read_cells(std::span<const std::string_view> row, const std::array<std::size_t, sizeof...(Ts)>& columns,
+                        std::size_t slot, column_result& result, std::index_sequence<TIndices...>,
+                        std::span<Ts>... into)
+        {
+            (read_cell(row, columns[TIndices], into[slot], result), ...);
+        }
+    }
+
+    // Reads rows until the outputs are full or the table runs out, converting one column into each output span.
+    //     std::vector<raoe::uuid> ids(count);
+    //     std::vector<float> weights(count);
+    //     raoe::csv::read_columns(reader, {0, 3}, std::span(ids), std::span(weights));
+    template <typename... Ts>
+    column_result read_columns(reader& from, const std::array<std::size_t, sizeof...(Ts)>& columns,
+                               std::span<Ts>... into)
+    {
+        column_result result;
+        const std::size_t capacity = std::min({into.size()...});
+        std::span<const std::string_view> row;
+        while(result.rows < capacity && from.next(row))
+        {
+            _internal::read_cells<Ts...>(row, columns, result.rows, result, std::index_sequence_for<Ts...>(), into...);
+            result.rows++;
+        }
+        return result;
+    }
+
+    template <typename T>
+    column_result read_column(reader& from, std::size_t column, std::span<T> into)
+    {
+        return read_columns<T>(from, {column}, into);
+    }
+}
@@ -0,0 +1,374 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/from_string.hpp"
+#include "core/function.hpp"
+#include "core/line_reader.hpp"
+#include "core/parse.hpp"
+#include "core/sync.hpp"
+#include "core/typename.hpp"
+#include "core/types.hpp"
+#include "tag/tag.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <format>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Console variables.
+//
+// A cvar is a named, typed tuning value that can be changed at runtime from a string (the console, a config file), and
+// read from any thread without taking a lock.  Declare them at namespace scope and they register themselves:
+//     inline raoe::cvar<float> gravity {"physics:gravity", 9.8f, "Downward acceleration, in m/s^2"};
+//     ...
+//     velocity.y -= gravity.get() * dt;
+//     raoe::cvar_registry::get().set("physics:gravity", "1.6");
+//
+// Reads are a single atomic load when T fits in a lock free atomic, a seqlock snapshot when T is trivially copyable,
+// and an atomic shared_ptr load otherwise (strings and the like).  Writes take a per-cvar lock and run the change
+// callbacks.
+namespace raoe
+{
+    class cvar_base;
+
+    // Every live cvar, by name.  Lookups take a lock, so use it for the console and config files, not per frame.
+    class cvar_registry
+    {
+      public:
+        static cvar_registry& get()
+        {
+            static cvar_registry registry;
+            return registry;
+        }
+
+        // Returns nullptr if no cvar has that name
+        [[nodiscard]] cvar_base* find(const tag& name) const
+        {
+            std::scoped_lock lock(m_mutex);
+            const auto found = m_cvars.find(name);
+            return found != m_cvars.end() ? found->second : nullptr;
+        }
+
+        // Sets a cvar from a string.  Returns false if there is no such cvar or the value didn't parse.
+        bool set(const tag& name, std::string_view value);
+
+        struct load_result
+        {
+            std::size_t applied = 0;
+            // Lines naming a cvar that doesn't exist, or with a value that didn't parse
+            std::size_t failed = 0;
+        };
+
+        // Reads "name value" lines.  Values with spaces in them are quoted, and anything after a # is a comment.
+        load_result load(std::istream& from);
+
+        // Writes every cvar as "name value" lines that load() can read back, sorted by name
+        void save(std::ostream& to) const;
+
+        // Calls fn(cvar_base&) for every cvar, in no particular order.  Don't register or unregister cvars from fn.
+        template <typename TFunc>
+        void for_each(TFunc&& fn) const
+        {
+            std::scoped_lock lock(m_mutex);
+            for(const auto& [name, var] : m_cvars)
+            {
+                fn(*var);
+            }
+        }
+
+      private:
+        friend class cvar_base;
+
+        cvar_registry() = default;
+
+        void add(cvar_base* var);
+        void remove(cvar_base* var)
+        {
+            std::scoped_lock lock(m_mutex);
+            const auto found = std::find_if(m_cvars.begin(), m_cvars.end(),
+                                            [var](const auto& entry) { return entry.second == var; });
+            if(found != m_cvars.end())
+            {
+                m_cvars.erase(found);
+            }
+        }
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<tag, cvar_base*> m_cvars;
+    };
+
+    // The type erased half of a cvar, which is what the registry hands out
+    class cvar_base
+    {
+      public:
+        cvar_base(const cvar_base&) = delete;
+        cvar_base& operator=(const cvar_base&) = delete;
+
+        [[nodiscard]] const tag& name() const noexcept { return m_name; }
+        [[nodiscard]] std::string_view description() const noexcept { return m_description; }
+        [[nodiscard]] virtual std::string_view type_name() const noexcept = 0;
+
+        // Parses value with raoe::from_string and stores it.  Returns false (and changes nothing) if it didn't parse.
+        virtual bool set_from_string(std::string_view value) = 0;
+        [[nodiscard]] virtual std::string to_string() const = 0;
+        // False if the value can't be turned back into a string (there's no std::formatter for it), so save() skips it
+        [[nodiscard]] virtual bool savable() const noexcept = 0;
+        // Puts the value back to what it was declared with
+        virtual void reset() = 0;
+
+      protected:
+        cvar_base(tag name, std::string_view description)
+            : m_name(std::move(name))
+            , m_description(description)
+        {
+            check_if(static_cast<bool>(m_name), "cvar names must be valid tags");
+            cvar_registry::get().add(this);
+        }
+
+        virtual ~cvar_base() { cvar_registry::get().remove(this); }
+
+      private:
+        tag m_name;
+        std::string m_description;
+    };
+
+    inline void cvar_registry::add(cvar_base* var)
+    {
+        std::scoped_lock lock(m_mutex);
+        const bool inserted = m_cvars.emplace(var->name(), var).second;
+        check_if(inserted, "cvar {} was registered twice", std::string_view(var->name()));
+    }
+
+    inline bool cvar_registry::set(const tag& name, std::string_view value)
+    {
+        cvar_base* var = find(name);
+        return var != nullptr && var->set_from_string(value);
+    }
+
+    inline cvar_registry::load_result cvar_registry::load(std::istream& from)
+    {
+        load_result result;
+        raoe::stream::line_reader reader(from);
+        std::string_view line;
+        while(reader.next(line))
+        {
+            line = line.substr(0, line.find('#'));
+            const auto tokens = reader.tokens(line);
+            if(tokens.empty())
+            {
+                continue;
+            }
+            if(tokens.size() >= 2 && set(tag(tokens[0]), tokens[1]))
+            {
+                result.applied++;
+            }
+            else
+            {
+                result.failed++;
+            }
+        }
+        return result;
+    }
+
+    inline void cvar_registry::save(std::ostream& to) const
+    {
+        std::vector<std::pair<std::string, std::string>> lines;
+        for_each([&](const cvar_base& var) {
+            if(var.savable())
+            {
+                lines.emplace_back(std::string(var.name()), var.to_string());
+            }
+        });
+        std::sort(lines.begin(), lines.end());
+
+        for(const auto& [name, value] : lines)
+        {
+            const bool needs_quotes = value.empty() || value.find_first_of(" \t#") != std::string::npos;
+            to << name << ' ' << (needs_quotes ? "\"" : "") << value << (needs_quotes ? "\"" : "") << '\n';
+        }
+    }
+
+    namespace _internal
+    {
+        // The three ways a cvar can hold its value, picked by how cheaply T can be read atomically
+        template <typename T>
+        concept cvar_lock_free = std::is_trivially_copyable_v<T> && std::atomic<T>::is_always_lock_free;
+
+        template <typename T>
+        concept cvar_seqlocked = std::is_trivially_copyable_v<T> && !cvar_lock_free<T>;
+
+        template <typename T>
+        class cvar_storage
+        {
+          public:
+            explicit cvar_storage(const T& value)
+                : m_value(std::make_shared<const T>(value))
+            {
+            }
+            T load() const { return *m_value.load(std::memory_order_acquire); }
+            void store(const T& value) { m_value.store(std::make_shared<const T>(value), std::memory_order_release); }
+
+          private:
+            std::atomic<std::shared_ptr<const T>> m_value;
+        };
+
+        template <cvar_lock_free T>
+        class cvar_storage<T>
+        {
+          public:
+            explicit cvar_storage(const T& value)
+                : m_value(value)
+            {
+            }
+            T load() const noexcept { return m_value.load(std::memory_order_acquire); }
+            void store(const T& value) noexcept { m_value.store(value, std::memory_order_release); }
+
+          private:
+            std::atomic<T> m_value;
+        };
+
+        template <cvar_seqlocked T>
+        class cvar_storage<T> : public sync::seqlock<T>
+        {
+          public:
+            using sync::seqlock<T>::seqlock;
+        };
+
+        template <typename T>
+        concept cvar_formattable =
+            std::convertible_to<const T&, std::string_view> || std::is_arithmetic_v<T> ||
+            requires(const T& value) { static_cast<double>(value); } || requires { std::formatter<T>(); };
+
+        template <typename T>
+        std::string cvar_to_string(const T& value)
+        {
+            if constexpr(std::convertible_to<const T&, std::string_view>)
+            {
+                return std::string(static_cast<std::string_view>(value));
+            }
+            else if constexpr(std::is_arithmetic_v<T>)
+            {
+                return std::format("{}", value);
+            }
+            else if constexpr(requires { static_cast<double>(value); })
+            {
+                // raoe::fixed and friends
+                return std::format("{}", static_cast<double>(value));
+            }
+            else if constexpr(cvar_formattable<T>)
+            {
+                return std::format("{}", value);
+            }
+            else
+            {
+                return {};
+            }
+        }
+    }
+
+    template <typename T>
+    concept cvar_type = std::copyable<T> && std::default_initializable<T> && requires(std::string_view s, T& value) {
+        {
+            from_string(s, value)
+        } -> std::same_as<bool>;
+    };
+
+    template <cvar_type T>
+    class cvar final : public cvar_base
+    {
+      public:
+        using value_type = T;
+        using callback_type = function<void(const T&)>;
+
+        cvar(tag name, T default_value, std::string_view description = {})
+            : cvar_base(std::move(name), description)
+            , m_default(default_value)
+            , m_value(default_value)
+        {
+        }
+
+        // Lock free, safe from any thread
+        [[nodiscard]] T get() const { return m_value.load(); }
+        operator T() const { return get(); }
+
+        void set(const T& value)
+        {
+            std::scoped_lock lock(m_write_mutex);
+            m_value.store(value);
+            for(const auto& [id, callback] : m_callbacks)
+            {
+                callback(value);
+            }
+        }
+
+        cvar& operator=(const T& value)
+        {
+            set(value);
+            return *this;
+        }
+
+        bool set_from_string(std::string_view text) override
+        {
+            T value {};
+            if(!from_string(text, value))
+            {
+                return false;
+            }
+            set(value);
+            return true;
+        }
+
+        [[nodiscard]] std::string to_string() const override { return _internal::cvar_to_string(get()); }
+        [[nodiscard]] bool savable() const noexcept override { return _internal::cvar_formattable<T>; }
+        [[nodiscard]] std::string_view type_name() const noexcept override { return raoe::core::name_of<T>(); }
+        void reset() override { set(m_default); }
+        [[nodiscard]] const T& default_value() const noexcept { return m_default; }
+
+        // Calls fn with the new value every time this cvar is set, on the thread that set it.  fn must not set this
+        // cvar.  Returns an id for remove_callback().
+        std::size_t on_change(callback_type fn)
+        {
+            std::scoped_lock lock(m_write_mutex);
+            m_callbacks.emplace_back(++m_next_callback, std::move(fn));
+            return m_next_callback;
+        }
+
+        void remove_callback(std::size_t id)
+        {
+            std::scoped_lock lock(m_write_mutex);
+            std::erase_if(m_callbacks, [id](const auto& entry) { return entry.first == id; });
+        }
+
+      private:
+        const T m_default;
+        _internal::cvar_storage<T> m_value;
+        std::mutex m_write_mutex;
+        std::vector<std::pair<std::size_t, callback_type>> m_callbacks;
+        std::size_t m_next_callback = 0;
+    };
+}
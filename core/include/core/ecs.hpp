@@ -0,0 +1,682 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/function.hpp"
+#include "core/sync.hpp"
+#include "core/typename.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Entities and components, stored by archetype.
+//
+// subclass_map kept a hash map of shared_ptrs per entity.  Here every distinct set of component types is an archetype,
+// and each archetype keeps one tightly packed array per component, so "everything with a position and a velocity" is
+// a walk down two arrays.  The per entity calls look like subclass_map's (insert<T>, find<T>, contains<T>, erase<T>),
+// but adding or removing a component moves the entity to another archetype, which invalidates pointers to its
+// components (and moves one other entity into its old row).
+//
+// Components are plain types, no base class needed, that can be moved without throwing.  Their ids are a hash of the
+// type's name, so they're the same from run to run.  You can't add, remove, create or destroy while iterating; record
+// it in a command_buffer and apply() it afterwards.
+//     raoe::ecs::world world;
+//     auto e = world.create(position {0, 0}, velocity {1, 0});
+//     world.each<position, const velocity>([](position& p, const velocity& v) { p.x += v.x; p.y += v.y; });
+namespace raoe::ecs
+{
+    template <typename T>
+    concept component = std::is_object_v<T> && !std::is_const_v<T> && !std::is_volatile_v<T> &&
+                        std::is_nothrow_move_constructible_v<T> && std::is_nothrow_destructible_v<T>;
+
+    // A component type in a query, which may be const
+    template <typename T>
+    concept query_component = component<std::remove_const_t<T>>;
+
+    struct entity
+    {
+        uint32 index = ~uint32 {0};
+        uint32 generation = 0;
+
+        [[nodiscard]] constexpr bool valid() const noexcept { return index != ~uint32 {0}; }
+        constexpr auto operator<=>(const entity&) const noexcept = default;
+    };
+
+    namespace _internal
+    {
+        struct component_info
+        {
+            uint64 id;
+            std::string_view name;
+            std::size_t size;
+            std::size_t align;
+            // Move constructs into `to` and destroys `from`
+            void (*relocate)(void* to, void* from) noexcept;
+            void (*destroy)(void* value) noexcept;
+        };
+
+        // One per type.  The id is a hash of the type's name, so two types with the same name (in anonymous namespaces in
+        // different files, say) share an id, but never an info; lookups by id check the info to catch that.
+        template <component T>
+        const component_info& info_of() noexcept
+        {
+            static constexpr component_info info {
+                stable_hash(core::name_of<T>()),
+                core::name_of<T>(),
+                sizeof(T),
+                alignof(T),
+                [](void* to, void* from) noexcept {
+                    T* source = std::launder(static_cast<T*>(from));
+                    ::new(to) T(std::move(*source));
+                    source->~T();
+                },
+                [](void* value) noexcept { std::launder(static_cast<T*>(value))->~T(); },
+            };
+            return info;
+        }
+
+        // One component's values for every row of an archetype
+        class column
+        {
+          public:
+            explicit column(const component_info& info)
+                : m_info(&info)
+            {
+            }
+
+            column(column&& other) noexcept
+                : m_info(other.m_info)
+                , m_data(std::exchange(other.m_data, nullptr))
+            {
+            }
+
+            column(const column&) = delete;
+            column& operator=(const column&) = delete;
+
+            // Rows are destroyed by the archetype; this just frees the memory
+            ~column() { ::operator delete(m_data, std::align_val_t(m_info->align)); }
+
+            [[nodiscard]] const component_info& info() const noexcept { return *m_info; }
+            [[nodiscard]] void* at(std::size_t row) const noexcept { return m_data + row * m_info->size; }
+
+            template <typename T>
+            [[nodiscard]] T* data() const noexcept
+            {
+                return std::launder(reinterpret_cast<T*>(m_data));
+            }
+
+            void reallocate(std::size_t rows, std::size_t capacity)
+            {
+                auto* data = static_cast<std::byte*>(
+                    ::operator new(capacity * m_info->size, std::align_val_t(m_info->align)));
+                for(std::size_t row = 0; row < rows; row++)
+                {
+                    m_info->relocate(data + row * m_info->size, at(row));
+                }
+                ::operator delete(m_data, std::align_val_t(m_info->align));
+                m_data = data;
+            }
+
+          private:
+            const component_info* m_info;
+            std::byte* m_data = nullptr;
+        };
+
+        struct archetype
+        {
+            // Sorted component ids, and a column for each in the same order
+            std::vector<uint64> signature;
+            std::vector<column> columns;
+            std::vector<entity> entities;
+            std::size_t capacity = 0;
+            std::unordered_map<uint64, archetype*> add_edges;
+            std::unordered_map<uint64, archetype*> remove_edges;
+
+            [[nodiscard]] std::size_t size() const noexcept { return entities.size(); }
+
+            [[nodiscard]] int32 column_index(uint64 id) const noexcept
+            {
+                const auto it = std::lower_bound(signature.begin(), signature.end(), id);
+                return it != signature.end() && *it == id ? static_cast<int32>(it - signature.begin()) : -1;
+            }
+
+            // The same, but panics if the column with that id belongs to a different type of the same name
+            [[nodiscard]] int32 column_index(const component_info& info) const noexcept
+            {
+                const int32 index = column_index(info.id);
+                check_if(index < 0 || &columns[index].info() == &info,
+                         "ecs: two different component types are both called '{}'", info.name);
+                return index;
+            }
+
+            // Adds a row for e with every column left unconstructed
+            uint32 push(entity e)
+            {
+                if(entities.size() == capacity)
+                {
+                    capacity = std::max<std::size_t>(16, capacity * 2);
+                    for(column& c : columns)
+                    {
+                        c.reallocate(entities.size(), capacity);
+                    }
+                }
+                entities.push_back(e);
+                return static_cast<uint32>(entities.size() - 1);
+            }
+
+            // Fills the (already destroyed) row with the last one.  Returns the entity that moved, if any.
+            entity pop_into(uint32 row) noexcept
+            {
+                const auto last = static_cast<uint32>(entities.size() - 1);
+                entity moved {};
+                if(row != last)
+                {
+                    for(column& c : columns)
+                    {
+                        c.info().relocate(c.at(row), c.at(last));
+                    }
+                    entities[row] = entities[last];
+                    moved = entities[row];
+                }
+                entities.pop_back();
+                return moved;
+            }
+
+            ~archetype()
+            {
+                for(column& c : columns)
+                {
+                    for(std::size_t row = 0; row < entities.size(); row++)
+                    {
+                        c.info().destroy(c.at(row));
+                    }
+                }
+            }
+        };
+    }
+
+    // A component's id: a hash of its type name
+    template <component T>
+    [[nodiscard]] inline uint64 component_id() noexcept
+    {
+        return _internal::info_of<T>().id;
+    }
+
+    class world;
+
+    // Structural changes recorded while iterating, and made later by world::apply().  Recording is thread safe, so
+    // every worker in a parallel_each can share one.  Commands on entities that are gone by the time they run are
+    // skipped.
+    class command_buffer
+    {
+      public:
+        using command = function<void(world&), 48>;
+
+        template <component... Ts>
+        void create(Ts... components);
+        void destroy(entity e);
+        template <component T>
+        void insert_or_assign(entity e, T value);
+        template <component T>
+        void erase(entity e);
+
+        [[nodiscard]] std::size_t size() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_commands.size();
+        }
+        [[nodiscard]] bool empty() const { return size() == 0; }
+
+      private:
+        friend class world;
+
+        void push(command cmd)
+        {
+            std::scoped_lock lock(m_mutex);
+            m_commands.push_back(std::move(cmd));
+        }
+
+        mutable sync::mutex m_mutex;
+        std::vector<command> m_commands;
+    };
+
+    class world
+    {
+        struct record
+        {
+            _internal::archetype* archetype = nullptr;
+            uint32 row = 0;
+            uint32 generation = 0;
+        };
+
+      public:
+        // Rows per piece of work in parallel_each
+        static constexpr std::size_t chunk_rows = 16384;
+
+        world() { m_empty = find_or_add_archetype({}); }
+
+        world(const world&) = delete;
+        world& operator=(const world&) = delete;
+
+        template <component... Ts>
+        entity create(Ts... components)
+        {
+            check_structural();
+            _internal::archetype* target = m_empty;
+            ((target = add_edge(target, _internal::info_of<Ts>())), ...);
+            check_if(target->columns.size() == sizeof...(Ts), "ecs: create() was given the same component twice");
+            check_if(target->size() < ~uint32 {0}, "ecs: too many entities in one archetype");
+
+            entity e = allocate_entity();
+            const uint32 row = target->push(e);
+            (::new(target->columns[target->column_index(_internal::info_of<Ts>())].at(row)) Ts(std::move(components)), ...);
+            m_records[e.index] = record {target, row, e.generation};
+            return e;
+        }
+
+        bool destroy(entity e)
+        {
+            check_structural();
+            record* r = lookup(e);
+            if(r == nullptr)
+            {
+                return false;
+            }
+            for(_internal::column& c : r->archetype->columns)
+            {
+                c.info().destroy(c.at(r->row));
+            }
+            remove_row(*r);
+            r->archetype = nullptr;
+            r->generation++;
+            m_free.push_back(e.index);
+            m_alive--;
+            return true;
+        }
+
+        [[nodiscard]] bool alive(entity e) const noexcept { return lookup(e) != nullptr; }
+
+        // Returns nullptr if e already has a T (or is gone)
+        template <component T, typename... Args>
+        T* insert(entity e, Args&&... args)
+        {
+            check_structural();
+            record* r = lookup(e);
+            if(r == nullptr || r->archetype->column_index(_internal::info_of<T>()) >= 0)
+            {
+                return nullptr;
+            }
+            // Made before anything moves, so a throwing constructor leaves everything as it was
+            T value(std::forward<Args>(args)...);
+            _internal::archetype* target = add_edge(r->archetype, _internal::info_of<T>());
+            move_to(*r, target);
+            return ::new(target->columns[target->column_index(_internal::info_of<T>())].at(r->row)) T(std::move(value));
+        }
+
+        template <component T>
+        T* insert_or_assign(entity e, T value)
+        {
+            if(T* existing = find<T>(e))
+            {
+                *existing = std::move(value);
+                return existing;
+            }
+            return insert<T>(e, std::move(value));
+        }
+
+        template <query_component T>
+        [[nodiscard]] T* find(entity e) const noexcept
+        {
+            const record* r = lookup(e);
+            if(r == nullptr)
+            {
+                return nullptr;
+            }
+            const int32 index = r->archetype->column_index(_internal::info_of<std::remove_const_t<T>>());
+            return index < 0 ? nullptr : static_cast<T*>(r->archetype->columns[index].at(r->row));
+        }
+
+        template <component T>
+        [[nodiscard]] bool contains(entity e) const noexcept
+        {
+            return find<T>(e) != nullptr;
+        }
+
+        template <component T>
+        bool erase(entity e)
+        {
+            check_structural();
+            record* r = lookup(e);
+            if(r == nullptr)
+            {
+                return false;
+            }
+            const int32 index = r->archetype->column_index(_internal::info_of<T>());
+            if(index < 0)
+            {
+                return false;
+            }
+            r->archetype->columns[index].info().destroy(r->archetype->columns[index].at(r->row));
+            move_to(*r, remove_edge(r->archetype, _internal::info_of<T>()));
+            return true;
+        }
+
+        // Calls fn(Ts&...) or fn(entity, Ts&...) for every entity that has all of Ts
+        template <query_component... Ts, typename F>
+        void each(F&& fn)
+        {
+            iteration_scope scope(*this);
+            for(const auto& [signature, archetype] : m_archetypes)
+            {
+                std::array<int32, sizeof...(Ts)> columns;
+                if(archetype->size() > 0 && match<Ts...>(*archetype, columns))
+                {
+                    run<Ts...>(*archetype, columns, 0, archetype->size(), fn, std::index_sequence_for<Ts...> {});
+                }
+            }
+        }
+
+        // each(), split into pieces of up to chunk_rows rows and run on `threads` threads (0 for one per core),
+        // including this one.  fn is called from several threads at once.
+        template <query_component... Ts, typename F>
+        void parallel_each(F&& fn, uint32 threads = 0)
+        {
+            struct piece
+            {
+                _internal::archetype* archetype;
+                std::array<int32, sizeof...(Ts)> columns;
+                std::size_t begin;
+                std::size_t end;
+            };
+
+            iteration_scope scope(*this);
+            std::vector<piece> pieces;
+            for(const auto& [signature, archetype] : m_archetypes)
+            {
+                std::array<int32, sizeof...(Ts)> columns;
+                if(archetype->size() > 0 && match<Ts...>(*archetype, columns))
+                {
+                    for(std::size_t begin = 0; begin < archetype->size(); begin += chunk_rows)
+                    {
+                        pieces.push_back(
+                            piece {archetype.get(), columns, begin, std::min(begin + chunk_rows, archetype->size())});
+                    }
+                }
+            }
+
+            std::atomic<std::size_t> next = 0;
+            auto work = [&] {
+                for(std::size_t i = next++; i < pieces.size(); i = next++)
+                {
+                    const piece& p = pieces[i];
+                    run<Ts...>(*p.archetype, p.columns, p.begin, p.end, fn, std::index_sequence_for<Ts...> {});
+                }
+            };
+
+            if(threads == 0)
+            {
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            // This thread is one of them
+            const std::size_t helpers = std::min<std::size_t>(threads, pieces.size()) - (pieces.empty() ? 0 : 1);
+            std::vector<std::jthread> workers;
+            workers.reserve(helpers);
+            for(std::size_t i = 0; i < helpers; i++)
+            {
+                workers.emplace_back(work);
+            }
+            work();
+        }
+
+        // Runs everything recorded, in order, and empties the buffer
+        void apply(command_buffer& commands)
+        {
+            std::vector<command_buffer::command> recorded;
+            {
+                std::scoped_lock lock(commands.m_mutex);
+                recorded.swap(commands.m_commands);
+            }
+            for(const command_buffer::command& cmd : recorded)
+            {
+                cmd(*this);
+            }
+            // Hand the memory back so next frame's recording doesn't have to grow it again
+            recorded.clear();
+            std::scoped_lock lock(commands.m_mutex);
+            if(commands.m_commands.empty())
+            {
+                commands.m_commands.swap(recorded);
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_alive; }
+        [[nodiscard]] std::size_t archetype_count() const noexcept { return m_archetypes.size(); }
+
+      private:
+        struct iteration_scope
+        {
+            explicit iteration_scope(world& w)
+                : owner(w)
+            {
+                owner.m_iterating++;
+            }
+            ~iteration_scope() { owner.m_iterating--; }
+            world& owner;
+        };
+
+        void check_structural() const
+        {
+            check_if(m_iterating == 0, "ecs: can't change entities while iterating them; use a command_buffer");
+        }
+
+        [[nodiscard]] record* lookup(entity e) noexcept
+        {
+            return e.index < m_records.size() && m_records[e.index].archetype != nullptr &&
+                           m_records[e.index].generation == e.generation
+                       ? &m_records[e.index]
+                       : nullptr;
+        }
+        [[nodiscard]] const record* lookup(entity e) const noexcept { return const_cast<world*>(this)->lookup(e); }
+
+        entity allocate_entity()
+        {
+            m_alive++;
+            if(!m_free.empty())
+            {
+                const uint32 index = m_free.back();
+                m_free.pop_back();
+                return entity {index, m_records[index].generation};
+            }
+            m_records.emplace_back();
+            return entity {static_cast<uint32>(m_records.size() - 1), 0};
+        }
+
+        _internal::archetype* find_or_add_archetype(std::vector<const _internal::component_info*> infos)
+        {
+            std::sort(infos.begin(), infos.end(), [](const auto* lhs, const auto* rhs) { return lhs->id < rhs->id; });
+            std::vector<uint64> signature;
+            for(const auto* info : infos)
+            {
+                signature.push_back(info->id);
+            }
+            check_if(std::adjacent_find(signature.begin(), signature.end()) == signature.end(),
+                     "ecs: two component types hash to the same id");
+
+            auto [it, added] = m_archetypes.try_emplace(signature);
+            if(added)
+            {
+                it->second = std::make_unique<_internal::archetype>();
+                it->second->signature = std::move(signature);
+                for(const auto* info : infos)
+                {
+                    it->second->columns.emplace_back(*info);
+                }
+            }
+            else
+            {
+                // Found by id, which doesn't mean it's the same types
+                for(std::size_t i = 0; i < infos.size(); i++)
+                {
+                    check_if(&it->second->columns[i].info() == infos[i],
+                             "ecs: two different component types are both called '{}'", infos[i]->name);
+                }
+            }
+            return it->second.get();
+        }
+
+        std::vector<const _internal::component_info*> infos_of(const _internal::archetype& from) const
+        {
+            std::vector<const _internal::component_info*> infos;
+            for(const _internal::column& c : from.columns)
+            {
+                infos.push_back(&c.info());
+            }
+            return infos;
+        }
+
+        _internal::archetype* add_edge(_internal::archetype* from, const _internal::component_info& info)
+        {
+            _internal::archetype*& edge = from->add_edges[info.id];
+            if(edge == nullptr)
+            {
+                auto infos = infos_of(*from);
+                infos.push_back(&info);
+                edge = find_or_add_archetype(std::move(infos));
+            }
+            else
+            {
+                // Edges are keyed by id too
+                (void)edge->column_index(info);
+            }
+            return edge;
+        }
+
+        _internal::archetype* remove_edge(_internal::archetype* from, const _internal::component_info& info)
+        {
+            (void)from->column_index(info);
+            _internal::archetype*& edge = from->remove_edges[info.id];
+            if(edge == nullptr)
+            {
+                auto infos = infos_of(*from);
+                std::erase_if(infos, [&](const auto* other) { return other->id == info.id; });
+                edge = find_or_add_archetype(std::move(infos));
+            }
+            return edge;
+        }
+
+        // Moves every component the target also has into a new row there.  Anything the target lacks must already be
+        // destroyed, and anything it has extra is left for the caller to construct.
+        void move_to(record& r, _internal::archetype* target)
+        {
+            _internal::archetype* source = r.archetype;
+            const entity e = source->entities[r.row];
+            const uint32 row = target->push(e);
+            for(_internal::column& c : target->columns)
+            {
+                const int32 index = source->column_index(c.info());
+                if(index >= 0)
+                {
+                    c.info().relocate(c.at(row), source->columns[index].at(r.row));
+                }
+            }
+            remove_row(r);
+            r.archetype = target;
+            r.row = row;
+        }
+
+        // The row's components have been destroyed or moved out; fill it from the end
+        void remove_row(const record& r) noexcept
+        {
+            const entity moved = r.archetype->pop_into(r.row);
+            if(moved.valid())
+            {
+                m_records[moved.index].row = r.row;
+            }
+        }
+
+        template <query_component... Ts>
+        static bool match(const _internal::archetype& archetype, std::array<int32, sizeof...(Ts)>& columns)
+        {
+            std::size_t i = 0;
+            return (((columns[i++] = archetype.column_index(_internal::info_of<std::remove_const_t<Ts>>())) >= 0) && ...);
+        }
+
+        template <query_component... Ts, typename F, std::size_t... Is>
+        static void run(const _internal::archetype& archetype, const std::array<int32, sizeof...(Ts)>& columns,
+                        std::size_t begin, std::size_t end, F& fn, std::index_sequence<Is...>)
+        {
+            const std::tuple<Ts*...> data {archetype.columns[columns[Is]].template data<std::remove_const_t<Ts>>()...};
+            const entity* entities = archetype.entities.data();
+            for(std::size_t row = begin; row < end; row++)
+            {
+                if constexpr(std::is_invocable_v<F&, entity, Ts&...>)
+                {
+                    fn(entities[row], std::get<Is>(data)[row]...);
+                }
+                else
+                {
+                    fn(std::get<Is>(data)[row]...);
+                }
+            }
+        }
+
+        std::map<std::vector<uint64>, std::unique_ptr<_internal::archetype>> m_archetypes;
+        _internal::archetype* m_empty = nullptr;
+        std::vector<record> m_records;
+        std::vector<uint32> m_free;
+        std::size_t m_alive = 0;
+        int32 m_iterating = 0;
+    };
+
+    template <component... Ts>
+    void command_buffer::create(Ts... components)
+    {
+        push([... components = std::move(components)](world& w) mutable { w.create(std::move(components)...); });
+    }
+
+    inline void command_buffer::destroy(entity e)
+    {
+        push([e](world& w) { w.destroy(e); });
+    }
+
+    template <component T>
+    void command_buffer::insert_or_assign(entity e, T value)
+    {
+        push([e, value = std::move(value)](world& w) mutable { w.insert_or_assign(e, std::move(value)); });
+    }
+
+    template <component T>
+    void command_buffer::erase(entity e)
+    {
+        push([e](world& w) { w.erase<T>(e); });
+    }
+}
@@ -0,0 +1,386 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/function.hpp"
+#include "core/sync.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Epoch based reclamation, for lock free structures that need to delete things readers might still be looking at.
+//
+// Readers hold an epoch::guard while they touch shared pointers.  Writers unlink a node, then epoch::retire() it
+// instead of deleting it; it's actually deleted once every thread that could have seen it has dropped its guard.
+//     {
+//         raoe::epoch::guard guard;
+//         const config* current = g_config.load(std::memory_order_acquire);
+//         use(*current);
+//     }
+//     ...
+//     raoe::epoch::retire(g_config.exchange(new_config, std::memory_order_acq_rel));
+//
+// Pinning is one exchange on the thread's own record and unpinning is one store, so guards are cheap, but don't hold
+// one for long: a thread sitting in a guard stops everything retired after it from being freed.  Retired pointers are
+// batched per thread and reclaimed 64 at a time.  If there's a job system, set_reclaim_handler() lets it do the
+// deleting on a worker instead of whichever thread happened to fill a batch.
+namespace raoe::epoch
+{
+    namespace _internal
+    {
+        inline constexpr std::size_t retire_batch = 64;
+
+        struct retired
+        {
+            void* pointer;
+            void (*deleter)(void*);
+            uint64 epoch;
+        };
+
+        // One per thread (reused after a thread exits).  Only the owning thread touches anything but state.
+        struct thread_record
+        {
+            // (epoch << 1) | 1 while pinned, 0 when not
+            std::atomic<uint64> state = 0;
+            std::atomic<bool> in_use = true;
+            thread_record* next = nullptr;
+
+            uint32 depth = 0;
+            std::vector<retired> garbage;
+        };
+
+        class domain
+        {
+          public:
+            static domain& get()
+            {
+                static domain instance;
+                return instance;
+            }
+
+            ~domain()
+            {
+                // Nothing can be pinned any more, so everything goes
+                free_all(m_pending);
+                for(thread_record* record = m_records.load(); record != nullptr;)
+                {
+                    thread_record* next = record->next;
+                    free_all(record->garbage);
+                    delete record;
+                    record = next;
+                }
+            }
+
+            domain(const domain&) = delete;
+            domain& operator=(const domain&) = delete;
+
+            thread_record& this_thread()
+            {
+                thread_record* record = t_record;
+                return record != nullptr ? *record : register_thread();
+            }
+
+            void pin(thread_record& record) noexcept
+            {
+                if(record.depth++ == 0)
+                {
+                    // A full barrier, so nothing this thread loads inside the guard can be read before it's pinned
+                    record.state.exchange((m_epoch.load(std::memory_order_relaxed) << 1) | 1,
+                                          std::memory_order_seq_cst);
+                }
+            }
+
+            void unpin(thread_record& record) noexcept
+            {
+                if(--record.depth == 0)
+                {
+                    record.state.store(0, std::memory_order_release);
+                }
+            }
+
+            void retire(void* pointer, void (*deleter)(void*))
+            {
+                thread_record& record = this_thread();
+                record.garbage.push_back({pointer, deleter, m_epoch.load(std::memory_order_acquire)});
+                m_retired.fetch_add(1, std::memory_order_relaxed);
+                if(record.garbage.size() < retire_batch)
+                {
+                    return;
+                }
+
+                std::shared_ptr<const function<void()>> handler;
+                {
+                    std::scoped_lock lock(m_mutex);
+                    handler = m_handler;
+                    if(handler)
+                    {
+                        // Hand the whole batch over; the handler decides where collect() runs
+                        m_pending.insert(m_pending.end(), record.garbage.begin(), record.garbage.end());
+                        record.garbage.clear();
+                    }
+                }
+                if(handler)
+                {
+                    (*handler)();
+                    return;
+                }
+                try_advance();
+                reclaim(record.garbage);
+            }
+
+            // Moves the global epoch forward if every pinned thread has caught up to it
+            bool try_advance() noexcept
+            {
+                // A read-modify-write instead of load + fence: same barrier against the readers' pin, and TSan
+                // understands it
+                uint64 epoch = m_epoch.fetch_add(0, std::memory_order_seq_cst);
+                for(thread_record* record = m_records.load(std::memory_order_acquire); record != nullptr;
+                    record = record->next)
+                {
+                    const uint64 state = record->state.load(std::memory_order_acquire);
+                    if((state & 1) != 0 && (state >> 1) != epoch)
+                    {
+                        return false;
+                    }
+                }
+                return m_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+            }
+
+            void collect()
+            {
+                try_advance();
+                if(t_record != nullptr && t_record->depth == 0)
+                {
+                    reclaim(t_record->garbage);
+                }
+                std::vector<retired> pending;
+                {
+                    std::scoped_lock lock(m_mutex);
+                    pending.swap(m_pending);
+                }
+                reclaim(pending);
+                if(!pending.empty())
+                {
+                    std::scoped_lock lock(m_mutex);
+                    m_pending.insert(m_pending.end(), pending.begin(), pending.end());
+                }
+            }
+
+            void synchronize()
+            {
+                check_if(t_record == nullptr || t_record->depth == 0,
+                         "epoch::synchronize() inside a guard would never return");
+                // Two advances past now and everything retired so far is unreachable
+                const uint64 target = m_epoch.load(std::memory_order_acquire) + 2;
+                while(m_epoch.load(std::memory_order_acquire) < target)
+                {
+                    if(!try_advance())
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                collect();
+            }
+
+            void set_reclaim_handler(function<void()> handler)
+            {
+                // Shared so retire() can call it outside the lock without copying it
+                auto shared = handler ? std::make_shared<const function<void()>>(std::move(handler)) : nullptr;
+                std::scoped_lock lock(m_mutex);
+                m_handler = std::move(shared);
+            }
+
+            [[nodiscard]] uint64 current_epoch() const noexcept { return m_epoch.load(std::memory_order_relaxed); }
+            [[nodiscard]] uint64 retired_count() const noexcept { return m_retired.load(std::memory_order_relaxed); }
+            [[nodiscard]] uint64 reclaimed_count() const noexcept
+            {
+                return m_reclaimed.load(std::memory_order_relaxed);
+            }
+
+          private:
+            domain() = default;
+
+            // Hands the thread's record (and anything it hasn't freed yet) back when the thread exits
+            struct thread_exit
+            {
+                thread_record* record = nullptr;
+                ~thread_exit()
+                {
+                    if(record == nullptr)
+                    {
+                        return;
+                    }
+                    domain& owner = domain::get();
+                    if(!record->garbage.empty())
+                    {
+                        std::scoped_lock lock(owner.m_mutex);
+                        owner.m_pending.insert(owner.m_pending.end(), record->garbage.begin(), record->garbage.end());
+                        record->garbage.clear();
+                    }
+                    t_record = nullptr;
+                    record->in_use.store(false, std::memory_order_release);
+                }
+            };
+
+            thread_record& register_thread()
+            {
+                thread_record* record = nullptr;
+                for(thread_record* existing = m_records.load(std::memory_order_acquire); existing != nullptr;
+                    existing = existing->next)
+                {
+                    bool in_use = false;
+                    if(existing->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire))
+                    {
+                        record = existing;
+                        break;
+                    }
+                }
+                if(record == nullptr)
+                {
+                    record = new thread_record;
+                    record->garbage.reserve(retire_batch);
+                    thread_record* head = m_records.load(std::memory_order_relaxed);
+                    do
+                    {
+                        record->next = head;
+                    } while(!m_records.compare_exchange_weak(head, record, std::memory_order_release,
+                                                             std::memory_order_relaxed));
+                }
+                static thread_local thread_exit exit_hook;
+                exit_hook.record = record;
+                t_record = record;
+                return *record;
+            }
+
+            // Frees everything that was retired at least two epochs ago and keeps the rest, in order
+            void reclaim(std::vector<retired>& garbage)
+            {
+                const uint64 epoch = m_epoch.load(std::memory_order_acquire);
+                if(std::ranges::none_of(garbage, [epoch](const retired& item) { return item.epoch + 2 <= epoch; }))
+                {
+                    return;
+                }
+                // A deleter can retire things itself, which lands in garbage, so run them over a list of our own
+                std::vector<retired> running;
+                running.swap(garbage);
+                std::size_t kept = 0;
+                for(std::size_t i = 0; i < running.size(); i++)
+                {
+                    if(running[i].epoch + 2 > epoch)
+                    {
+                        // Per thread lists are in epoch order, but pending ones are mixed together
+                        running[kept++] = running[i];
+                        continue;
+                    }
+                    running[i].deleter(running[i].pointer);
+                }
+                const std::size_t freed = running.size() - kept;
+                running.resize(kept);
+                // Anything the deleters retired is newer than what's kept, so it goes after
+                running.insert(running.end(), garbage.begin(), garbage.end());
+                garbage.swap(running);
+                m_reclaimed.fetch_add(freed, std::memory_order_relaxed);
+            }
+
+            static void free_all(std::vector<retired>& garbage)
+            {
+                while(!garbage.empty())
+                {
+                    std::vector<retired> running;
+                    running.swap(garbage);
+                    for(const retired& item : running)
+                    {
+                        item.deleter(item.pointer);
+                    }
+                }
+            }
+
+            static inline thread_local thread_record* t_record = nullptr;
+
+            std::atomic<uint64> m_epoch = 0;
+            std::atomic<thread_record*> m_records = nullptr;
+            std::atomic<uint64> m_retired = 0;
+            std::atomic<uint64> m_reclaimed = 0;
+
+            sync::mutex m_mutex;
+            std::vector<retired> m_pending;
+            std::shared_ptr<const function<void()>> m_handler;
+        };
+    }
+
+    // Pins the calling thread for as long as it's alive.  Guards nest.
+    class guard
+    {
+      public:
+        guard()
+            : m_record(_internal::domain::get().this_thread())
+        {
+            _internal::domain::get().pin(m_record);
+        }
+        ~guard() { _internal::domain::get().unpin(m_record); }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+      private:
+        _internal::thread_record& m_record;
+    };
+
+    // Calls deleter(pointer) once no guard that was alive before this call still is.  pointer must already be
+    // unreachable for new readers.
+    inline void retire(void* pointer, void (*deleter)(void*))
+    {
+        _internal::domain::get().retire(pointer, deleter);
+    }
+
+    template <typename T>
+    void retire(T* pointer)
+    {
+        if(pointer != nullptr)
+        {
+            retire(const_cast<void*>(static_cast<const void*>(pointer)),
+                   [](void* p) { delete static_cast<T*>(p); });
+        }
+    }
+
+    // Advances the epoch if it can and frees what's safe to free: this thread's garbage, and whatever's been handed to
+    // the shared list (by exited threads or the reclaim handler).  Never blocks.  Call it from an idle job, or from
+    // the reclaim handler's job.
+    inline void collect() { _internal::domain::get().collect(); }
+
+    // Waits until everything retired before this call can be freed, then frees it.  For shutdown and tests; it spins
+    // while other threads hold guards, and must not be called from inside one.
+    inline void synchronize() { _internal::domain::get().synchronize(); }
+
+    // With a handler set, a thread that fills a batch of retired pointers moves it to the shared list and calls
+    // handler() instead of freeing them itself.  The handler should schedule epoch::collect() somewhere (a job, a
+    // low priority thread...).  Pass an empty function to go back to freeing inline.
+    inline void set_reclaim_handler(function<void()> handler)
+    {
+        _internal::domain::get().set_reclaim_handler(std::move(handler));
+    }
+
+    [[nodiscard]] inline uint64 current_epoch() { return _internal::domain::get().current_epoch(); }
+    [[nodiscard]] inline uint64 retired_count() { return _internal::domain::get().retired_count(); }
+    [[nodiscard]] inline uint64 reclaimed_count() { return _internal::domain::get().reclaimed_count(); }
+}
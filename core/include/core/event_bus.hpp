@@ -0,0 +1,443 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/epoch.hpp"
+#include "core/function.hpp"
+#include "core/sync.hpp"
+#include "core/typename.hpp"
+#include "core/types.hpp"
+#include "tag/tag.hpp"
+
+#include <array>
+#include <atomic>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Events named by tags, with a payload type per event.
+//
+// Look an event up once with event<T>(tag) and keep the id; publishing by id is an array index and a walk over a
+// contiguous list of handlers, with no hashing and no locks.  Subscribing matches the way tag::matches does: a
+// subscriber to "game:hit" hears "game#melee:hit" and "game#ranged:hit" too, and one to "game#melee:hit" hears the
+// untyped "game:hit".  That's all worked out when you subscribe (or when an event is first looked up), not when you
+// publish.  Everything sharing a prefix and identifier has to use the same payload type.
+//
+// Handlers can subscribe and unsubscribe (even themselves) from inside a publish; the handler lists are copied on
+// write and freed through raoe::epoch.  enqueue() defers an event into a queue for the calling thread, and
+// dispatch_deferred() publishes everything queued, thread by thread, in the order each thread queued it.
+//     raoe::event_bus bus;
+//     const auto hit = bus.event<damage>("game#melee:hit");
+//     bus.subscribe<damage>("game:hit", [](const damage& d) { ... });
+//     bus.publish(hit, damage {10});   // now
+//     bus.enqueue(hit, damage {10});   // at the next dispatch_deferred()
+namespace raoe
+{
+    class event_bus;
+
+    // An event on a particular bus.  Cheap to copy; keep it instead of looking the tag up again.
+    template <typename T>
+    class event_id
+    {
+      public:
+        constexpr event_id() = default;
+
+        [[nodiscard]] constexpr uint32 index() const noexcept { return m_index; }
+        [[nodiscard]] constexpr bool valid() const noexcept { return m_index != invalid; }
+        constexpr bool operator==(const event_id&) const noexcept = default;
+
+      private:
+        friend class event_bus;
+        static constexpr uint32 invalid = ~uint32 {0};
+
+        constexpr explicit event_id(uint32 index)
+            : m_index(index)
+        {
+        }
+
+        uint32 m_index = invalid;
+    };
+
+    namespace _internal
+    {
+        struct event_handler
+        {
+            void (*invoke)(void* object, const void* payload);
+            void* object;
+            uint64 subscription;
+        };
+
+        // Never changed once published; a change makes a new one
+        using event_handler_list = std::vector<event_handler>;
+
+        struct event_slot
+        {
+            std::atomic<const event_handler_list*> handlers = nullptr;
+            uint32 base = 0;
+            std::string type;
+        };
+
+        inline bool event_types_match(std::string_view lhs, std::string_view rhs)
+        {
+            return lhs.empty() || rhs.empty() || lhs == rhs;
+        }
+    }
+
+    class event_bus
+    {
+        static constexpr uint32 slots_per_chunk = 256;
+        static constexpr uint32 max_chunks = 4096;
+
+      public:
+        using subscription = uint64;
+
+        explicit event_bus(std::string_view name = {})
+            : m_mutex(name)
+            , m_id(next_bus_id())
+        {
+        }
+
+        event_bus(const event_bus&) = delete;
+        event_bus& operator=(const event_bus&) = delete;
+
+        // Anything still queued is dropped
+        ~event_bus()
+        {
+            for(uint32 i = 0; i < m_slot_count; i++)
+            {
+                delete slot_at(i).handlers.load(std::memory_order_relaxed);
+            }
+            for(auto& chunk : m_chunks)
+            {
+                delete[] chunk.load(std::memory_order_relaxed);
+            }
+            for(auto& [id, record] : m_subscriptions)
+            {
+                record.destroy(record.object);
+            }
+        }
+
+        // Finds or adds the event for a tag.  Panics if the tag is invalid, or if something sharing its prefix and
+        // identifier was already set up with a different payload type.
+        template <typename T>
+        [[nodiscard]] event_id<T> event(const tag& name)
+        {
+            std::scoped_lock lock(m_mutex);
+            return event_id<T>(find_or_add_slot(name, core::name_of<T>()));
+        }
+
+        // Calls handler with every matching event's payload, on whichever thread publishes it.  Returns an id for
+        // unsubscribe().
+        template <typename T, typename F>
+            requires std::is_invocable_v<std::decay_t<F>&, const T&>
+        subscription subscribe(const tag& name, F&& handler)
+        {
+            using handler_type = std::decay_t<F>;
+            check_if(static_cast<bool>(name), "event_bus: '{}' isn't a valid tag", std::string_view(name));
+
+            std::scoped_lock lock(m_mutex);
+            const uint32 base = find_or_add_base(name, core::name_of<T>());
+            const subscription id = ++m_next_subscription;
+            subscription_record& record = m_subscriptions[id];
+            record.base = base;
+            record.type = std::string(name.type());
+            record.object = new handler_type(std::forward<F>(handler));
+            record.invoke = [](void* object, const void* payload) {
+                std::invoke(*static_cast<handler_type*>(object), *static_cast<const T*>(payload));
+            };
+            record.destroy = [](void* object) { delete static_cast<handler_type*>(object); };
+            m_bases[base].subscriptions.push_back(id);
+
+            for(uint32 slot : m_bases[base].slots)
+            {
+                if(_internal::event_types_match(record.type, slot_at(slot).type))
+                {
+                    replace_handlers(slot, [&](_internal::event_handler_list& handlers) {
+                        handlers.push_back({record.invoke, record.object, id});
+                    });
+                }
+            }
+            return id;
+        }
+
+        // Safe from inside a handler, including the one being removed.  A publish already under way on another
+        // thread may still call it once.
+        void unsubscribe(subscription id)
+        {
+            std::scoped_lock lock(m_mutex);
+            auto it = m_subscriptions.find(id);
+            if(it == m_subscriptions.end())
+            {
+                return;
+            }
+            const subscription_record record = it->second;
+            m_subscriptions.erase(it);
+
+            base_record& base = m_bases[record.base];
+            std::erase(base.subscriptions, id);
+            for(uint32 slot : base.slots)
+            {
+                if(_internal::event_types_match(record.type, slot_at(slot).type))
+                {
+                    replace_handlers(slot, [&](_internal::event_handler_list& handlers) {
+                        std::erase_if(handlers, [id](const auto& handler) { return handler.subscription == id; });
+                    });
+                }
+            }
+            epoch::retire(record.object, record.destroy);
+        }
+
+        // Calls every handler for the event, on this thread, before returning
+        template <typename T>
+        void publish(event_id<T> id, const T& payload) const
+        {
+            check_if(id.valid(), "event_bus: publishing an event_id that was never looked up");
+            epoch::guard guard;
+            const _internal::event_handler_list* handlers = slot_at(id.m_index).handlers.load(std::memory_order_acquire);
+            if(handlers == nullptr)
+            {
+                return;
+            }
+            for(const _internal::event_handler& handler : *handlers)
+            {
+                handler.invoke(handler.object, &payload);
+            }
+        }
+
+        // Looks the tag up every time; fine for rare events, but keep the event_id for anything hot
+        template <typename T>
+        void publish(const tag& name, const T& payload)
+        {
+            publish(event<T>(name), payload);
+        }
+
+        // Queues the event on this thread's queue, for the next dispatch_deferred()
+        template <typename T>
+        void enqueue(event_id<T> id, T payload)
+        {
+            check_if(id.valid(), "event_bus: enqueueing an event_id that was never looked up");
+            deferred_queue& queue = this_thread_queue();
+            std::scoped_lock lock(queue.mutex);
+            queue.events.emplace_back([this, id, payload = std::move(payload)] { publish(id, payload); });
+        }
+
+        // The sync point: publishes everything enqueued so far, on this thread.  Events enqueued by the handlers wait
+        // for the next call.  Returns how many were published.
+        std::size_t dispatch_deferred()
+        {
+            std::vector<deferred_queue*> queues;
+            {
+                std::scoped_lock lock(m_mutex);
+                for(const auto& queue : m_queues)
+                {
+                    queues.push_back(queue.get());
+                }
+            }
+
+            std::size_t published = 0;
+            std::vector<deferred_event> batch;
+            for(deferred_queue* queue : queues)
+            {
+                {
+                    std::scoped_lock lock(queue->mutex);
+                    batch.swap(queue->events);
+                }
+                for(const deferred_event& queued : batch)
+                {
+                    queued();
+                }
+                published += batch.size();
+                batch.clear();
+
+                // Hand the memory back, so a busy queue doesn't grow from nothing every frame
+                std::scoped_lock lock(queue->mutex);
+                if(queue->events.empty())
+                {
+                    batch.swap(queue->events);
+                }
+            }
+            return published;
+        }
+
+        [[nodiscard]] std::size_t event_count() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_slot_count;
+        }
+
+        [[nodiscard]] std::size_t subscription_count() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_subscriptions.size();
+        }
+
+        template <typename T>
+        [[nodiscard]] std::size_t handler_count(event_id<T> id) const
+        {
+            if(!id.valid())
+            {
+                return 0;
+            }
+            epoch::guard guard;
+            const _internal::event_handler_list* handlers = slot_at(id.m_index).handlers.load(std::memory_order_acquire);
+            return handlers == nullptr ? 0 : handlers->size();
+        }
+
+      private:
+        // Everything sharing a prefix and identifier: the events that have been looked up and everyone listening
+        struct base_record
+        {
+            std::string_view payload_type;
+            std::vector<uint32> slots;
+            std::vector<subscription> subscriptions;
+        };
+
+        struct subscription_record
+        {
+            uint32 base = 0;
+            std::string type;
+            void* object = nullptr;
+            void (*invoke)(void*, const void*) = nullptr;
+            void (*destroy)(void*) = nullptr;
+        };
+
+        using deferred_event = function<void(), 48>;
+        struct deferred_queue
+        {
+            sync::mutex mutex;
+            std::vector<deferred_event> events;
+        };
+
+        static uint64 next_bus_id()
+        {
+            static std::atomic<uint64> next = 0;
+            return ++next;
+        }
+
+        _internal::event_slot& slot_at(uint32 index) const
+        {
+            return m_chunks[index / slots_per_chunk].load(std::memory_order_acquire)[index % slots_per_chunk];
+        }
+
+        uint32 find_or_add_base(const tag& name, std::string_view payload_type)
+        {
+            std::string key = std::format("{}:{}", name.prefix(), name.identifier());
+            auto [it, added] = m_base_index.try_emplace(std::move(key), static_cast<uint32>(m_bases.size()));
+            if(added)
+            {
+                m_bases.push_back(base_record {payload_type, {}, {}});
+            }
+            base_record& base = m_bases[it->second];
+            check_if(base.payload_type == payload_type, "event_bus: '{}' carries a {}, not a {}",
+                     std::string_view(name), base.payload_type, payload_type);
+            return it->second;
+        }
+
+        uint32 find_or_add_slot(const tag& name, std::string_view payload_type)
+        {
+            check_if(static_cast<bool>(name), "event_bus: '{}' isn't a valid tag", std::string_view(name));
+            const uint32 base = find_or_add_base(name, payload_type);
+            const std::string& key = name;
+            if(auto it = m_slot_index.find(key); it != m_slot_index.end())
+            {
+                return it->second;
+            }
+
+            const uint32 index = m_slot_count;
+            check_if(index < slots_per_chunk * max_chunks, "event_bus: too many events");
+            if(index % slots_per_chunk == 0)
+            {
+                m_chunks[index / slots_per_chunk].store(new _internal::event_slot[slots_per_chunk],
+                                                        std::memory_order_release);
+            }
+            _internal::event_slot& slot = slot_at(index);
+            slot.base = base;
+            slot.type = std::string(name.type());
+
+            auto* handlers = new _internal::event_handler_list();
+            for(subscription id : m_bases[base].subscriptions)
+            {
+                const subscription_record& record = m_subscriptions.at(id);
+                if(_internal::event_types_match(record.type, slot.type))
+                {
+                    handlers->push_back({record.invoke, record.object, id});
+                }
+            }
+            slot.handlers.store(handlers, std::memory_order_release);
+
+            m_bases[base].slots.push_back(index);
+            m_slot_index.emplace(key, index);
+            m_slot_count++;
+            return index;
+        }
+
+        template <typename F>
+        void replace_handlers(uint32 slot, F&& change)
+        {
+            std::atomic<const _internal::event_handler_list*>& current = slot_at(slot).handlers;
+            const _internal::event_handler_list* old = current.load(std::memory_order_relaxed);
+            auto* handlers = new _internal::event_handler_list(*old);
+            change(*handlers);
+            current.store(handlers, std::memory_order_release);
+            epoch::retire(const_cast<_internal::event_handler_list*>(old));
+        }
+
+        deferred_queue& this_thread_queue()
+        {
+            // Bus ids are never reused, so an entry for a bus that's gone just never matches again
+            struct cached_queue
+            {
+                uint64 bus;
+                deferred_queue* queue;
+            };
+            static thread_local std::vector<cached_queue> t_queues;
+            for(const cached_queue& cached : t_queues)
+            {
+                if(cached.bus == m_id)
+                {
+                    return *cached.queue;
+                }
+            }
+
+            std::scoped_lock lock(m_mutex);
+            deferred_queue* queue = m_queues.emplace_back(std::make_unique<deferred_queue>()).get();
+            t_queues.push_back({m_id, queue});
+            return *queue;
+        }
+
+        mutable sync::mutex m_mutex;
+        const uint64 m_id;
+
+        std::array<std::atomic<_internal::event_slot*>, max_chunks> m_chunks {};
+        uint32 m_slot_count = 0;
+
+        // All of these are only touched under m_mutex
+        std::unordered_map<std::string, uint32> m_slot_index;
+        std::unordered_map<std::string, uint32> m_base_index;
+        std::vector<base_record> m_bases;
+        std::unordered_map<subscription, subscription_record> m_subscriptions;
+        subscription m_next_subscription = 0;
+        std::vector<std::unique_ptr<deferred_queue>> m_queues;
+    };
+}
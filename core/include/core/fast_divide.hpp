@@ -0,0 +1,399 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Division by a runtime constant, using a precomputed multiply and shift.
+// The algorithm is from libdivide by ridiculous_fish, licensed under zlib: https://libdivide.com/
+
+#pragma once
+
+#include "check.hpp"
+#include "types.hpp"
+
+#include <bit>
+#include <concepts>
+#include <span>
+#include <type_traits>
+
+namespace raoe
+{
+    template <typename T>
+    concept fast_dividable = std::same_as<T, int32> || std::same_as<T, uint32> || std::same_as<T, int64> ||
+                             std::same_as<T, uint64>;
+
+    namespace _internal
+    {
+        // High half of the full width product
+        template <fast_dividable T>
+        constexpr T mul_high(T a, T b) noexcept
+        {
+            if constexpr(std::same_as<T, uint32>)
+            {
+                return static_cast<uint32>((static_cast<uint64>(a) * b) >> 32);
+            }
+            else if constexpr(std::same_as<T, int32>)
+            {
+                return static_cast<int32>((static_cast<int64>(a) * b) >> 32);
+            }
+            else if constexpr(std::same_as<T, uint64>)
+            {
+                return raoe::mul_wide(a, b).high;
+            }
+            else
+            {
+                // Signed high multiply from the unsigned one: subtract the other operand for each negative input
+                const uint64 high = raoe::mul_wide(static_cast<uint64>(a), static_cast<uint64>(b)).high;
+                const uint64 a_fix = a < 0 ? static_cast<uint64>(b) : 0;
+                const uint64 b_fix = b < 0 ? static_cast<uint64>(a) : 0;
+                return static_cast<int64>(high - a_fix - b_fix);
+            }
+        }
+
+        struct wide_quotient
+        {
+            uint64 quotient;
+            uint64 remainder;
+        };
+
+        // (high:low) / divisor where high < divisor, so the quotient fits in TBits.
+        template <std::size_t TBits>
+        constexpr wide_quotient div_wide(uint64 high, uint64 low, uint64 divisor) noexcept
+        {
+            if constexpr(TBits == 32)
+            {
+                const uint64 numerator = (high << 32) | low;
+                return {numerator / divisor, numerator % divisor};
+            }
+            else
+            {
+#if defined(__SIZEOF_INT128__)
+                const unsigned __int128 numerator = (static_cast<unsigned __int128>(high) << 64) | low;
+                return {static_cast<uint64>(numerator / divisor), static_cast<uint64>(numerator % divisor)};
+#else
+                // Shift-subtract long division.  Only runs when a divider is constructed, so speed doesn't matter.
+                uint64 quotient = 0;
+                for(int32 bit = 63; bit >= 0; bit--)
+                {
+                    const bool carry = (high >> 63) != 0;
+                    high = (high << 1) | (low >> 63);
+                    low <<= 1;
+                    quotient <<= 1;
+                    if(carry || high >= divisor)
+                    {
+                        high -= divisor;
+                        quotient |= 1;
+                    }
+                }
+                return {quotient, high};
+#endif
+            }
+        }
+    }
+
+    // Divides by a divisor that is only known at runtime, but used many times (table sizes, fixed point scales,
+    // strides).  Construction does the expensive part once, and each division afterwards is a multiply, an add and a
+    // shift.
+    // Results are identical to the built in / and % operators (rounding toward zero), for every numerator.
+    template <fast_dividable T>
+    class fast_divider
+    {
+        using unsigned_t = std::make_unsigned_t<T>;
+        static constexpr std::size_t bits = sizeof(T) * 8;
+        static constexpr uint8 shift_mask = bits - 1;
+        static constexpr uint8 add_marker = 0x40;
+        static constexpr uint8 negative_divisor = 0x80;
+
+      public:
+        constexpr fast_divider() noexcept
+            : fast_divider(T(1))
+        {
+        }
+
+        constexpr explicit fast_divider(T divisor) noexcept
+            : m_divisor(divisor)
+        {
+            if(!std::is_constant_evaluated())
+            {
+                raoe::check_if(divisor != 0, "fast_divider: division by zero");
+            }
+
+            if constexpr(std::is_unsigned_v<T>)
+            {
+                const uint8 floor_log2 = static_cast<uint8>(std::bit_width(divisor) - 1);
+                if(std::has_single_bit(divisor))
+                {
+                    m_magic = 0;
+                    m_more = floor_log2;
+                    return;
+                }
+
+                auto [proposed, remainder] =
+                    _internal::div_wide<bits>(uint64(1) << floor_log2, 0, static_cast<uint64>(divisor));
+                const uint64 error = divisor - remainder;
+                if(error < (uint64(1) << floor_log2))
+                {
+                    m_more = floor_log2;
+                }
+                else
+                {
+                    proposed += proposed;
+                    const uint64 twice_remainder = remainder + remainder;
+                    if(twice_remainder >= divisor || twice_remainder < remainder)
+                    {
+                        proposed += 1;
+                    }
+                    m_more = floor_log2 | add_marker;
+                }
+                m_magic = static_cast<T>(proposed + 1);
+            }
+            else
+            {
+                const unsigned_t abs_divisor =
+                    divisor < 0 ? unsigned_t(0) - static_cast<unsigned_t>(divisor) : static_cast<unsigned_t>(divisor);
+                const uint8 floor_log2 = static_cast<uint8>(std::bit_width(abs_divisor) - 1);
+                if(std::has_single_bit(abs_divisor))
+                {
+                    m_magic = 0;
+                    m_more = floor_log2 | (divisor < 0 ? negative_divisor : 0);
+                    return;
+                }
+
+                auto [proposed, remainder] =
+                    _internal::div_wide<bits>(uint64(1) << (floor_log2 - 1), 0, static_cast<uint64>(abs_divisor));
+                proposed &= static_cast<unsigned_t>(~unsigned_t(0));
+                const uint64 error = abs_divisor - remainder;
+                uint8 more = 0;
+                if(error < (uint64(1) << floor_log2))
+                {
+                    more = floor_log2 - 1;
+                }
+                else
+                {
+                    proposed += proposed;
+                    const uint64 twice_remainder = (remainder + remainder) & static_cast<unsigned_t>(~unsigned_t(0));
+                    if(twice_remainder >= abs_divisor || twice_remainder < remainder)
+                    {
+                        proposed += 1;
+                    }
+                    more = floor_log2 | add_marker;
+                }
+                proposed += 1;
+
+                m_magic = static_cast<T>(static_cast<unsigned_t>(proposed));
+                if(divisor < 0)
+                {
+                    more |= negative_divisor;
+                    m_magic = static_cast<T>(unsigned_t(0) - static_cast<unsigned_t>(m_magic));
+                }
+                m_more = more;
+            }
+        }
+
+        [[nodiscard]] constexpr T divisor() const noexcept { return m_divisor; }
+
+        [[nodiscard]] constexpr T divide(T numerator) const noexcept
+        {
+            const uint8 shift = m_more & shift_mask;
+            if constexpr(std::is_unsigned_v<T>)
+            {
+                if(m_magic == 0)
+                {
+                    return numerator >> shift;
+                }
+                const T quotient = _internal::mul_high(m_magic, numerator);
+                if(m_more & add_marker)
+                {
+                    return (((numerator - quotient) >> 1) + quotient) >> shift;
+                }
+                return quotient >> shift;
+            }
+            else
+            {
+                if(m_magic == 0)
+                {
+                    const unsigned_t sign = static_cast<unsigned_t>(static_cast<T>(static_cast<int8>(m_more) >> 7));
+                    const unsigned_t mask = (unsigned_t(1) << shift) - 1;
+                    const unsigned_t rounded = static_cast<unsigned_t>(numerator) +
+                                               (static_cast<unsigned_t>(numerator >> (bits - 1)) & mask);
+                    const T quotient = static_cast<T>(rounded) >> shift;
+                    return static_cast<T>((static_cast<unsigned_t>(quotient) ^ sign) - sign);
+                }
+
+                unsigned_t quotient = static_cast<unsigned_t>(_internal::mul_high(m_magic, numerator));
+                if(m_more & add_marker)
+                {
+                    const unsigned_t sign = static_cast<unsigned_t>(static_cast<T>(static_cast<int8>(m_more) >> 7));
+                    quotient += (static_cast<unsigned_t>(numerator) ^ sign) - sign;
+                }
+                T result = static_cast<T>(quotient) >> shift;
+                result += (result < 0);
+                return result;
+            }
+        }
+
+        [[nodiscard]] constexpr T modulo(T numerator) const noexcept
+        {
+            return static_cast<T>(numerator - divide(numerator) * m_divisor);
+        }
+
+        // Divides every element of from into into.  The algorithm is picked once up front, so each loop body is
+        // branch free and the compiler is free to vectorize it.
+        void divide(std::span<const T> from, std::span<T> into) const noexcept
+        {
+            raoe::check_if(into.size() >= from.size(), "fast_divider: output span is smaller than the input");
+
+            const std::size_t count = from.size();
+            const T* in = from.data();
+            T* out = into.data();
+            const T magic = m_magic;
+            const uint8 shift = m_more & shift_mask;
+
+            if constexpr(std::is_unsigned_v<T>)
+            {
+                if(magic == 0)
+                {
+                    for(std::size_t i = 0; i < count; i++)
+                    {
+                        out[i] = in[i] >> shift;
+                    }
+                }
+                else if(m_more & add_marker)
+                {
+                    for(std::size_t i = 0; i < count; i++)
+                    {
+                        const T quotient = _internal::mul_high(magic, in[i]);
+                        out[i] = (((in[i] - quotient) >> 1) + quotient) >> shift;
+                    }
+                }
+                else
+                {
+                    for(std::size_t i = 0; i < count; i++)
+                    {
+                        out[i] = _internal::mul_high(magic, in[i]) >> shift;
+                    }
+                }
+            }
+            else
+            {
+                if(magic == 0)
+                {
+                    for(std::size_t i = 0; i < count; i++)
+                    {
+                        out[i] = divide(in[i]);
+                    }
+                    return;
+                }
+
+                const unsigned_t sign = static_cast<unsigned_t>(static_cast<T>(static_cast<int8>(m_more) >> 7));
+                const unsigned_t add = (m_more & add_marker) ? ~unsigned_t(0) : unsigned_t(0);
+                for(std::size_t i = 0; i < count; i++)
+                {
+                    unsigned_t quotient = static_cast<unsigned_t>(_internal::mul_high(magic, in[i]));
+                    quotient += ((static_cast<unsigned_t>(in[i]) ^ sign) - sign) & add;
+                    T result = static_cast<T>(quotient) >> shift;
+                    out[i] = result + (result < 0);
+                }
+            }
+        }
+
+        void modulo(std::span<const T> from, std::span<T> into) const noexcept
+        {
+            divide(from, into);
+            for(std::size_t i = 0; i < from.size(); i++)
+            {
+                into[i] = static_cast<T>(from[i] - into[i] * m_divisor);
+            }
+        }
+
+        friend constexpr T operator/(T numerator, const fast_divider& divider) noexcept
+        {
+            return divider.divide(numerator);
+        }
+
+        friend constexpr T operator%(T numerator, const fast_divider& divider) noexcept
+        {
+            return divider.modulo(numerator);
+        }
+
+        friend constexpr T& operator/=(T& numerator, const fast_divider& divider) noexcept
+        {
+            return numerator = divider.divide(numerator);
+        }
+
+      private:
+        T m_divisor = 1;
+        T m_magic = 0;
+        uint8 m_more = 0;
+    };
+
+    template <typename T>
+    concept fast_dividable_fixed = requires {
+        typename T::intermediate_type;
+        typename T::underlying_type;
+        {
+            T::rounding
+        } -> std::convertible_to<bool>;
+    } && fast_dividable<typename T::intermediate_type>;
+
+    // Divides raoe::fixed values by the same fixed divisor over and over.  Produces the same results as
+    // fixed::operator/=, without the hardware divide.
+    template <fast_dividable_fixed TFixed>
+    class fixed_divider
+    {
+        using intermediate_t = typename TFixed::intermediate_type;
+        using underlying_t = typename TFixed::underlying_type;
+
+      public:
+        explicit fixed_divider(TFixed divisor) noexcept
+            : m_divider(static_cast<intermediate_t>(divisor.raw()))
+        {
+        }
+
+        [[nodiscard]] TFixed divide(TFixed value) const noexcept
+        {
+            const intermediate_t one = static_cast<intermediate_t>(TFixed(1).raw());
+            if constexpr(TFixed::rounding)
+            {
+                // Same as fixed::operator/=: divide with one extra bit and round using it
+                const intermediate_t quotient = m_divider.divide(static_cast<intermediate_t>(value.raw()) * one * 2);
+                return TFixed::make_from_raw(static_cast<underlying_t>((quotient / 2) + (quotient % 2)));
+            }
+            else
+            {
+                return TFixed::make_from_raw(
+                    static_cast<underlying_t>(m_divider.divide(static_cast<intermediate_t>(value.raw()) * one)));
+            }
+        }
+
+        void divide(std::span<const TFixed> from, std::span<TFixed> into) const noexcept
+        {
+            raoe::check_if(into.size() >= from.size(), "fixed_divider: output span is smaller than the input");
+            for(std::size_t i = 0; i < from.size(); i++)
+            {
+                into[i] = divide(from[i]);
+            }
+        }
+
+        [[nodiscard]] TFixed divisor() const noexcept
+        {
+            return TFixed::make_from_raw(static_cast<underlying_t>(m_divider.divisor()));
+        }
+
+        friend TFixed operator/(TFixed value, const fixed_divider& divider) noexcept { return divider.divide(value); }
+
+      private:
+        fast_divider<intermediate_t> m_divider;
+    };
+}
@@ -48,6 +48,11 @@ namespace raoe
         }
 
       public:
+        using underlying_type = TUnderlying;
+        using intermediate_type = TIntermediate;
+        static constexpr uint8 fraction_bits = TFractionBits;
+        static constexpr bool rounding = TRounding;
+
         inline fixed() noexcept = default;
 
         template <std::integral T>
@@ -61,7 +66,8 @@ namespace raoe
         {
             if constexpr(TRounding)
             {
-                m_value = static_cast<TUnderlying>((value >= 0.0) ? (val * FRACTION_MULT + T {0.5} : (val * FRACTION_MULT - T {0.5})))
+                m_value = static_cast<TUnderlying>((value >= 0.0) ? (value * FRACTION_MULT + T {0.5})
+                                                                  : (value * FRACTION_MULT - T {0.5}));
             }
             else
             {
@@ -73,7 +79,7 @@ namespace raoe
                   std::integral TOtherIntermediate = TUnderlying, bool TOtherRounding = true>
         constexpr inline fixed(
             fixed<TOtherUnderlying, TOtherFractionBits, TOtherIntermediate, TOtherRounding> other) noexcept
-            : m_value(from_fixed<TOtherFractionBits>(other.m_value).m_value)
+            : m_value(from_fixed<TOtherFractionBits>(other.raw()).m_value)
         {
         }
 
@@ -83,13 +89,13 @@ namespace raoe
         {
             if constexpr(TRounding)
             {
-                return fixed(static_cast<TUnderlying>(value / T(1) << (TOtherFractionalBits - TFractionBits)) +
-                                 (value / (T(1) << (TOtherFractionalBits - TFractionBits - 1)) % 2),
+                return fixed(static_cast<TUnderlying>(value / (T(1) << (TOtherFractionalBits - TFractionBits)) +
+                                                      (value / (T(1) << (TOtherFractionalBits - TFractionBits - 1)) % 2)),
                              raw_construct_tag());
             }
             else
             {
-                return fixed(static_cast<TUnderlying>(value / T(1) << (TOtherFractionalBits - TFractionBits)),
+                return fixed(static_cast<TUnderlying>(value / (T(1) << (TOtherFractionalBits - TFractionBits))),
                              raw_construct_tag());
             }
         }
@@ -107,7 +113,7 @@ namespace raoe
             return fixed(val, raw_construct_tag());
         }
 
-        [[nodiscard]] inline TUnderlying raw() const { return m_value; }
+        [[nodiscard]] constexpr inline TUnderlying raw() const { return m_value; }
 
         template <std::floating_point T>
         constexpr inline explicit operator T() const noexcept
@@ -138,7 +144,7 @@ namespace raoe
             requires std::integral<T> || std::floating_point<T>
         inline fixed& operator+=(T other) noexcept
         {
-            return (*this + fixed(other));
+            return (*this += fixed(other));
         }
 
         inline fixed& operator-=(fixed other) noexcept
@@ -151,12 +157,12 @@ namespace raoe
             requires std::integral<T> || std::floating_point<T>
         inline fixed& operator-=(T other) noexcept
         {
-            return (*this - fixed(other));
+            return (*this -= fixed(other));
         }
 
         inline fixed& operator*=(fixed other) noexcept
         {
-            if(EnableRounding)
+            if constexpr(TRounding)
             {
                 // Normal fixed-point multiplication is: x * y / 2**FractionBits.
                 // To correctly round the last bit in the result, we need one more bit of information.
@@ -176,13 +182,13 @@ namespace raoe
             requires std::integral<T> || std::floating_point<T>
         inline fixed& operator*=(T other) noexcept
         {
-            return (*this * fixed(other));
+            return (*this *= fixed(other));
         }
 
         inline fixed& operator/=(fixed other) noexcept
         {
             raoe::check_if(other.m_value != 0, "Fixed-point division by zero");
-            if(EnableRounding)
+            if constexpr(TRounding)
             {
                 // Normal fixed-point division is: x * 2**FractionBits / y.
                 // To correctly round the last bit in the result, we need one more bit of information.
@@ -202,8 +208,102 @@ namespace raoe
             requires std::integral<T> || std::floating_point<T>
         inline fixed& operator/=(T other) noexcept
         {
-            return (*this / fixed(other));
+            return (*this /= fixed(other));
         }
+
+        constexpr inline auto operator<=>(const fixed& other) const noexcept = default;
+
+        friend inline fixed operator+(fixed lhs, fixed rhs) noexcept { return lhs += rhs; }
+        friend inline fixed operator-(fixed lhs, fixed rhs) noexcept { return lhs -= rhs; }
+        friend inline fixed operator*(fixed lhs, fixed rhs) noexcept { return lhs *= rhs; }
+        friend inline fixed operator/(fixed lhs, fixed rhs) noexcept { return lhs /= rhs; }
     };
 
+    // Parses decimal text ("-12.375") straight into the raw value.  It never goes through a double, so the result is the
+    // same on every platform.  Fraction digits past the 18th are ignored.
+    template <std::integral TUnderlying, uint8 TFractionBits, std::integral TIntermediate, bool TRounding>
+    inline bool from_string(std::string_view arg, fixed<TUnderlying, TFractionBits, TIntermediate, TRounding>& value,
+                            std::string_view fmt = {})
+    {
+        using fixed_t = fixed<TUnderlying, TFractionBits, TIntermediate, TRounding>;
+
+        bool negative = false;
+        if(arg.starts_with('-') || arg.starts_with('+'))
+        {
+            negative = arg.front() == '-';
+            arg.remove_prefix(1);
+        }
+
+        const std::size_t dot = arg.find('.');
+        const std::string_view whole_digits = arg.substr(0, dot);
+        const std::string_view fraction_digits = dot == std::string_view::npos ? std::string_view() : arg.substr(dot + 1);
+        if(whole_digits.empty() && fraction_digits.empty())
+        {
+            return false;
+        }
+
+        uint64 whole = 0;
+        if(!whole_digits.empty())
+        {
+            auto result = std::from_chars(whole_digits.data(), whole_digits.data() + whole_digits.size(), whole);
+            if(result.ec != std::errc() || result.ptr != whole_digits.data() + whole_digits.size())
+            {
+                return false;
+            }
+        }
+
+        uint64 numerator = 0;
+        uint64 denominator = 1;
+        for(std::size_t i = 0; i < fraction_digits.size(); i++)
+        {
+            const char c = fraction_digits[i];
+            if(c < '0' || c > '9')
+            {
+                return false;
+            }
+            if(i < 18)
+            {
+                numerator = numerator * 10 + static_cast<uint64>(c - '0');
+                denominator *= 10;
+            }
+        }
+
+        // Binary long division of numerator / denominator, one fraction bit at a time.  Both stay below 10^18, so
+        // doubling never overflows.
+        uint64 fraction = 0;
+        for(uint8 bit = 0; bit < TFractionBits; bit++)
+        {
+            numerator *= 2;
+            fraction <<= 1;
+            if(numerator >= denominator)
+            {
+                numerator -= denominator;
+                fraction |= 1;
+            }
+        }
+        if constexpr(TRounding)
+        {
+            fraction += (numerator * 2 >= denominator) ? 1 : 0;
+        }
+
+        using unsigned_t = std::make_unsigned_t<TUnderlying>;
+        const uint64 limit = static_cast<uint64>(std::numeric_limits<TUnderlying>::max()) >> TFractionBits;
+        if(whole > limit)
+        {
+            return false;
+        }
+        const uint64 magnitude = (whole << TFractionBits) + fraction;
+        if(magnitude > static_cast<uint64>(std::numeric_limits<TUnderlying>::max()))
+        {
+            return false;
+        }
+        if(negative && !std::is_signed_v<TUnderlying> && magnitude != 0)
+        {
+            return false;
+        }
+
+        const auto raw = static_cast<unsigned_t>(magnitude);
+        value = fixed_t::make_from_raw(static_cast<TUnderlying>(negative ? unsigned_t(0) - raw : raw));
+        return true;
+    }
 }
\ No newline at end of file
@@ -103,6 +103,22 @@ namespace raoe
         return success;
     }
 
+    // Accepts true/false, 1/0 and on/off
+    inline bool from_string(std::string_view arg, bool& value, std::string_view fmt = {})
+    {
+        if(arg == "true" || arg == "1" || arg == "on")
+        {
+            value = true;
+            return true;
+        }
+        if(arg == "false" || arg == "0" || arg == "off")
+        {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
     inline bool from_string(std::string_view arg, std::floating_point auto& value, std::string_view fmt = {})
     {
         auto result = std::from_chars(arg.data(), arg.data() + arg.size(), value);
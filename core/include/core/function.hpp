@@ -0,0 +1,211 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/function_ref.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// An owning, move only std::function with a buffer you pick the size of.
+//
+// Anything callable that fits in InlineSize bytes (and can be moved without throwing) lives inside the function, so
+// making one doesn't allocate; bigger things go on the heap like std::function does.  A call is one indirect jump.
+// Being move only means it can hold lambdas that capture unique_ptrs and the like.  Calling an empty one panics.
+//     raoe::function<void(int)> on_resize = [this](int size) { m_size = size; };
+//     raoe::function<void(), 64> job = [big = std::array<int, 12> {}] { ... };
+namespace raoe
+{
+    template <typename TSignature, std::size_t InlineSize = 3 * sizeof(void*)>
+    class function;
+
+    template <typename R, typename... Args, std::size_t InlineSize>
+    class function<R(Args...), InlineSize>
+    {
+        static_assert(InlineSize >= sizeof(void*), "raoe::function needs room for at least a pointer");
+
+        using invoke_type = R (*)(void* storage, Args&&...);
+        // Moves what's in `from` into `to` and destroys it, or just destroys `from` if `to` is null
+        using manage_type = void (*)(void* to, void* from) noexcept;
+
+      public:
+        // True if F is stored inline rather than on the heap
+        template <typename F>
+        static constexpr bool stores_inline = sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) &&
+                                              std::is_nothrow_move_constructible_v<F>;
+
+        function() noexcept = default;
+        function(std::nullptr_t) noexcept {}
+
+        template <typename F>
+            requires(!std::is_same_v<std::remove_cvref_t<F>, function> &&
+                     std::is_move_constructible_v<std::decay_t<F>> &&
+                     std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+        function(F&& fn)
+        {
+            emplace<std::decay_t<F>>(std::forward<F>(fn));
+        }
+
+        function(function&& other) noexcept { take(other); }
+
+        function& operator=(function&& other) noexcept
+        {
+            if(this != &other)
+            {
+                reset();
+                take(other);
+            }
+            return *this;
+        }
+
+        function& operator=(std::nullptr_t) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        template <typename F>
+            requires(!std::is_same_v<std::remove_cvref_t<F>, function> &&
+                     std::is_move_constructible_v<std::decay_t<F>> &&
+                     std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+        function& operator=(F&& fn)
+        {
+            reset();
+            emplace<std::decay_t<F>>(std::forward<F>(fn));
+            return *this;
+        }
+
+        function(const function&) = delete;
+        function& operator=(const function&) = delete;
+
+        ~function() { reset(); }
+
+        explicit operator bool() const noexcept { return m_invoke != &invoke_empty; }
+
+        R operator()(Args... args) const { return m_invoke(m_storage, std::forward<Args>(args)...); }
+
+        void swap(function& other) noexcept
+        {
+            function temp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(temp);
+        }
+
+      private:
+        template <typename T, typename F>
+        void emplace(F&& fn)
+        {
+            // A function reference decays to a pointer too, but can't be null (and GCC warns about checking it)
+            using given = std::remove_cvref_t<F>;
+            if constexpr(std::is_pointer_v<given> || std::is_member_pointer_v<given>)
+            {
+                if(fn == nullptr)
+                {
+                    return;
+                }
+            }
+
+            if constexpr(stores_inline<T>)
+            {
+                ::new(static_cast<void*>(m_storage)) T(std::forward<F>(fn));
+                m_invoke = [](void* storage, Args&&... args) -> R {
+                    return _internal::invoke_r<R>(*std::launder(static_cast<T*>(storage)),
+                                                  std::forward<Args>(args)...);
+                };
+                // Plain old data (function pointers, lambdas that capture pointers and references) just gets copied
+                if constexpr(!std::is_trivially_copyable_v<T> || !std::is_trivially_destructible_v<T>)
+                {
+                    m_manage = [](void* to, void* from) noexcept {
+                        T* source = std::launder(static_cast<T*>(from));
+                        if(to != nullptr)
+                        {
+                            ::new(to) T(std::move(*source));
+                        }
+                        source->~T();
+                    };
+                }
+            }
+            else
+            {
+                T* heap = new T(std::forward<F>(fn));
+                std::memcpy(m_storage, &heap, sizeof(heap));
+                m_invoke = [](void* storage, Args&&... args) -> R {
+                    return _internal::invoke_r<R>(*heap_target<T>(storage), std::forward<Args>(args)...);
+                };
+                m_manage = [](void* to, void* from) noexcept {
+                    if(to != nullptr)
+                    {
+                        std::memcpy(to, from, sizeof(T*));
+                    }
+                    else
+                    {
+                        delete heap_target<T>(from);
+                    }
+                };
+            }
+        }
+
+        template <typename T>
+        static T* heap_target(void* storage) noexcept
+        {
+            T* target;
+            std::memcpy(&target, storage, sizeof(target));
+            return target;
+        }
+
+        void take(function& other) noexcept
+        {
+            if(other.m_manage != nullptr)
+            {
+                other.m_manage(m_storage, other.m_storage);
+            }
+            else
+            {
+                std::memcpy(m_storage, other.m_storage, InlineSize);
+            }
+            m_invoke = std::exchange(other.m_invoke, &invoke_empty);
+            m_manage = std::exchange(other.m_manage, nullptr);
+        }
+
+        void reset() noexcept
+        {
+            if(m_manage != nullptr)
+            {
+                m_manage(nullptr, m_storage);
+            }
+            m_invoke = &invoke_empty;
+            m_manage = nullptr;
+        }
+
+        [[noreturn]] static R invoke_empty(void*, Args&&...) { raoe::panic("Called an empty raoe::function"); }
+
+        alignas(std::max_align_t) mutable std::byte m_storage[InlineSize];
+        invoke_type m_invoke = &invoke_empty;
+        manage_type m_manage = nullptr;
+    };
+
+    template <typename R, typename... Args, std::size_t InlineSize>
+    void swap(function<R(Args...), InlineSize>& lhs, function<R(Args...), InlineSize>& rhs) noexcept
+    {
+        lhs.swap(rhs);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// A non owning reference to something callable: two pointers, never allocates, cheap to pass by value.
+//
+// It's for parameters, when the callee calls the thing before returning and doesn't keep it.  It doesn't extend the
+// lifetime of what it points at, so don't store one that was made from a temporary lambda.
+//     void for_each_file(std::string_view dir, raoe::function_ref<void(std::string_view)> fn);
+//     for_each_file("textures", [&](std::string_view name) { names.push_back(name); });
+namespace raoe
+{
+    namespace _internal
+    {
+        // std::invoke_r, which is C++23: a void signature throws away whatever the callable returns
+        template <typename R, typename F, typename... Args>
+        constexpr R invoke_r(F&& fn, Args&&... args)
+        {
+            if constexpr(std::is_void_v<R>)
+            {
+                std::invoke(std::forward<F>(fn), std::forward<Args>(args)...);
+            }
+            else
+            {
+                return std::invoke(std::forward<F>(fn), std::forward<Args>(args)...);
+            }
+        }
+    }
+
+    template <typename TSignature>
+    class function_ref;
+
+    template <typename R, typename... Args>
+    class function_ref<R(Args...)>
+    {
+        union target
+        {
+            void* object;
+            void (*function)();
+        };
+        using invoke_type = R (*)(target, Args&&...);
+
+        template <typename F>
+        static constexpr bool is_function_pointer =
+            std::is_pointer_v<F> && std::is_function_v<std::remove_pointer_t<F>>;
+
+      public:
+        // Plain functions (or pointers to them) are held by value, so it's fine to point one at a function pointer
+        // that's about to go away
+        template <typename F>
+            requires std::is_function_v<F> && std::is_invocable_r_v<R, F&, Args...>
+        function_ref(F* fn) noexcept
+        {
+            m_target.function = reinterpret_cast<void (*)()>(fn);
+            m_invoke = [](target t, Args&&... args) -> R {
+                return _internal::invoke_r<R>(reinterpret_cast<F*>(t.function), std::forward<Args>(args)...);
+            };
+        }
+
+        template <typename F>
+            requires(!std::is_same_v<std::remove_cvref_t<F>, function_ref> &&
+                     !std::is_function_v<std::remove_reference_t<F>> &&
+                     !is_function_pointer<std::remove_cvref_t<F>> && std::is_invocable_r_v<R, F&, Args...>)
+        function_ref(F&& fn) noexcept
+        {
+            using target_type = std::remove_reference_t<F>;
+            m_target.object = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+            m_invoke = [](target t, Args&&... args) -> R {
+                return _internal::invoke_r<R>(*static_cast<target_type*>(t.object), std::forward<Args>(args)...);
+            };
+        }
+
+        function_ref(const function_ref&) noexcept = default;
+        function_ref& operator=(const function_ref&) noexcept = default;
+
+        R operator()(Args... args) const { return m_invoke(m_target, std::forward<Args>(args)...); }
+
+      private:
+        target m_target;
+        invoke_type m_invoke;
+    };
+}
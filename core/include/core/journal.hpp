@@ -0,0 +1,831 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include "core/check.hpp"
+#include "core/function.hpp"
+#include "core/function_ref.hpp"
+#include "core/mapped_file.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAOE_JOURNAL_USE_FSYNC 1
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// An append only log of small records, for state that changes all the time (progress, telemetry) and shouldn't be
+// rewritten whole every time it does.
+//
+// A record is a type tag and some bytes, and gets a sequence number and a checksum.  Appends from any thread go into a
+// buffer that a committer thread writes out in one go, so lots of appends share one write, and one fsync if they're
+// waiting to be on the disk (group commit).  Opening a journal reads up to the last record that's whole and checks
+// out, and cuts off whatever's after it, which is what a crash halfway through a write leaves.
+//
+// The log is split into segment files.  Give it take_snapshot and a compactor thread calls it once enough has been
+// appended, saves the snapshot and deletes the segments it covers.  A snapshot says which sequence number it's up to
+// (append() returns each record's), and replay() hands you the snapshot and then every record after it.
+//     raoe::journal progress(raoe::fs::write_dir() / "progress");
+//     progress.replay(load_progress, apply_change);
+//     progress.append(achievement_unlocked, raoe::as_bytes(achievement));
+namespace raoe
+{
+    namespace _internal::journal_format
+    {
+        inline constexpr uint32 segment_magic = 0x4c4a4152;  // "RAJL"
+        inline constexpr uint32 snapshot_magic = 0x534a4152; // "RAJS"
+        inline constexpr uint32 version = 1;
+        inline constexpr uint64 golden = 0x9e3779b97f4a7c15;
+
+        struct segment_header
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 number;
+        };
+
+        struct record_header
+        {
+            uint32 size;
+            uint32 type;
+            uint64 sequence;
+            uint64 checksum;
+        };
+
+        struct snapshot_header
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 through;
+            uint64 size;
+            uint64 checksum;
+        };
+
+        static_assert(sizeof(segment_header) == 16 && sizeof(record_header) == 24 && sizeof(snapshot_header) == 32,
+                      "journal's file layout has padding in it");
+
+        [[nodiscard]] inline uint64 hash_bytes(std::span<const std::byte> bytes, uint64 seed) noexcept
+        {
+            return stable_hash(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()), seed);
+        }
+
+        // The part of a record's checksum that can be worked out before it has a sequence number
+        [[nodiscard]] inline uint64 payload_hash(uint32 type, std::span<const std::byte> bytes) noexcept
+        {
+            return hash_bytes(bytes, (uint64 {type} << 32) | bytes.size());
+        }
+
+        [[nodiscard]] inline uint64 checksum(uint64 payload, uint64 sequence) noexcept
+        {
+            return distribute(payload ^ (sequence * golden));
+        }
+
+        [[nodiscard]] inline std::string segment_name(uint64 number)
+        {
+            constexpr std::string_view digits = "0123456789abcdef";
+            std::string name(16, '0');
+            for(std::size_t i = 16; i-- > 0; number >>= 4)
+            {
+                name[i] = digits[number & 0xf];
+            }
+            return name + ".log";
+        }
+
+        [[nodiscard]] inline std::optional<uint64> segment_number(std::string_view name)
+        {
+            if(name.size() != 20 || !name.ends_with(".log"))
+            {
+                return std::nullopt;
+            }
+            uint64 number = 0;
+            for(const char c : name.substr(0, 16))
+            {
+                const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+                if(digit < 0)
+                {
+                    return std::nullopt;
+                }
+                number = (number << 4) | static_cast<uint64>(digit);
+            }
+            return number;
+        }
+
+        // A file that only ever gets added to the end of
+        class append_file
+        {
+          public:
+            append_file() = default;
+            explicit append_file(const std::filesystem::path& path)
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                : m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644))
+            {
+            }
+#else
+                : m_out(path, std::ios::binary | std::ios::app)
+            {
+            }
+#endif
+
+            ~append_file() { close(); }
+
+            append_file(append_file&& other) noexcept { *this = std::move(other); }
+            append_file& operator=(append_file&& other) noexcept
+            {
+                if(this != &other)
+                {
+                    close();
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                    m_fd = std::exchange(other.m_fd, -1);
+#else
+                    m_out = std::move(other.m_out);
+#endif
+                }
+                return *this;
+            }
+
+            [[nodiscard]] bool is_open() const noexcept
+            {
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                return m_fd >= 0;
+#else
+                return m_out.is_open();
+#endif
+            }
+
+            bool write(std::span<const std::byte> bytes)
+            {
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                while(!bytes.empty())
+                {
+                    const ssize_t count = ::write(m_fd, bytes.data(), bytes.size());
+                    if(count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if(count <= 0)
+                    {
+                        return false;
+                    }
+                    bytes = bytes.subspan(static_cast<std::size_t>(count));
+                }
+                return true;
+#else
+                return static_cast<bool>(m_out.write(reinterpret_cast<const char*>(bytes.data()),
+                                                     static_cast<std::streamsize>(bytes.size())));
+#endif
+            }
+
+            // Where there's no fsync this only gets it as far as the OS
+            bool sync()
+            {
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                return ::fsync(m_fd) == 0;
+#else
+                return static_cast<bool>(m_out.flush());
+#endif
+            }
+
+            void close()
+            {
+#ifdef RAOE_JOURNAL_USE_FSYNC
+                if(m_fd >= 0)
+                {
+                    ::close(m_fd);
+                    m_fd = -1;
+                }
+#else
+                m_out.close();
+#endif
+            }
+
+          private:
+#ifdef RAOE_JOURNAL_USE_FSYNC
+            int m_fd = -1;
+#else
+            std::ofstream m_out;
+#endif
+        };
+
+        inline void sync_directory([[maybe_unused]] const std::filesystem::path& path)
+        {
+#ifdef RAOE_JOURNAL_USE_FSYNC
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd >= 0)
+            {
+                ::fsync(fd);
+                ::close(fd);
+            }
+#endif
+        }
+    }
+
+    class journal
+    {
+      public:
+        enum class durability
+        {
+            // Written as soon as the committer gets to it, and on the disk whenever the OS gets round to it.  Survives
+            // the game crashing, but not the machine.
+            buffered,
+            // Like buffered, plus an fsync every sync_interval
+            periodic,
+            // append() waits until its record has been fsynced
+            sync,
+        };
+
+        struct snapshot
+        {
+            // The last record the snapshot includes
+            uint64 through = 0;
+            std::vector<std::byte> bytes;
+        };
+
+        struct options
+        {
+            journal::durability durability = journal::durability::sync;
+            std::chrono::milliseconds sync_interval {100};
+            // A new segment is started once the current one is this big
+            uint64 segment_size = 16 * 1024 * 1024;
+            // Compacts once this much has been appended since the last snapshot
+            uint64 compact_after = 64 * 1024 * 1024;
+            // append() waits while this much is still waiting to be written
+            std::size_t max_buffered = 16 * 1024 * 1024;
+            // Called from the compactor thread.  Without it the journal never compacts.
+            function<snapshot()> take_snapshot {};
+        };
+
+        struct record
+        {
+            uint64 sequence;
+            uint32 type;
+            std::span<const std::byte> bytes;
+        };
+
+        struct statistics
+        {
+            uint64 records = 0;
+            uint64 writes = 0;
+            uint64 syncs = 0;
+            uint64 snapshots = 0;
+        };
+
+        explicit journal(std::filesystem::path directory)
+            : journal(std::move(directory), options {})
+        {
+        }
+
+        journal(std::filesystem::path directory, options opts)
+            : m_directory(std::move(directory))
+            , m_options(std::move(opts))
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(m_directory, ec);
+            recover();
+            m_committer = std::jthread([this] { commit_loop(); });
+            if(m_options.take_snapshot)
+            {
+                m_compactor = std::jthread([this](std::stop_token stop) { compact_loop(stop); });
+            }
+        }
+
+        // Writes (and for anything but buffered, syncs) everything that was appended first
+        ~journal()
+        {
+            if(m_compactor.joinable())
+            {
+                m_compactor.request_stop();
+                m_compact_wake.notify_all();
+                m_compactor.join();
+            }
+            {
+                std::scoped_lock lock(m_mutex);
+                m_stopping = true;
+            }
+            m_commit_wake.notify_all();
+            m_committer.join();
+        }
+
+        journal(const journal&) = delete;
+        journal& operator=(const journal&) = delete;
+
+        // The record's sequence number, or nullopt if the journal can't write any more (or, with durability::sync,
+        // couldn't write this one)
+        std::optional<uint64> append(uint32 type, std::span<const std::byte> bytes)
+        {
+            namespace format = _internal::journal_format;
+            check_if(bytes.size() <= ~uint32 {0}, "journal: a record can't be more than 4GB");
+            const uint64 payload = format::payload_hash(type, bytes);
+
+            std::unique_lock lock(m_mutex);
+            m_written_wake.wait(lock, [&] { return m_pending.size() < m_options.max_buffered || m_failed; });
+            if(m_failed)
+            {
+                return std::nullopt;
+            }
+            const uint64 sequence = ++m_last_sequence;
+            const format::record_header header {static_cast<uint32>(bytes.size()), type, sequence,
+                                                format::checksum(payload, sequence)};
+            const std::size_t at = m_pending.size();
+            m_pending.resize(at + sizeof(header) + bytes.size());
+            std::memcpy(m_pending.data() + at, &header, sizeof(header));
+            if(!bytes.empty())
+            {
+                std::memcpy(m_pending.data() + at + sizeof(header), bytes.data(), bytes.size());
+            }
+            m_stats.records++;
+            if(at == 0)
+            {
+                m_commit_wake.notify_one();
+            }
+            if(m_options.durability != durability::sync)
+            {
+                return sequence;
+            }
+            m_written_wake.wait(lock, [&] { return m_synced >= sequence || m_failed; });
+            return m_synced >= sequence ? std::optional(sequence) : std::nullopt;
+        }
+
+        // Waits until everything appended so far is on the disk, whatever the durability.  False if it couldn't be.
+        bool flush()
+        {
+            std::unique_lock lock(m_mutex);
+            const uint64 target = m_last_sequence;
+            m_sync_requested = true;
+            m_commit_wake.notify_one();
+            m_written_wake.wait(lock, [&] { return m_synced >= target || m_failed; });
+            return m_synced >= target;
+        }
+
+        // Calls on_snapshot with the latest snapshot (if there is one), then on_record with every record after it, in
+        // order.  Meant for when the journal's just been opened; records appended while it's replaying are skipped.
+        void replay(function_ref<void(std::span<const std::byte>)> on_snapshot,
+                    function_ref<void(const record&)> on_record) const
+        {
+            namespace format = _internal::journal_format;
+            std::vector<uint64> segments;
+            uint64 through = 0;
+            uint64 last = 0;
+            {
+                std::scoped_lock lock(m_mutex);
+                for(const segment& s : m_segments)
+                {
+                    segments.push_back(s.number);
+                }
+                last = m_written;
+            }
+            {
+                std::scoped_lock lock(m_snapshot_mutex);
+                const mapped_file file(m_directory / "snapshot");
+                if(const auto bytes = read_snapshot(file))
+                {
+                    through = bytes->first;
+                    on_snapshot(bytes->second);
+                }
+            }
+            for(const uint64 number : segments)
+            {
+                const mapped_file file(m_directory / format::segment_name(number));
+                for_each_record(file, [&](const record& r) {
+                    if(r.sequence > last)
+                    {
+                        return false;
+                    }
+                    if(r.sequence > through)
+                    {
+                        on_record(r);
+                    }
+                    return true;
+                });
+            }
+        }
+
+        // Takes a snapshot now, rather than waiting for compact_after.  False if there's no take_snapshot or it
+        // couldn't be saved.
+        bool compact()
+        {
+            namespace format = _internal::journal_format;
+            if(!m_options.take_snapshot)
+            {
+                return false;
+            }
+            std::scoped_lock compacting(m_compact_mutex);
+            const snapshot taken = m_options.take_snapshot();
+            {
+                std::scoped_lock lock(m_mutex);
+                check_if(taken.through <= m_last_sequence, "journal: a snapshot through {} is ahead of the journal ({})",
+                         taken.through, m_last_sequence);
+                if(taken.through < m_snapshot_through)
+                {
+                    return false;
+                }
+            }
+
+            std::vector<std::byte> bytes(sizeof(format::snapshot_header) + taken.bytes.size());
+            const format::snapshot_header header {format::snapshot_magic, format::version, taken.through,
+                                                  taken.bytes.size(), format::hash_bytes(taken.bytes, taken.through)};
+            std::memcpy(bytes.data(), &header, sizeof(header));
+            if(!taken.bytes.empty())
+            {
+                std::memcpy(bytes.data() + sizeof(header), taken.bytes.data(), taken.bytes.size());
+            }
+            const std::filesystem::path path = m_directory / "snapshot";
+            const std::filesystem::path temp = m_directory / "snapshot.tmp";
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            {
+                format::append_file out(temp);
+                if(!out.is_open() || !out.write(bytes) || !out.sync())
+                {
+                    return false;
+                }
+            }
+            {
+                // Readers map the snapshot, so swap it while none are
+                std::scoped_lock lock(m_snapshot_mutex);
+                std::filesystem::rename(temp, path, ec);
+            }
+            if(ec)
+            {
+                return false;
+            }
+            format::sync_directory(m_directory);
+
+            // Every segment before the one being written to that the snapshot covers can go
+            std::vector<uint64> covered;
+            {
+                std::scoped_lock lock(m_mutex);
+                m_stats.snapshots++;
+                m_snapshot_through = std::max(m_snapshot_through, taken.through);
+                while(m_segments.size() > 1 && m_segments.front().last <= m_snapshot_through)
+                {
+                    covered.push_back(m_segments.front().number);
+                    m_segments.erase(m_segments.begin());
+                }
+                m_since_snapshot = 0;
+            }
+            for(const uint64 number : covered)
+            {
+                std::filesystem::remove(m_directory / format::segment_name(number), ec);
+            }
+            return true;
+        }
+
+        // The last sequence number handed out
+        [[nodiscard]] uint64 last_sequence() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_last_sequence;
+        }
+
+        // False once a write has failed; nothing more gets written after that
+        [[nodiscard]] bool ok() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return !m_failed;
+        }
+
+        [[nodiscard]] statistics stats() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_stats;
+        }
+
+      private:
+        struct segment
+        {
+            uint64 number;
+            // The last record in it
+            uint64 last;
+            uint64 size;
+        };
+
+        // Calls func with each good record in a segment, until it turns one down by returning false.  Returns where
+        // the records it took end.
+        template <typename TFunc>
+        static std::size_t for_each_record(const mapped_file& file, TFunc&& func)
+        {
+            namespace format = _internal::journal_format;
+            format::segment_header header {};
+            if(file.size() < sizeof(header))
+            {
+                return 0;
+            }
+            std::memcpy(&header, file.bytes().data(), sizeof(header));
+            if(header.magic != format::segment_magic || header.version != format::version)
+            {
+                return 0;
+            }
+            std::size_t at = sizeof(header);
+            uint64 previous = 0;
+            while(file.size() - at >= sizeof(format::record_header))
+            {
+                format::record_header r {};
+                std::memcpy(&r, file.bytes().data() + at, sizeof(r));
+                if(r.size > file.size() - at - sizeof(r) || (previous != 0 && r.sequence != previous + 1))
+                {
+                    break;
+                }
+                const auto bytes = file.bytes().subspan(at + sizeof(r), r.size);
+                if(format::checksum(format::payload_hash(r.type, bytes), r.sequence) != r.checksum ||
+                   !func(record {r.sequence, r.type, bytes}))
+                {
+                    break;
+                }
+                at += sizeof(r) + r.size;
+                previous = r.sequence;
+            }
+            return at;
+        }
+
+        [[nodiscard]] static std::optional<std::pair<uint64, std::span<const std::byte>>> read_snapshot(
+            const mapped_file& file)
+        {
+            namespace format = _internal::journal_format;
+            format::snapshot_header header {};
+            if(file.size() < sizeof(header))
+            {
+                return std::nullopt;
+            }
+            std::memcpy(&header, file.bytes().data(), sizeof(header));
+            const auto bytes = file.bytes().subspan(sizeof(header));
+            if(header.magic != format::snapshot_magic || header.version != format::version ||
+               header.size != bytes.size() || format::hash_bytes(bytes, header.through) != header.checksum)
+            {
+                return std::nullopt;
+            }
+            return std::pair(header.through, bytes);
+        }
+
+        // Works out where the journal got to, and cuts off anything after the last good record
+        void recover()
+        {
+            namespace format = _internal::journal_format;
+            std::error_code ec;
+            std::filesystem::remove(m_directory / "snapshot.tmp", ec);
+            if(const auto found = read_snapshot(mapped_file(m_directory / "snapshot")))
+            {
+                m_snapshot_through = found->first;
+            }
+
+            std::vector<uint64> numbers;
+            for(const auto& file : std::filesystem::directory_iterator(m_directory, ec))
+            {
+                if(const auto number = format::segment_number(file.path().filename().string()))
+                {
+                    numbers.push_back(*number);
+                }
+            }
+            std::ranges::sort(numbers);
+
+            uint64 last = 0;
+            bool damaged = false;
+            for(const uint64 number : numbers)
+            {
+                const std::filesystem::path path = m_directory / format::segment_name(number);
+                if(damaged)
+                {
+                    // Nothing after a bad record can be trusted to follow on from it
+                    std::filesystem::remove(path, ec);
+                    continue;
+                }
+                uint64 segment_last = last;
+                std::size_t good = 0;
+                std::size_t size = 0;
+                {
+                    const mapped_file file(path);
+                    size = file.size();
+                    good = for_each_record(file, [&](const record& r) {
+                        // A segment started after a crash lost records the snapshot already had picks up after the
+                        // snapshot instead
+                        const bool after_snapshot = segment_last == last && segment_last < m_snapshot_through &&
+                                                    r.sequence == m_snapshot_through + 1;
+                        if(segment_last != 0 && r.sequence != segment_last + 1 && !after_snapshot)
+                        {
+                            return false;
+                        }
+                        segment_last = r.sequence;
+                        return true;
+                    });
+                }
+                if(good < sizeof(format::segment_header))
+                {
+                    std::filesystem::remove(path, ec);
+                    damaged = true;
+                    continue;
+                }
+                if(good < size)
+                {
+                    std::filesystem::resize_file(path, good, ec);
+                    damaged = true;
+                }
+                last = segment_last;
+                m_segments.push_back(segment {number, segment_last, good});
+                m_since_snapshot += good;
+            }
+            m_last_sequence = std::max(last, m_snapshot_through);
+            m_written = m_synced = m_last_sequence;
+            m_next_segment = numbers.empty() ? 0 : numbers.back() + 1;
+            // If the snapshot got further than the records did, the next record can't follow on from the last one in
+            // the same segment, so it starts a new one
+            if(!m_segments.empty() && m_segments.back().size < m_options.segment_size && last >= m_snapshot_through)
+            {
+                m_file = format::append_file(m_directory / format::segment_name(m_segments.back().number));
+            }
+            if(!m_file.is_open())
+            {
+                m_failed = !start_segment();
+            }
+        }
+
+        // Starts a new segment file and makes it the one being written to.  Only the committer (or recover()) calls
+        // this.
+        bool start_segment()
+        {
+            namespace format = _internal::journal_format;
+            const uint64 number = m_next_segment++;
+            const std::filesystem::path path = m_directory / format::segment_name(number);
+            format::append_file file(path);
+            const format::segment_header header {format::segment_magic, format::version, number};
+            if(!file.is_open() || !file.write(std::as_bytes(std::span(&header, 1))) || !file.sync())
+            {
+                return false;
+            }
+            format::sync_directory(m_directory);
+            m_file = std::move(file);
+            std::scoped_lock lock(m_mutex);
+            m_segments.push_back(segment {number, 0, sizeof(header)});
+            return true;
+        }
+
+        void commit_loop()
+        {
+            std::vector<std::byte> writing;
+            auto last_sync = std::chrono::steady_clock::now();
+            std::unique_lock lock(m_mutex);
+            while(true)
+            {
+                auto ready = [&] { return m_stopping || m_sync_requested || !m_pending.empty(); };
+                if(m_options.durability == durability::periodic && m_synced < m_written)
+                {
+                    m_commit_wake.wait_until(lock, last_sync + m_options.sync_interval, ready);
+                }
+                else
+                {
+                    m_commit_wake.wait(lock, ready);
+                }
+                if(m_failed)
+                {
+                    m_pending.clear();
+                    m_written_wake.notify_all();
+                    if(m_stopping)
+                    {
+                        return;
+                    }
+                    continue;
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                const bool stopping = m_stopping;
+                const bool sync =
+                    m_sync_requested || m_options.durability == durability::sync ||
+                    (m_options.durability == durability::periodic && now - last_sync >= m_options.sync_interval) ||
+                    (stopping && m_options.durability != durability::buffered);
+                m_sync_requested = false;
+                writing.swap(m_pending);
+                const uint64 through = m_last_sequence;
+                const bool rotate = m_segments.back().size >= m_options.segment_size && !writing.empty();
+                lock.unlock();
+
+                bool ok = true;
+                if(rotate)
+                {
+                    // Whatever's in the old segment gets synced before it's left behind
+                    ok = m_file.sync() && start_segment();
+                }
+                if(ok && !writing.empty())
+                {
+                    ok = m_file.write(writing);
+                }
+                if(ok && sync)
+                {
+                    ok = m_file.sync();
+                    last_sync = now;
+                }
+
+                lock.lock();
+                if(ok)
+                {
+                    m_stats.writes += !writing.empty();
+                    m_stats.syncs += sync;
+                    if(!writing.empty())
+                    {
+                        m_segments.back().last = through;
+                        m_segments.back().size += writing.size();
+                        m_since_snapshot += writing.size();
+                    }
+                    m_written = through;
+                    if(sync)
+                    {
+                        m_synced = through;
+                    }
+                }
+                else
+                {
+                    m_failed = true;
+                }
+                writing.clear();
+                m_written_wake.notify_all();
+                if(m_since_snapshot >= m_options.compact_after)
+                {
+                    m_compact_wake.notify_one();
+                }
+                if(stopping && m_pending.empty())
+                {
+                    return;
+                }
+            }
+        }
+
+        void compact_loop(std::stop_token stop)
+        {
+            while(!stop.stop_requested())
+            {
+                {
+                    std::unique_lock lock(m_mutex);
+                    m_compact_wake.wait(lock, stop, [&] { return m_since_snapshot >= m_options.compact_after; });
+                    if(stop.stop_requested())
+                    {
+                        return;
+                    }
+                }
+                if(!compact())
+                {
+                    // Don't spin on a snapshot that can't be saved; try again after another compact_after
+                    std::scoped_lock lock(m_mutex);
+                    m_since_snapshot = 0;
+                }
+            }
+        }
+
+        std::filesystem::path m_directory;
+        options m_options;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_commit_wake;
+        std::condition_variable m_written_wake;
+        std::condition_variable_any m_compact_wake;
+        std::vector<std::byte> m_pending;
+        uint64 m_last_sequence = 0;
+        // Up to which record has been written, and fsynced
+        uint64 m_written = 0;
+        uint64 m_synced = 0;
+        bool m_sync_requested = false;
+        bool m_stopping = false;
+        bool m_failed = false;
+        std::vector<segment> m_segments;
+        uint64 m_since_snapshot = 0;
+        uint64 m_snapshot_through = 0;
+        statistics m_stats;
+
+        // Only the committer touches these once it's started
+        _internal::journal_format::append_file m_file;
+        uint64 m_next_segment = 0;
+
+        mutable std::mutex m_snapshot_mutex;
+        std::mutex m_compact_mutex;
+        std::jthread m_committer;
+        std::jthread m_compactor;
+    };
+}
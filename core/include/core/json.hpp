@@ -0,0 +1,765 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/from_string.hpp"
+#include "core/simd_scan.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// An on-demand JSON reader, in the style of simdjson.
+//
+// Stage one runs over the whole document 64 bytes at a time and records the offset of every structural character
+// ({ } [ ] : ,) and the start of every string, number and literal, skipping anything inside a string.  Stage two pairs
+// up the brackets so any value can be skipped in O(1), and checks the structure holds together.  Nothing is parsed beyond that until you ask for it: a value is
+// just a position in the index, and get() hands the text of that value straight to raoe::from_string.  Strings are
+// std::string_views into the input, so tags and uuids are converted without copying.
+//
+// The document is only lightly validated (balanced brackets, terminated strings, keys and colons and commas where they
+// belong).  Malformed scalars fail in get().
+namespace raoe::json
+{
+    enum class json_type : uint8
+    {
+        invalid,
+        object,
+        array,
+        string,
+        number,
+        boolean,
+        null,
+    };
+
+    class document;
+    struct field;
+
+    namespace _internal
+    {
+        // Carries the backslash state across blocks.  Returns the bits of every character that is escaped by a
+        // backslash.  Runs of backslashes escape each other, so only an odd length run escapes the next character.
+        // Straight out of simdjson.
+        class escape_scanner
+        {
+          public:
+            uint64 next(uint64 backslash) noexcept
+            {
+                constexpr uint64 even_bits = 0x5555555555555555ull;
+
+                backslash &= ~m_prev_escaped;
+                const uint64 follows_escape = (backslash << 1) | m_prev_escaped;
+                const uint64 odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+                const uint64 sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+                m_prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts ? 1 : 0;
+                const uint64 invert_mask = sequences_starting_on_even_bits << 1;
+                return (even_bits ^ invert_mask) & follows_escape;
+            }
+
+          private:
+            uint64 m_prev_escaped = 0;
+        };
+
+        inline bool is_whitespace(char c) noexcept { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+        inline void append_utf8(std::string& out, uint32 code_point)
+        {
+            if(code_point < 0x80)
+            {
+                out.push_back(static_cast<char>(code_point));
+            }
+            else if(code_point < 0x800)
+            {
+                out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else if(code_point < 0x10000)
+            {
+                out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+        }
+
+        inline bool parse_hex4(std::string_view text, uint32& out)
+        {
+            if(text.size() < 4)
+            {
+                return false;
+            }
+            out = 0;
+            for(std::size_t i = 0; i < 4; i++)
+            {
+                const char c = text[i];
+                out <<= 4;
+                if(c >= '0' && c <= '9')
+                {
+                    out |= static_cast<uint32>(c - '0');
+                }
+                else if(c >= 'a' && c <= 'f')
+                {
+                    out |= static_cast<uint32>(c - 'a' + 10);
+                }
+                else if(c >= 'A' && c <= 'F')
+                {
+                    out |= static_cast<uint32>(c - 'A' + 10);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Decodes the escapes in the body of a string (without its quotes)
+        inline bool unescape(std::string_view raw, std::string& out)
+        {
+            out.clear();
+            out.reserve(raw.size());
+            for(std::size_t i = 0; i < raw.size(); i++)
+            {
+                if(raw[i] != '\\')
+                {
+                    out.push_back(raw[i]);
+                    continue;
+                }
+                if(++i >= raw.size())
+                {
+                    return false;
+                }
+                switch(raw[i])
+                {
+                    case '"': out.push_back('"'); break;
+                    case '\\': out.push_back('\\'); break;
+                    case '/': out.push_back('/'); break;
+                    case 'b': out.push_back('\b'); break;
+                    case 'f': out.push_back('\f'); break;
+                    case 'n': out.push_back('\n'); break;
+                    case 'r': out.push_back('\r'); break;
+                    case 't': out.push_back('\t'); break;
+                    case 'u':
+                    {
+                        uint32 code_point;
+                        if(!parse_hex4(raw.substr(i + 1), code_point))
+                        {
+                            return false;
+                        }
+                        i += 4;
+                        // Characters outside the BMP come as a surrogate pair
+                        if(code_point >= 0xD800 && code_point < 0xDC00)
+                        {
+                            uint32 low;
+                            if(raw.substr(i + 1, 2) != "\\u" || !parse_hex4(raw.substr(i + 3), low) || low < 0xDC00 ||
+                               low >= 0xE000)
+                            {
+                                return false;
+                            }
+                            i += 6;
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        append_utf8(out, code_point);
+                        break;
+                    }
+                    default: return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    // A position in a document.  Cheap to copy, and only valid while the document is alive.
+    // A value that doesn't exist (a missing key, an out of range index) converts to false and fails every get().
+    class value
+    {
+      public:
+        value() = default;
+
+        [[nodiscard]] json_type type() const noexcept;
+        explicit operator bool() const noexcept { return m_document != nullptr; }
+
+        [[nodiscard]] bool is_null() const noexcept { return type() == json_type::null; }
+        [[nodiscard]] bool is_object() const noexcept { return type() == json_type::object; }
+        [[nodiscard]] bool is_array() const noexcept { return type() == json_type::array; }
+        [[nodiscard]] bool is_string() const noexcept { return type() == json_type::string; }
+        [[nodiscard]] bool is_number() const noexcept { return type() == json_type::number; }
+
+        // Looks up a key in an object.  Keys are compared against the raw text, so a key with escapes in it has to be
+        // looked up with the same escapes.
+        [[nodiscard]] value operator[](std::string_view key) const noexcept;
+        // Looks up an element of an array.  This walks the array, so use elements() to visit all of them.
+        [[nodiscard]] value operator[](std::size_t index) const noexcept;
+
+        // Number of elements in an array or fields in an object
+        [[nodiscard]] std::size_t size() const noexcept;
+
+        // The exact text of this value in the input, from its first character to its last
+        [[nodiscard]] std::string_view raw() const noexcept;
+        // The body of a string, without the quotes and with any escapes left in
+        [[nodiscard]] std::string_view raw_string() const noexcept;
+
+        // Converts this value with raoe::from_string.  Strings are passed without their quotes (and without decoding
+        // escapes; use get(std::string&) for that), numbers are passed as their text.  Returns false if the value is
+        // missing, is the wrong kind of value, or didn't parse.
+        template <typename T>
+        bool get(T& out) const
+        {
+            if constexpr(std::same_as<T, bool>)
+            {
+                const std::string_view text = raw();
+                if(text != "true" && text != "false")
+                {
+                    return false;
+                }
+                out = text == "true";
+                return true;
+            }
+            else if constexpr(std::same_as<T, std::string>)
+            {
+                return is_string() && _internal::unescape(raw_string(), out);
+            }
+            else
+            {
+                switch(type())
+                {
+                    case json_type::string: return from_string(raw_string(), out);
+                    case json_type::number: return from_string(raw(), out);
+                    default: return false;
+                }
+            }
+        }
+
+        template <typename T>
+        [[nodiscard]] T value_or(T fallback) const
+        {
+            T out;
+            return get(out) ? out : fallback;
+        }
+
+        template <typename T>
+        [[nodiscard]] std::optional<T> as() const
+        {
+            T out;
+            if(get(out))
+            {
+                return out;
+            }
+            return std::nullopt;
+        }
+
+        // Visits the elements of an array or the fields of an object, in order.  Anything else visits nothing.
+        class iterator
+        {
+          public:
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+
+            iterator() = default;
+            iterator(const document* doc, uint32 position, bool fields)
+                : m_document(doc)
+                , m_position(position)
+                , m_fields(fields)
+            {
+            }
+
+            // Only valid to call on an object's iterator
+            [[nodiscard]] json::field operator*() const noexcept;
+            iterator& operator++() noexcept;
+            iterator operator++(int) noexcept
+            {
+                iterator copy = *this;
+                ++(*this);
+                return copy;
+            }
+
+            bool operator==(const iterator& other) const noexcept { return m_position == other.m_position; }
+
+          protected:
+            const document* m_document = nullptr;
+            uint32 m_position = 0;
+            bool m_fields = false;
+        };
+
+        class element_iterator : public iterator
+        {
+          public:
+            using value_type = json::value;
+            using iterator::iterator;
+
+            [[nodiscard]] json::value operator*() const noexcept { return json::value(m_document, m_position); }
+            element_iterator& operator++() noexcept
+            {
+                iterator::operator++();
+                return *this;
+            }
+            element_iterator operator++(int) noexcept
+            {
+                element_iterator copy = *this;
+                ++(*this);
+                return copy;
+            }
+        };
+
+        class field_iterator : public iterator
+        {
+          public:
+            using value_type = json::field;
+            using iterator::iterator;
+
+            field_iterator& operator++() noexcept
+            {
+                iterator::operator++();
+                return *this;
+            }
+            field_iterator operator++(int) noexcept
+            {
+                field_iterator copy = *this;
+                ++(*this);
+                return copy;
+            }
+        };
+
+        template <typename TIterator>
+        struct range
+        {
+            TIterator first;
+            TIterator last;
+            TIterator begin() const { return first; }
+            TIterator end() const { return last; }
+        };
+
+        // for(json::value element : array.elements()) { ... }
+        [[nodiscard]] range<element_iterator> elements() const noexcept;
+        // for(auto [key, value] : object.fields()) { ... }
+        [[nodiscard]] range<field_iterator> fields() const noexcept;
+
+      private:
+        friend class document;
+
+        value(const document* doc, uint32 position)
+            : m_document(doc)
+            , m_position(position)
+        {
+        }
+
+        [[nodiscard]] char first_char() const noexcept;
+
+        const document* m_document = nullptr;
+        // Index into the document's structural index
+        uint32 m_position = 0;
+    };
+
+    // One key/value pair of an object
+    struct field
+    {
+        std::string_view key;
+        json::value value;
+    };
+
+    class document
+    {
+      public:
+        // Indexes JSON that's already in memory.  The document doesn't copy it, so it has to outlive the document.
+        explicit document(std::string_view json)
+            : m_input(json)
+        {
+            build_index();
+        }
+
+        explicit document(std::span<const std::byte> json)
+            : document(std::string_view(reinterpret_cast<const char*>(json.data()), json.size()))
+        {
+        }
+
+        // Reads a whole stream (eg. a raoe::fs::ifstream) and indexes it.  The document owns the text.
+        explicit document(std::istream& from)
+            : m_storage(std::istreambuf_iterator<char>(from), std::istreambuf_iterator<char>())
+            , m_input(m_storage)
+        {
+            build_index();
+        }
+
+        // Values point back at their document
+        document(const document&) = delete;
+        document& operator=(const document&) = delete;
+
+        // False if the brackets didn't balance, a string wasn't closed, or there was nothing in the document
+        [[nodiscard]] bool valid() const noexcept { return m_valid; }
+
+        // The top level value.  Converts to false if the document isn't valid.
+        [[nodiscard]] json::value root() const noexcept
+        {
+            return m_valid ? json::value(this, 0) : json::value();
+        }
+
+        [[nodiscard]] json::value operator[](std::string_view key) const noexcept { return root()[key]; }
+
+        [[nodiscard]] std::string_view input() const noexcept { return m_input; }
+
+      private:
+        friend class json::value;
+
+        // Stage one.  Records the offset of every structural character and every scalar start, outside of strings.
+        void build_index()
+        {
+            if(m_input.size() >= std::numeric_limits<uint32>::max())
+            {
+                return;
+            }
+            m_index.resize(m_input.size() / 4 + simd::block_size);
+            std::size_t written = 0;
+
+            _internal::escape_scanner escapes;
+            uint64 string_carry = 0;
+            uint64 scalar_carry = 0;
+            for(std::size_t offset = 0; offset < m_input.size(); offset += simd::block_size)
+            {
+                const std::size_t available = m_input.size() - offset;
+                // The last block is padded out with whitespace, which never produces a structural
+                const simd::block64 block = available >= simd::block_size
+                                                ? simd::block64(m_input.data() + offset)
+                                                : simd::block64(simd::padded_block(m_input.data() + offset, available, ' ').data());
+
+                const uint64 escaped = escapes.next(block.eq('\\'));
+                const uint64 quotes = block.eq('"') & ~escaped;
+                // Opening quotes are inside, closing quotes are outside
+                const uint64 in_string = simd::prefix_xor(quotes) ^ string_carry;
+                string_carry = static_cast<uint64>(static_cast<int64>(in_string) >> 63);
+                const uint64 string_tail = in_string ^ quotes;
+
+                const uint64 operators = block.eq('{') | block.eq('}') | block.eq('[') | block.eq(']') |
+                                         block.eq(':') | block.eq(',');
+                const uint64 whitespace = block.le(' ');
+                // Bytes of a number or literal.  Their first byte is structural too, so we can find where they start.
+                const uint64 scalar = ~operators & ~whitespace & ~quotes & ~in_string & ~string_tail;
+                const uint64 scalar_starts = scalar & ~((scalar << 1) | scalar_carry);
+                scalar_carry = scalar >> 63;
+
+                const uint64 structurals = ((operators | scalar_starts) & ~in_string & ~string_tail) |
+                                           (quotes & in_string);
+                // Make sure there's room for a whole block's worth, then write without checking the capacity
+                if(m_index.size() < written + simd::block_size)
+                {
+                    m_index.resize(std::max(m_index.size() * 2, written + simd::block_size));
+                }
+                uint32* out = m_index.data() + written;
+                simd::for_each_bit(structurals, [&](uint32 bit) { *out++ = static_cast<uint32>(offset + bit); });
+                written = static_cast<std::size_t>(out - m_index.data());
+            }
+            m_index.resize(written);
+
+            if(string_carry != 0 || m_index.empty())
+            {
+                return;
+            }
+            match_brackets();
+        }
+
+        // Stage two.  Pairs up every { and [ with its closer, so containers can be skipped without walking them, then
+        // checks the rest of the structure.
+        void match_brackets()
+        {
+            m_match.assign(m_index.size(), 0);
+            std::vector<uint32> open;
+            for(uint32 i = 0; i < m_index.size(); i++)
+            {
+                const char c = m_input[m_index[i]];
+                if(c == '{' || c == '[')
+                {
+                    open.push_back(i);
+                }
+                else if(c == '}' || c == ']')
+                {
+                    if(open.empty() || m_input[m_index[open.back()]] != (c == '}' ? '{' : '['))
+                    {
+                        return;
+                    }
+                    m_match[open.back()] = i;
+                    open.pop_back();
+                }
+            }
+            m_valid = open.empty() && well_formed();
+        }
+
+        // Every object member is a string, a colon and a value, every element a value, with commas between them and
+        // nothing after the top level value.  Iterating relies on this to step from key to value.
+        [[nodiscard]] bool well_formed() const
+        {
+            enum class expecting
+            {
+                value,
+                value_or_close,
+                key,
+                key_or_close,
+                colon,
+                comma_or_close,
+                nothing,
+            };
+            std::vector<char> containers;
+            expecting next = expecting::value;
+            auto after_value = [&] { next = containers.empty() ? expecting::nothing : expecting::comma_or_close; };
+            for(const uint32 offset : m_index)
+            {
+                const char c = m_input[offset];
+                switch(next)
+                {
+                    case expecting::value_or_close:
+                    case expecting::value:
+                        if(c == ']' && next == expecting::value_or_close)
+                        {
+                            containers.pop_back();
+                            after_value();
+                        }
+                        else if(c == '{' || c == '[')
+                        {
+                            containers.push_back(c);
+                            next = c == '{' ? expecting::key_or_close : expecting::value_or_close;
+                        }
+                        else if(c == '}' || c == ']' || c == ':' || c == ',')
+                        {
+                            return false;
+                        }
+                        else
+                        {
+                            after_value();
+                        }
+                        break;
+                    case expecting::key_or_close:
+                    case expecting::key:
+                        if(c == '}' && next == expecting::key_or_close)
+                        {
+                            containers.pop_back();
+                            after_value();
+                        }
+                        else if(c == '"')
+                        {
+                            next = expecting::colon;
+                        }
+                        else
+                        {
+                            return false;
+                        }
+                        break;
+                    case expecting::colon:
+                        if(c != ':')
+                        {
+                            return false;
+                        }
+                        next = expecting::value;
+                        break;
+                    case expecting::comma_or_close:
+                        if(c == ',')
+                        {
+                            next = containers.back() == '{' ? expecting::key : expecting::value;
+                        }
+                        else if(c == (containers.back() == '{' ? '}' : ']'))
+                        {
+                            containers.pop_back();
+                            after_value();
+                        }
+                        else
+                        {
+                            return false;
+                        }
+                        break;
+                    case expecting::nothing: return false;
+                }
+            }
+            return next == expecting::nothing;
+        }
+
+        // Index of whatever comes after the value at position
+        [[nodiscard]] uint32 skip(uint32 position) const noexcept
+        {
+            if(position >= m_index.size())
+            {
+                return position;
+            }
+            const char c = m_input[m_index[position]];
+            return (c == '{' || c == '[') ? m_match[position] + 1 : position + 1;
+        }
+
+        [[nodiscard]] char char_at(uint32 position) const noexcept
+        {
+            return position < m_index.size() ? m_input[m_index[position]] : '\0';
+        }
+
+        std::string m_storage;
+        std::string_view m_input;
+        std::vector<uint32> m_index;
+        std::vector<uint32> m_match;
+        bool m_valid = false;
+    };
+
+    inline char value::first_char() const noexcept
+    {
+        return m_document != nullptr ? m_document->char_at(m_position) : '\0';
+    }
+
+    inline json_type value::type() const noexcept
+    {
+        switch(first_char())
+        {
+            case '\0': return json_type::invalid;
+            case '{': return json_type::object;
+            case '[': return json_type::array;
+            case '"': return json_type::string;
+            // Anything else starting with these letters is a typo, not a number
+            case 't': return raw() == "true" ? json_type::boolean : json_type::invalid;
+            case 'f': return raw() == "false" ? json_type::boolean : json_type::invalid;
+            case 'n': return raw() == "null" ? json_type::null : json_type::invalid;
+            case '}':
+            case ']':
+            case ':':
+            case ',': return json_type::invalid;
+            default: return json_type::number;
+        }
+    }
+
+    inline std::string_view value::raw() const noexcept
+    {
+        if(m_document == nullptr)
+        {
+            return {};
+        }
+        const std::string_view input = m_document->m_input;
+        const uint32 begin = m_document->m_index[m_position];
+        // Everything up to the next structural, minus the whitespace in between
+        const uint32 after = m_document->skip(m_position);
+        std::size_t end = after < m_document->m_index.size() ? m_document->m_index[after] : input.size();
+        while(end > begin && _internal::is_whitespace(input[end - 1]))
+        {
+            end--;
+        }
+        return input.substr(begin, end - begin);
+    }
+
+    inline std::string_view value::raw_string() const noexcept
+    {
+        if(!is_string())
+        {
+            return {};
+        }
+        std::string_view text = raw();
+        text.remove_prefix(1);
+        if(text.ends_with('"'))
+        {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    inline value value::operator[](std::string_view key) const noexcept
+    {
+        for(auto [name, found] : fields())
+        {
+            if(name == key)
+            {
+                return found;
+            }
+        }
+        return {};
+    }
+
+    inline value value::operator[](std::size_t index) const noexcept
+    {
+        for(json::value element : elements())
+        {
+            if(index-- == 0)
+            {
+                return element;
+            }
+        }
+        return {};
+    }
+
+    inline std::size_t value::size() const noexcept
+    {
+        std::size_t count = 0;
+        if(is_object())
+        {
+            for(auto it = fields().begin(), end = fields().end(); it != end; ++it)
+            {
+                count++;
+            }
+        }
+        else if(is_array())
+        {
+            for(auto it = elements().begin(), end = elements().end(); it != end; ++it)
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    inline field value::iterator::operator*() const noexcept
+    {
+        // Objects are laid out in the index as "key" : value
+        const json::value key(m_document, m_position);
+        return {key.raw_string(), json::value(m_document, m_position + 2)};
+    }
+
+    inline value::iterator& value::iterator::operator++() noexcept
+    {
+        // Step over the value (and the key and colon in an object), then the comma if there is one
+        const uint32 element = m_fields ? m_position + 2 : m_position;
+        uint32 next = m_document->skip(element);
+        if(m_document->char_at(next) == ',')
+        {
+            next++;
+        }
+        m_position = next;
+        return *this;
+    }
+
+    inline value::range<value::element_iterator> value::elements() const noexcept
+    {
+        if(!is_array())
+        {
+            return {};
+        }
+        const uint32 close = m_document->m_match[m_position];
+        return {element_iterator(m_document, m_position + 1, false), element_iterator(m_document, close, false)};
+    }
+
+    inline value::range<value::field_iterator> value::fields() const noexcept
+    {
+        if(!is_object())
+        {
+            return {};
+        }
+        const uint32 close = m_document->m_match[m_position];
+        return {field_iterator(m_document, m_position + 1, true), field_iterator(m_document, close, true)};
+    }
+}
@@ -0,0 +1,212 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/parse.hpp"
+#include "core/string.hpp"
+#include "core/types.hpp"
+
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace raoe::stream
+{
+    // Reads a stream (or a buffer) a large block at a time and hands out each line as a std::string_view into its own
+    // buffer.  Nothing is copied per line, so it's a lot faster than std::getline for big files.
+    //
+    // The views returned by next() are only valid until the next call to next().  Copy them if you need them longer.
+    //
+    // Lines that straddle two blocks are moved to the front of the buffer before the next block is read, and the
+    // buffer grows if a single line is bigger than a whole block.  A trailing \r is stripped when splitting on \n, so
+    // CRLF files work.
+    class line_reader
+    {
+      public:
+        static constexpr std::size_t default_block_size = 1 << 20;
+
+        explicit line_reader(std::istream& from, char delimiter = '\n', std::size_t block_size = default_block_size)
+            : m_stream(from.rdbuf())
+            , m_delimiter(delimiter)
+            , m_storage(block_size > 0 ? block_size : default_block_size)
+        {
+        }
+
+        // Reads lines out of memory you already have.  No buffer is allocated and the views point into buffer.
+        explicit line_reader(std::string_view buffer, char delimiter = '\n')
+            : m_delimiter(delimiter)
+            , m_data(buffer.data())
+            , m_end(buffer.size())
+        {
+        }
+
+        line_reader(const line_reader&) = delete;
+        line_reader& operator=(const line_reader&) = delete;
+
+        // Gets the next line, without the delimiter.  Returns false once the input is exhausted.
+        bool next(std::string_view& line)
+        {
+            while(true)
+            {
+                const char* begin = m_data + m_cursor;
+                const std::size_t available = m_end - m_cursor;
+                // memchr is the libc's vectorized scan, which beats anything we'd write by hand
+                const void* found = available > 0 ? std::memchr(begin, m_delimiter, available) : nullptr;
+                if(found != nullptr)
+                {
+                    const std::size_t length = static_cast<std::size_t>(static_cast<const char*>(found) - begin);
+                    m_cursor += length + 1;
+                    line = strip(std::string_view(begin, length));
+                    m_line_number++;
+                    return true;
+                }
+
+                if(!refill())
+                {
+                    // Out of input.  Whatever is left is the last line, which didn't end with a delimiter.
+                    if(m_cursor < m_end)
+                    {
+                        line = strip(std::string_view(m_data + m_cursor, m_end - m_cursor));
+                        m_cursor = m_end;
+                        m_line_number++;
+                        return true;
+                    }
+                    return false;
+                }
+            }
+        }
+
+        // Number of lines returned so far
+        [[nodiscard]] std::size_t line_number() const noexcept { return m_line_number; }
+
+        // Splits a line with the same rules as raoe::core::parse::parse_split (whitespace separated, quotes group).
+        // The returned span is reused by the next call to tokens() or fields().
+        std::span<const std::string_view> tokens(std::string_view line)
+        {
+            m_tokens.clear();
+            raoe::core::parse::parse_split(line, std::back_inserter(m_tokens));
+            return m_tokens;
+        }
+
+        // Splits a line on a single character, keeping empty fields.
+        // The returned span is reused by the next call to tokens() or fields().
+        std::span<const std::string_view> fields(std::string_view line, char delimiter)
+        {
+            m_tokens.clear();
+            raoe::string::split(line, delimiter, std::back_inserter(m_tokens));
+            return m_tokens;
+        }
+
+        class iterator
+        {
+          public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::string_view*;
+            using reference = const std::string_view&;
+
+            iterator() = default;
+            explicit iterator(line_reader* reader)
+                : m_reader(reader)
+            {
+                ++(*this);
+            }
+
+            reference operator*() const { return m_line; }
+            pointer operator->() const { return &m_line; }
+
+            iterator& operator++()
+            {
+                if(m_reader != nullptr && !m_reader->next(m_line))
+                {
+                    m_reader = nullptr;
+                }
+                return *this;
+            }
+
+            void operator++(int) { ++(*this); }
+
+            bool operator==(std::default_sentinel_t) const { return m_reader == nullptr; }
+
+          private:
+            line_reader* m_reader = nullptr;
+            std::string_view m_line;
+        };
+
+        // for(std::string_view line : reader) { ... }
+        iterator begin() { return iterator(this); }
+        std::default_sentinel_t end() { return std::default_sentinel; }
+
+      private:
+        std::string_view strip(std::string_view line) const
+        {
+            if(m_delimiter == '\n' && line.ends_with('\r'))
+            {
+                line.remove_suffix(1);
+            }
+            return line;
+        }
+
+        // Moves the unfinished line to the front of the buffer and reads another block after it.
+        // Returns false if nothing more could be read.
+        bool refill()
+        {
+            if(m_stream == nullptr || m_eof)
+            {
+                return false;
+            }
+
+            const std::size_t partial = m_end - m_cursor;
+            if(partial > 0 && m_cursor > 0)
+            {
+                std::memmove(m_storage.data(), m_storage.data() + m_cursor, partial);
+            }
+            m_cursor = 0;
+            m_end = partial;
+
+            // One line is bigger than a whole block
+            if(m_end == m_storage.size())
+            {
+                m_storage.resize(m_storage.size() * 2);
+            }
+
+            const std::streamsize read = m_stream->sgetn(m_storage.data() + m_end,
+                                                         static_cast<std::streamsize>(m_storage.size() - m_end));
+            m_data = m_storage.data();
+            if(read <= 0)
+            {
+                m_eof = true;
+                return false;
+            }
+            m_end += static_cast<std::size_t>(read);
+            return true;
+        }
+
+        std::streambuf* m_stream = nullptr;
+        char m_delimiter = '\n';
+        std::vector<char> m_storage;
+        const char* m_data = nullptr;
+        std::size_t m_cursor = 0;
+        std::size_t m_end = 0;
+        std::size_t m_line_number = 0;
+        bool m_eof = false;
+        std::vector<std::string_view> m_tokens;
+    };
+}
@@ -0,0 +1,556 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/check.hpp"
+#include "core/concurrent_map.hpp"
+#include "core/function.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Loads a pile of assets that depend on each other, as parallel as the dependencies allow.
+//
+// Every asset is a key (a tag, or a path's string_view) with the keys it depends on, a read stage and a decode stage.
+// Reads run on a few I/O threads and decodes on a worker per core.  An asset can be read as soon as everything it
+// depends on has been read, and decoded once everything it depends on has been decoded, so a material's file is read
+// while its textures are still decoding.  Assets that lots of others depend on (and long chains) go first.
+//
+// Adding the same key twice gives back the first one, so shared dependencies load once; a key that's only ever
+// depended on and never added fails.  If a stage fails, everything that depends on it is cancelled, and cancel() does
+// the same for everything still to do.  Bytes that have been read but not decoded count against max_bytes_in_flight,
+// and reads wait while it's full.
+//     raoe::load_graph graph;
+//     graph.add("game:grass", {}, read_file, decode_texture);
+//     graph.add("game:lawn", {"game:grass"}, read_file, decode_material);
+//     const auto report = graph.run();
+namespace raoe
+{
+    class load_graph
+    {
+      public:
+        using node_id = uint32;
+        // The asset's bytes, or nullopt if it couldn't be read.  Runs on an I/O thread.
+        using read_function = function<std::optional<std::vector<std::byte>>(std::string_view key), 48>;
+        // Turns the bytes into the asset (keeping it wherever it belongs), or returns false.  Runs on a worker.
+        using decode_function = function<bool(std::string_view key, std::vector<std::byte> data), 48>;
+
+        enum class state : uint8
+        {
+            pending,
+            reading,
+            read,
+            decoding,
+            loaded,
+            failed,
+            cancelled,
+        };
+
+        struct options
+        {
+            uint32 io_threads = 4;
+            // 0 for one per core
+            uint32 decode_threads = 0;
+            std::size_t max_bytes_in_flight = std::size_t {256} << 20;
+        };
+
+        struct report
+        {
+            std::size_t loaded = 0;
+            std::size_t failed = 0;
+            std::size_t cancelled = 0;
+            std::chrono::nanoseconds wall {};
+            // The chain of dependencies with the most read and decode time in it, first to last.  No amount of
+            // threads gets the wall time under its length.
+            std::vector<std::string> critical_path;
+            std::chrono::nanoseconds critical_path_time {};
+            // Time spent inside the stages, over all threads
+            std::chrono::nanoseconds read_time {};
+            std::chrono::nanoseconds decode_time {};
+            std::size_t peak_bytes_in_flight = 0;
+        };
+
+        load_graph() = default;
+        explicit load_graph(options opts)
+            : m_options(opts)
+        {
+        }
+
+        load_graph(const load_graph&) = delete;
+        load_graph& operator=(const load_graph&) = delete;
+
+        node_id add(std::string_view key, std::span<const std::string_view> dependencies, read_function read,
+                    decode_function decode)
+        {
+            check_if(!m_ran, "load_graph: can't add to a graph that's already run");
+            const node_id id = node_for(key);
+            if(m_nodes[id].defined)
+            {
+                return id;
+            }
+            m_nodes[id].defined = true;
+            m_nodes[id].read = std::move(read);
+            m_nodes[id].decode = std::move(decode);
+            std::vector<node_id> deps;
+            for(std::string_view dependency : dependencies)
+            {
+                deps.push_back(node_for(dependency));
+            }
+            std::ranges::sort(deps);
+            deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+            for(node_id dep : deps)
+            {
+                m_nodes[dep].dependents.push_back(id);
+            }
+            m_nodes[id].dependencies = std::move(deps);
+            return id;
+        }
+
+        node_id add(std::string_view key, std::initializer_list<std::string_view> dependencies, read_function read,
+                    decode_function decode)
+        {
+            return add(key, std::span(dependencies.begin(), dependencies.size()), std::move(read), std::move(decode));
+        }
+
+        [[nodiscard]] std::optional<node_id> find(std::string_view key) const
+        {
+            const auto it = m_ids.find(key);
+            return it != m_ids.end() ? std::optional(it->second) : std::nullopt;
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_nodes.size(); }
+        [[nodiscard]] std::string_view key(node_id id) const { return m_nodes[id].key; }
+
+        [[nodiscard]] state state_of(node_id id) const
+        {
+            std::scoped_lock lock(m_mutex);
+            return m_nodes[id].current;
+        }
+
+        // Loads everything and returns when it's all loaded, failed or cancelled.  A graph only runs once.
+        report run()
+        {
+            check_if(!m_ran, "load_graph: already ran");
+            m_ran = true;
+            const auto start = clock::now();
+            {
+                std::unique_lock lock(m_mutex);
+                prepare();
+            }
+
+            const uint32 decode_threads = m_options.decode_threads != 0
+                                              ? m_options.decode_threads
+                                              : std::max(1u, std::thread::hardware_concurrency());
+            {
+                std::vector<std::jthread> threads;
+                for(uint32 i = 0; i < std::max(1u, m_options.io_threads); i++)
+                {
+                    threads.emplace_back([this] { io_loop(); });
+                }
+                for(uint32 i = 0; i < decode_threads; i++)
+                {
+                    threads.emplace_back([this] { decode_loop(); });
+                }
+            }
+
+            report result = summarize();
+            result.wall = clock::now() - start;
+            return result;
+        }
+
+        // Stops starting anything new; whatever's mid read or decode finishes, and the rest is cancelled.  Safe from
+        // any thread, including from inside a stage.
+        void cancel()
+        {
+            std::scoped_lock lock(m_mutex);
+            m_cancelled = true;
+            m_io_wake.notify_all();
+            m_decode_wake.notify_all();
+        }
+
+      private:
+        using clock = std::chrono::steady_clock;
+
+        struct node
+        {
+            std::string key;
+            std::vector<node_id> dependencies;
+            std::vector<node_id> dependents;
+            read_function read;
+            decode_function decode;
+            bool defined = false;
+
+            state current = state::pending;
+            // Something it depends on failed while it was being read
+            bool cancel_when_read = false;
+            // Dependencies not yet read, and not yet loaded
+            uint32 unread = 0;
+            uint32 unloaded = 0;
+            // Longest chain of dependents waiting on this one; longer goes first
+            uint32 priority = 0;
+            std::vector<std::byte> data;
+            clock::duration read_time {};
+            clock::duration decode_time {};
+        };
+
+        struct by_priority
+        {
+            const std::vector<node>* nodes;
+            bool operator()(node_id lhs, node_id rhs) const
+            {
+                return (*nodes)[lhs].priority < (*nodes)[rhs].priority;
+            }
+        };
+        using ready_queue = std::priority_queue<node_id, std::vector<node_id>, by_priority>;
+
+        node_id node_for(std::string_view key)
+        {
+            const auto [it, added] = m_ids.try_emplace(std::string(key), static_cast<node_id>(m_nodes.size()));
+            if(added)
+            {
+                check_if(m_nodes.size() < ~node_id {0}, "load_graph: too many assets");
+                m_nodes.emplace_back().key = key;
+            }
+            return it->second;
+        }
+
+        // Orders the graph, fails what can't load (undefined, or in a cycle) and queues everything with nothing to
+        // wait for
+        void prepare()
+        {
+            std::vector<node_id> order;
+            order.reserve(m_nodes.size());
+            std::vector<uint32> waiting(m_nodes.size());
+            for(node_id id = 0; id < m_nodes.size(); id++)
+            {
+                node& n = m_nodes[id];
+                n.unread = n.unloaded = waiting[id] = static_cast<uint32>(n.dependencies.size());
+                if(waiting[id] == 0)
+                {
+                    order.push_back(id);
+                }
+            }
+            for(std::size_t i = 0; i < order.size(); i++)
+            {
+                for(node_id dependent : m_nodes[order[i]].dependents)
+                {
+                    if(--waiting[dependent] == 0)
+                    {
+                        order.push_back(dependent);
+                    }
+                }
+            }
+            for(auto it = order.rbegin(); it != order.rend(); ++it)
+            {
+                node& n = m_nodes[*it];
+                for(node_id dependent : n.dependents)
+                {
+                    n.priority = std::max(n.priority, m_nodes[dependent].priority + 1);
+                }
+            }
+
+            m_io_queue = ready_queue(by_priority {&m_nodes});
+            m_decode_queue = ready_queue(by_priority {&m_nodes});
+            m_finished = 0;
+            m_in_flight = m_peak_in_flight = 0;
+            for(node_id id = 0; id < m_nodes.size(); id++)
+            {
+                // Cycles never get down to nothing to wait for
+                if(!m_nodes[id].defined || waiting[id] != 0)
+                {
+                    finish(id, state::failed);
+                }
+                else if(m_nodes[id].dependencies.empty())
+                {
+                    m_io_queue.push(id);
+                }
+            }
+        }
+
+        void io_loop()
+        {
+            std::unique_lock lock(m_mutex);
+            while(true)
+            {
+                // An empty pipeline always gets to read one, however big
+                m_io_wake.wait(lock, [&] {
+                    return done() || (!m_io_queue.empty() &&
+                                      (m_cancelled || m_in_flight < m_options.max_bytes_in_flight || m_in_flight == 0));
+                });
+                if(done())
+                {
+                    return;
+                }
+                const node_id id = m_io_queue.top();
+                m_io_queue.pop();
+                node& n = m_nodes[id];
+                // Cancelled while it sat in the queue
+                if(n.current != state::pending)
+                {
+                    continue;
+                }
+                if(m_cancelled)
+                {
+                    finish(id, state::cancelled);
+                    continue;
+                }
+
+                n.current = state::reading;
+                lock.unlock();
+                const auto start = clock::now();
+                std::optional<std::vector<std::byte>> data = n.read(n.key);
+                const auto time = clock::now() - start;
+                lock.lock();
+
+                n.read_time = time;
+                if(m_cancelled || n.cancel_when_read)
+                {
+                    finish(id, state::cancelled);
+                    continue;
+                }
+                if(!data)
+                {
+                    finish(id, state::failed);
+                    continue;
+                }
+                n.data = std::move(*data);
+                n.current = state::read;
+                m_in_flight += n.data.size();
+                m_peak_in_flight = std::max(m_peak_in_flight, m_in_flight);
+                for(node_id dependent : n.dependents)
+                {
+                    if(--m_nodes[dependent].unread == 0 && m_nodes[dependent].current == state::pending)
+                    {
+                        m_io_queue.push(dependent);
+                        m_io_wake.notify_one();
+                    }
+                }
+                if(n.unloaded == 0)
+                {
+                    m_decode_queue.push(id);
+                    m_decode_wake.notify_one();
+                }
+            }
+        }
+
+        void decode_loop()
+        {
+            std::unique_lock lock(m_mutex);
+            while(true)
+            {
+                m_decode_wake.wait(lock, [&] { return done() || !m_decode_queue.empty(); });
+                if(done())
+                {
+                    return;
+                }
+                const node_id id = m_decode_queue.top();
+                m_decode_queue.pop();
+                node& n = m_nodes[id];
+                if(n.current != state::read)
+                {
+                    continue;
+                }
+                if(m_cancelled)
+                {
+                    finish(id, state::cancelled);
+                    continue;
+                }
+
+                n.current = state::decoding;
+                const std::size_t bytes = n.data.size();
+                std::vector<std::byte> data = std::move(n.data);
+                lock.unlock();
+                const auto start = clock::now();
+                const bool loaded = n.decode(n.key, std::move(data));
+                const auto time = clock::now() - start;
+                lock.lock();
+
+                n.decode_time = time;
+                m_in_flight -= bytes;
+                m_io_wake.notify_all();
+                if(!loaded)
+                {
+                    finish(id, state::failed);
+                    continue;
+                }
+                finish(id, state::loaded);
+                for(node_id dependent : n.dependents)
+                {
+                    node& d = m_nodes[dependent];
+                    if(--d.unloaded == 0 && d.current == state::read)
+                    {
+                        m_decode_queue.push(dependent);
+                        m_decode_wake.notify_one();
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] static bool ended(state s) noexcept
+        {
+            return s == state::loaded || s == state::failed || s == state::cancelled;
+        }
+
+        // Records how id ended up; anything that didn't load takes everything depending on it down too
+        void finish(node_id id, state how)
+        {
+            std::vector<node_id> stack;
+            std::size_t released = 0;
+            auto end = [&](node_id which, state with) {
+                node& n = m_nodes[which];
+                if(ended(n.current))
+                {
+                    return;
+                }
+                released += n.data.size();
+                m_in_flight -= n.data.size();
+                n.data = {};
+                n.current = with;
+                m_finished++;
+                if(with != state::loaded)
+                {
+                    stack.push_back(which);
+                }
+            };
+
+            end(id, how);
+            while(!stack.empty())
+            {
+                const node_id top = stack.back();
+                stack.pop_back();
+                for(node_id dependent : m_nodes[top].dependents)
+                {
+                    node& d = m_nodes[dependent];
+                    if(d.current == state::reading)
+                    {
+                        // Its reader ends it when the read comes back; what depends on it can go now
+                        if(!std::exchange(d.cancel_when_read, true))
+                        {
+                            stack.push_back(dependent);
+                        }
+                    }
+                    else
+                    {
+                        end(dependent, state::cancelled);
+                    }
+                }
+            }
+            if(done())
+            {
+                m_io_wake.notify_all();
+                m_decode_wake.notify_all();
+            }
+            else if(released > 0)
+            {
+                m_io_wake.notify_all();
+            }
+        }
+
+        [[nodiscard]] bool done() const noexcept { return m_finished == m_nodes.size(); }
+
+        [[nodiscard]] report summarize() const
+        {
+            report result;
+            result.peak_bytes_in_flight = m_peak_in_flight;
+            // The longest chain (by time in the stages) ending at each node, walked in dependency order like prepare()
+            std::vector<clock::duration> chain(m_nodes.size());
+            std::vector<node_id> previous(m_nodes.size(), ~node_id {0});
+            std::vector<uint32> waiting(m_nodes.size());
+            std::vector<node_id> order;
+            for(node_id id = 0; id < m_nodes.size(); id++)
+            {
+                const node& n = m_nodes[id];
+                switch(n.current)
+                {
+                    case state::loaded: result.loaded++; break;
+                    case state::failed: result.failed++; break;
+                    default: result.cancelled++; break;
+                }
+                result.read_time += n.read_time;
+                result.decode_time += n.decode_time;
+                waiting[id] = static_cast<uint32>(n.dependencies.size());
+                if(waiting[id] == 0)
+                {
+                    order.push_back(id);
+                }
+            }
+            node_id last = ~node_id {0};
+            for(std::size_t i = 0; i < order.size(); i++)
+            {
+                const node_id id = order[i];
+                const node& n = m_nodes[id];
+                chain[id] += n.read_time + n.decode_time;
+                if(last == ~node_id {0} || chain[id] > chain[last])
+                {
+                    last = id;
+                }
+                for(node_id dependent : n.dependents)
+                {
+                    if(chain[id] > chain[dependent])
+                    {
+                        chain[dependent] = chain[id];
+                        previous[dependent] = id;
+                    }
+                    if(--waiting[dependent] == 0)
+                    {
+                        order.push_back(dependent);
+                    }
+                }
+            }
+            if(last != ~node_id {0})
+            {
+                result.critical_path_time = chain[last];
+                for(node_id id = last; id != ~node_id {0}; id = previous[id])
+                {
+                    result.critical_path.push_back(m_nodes[id].key);
+                }
+                std::ranges::reverse(result.critical_path);
+            }
+            return result;
+        }
+
+        options m_options;
+        std::vector<node> m_nodes;
+        std::unordered_map<std::string, node_id, _internal::transparent_hash<std::string>,
+                           _internal::transparent_equal<std::string>>
+            m_ids;
+        bool m_ran = false;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_io_wake;
+        std::condition_variable m_decode_wake;
+        ready_queue m_io_queue {by_priority {&m_nodes}};
+        ready_queue m_decode_queue {by_priority {&m_nodes}};
+        std::size_t m_finished = 0;
+        std::size_t m_in_flight = 0;
+        std::size_t m_peak_in_flight = 0;
+        bool m_cancelled = false;
+    };
+}
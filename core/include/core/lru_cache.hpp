@@ -0,0 +1,772 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/concurrent_map.hpp"
+#include "core/sync.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A bounded cache: keeps the most useful entries under a budget and evicts the rest.
+//
+// Entries live in one slab (a vector of nodes, recycled through a free list) and are linked into the eviction queues
+// by index, and the lookup index is an open addressed table of node indices, so an insert doesn't allocate once the
+// cache has warmed up.  The budget is in whatever the cost function returns: the default counts entries, or pass
+// something like [](const auto&, const auto& image) { return image.bytes.size(); } for a byte budget.
+//     raoe::lru_cache<raoe::tag, parsed_config> configs(64);
+//     if(auto* config = configs.find(name)) ...
+//
+// cache_policy::lru is plain least recently used.  cache_policy::s3fifo is S3-FIFO (Yang et al. 2023): new entries go
+// in a small FIFO and only move to the main one if they're hit again before they fall out, so a one-off scan over a
+// pile of assets can't flush everything that's actually hot.  It usually has a better hit rate than LRU as well.
+//
+// lru_cache isn't thread safe (even find() moves things around); concurrent_lru_cache shards one behind locks.
+namespace raoe
+{
+    enum class cache_policy : uint8
+    {
+        lru,
+        s3fifo,
+    };
+
+    struct cache_stats
+    {
+        uint64 hits = 0;
+        uint64 misses = 0;
+        uint64 insertions = 0;
+        uint64 evictions = 0;
+
+        [[nodiscard]] double hit_rate() const noexcept
+        {
+            return hits + misses == 0 ? 0 : static_cast<double>(hits) / static_cast<double>(hits + misses);
+        }
+
+        cache_stats& operator+=(const cache_stats& other) noexcept
+        {
+            hits += other.hits;
+            misses += other.misses;
+            insertions += other.insertions;
+            evictions += other.evictions;
+            return *this;
+        }
+    };
+
+    namespace _internal
+    {
+        struct unit_cost
+        {
+            template <typename K, typename V>
+            std::size_t operator()(const K&, const V&) const noexcept
+            {
+                return 1;
+            }
+        };
+
+        inline constexpr uint32 no_node = std::numeric_limits<uint32>::max();
+
+        // Hash -> node index, linear probing.  Erasing shifts the following entries back instead of leaving
+        // tombstones, so lookups never get slower as entries churn.
+        class cache_index
+        {
+            struct slot
+            {
+                uint64 hash = 0;
+                uint32 id = no_node;
+            };
+
+          public:
+            template <typename TMatch>
+            [[nodiscard]] uint32 find(uint64 hash, TMatch&& match) const
+            {
+                if(m_slots.empty())
+                {
+                    return no_node;
+                }
+                for(std::size_t i = bucket(hash);; i = (i + 1) & m_mask)
+                {
+                    const slot& s = m_slots[i];
+                    if(s.id == no_node)
+                    {
+                        return no_node;
+                    }
+                    if(s.hash == hash && match(s.id))
+                    {
+                        return s.id;
+                    }
+                }
+            }
+
+            void insert(uint64 hash, uint32 id)
+            {
+                if((m_size + 1) * 2 > m_slots.size())
+                {
+                    rehash(std::max<std::size_t>(16, m_slots.size() * 2));
+                }
+                place(hash, id);
+                m_size++;
+            }
+
+            void erase(uint64 hash, uint32 id) noexcept
+            {
+                std::size_t hole = bucket(hash);
+                while(m_slots[hole].id != id)
+                {
+                    hole = (hole + 1) & m_mask;
+                }
+                for(std::size_t i = (hole + 1) & m_mask; m_slots[i].id != no_node; i = (i + 1) & m_mask)
+                {
+                    // It can fill the hole if the hole is between its home bucket and where it is now
+                    const std::size_t home = bucket(m_slots[i].hash);
+                    if(((i - home) & m_mask) >= ((i - hole) & m_mask))
+                    {
+                        m_slots[hole] = m_slots[i];
+                        hole = i;
+                    }
+                }
+                m_slots[hole].id = no_node;
+                m_size--;
+            }
+
+            void clear() noexcept
+            {
+                std::fill(m_slots.begin(), m_slots.end(), slot {});
+                m_size = 0;
+            }
+
+            [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+          private:
+            [[nodiscard]] std::size_t bucket(uint64 hash) const noexcept
+            {
+                return static_cast<std::size_t>(distribute(hash)) & m_mask;
+            }
+
+            void place(uint64 hash, uint32 id) noexcept
+            {
+                std::size_t i = bucket(hash);
+                while(m_slots[i].id != no_node)
+                {
+                    i = (i + 1) & m_mask;
+                }
+                m_slots[i] = {hash, id};
+            }
+
+            void rehash(std::size_t count)
+            {
+                std::vector<slot> old = std::exchange(m_slots, std::vector<slot>(count));
+                m_mask = count - 1;
+                for(const slot& s : old)
+                {
+                    if(s.id != no_node)
+                    {
+                        place(s.hash, s.id);
+                    }
+                }
+            }
+
+            std::vector<slot> m_slots;
+            std::size_t m_mask = 0;
+            std::size_t m_size = 0;
+        };
+
+        // The hashes of entries S3-FIFO recently evicted from its small queue, oldest overwritten first.  Hash
+        // collisions just mean the odd entry skips the small queue, which is harmless.
+        class ghost_queue
+        {
+          public:
+            [[nodiscard]] bool take(uint64 hash) noexcept
+            {
+                const uint32 slot = m_index.find(hash, [](uint32) { return true; });
+                if(slot == no_node)
+                {
+                    return false;
+                }
+                m_index.erase(hash, slot);
+                m_ring[slot].second = false;
+                return true;
+            }
+
+            void add(uint64 hash, std::size_t capacity)
+            {
+                if(m_ring.size() < capacity)
+                {
+                    m_ring.resize(std::bit_ceil(capacity));
+                }
+                if(m_ring.empty())
+                {
+                    return;
+                }
+                const uint32 slot = static_cast<uint32>(m_next++ & (m_ring.size() - 1));
+                if(m_ring[slot].second)
+                {
+                    m_index.erase(m_ring[slot].first, slot);
+                }
+                m_ring[slot] = {hash, true};
+                m_index.insert(hash, slot);
+            }
+
+            void clear() noexcept
+            {
+                m_index.clear();
+                std::fill(m_ring.begin(), m_ring.end(), std::pair<uint64, bool> {});
+            }
+
+          private:
+            std::vector<std::pair<uint64, bool>> m_ring;
+            cache_index m_index;
+            uint64 m_next = 0;
+        };
+    }
+
+    template <typename K, typename V, cache_policy Policy = cache_policy::lru, typename Cost = _internal::unit_cost,
+              typename Hash = _internal::transparent_hash<K>, typename KeyEqual = _internal::transparent_equal<K>>
+    class lru_cache
+    {
+        static constexpr uint32 no_node = _internal::no_node;
+
+        template <typename Q>
+        static constexpr bool lookup_key =
+            std::same_as<std::remove_cvref_t<Q>, K> ||
+            (requires { typename Hash::is_transparent; typename KeyEqual::is_transparent; } &&
+             std::is_invocable_r_v<std::size_t, const Hash&, const Q&>);
+
+        // LRU only uses the first queue.  S3-FIFO: small, then main.
+        enum queue_id : uint8
+        {
+            small_queue = 0,
+            main_queue = 1,
+        };
+
+      public:
+        explicit lru_cache(std::size_t budget, Cost cost = {})
+            : m_budget(budget)
+            , m_cost_fn(std::move(cost))
+        {
+        }
+
+        lru_cache(lru_cache&&) noexcept = default;
+        lru_cache& operator=(lru_cache&&) noexcept = default;
+
+        // Counts as a use.  The pointer is good until the next insert or erase.
+        template <typename Q>
+            requires lookup_key<Q>
+        [[nodiscard]] V* find(const Q& key)
+        {
+            const uint32 id = lookup(key);
+            if(id == no_node)
+            {
+                m_stats.misses++;
+                return nullptr;
+            }
+            m_stats.hits++;
+            touch(id);
+            return &m_nodes[id].entry->second;
+        }
+
+        // Doesn't count as a use
+        template <typename Q>
+            requires lookup_key<Q>
+        [[nodiscard]] const V* peek(const Q& key) const
+        {
+            const uint32 id = lookup(key);
+            return id == no_node ? nullptr : &m_nodes[id].entry->second;
+        }
+
+        template <typename Q>
+            requires lookup_key<Q>
+        [[nodiscard]] bool contains(const Q& key) const
+        {
+            return lookup(key) != no_node;
+        }
+
+        // Inserts or replaces, evicting whatever it has to.  Returns null (and doesn't keep it) if the value costs
+        // more than the whole budget.
+        template <typename KArg, typename VArg>
+        V* insert_or_assign(KArg&& key, VArg&& value)
+        {
+            const uint64 hash = hash_of(key);
+            const uint32 existing = lookup(key, hash);
+            if(existing != no_node)
+            {
+                node& n = m_nodes[existing];
+                const std::size_t cost = m_cost_fn(n.entry->first, value);
+                if(cost > m_budget)
+                {
+                    remove(existing);
+                    return nullptr;
+                }
+                // Out of the queues while making room, so it can't evict itself
+                const uint8 queue = n.queue;
+                unlink(existing);
+                make_room(cost);
+                m_nodes[existing].entry->second = std::forward<VArg>(value);
+                m_nodes[existing].cost = cost;
+                link_front(existing, queue);
+                return &m_nodes[existing].entry->second;
+            }
+            return insert_new(hash, std::forward<KArg>(key), std::forward<VArg>(value));
+        }
+
+        // The cached value for key, or factory()'s result, cached.  Null if that costs more than the whole budget.
+        template <typename KArg, typename TFactory>
+            requires std::convertible_to<std::invoke_result_t<TFactory&>, V>
+        V* find_or_insert_with(KArg&& key, TFactory&& factory)
+        {
+            const uint64 hash = hash_of(key);
+            if(const uint32 id = lookup(key, hash); id != no_node)
+            {
+                m_stats.hits++;
+                touch(id);
+                return &m_nodes[id].entry->second;
+            }
+            m_stats.misses++;
+            return insert_new(hash, std::forward<KArg>(key), std::invoke(factory));
+        }
+
+        template <typename Q>
+            requires lookup_key<Q>
+        bool erase(const Q& key)
+        {
+            const uint32 id = lookup(key);
+            if(id == no_node)
+            {
+                return false;
+            }
+            remove(id);
+            return true;
+        }
+
+        void clear()
+        {
+            m_nodes.clear();
+            m_free = no_node;
+            m_index.clear();
+            m_ghosts.clear();
+            m_queues[0] = {};
+            m_queues[1] = {};
+            m_cost = 0;
+        }
+
+        // Evicts down to the new budget if it shrank
+        void set_budget(std::size_t budget)
+        {
+            m_budget = budget;
+            make_room(0);
+        }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_index.size(); }
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+        [[nodiscard]] std::size_t cost() const noexcept { return m_cost; }
+        [[nodiscard]] std::size_t budget() const noexcept { return m_budget; }
+        [[nodiscard]] const cache_stats& stats() const noexcept { return m_stats; }
+        void reset_stats() noexcept { m_stats = {}; }
+
+      private:
+        struct node
+        {
+            std::optional<std::pair<K, V>> entry;
+            uint64 hash = 0;
+            std::size_t cost = 0;
+            uint32 prev = no_node;
+            uint32 next = no_node; // also the free list
+            uint8 queue = small_queue;
+            uint8 freq = 0;
+        };
+
+        struct queue
+        {
+            uint32 head = no_node;
+            uint32 tail = no_node;
+            std::size_t cost = 0;
+        };
+
+        template <typename Q>
+        [[nodiscard]] static uint64 hash_of(const Q& key)
+        {
+            if constexpr(lookup_key<Q>)
+            {
+                return static_cast<uint64>(Hash {}(key));
+            }
+            else
+            {
+                return static_cast<uint64>(Hash {}(K(key)));
+            }
+        }
+
+        template <typename Q>
+        [[nodiscard]] uint32 lookup(const Q& key) const
+        {
+            return lookup(key, hash_of(key));
+        }
+
+        template <typename Q>
+        [[nodiscard]] uint32 lookup(const Q& key, uint64 hash) const
+        {
+            return m_index.find(hash, [&](uint32 id) {
+                if constexpr(lookup_key<Q>)
+                {
+                    return KeyEqual {}(m_nodes[id].entry->first, key);
+                }
+                else
+                {
+                    return KeyEqual {}(m_nodes[id].entry->first, K(key));
+                }
+            });
+        }
+
+        template <typename KArg, typename VArg>
+        V* insert_new(uint64 hash, KArg&& key, VArg&& value)
+        {
+            uint32 id = m_free;
+            if(id != no_node)
+            {
+                m_free = m_nodes[id].next;
+            }
+            else
+            {
+                id = static_cast<uint32>(m_nodes.size());
+                m_nodes.emplace_back();
+            }
+            node& n = m_nodes[id];
+            n.entry.emplace(std::piecewise_construct, std::forward_as_tuple(std::forward<KArg>(key)),
+                            std::forward_as_tuple(std::forward<VArg>(value)));
+            n.cost = m_cost_fn(n.entry->first, n.entry->second);
+            if(n.cost > m_budget)
+            {
+                n.entry.reset();
+                n.next = m_free;
+                m_free = id;
+                return nullptr;
+            }
+            n.hash = hash;
+            n.freq = 0;
+
+            // It isn't linked into a queue yet, so this can't pick it
+            make_room(n.cost);
+            m_index.insert(hash, id);
+            m_stats.insertions++;
+
+            // Something evicted from the small queue not long ago was wanted again, so it goes straight to main
+            const bool returning = Policy == cache_policy::s3fifo && m_ghosts.take(hash);
+            link_front(id, returning ? main_queue : small_queue);
+            return &m_nodes[id].entry->second;
+        }
+
+        void touch(uint32 id) noexcept
+        {
+            if constexpr(Policy == cache_policy::lru)
+            {
+                if(m_queues[small_queue].head != id)
+                {
+                    unlink(id);
+                    link_front(id, small_queue);
+                }
+            }
+            else
+            {
+                node& n = m_nodes[id];
+                n.freq = static_cast<uint8>(std::min(n.freq + 1, 3));
+            }
+        }
+
+        void make_room(std::size_t incoming)
+        {
+            while(m_cost + incoming > m_budget && !empty_queues())
+            {
+                evict_one();
+            }
+        }
+
+        [[nodiscard]] bool empty_queues() const noexcept
+        {
+            return m_queues[small_queue].tail == no_node && m_queues[main_queue].tail == no_node;
+        }
+
+        void evict_one()
+        {
+            if constexpr(Policy == cache_policy::lru)
+            {
+                evict(m_queues[small_queue].tail);
+            }
+            else
+            {
+                while(true)
+                {
+                    queue& small = m_queues[small_queue];
+                    queue& main = m_queues[main_queue];
+                    if(small.tail != no_node && (small.cost > m_budget / 10 || main.tail == no_node))
+                    {
+                        const uint32 id = small.tail;
+                        if(m_nodes[id].freq > 0)
+                        {
+                            // Hit while it was on probation: keep it
+                            unlink(id);
+                            m_nodes[id].freq = 0;
+                            link_front(id, main_queue);
+                            continue;
+                        }
+                        m_ghosts.add(m_nodes[id].hash, std::max<std::size_t>(size(), 64));
+                        evict(id);
+                        return;
+                    }
+
+                    // Main is a FIFO with second chances (CLOCK, more or less)
+                    const uint32 id = main.tail;
+                    if(m_nodes[id].freq > 0)
+                    {
+                        unlink(id);
+                        m_nodes[id].freq--;
+                        link_front(id, main_queue);
+                        continue;
+                    }
+                    evict(id);
+                    return;
+                }
+            }
+        }
+
+        void evict(uint32 id)
+        {
+            remove(id);
+            m_stats.evictions++;
+        }
+
+        void remove(uint32 id)
+        {
+            unlink(id);
+            node& n = m_nodes[id];
+            m_index.erase(n.hash, id);
+            n.entry.reset();
+            n.next = m_free;
+            m_free = id;
+        }
+
+        void link_front(uint32 id, uint8 queue_index) noexcept
+        {
+            node& n = m_nodes[id];
+            queue& q = m_queues[queue_index];
+            n.queue = queue_index;
+            n.prev = no_node;
+            n.next = q.head;
+            if(q.head != no_node)
+            {
+                m_nodes[q.head].prev = id;
+            }
+            else
+            {
+                q.tail = id;
+            }
+            q.head = id;
+            q.cost += n.cost;
+            m_cost += n.cost;
+        }
+
+        void unlink(uint32 id) noexcept
+        {
+            node& n = m_nodes[id];
+            queue& q = m_queues[n.queue];
+            (n.prev != no_node ? m_nodes[n.prev].next : q.head) = n.next;
+            (n.next != no_node ? m_nodes[n.next].prev : q.tail) = n.prev;
+            n.prev = n.next = no_node;
+            q.cost -= n.cost;
+            m_cost -= n.cost;
+        }
+
+        std::vector<node> m_nodes;
+        uint32 m_free = no_node;
+        _internal::cache_index m_index;
+        _internal::ghost_queue m_ghosts;
+        queue m_queues[2];
+
+        std::size_t m_budget;
+        std::size_t m_cost = 0;
+        [[no_unique_address]] Cost m_cost_fn;
+        cache_stats m_stats;
+    };
+
+    // lru_cache split into shards by key hash, each behind its own lock, with the budget split between them.  Values
+    // come out by copy.
+    template <typename K, typename V, cache_policy Policy = cache_policy::lru, typename Cost = _internal::unit_cost,
+              typename Hash = _internal::transparent_hash<K>, typename KeyEqual = _internal::transparent_equal<K>>
+    class concurrent_lru_cache
+    {
+        using cache_type = lru_cache<K, V, Policy, Cost, Hash, KeyEqual>;
+
+      public:
+        // shard_count is rounded up to a power of two; 0 picks one per hardware thread (at most 64).  A name
+        // instruments the shard locks under it.
+        explicit concurrent_lru_cache(std::size_t budget, std::size_t shard_count = 0, Cost cost = {},
+                                      std::string_view name = {})
+        {
+            if(shard_count == 0)
+            {
+                shard_count = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 64);
+            }
+            shard_count = std::bit_ceil(shard_count);
+            m_shift = 64 - std::countr_zero(shard_count);
+            const std::size_t shard_budget = (budget + shard_count - 1) / shard_count;
+            for(std::size_t i = 0; i < shard_count; i++)
+            {
+                m_shards.push_back(std::make_unique<shard>(shard_budget, cost, name));
+            }
+        }
+
+        template <typename Q>
+        [[nodiscard]] std::optional<V> find(const Q& key)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            if(V* value = s.cache.find(key))
+            {
+                return *value;
+            }
+            return std::nullopt;
+        }
+
+        template <typename Q>
+        [[nodiscard]] bool contains(const Q& key) const
+        {
+            const shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            return s.cache.contains(key);
+        }
+
+        // False if the value costs more than a whole shard's budget
+        template <typename KArg, typename VArg>
+        bool insert_or_assign(KArg&& key, VArg&& value)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            return s.cache.insert_or_assign(std::forward<KArg>(key), std::forward<VArg>(value)) != nullptr;
+        }
+
+        // factory runs under the shard's lock, so it's only ever called once for a key at a time.  If its result is
+        // too big to cache, you still get it.
+        template <typename KArg, typename TFactory>
+            requires std::convertible_to<std::invoke_result_t<TFactory&>, V>
+        V find_or_insert_with(KArg&& key, TFactory&& factory)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            if(V* value = s.cache.find(key))
+            {
+                return *value;
+            }
+            V value = std::invoke(factory);
+            s.cache.insert_or_assign(std::forward<KArg>(key), value);
+            return value;
+        }
+
+        template <typename Q>
+        bool erase(const Q& key)
+        {
+            shard& s = shard_for(key);
+            std::scoped_lock lock(s.lock);
+            return s.cache.erase(key);
+        }
+
+        void clear()
+        {
+            for(auto& s : m_shards)
+            {
+                std::scoped_lock lock(s->lock);
+                s->cache.clear();
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const
+        {
+            std::size_t total = 0;
+            for(const auto& s : m_shards)
+            {
+                std::scoped_lock lock(s->lock);
+                total += s->cache.size();
+            }
+            return total;
+        }
+
+        [[nodiscard]] std::size_t cost() const
+        {
+            std::size_t total = 0;
+            for(const auto& s : m_shards)
+            {
+                std::scoped_lock lock(s->lock);
+                total += s->cache.cost();
+            }
+            return total;
+        }
+
+        [[nodiscard]] cache_stats stats() const
+        {
+            cache_stats total;
+            for(const auto& s : m_shards)
+            {
+                std::scoped_lock lock(s->lock);
+                total += s->cache.stats();
+            }
+            return total;
+        }
+
+        [[nodiscard]] std::size_t shard_count() const noexcept { return m_shards.size(); }
+
+      private:
+        struct alignas(64) shard
+        {
+            shard(std::size_t budget, const Cost& cost, std::string_view name)
+                : lock(name)
+                , cache(budget, cost)
+            {
+            }
+
+            mutable sync::mutex lock;
+            cache_type cache;
+        };
+
+        template <typename Q>
+        [[nodiscard]] std::size_t shard_index(const Q& key) const
+        {
+            // Top bits, since each shard's index uses the (mixed) low ones
+            const uint64 hash = static_cast<uint64>(Hash {}(key)) * 0x9E3779B97F4A7C15ull;
+            return m_shift == 64 ? 0 : static_cast<std::size_t>(hash >> m_shift);
+        }
+
+        template <typename Q>
+        [[nodiscard]] shard& shard_for(const Q& key)
+        {
+            return *m_shards[shard_index(key)];
+        }
+
+        template <typename Q>
+        [[nodiscard]] const shard& shard_for(const Q& key) const
+        {
+            return *m_shards[shard_index(key)];
+        }
+
+        std::vector<std::unique_ptr<shard>> m_shards;
+        uint32 m_shift = 64;
+    };
+}
@@ -0,0 +1,138 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/types.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAOE_MAPPED_FILE_USE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read only into memory.  Pages are read in as they're touched, so opening a big file is about
+// as cheap as opening a small one.  Where there's no mmap it reads the whole file in instead.  Takes a real path,
+// not a fs::path (PhysFS can't map things).  fs::path::real_path() is only the directory or archive the file was
+// mounted from, so for a directory mounted at the root it's real_path() / path.
+//     raoe::mapped_file file(path);
+//     if(file.is_open()) parse(file.bytes());
+namespace raoe
+{
+    class mapped_file
+    {
+      public:
+        mapped_file() = default;
+
+        // Not open if the file is missing, can't be read or is empty
+        explicit mapped_file(const std::filesystem::path& path)
+        {
+#ifdef RAOE_MAPPED_FILE_USE_MMAP
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+            {
+                return;
+            }
+            struct stat info {};
+            if(::fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                void* data = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if(data != MAP_FAILED)
+                {
+                    m_data = static_cast<const std::byte*>(data);
+                    m_size = static_cast<std::size_t>(info.st_size);
+                }
+            }
+            // The mapping keeps the file alive on its own
+            ::close(fd);
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            const auto size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
+            if(size > 0)
+            {
+                m_copy = std::make_unique_for_overwrite<std::byte[]>(static_cast<std::size_t>(size));
+                file.seekg(0);
+                if(file.read(reinterpret_cast<char*>(m_copy.get()), size))
+                {
+                    m_data = m_copy.get();
+                    m_size = static_cast<std::size_t>(size);
+                }
+            }
+#endif
+        }
+
+        mapped_file(mapped_file&& other) noexcept
+            : m_data(std::exchange(other.m_data, nullptr))
+            , m_size(std::exchange(other.m_size, 0))
+#ifndef RAOE_MAPPED_FILE_USE_MMAP
+            , m_copy(std::move(other.m_copy))
+#endif
+        {
+        }
+
+        mapped_file& operator=(mapped_file&& other) noexcept
+        {
+            if(this != &other)
+            {
+                close();
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+#ifndef RAOE_MAPPED_FILE_USE_MMAP
+                m_copy = std::move(other.m_copy);
+#endif
+            }
+            return *this;
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file() { close(); }
+
+        [[nodiscard]] bool is_open() const noexcept { return m_data != nullptr; }
+        [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return {m_data, m_size}; }
+        [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+        void close() noexcept
+        {
+#ifdef RAOE_MAPPED_FILE_USE_MMAP
+            if(m_data != nullptr)
+            {
+                ::munmap(const_cast<std::byte*>(m_data), m_size);
+            }
+#else
+            m_copy.reset();
+#endif
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+      private:
+        const std::byte* m_data = nullptr;
+        std::size_t m_size = 0;
+#ifndef RAOE_MAPPED_FILE_USE_MMAP
+        std::unique_ptr<std::byte[]> m_copy;
+#endif
+    };
+}
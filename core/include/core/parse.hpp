@@ -17,9 +17,9 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #pragma once
 
 #include "from_string.hpp"
+#include "function_ref.hpp"
 #include "types.hpp"
 #include <cctype>
-#include <functional>
 #include <iterator>
 #include <string>
 #include <tuple>
@@ -53,7 +53,7 @@ namespace raoe::core::parse
 
         inline void parse_split(std::string_view from, std::output_iterator<std::string_view> auto out_itr)
         {
-            using ScanFunc_T = std::function<bool(std::string_view, int32)>;
+            using ScanFunc_T = function_ref<bool(std::string_view, int32)>;
 
             int32 cursor = 0;
             while (cursor < from.length())
@@ -0,0 +1,356 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#if defined(__linux__)
+#define RAOE_PERF_COUNTERS_SUPPORTED 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware performance counters for the calling thread (and optionally the threads it starts), through
+// perf_event_open.
+//
+// Wall clock time says something got slower; the counters say why.  Low IPC with lots of LLC misses is waiting on
+// memory, lots of branch misses is a data dependent branch, and so on.
+//     raoe::debug::perf_counters counters;
+//     {
+//         auto scope = counters.measure();
+//         for(auto& name : names) tags.emplace_back(name);
+//     }
+//     auto result = counters.result();
+//     std::cout << result.summary(names.size());
+//
+// Counters that the machine (or the VM, or perf_event_paranoid) won't give us are just missing from the results, and if
+// none are available available() is false and everything reads as zero.  Nothing throws or panics.
+namespace raoe::debug
+{
+    enum class perf_counter : uint8
+    {
+        cycles,
+        instructions,
+        l1d_misses,
+        llc_misses,
+        branch_misses,
+        count,
+    };
+
+    inline constexpr std::size_t perf_counter_count = static_cast<std::size_t>(perf_counter::count);
+
+    inline std::string_view to_string(perf_counter counter)
+    {
+        constexpr std::array<std::string_view, perf_counter_count + 1> names = {
+            "cycles", "instructions", "L1d misses", "LLC misses", "branch misses", "?"};
+        return names[std::min(static_cast<std::size_t>(counter), perf_counter_count)];
+    }
+
+    struct perf_result
+    {
+        std::array<uint64, perf_counter_count> values {};
+        std::array<bool, perf_counter_count> valid {};
+        // Less than 1 when the kernel had to multiplex the counters, in which case the values are scaled estimates
+        double running_fraction = 1;
+
+        [[nodiscard]] bool has(perf_counter counter) const { return valid[static_cast<std::size_t>(counter)]; }
+        [[nodiscard]] uint64 operator[](perf_counter counter) const { return values[static_cast<std::size_t>(counter)]; }
+
+        [[nodiscard]] double instructions_per_cycle() const
+        {
+            if(!has(perf_counter::cycles) || !has(perf_counter::instructions) || (*this)[perf_counter::cycles] == 0)
+            {
+                return 0;
+            }
+            return static_cast<double>((*this)[perf_counter::instructions]) /
+                   static_cast<double>((*this)[perf_counter::cycles]);
+        }
+
+        [[nodiscard]] double per_op(perf_counter counter, std::size_t ops) const
+        {
+            return ops == 0 ? 0 : static_cast<double>((*this)[counter]) / static_cast<double>(ops);
+        }
+
+        perf_result& operator+=(const perf_result& other)
+        {
+            for(std::size_t i = 0; i < perf_counter_count; i++)
+            {
+                values[i] += other.values[i];
+                valid[i] = valid[i] || other.valid[i];
+            }
+            running_fraction = std::min(running_fraction, other.running_fraction);
+            return *this;
+        }
+
+        // One line, like "IPC 2.31, 41.2 cycles/op, 0.12 L1d misses/op, ..." with whatever was available
+        [[nodiscard]] std::string summary(std::size_t ops = 1) const
+        {
+            std::string out;
+            if(has(perf_counter::cycles) && has(perf_counter::instructions))
+            {
+                out += std::format("IPC {:.2f}", instructions_per_cycle());
+            }
+            for(std::size_t i = 0; i < perf_counter_count; i++)
+            {
+                if(valid[i])
+                {
+                    out += std::format("{}{:.3g} {}/op", out.empty() ? "" : ", ",
+                                       per_op(static_cast<perf_counter>(i), ops),
+                                       to_string(static_cast<perf_counter>(i)));
+                }
+            }
+            if(out.empty())
+            {
+                return "no hardware counters available";
+            }
+            if(running_fraction < 0.99)
+            {
+                out += std::format(" (multiplexed, {:.0f}% coverage)", running_fraction * 100);
+            }
+            return out;
+        }
+    };
+
+    // A group of counters on the calling thread.  Open it once and measure() as many times as you like; it only counts
+    // while a scope is alive.  With with_new_threads, threads the calling thread starts after this is made are counted
+    // too, for work that's handed out to workers.
+    class perf_counters
+    {
+      public:
+        perf_counters()
+            : perf_counters(false)
+        {
+        }
+
+        explicit perf_counters(bool with_new_threads)
+        {
+#ifdef RAOE_PERF_COUNTERS_SUPPORTED
+            // The first one that opens leads the group, so they all start and stop together
+            for(std::size_t i = 0; i < perf_counter_count; i++)
+            {
+                perf_event_attr attr {};
+                attr.size = sizeof(attr);
+                configure(static_cast<perf_counter>(i), attr);
+                attr.disabled = m_leader == -1 ? 1 : 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.inherit = with_new_threads ? 1 : 0;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                const int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+                if(fd == -1)
+                {
+                    continue;
+                }
+                uint64 id = 0;
+                if(::ioctl(fd, PERF_EVENT_IOC_ID, &id) == -1)
+                {
+                    ::close(fd);
+                    continue;
+                }
+                if(m_leader == -1)
+                {
+                    m_leader = fd;
+                }
+                m_fds[i] = fd;
+                m_ids[i] = id;
+            }
+#endif
+        }
+
+        ~perf_counters()
+        {
+#ifdef RAOE_PERF_COUNTERS_SUPPORTED
+            for(int fd : m_fds)
+            {
+                if(fd != -1)
+                {
+                    ::close(fd);
+                }
+            }
+#endif
+        }
+
+        perf_counters(const perf_counters&) = delete;
+        perf_counters& operator=(const perf_counters&) = delete;
+
+        // False if no counter could be opened (not Linux, no PMU in the VM, perf_event_paranoid too high...)
+        [[nodiscard]] bool available() const noexcept { return m_leader != -1; }
+        [[nodiscard]] bool available(perf_counter counter) const noexcept
+        {
+            return m_fds[static_cast<std::size_t>(counter)] != -1;
+        }
+
+        // Resets and starts counting
+        void start()
+        {
+#ifdef RAOE_PERF_COUNTERS_SUPPORTED
+            if(available())
+            {
+                ::ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                // A reset doesn't clear what threads that have exited handed back, so count from here instead
+                m_start = read_totals().value_or(totals {});
+                ::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+
+        // Stops counting and reads the totals since start()
+        perf_result stop()
+        {
+            perf_result result;
+#ifdef RAOE_PERF_COUNTERS_SUPPORTED
+            if(!available())
+            {
+                return m_result = result;
+            }
+            ::ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+            const auto end = read_totals();
+            if(!end)
+            {
+                return m_result = result;
+            }
+            const uint64 enabled = end->enabled - m_start.enabled;
+            const uint64 running = end->running - m_start.running;
+            result.running_fraction = enabled == 0 ? 1 : static_cast<double>(running) / static_cast<double>(enabled);
+            for(std::size_t i = 0; i < perf_counter_count; i++)
+            {
+                if(end->valid[i])
+                {
+                    // Scale up if the group only got the PMU part of the time
+                    const uint64 value = end->values[i] - m_start.values[i];
+                    result.values[i] = running == 0 ? 0
+                                                    : static_cast<uint64>(static_cast<double>(value) *
+                                                                          static_cast<double>(enabled) /
+                                                                          static_cast<double>(running));
+                    result.valid[i] = running != 0;
+                }
+            }
+#endif
+            return m_result = result;
+        }
+
+        // The last stop()
+        [[nodiscard]] const perf_result& result() const noexcept { return m_result; }
+
+        // Counts for as long as it's alive
+        class scope
+        {
+          public:
+            explicit scope(perf_counters& counters)
+                : m_counters(counters)
+            {
+                m_counters.start();
+            }
+            ~scope() { m_counters.stop(); }
+
+            scope(const scope&) = delete;
+            scope& operator=(const scope&) = delete;
+
+          private:
+            perf_counters& m_counters;
+        };
+
+        [[nodiscard]] scope measure() { return scope(*this); }
+
+      private:
+        // Raw running totals, as the kernel keeps them
+        struct totals
+        {
+            std::array<uint64, perf_counter_count> values {};
+            std::array<bool, perf_counter_count> valid {};
+            uint64 enabled = 0;
+            uint64 running = 0;
+        };
+
+#ifdef RAOE_PERF_COUNTERS_SUPPORTED
+        [[nodiscard]] std::optional<totals> read_totals() const
+        {
+            // { nr, time_enabled, time_running, { value, id } * nr }, summed over any threads that inherited the group
+            std::array<uint64, 3 + 2 * perf_counter_count> buffer {};
+            if(::read(m_leader, buffer.data(), sizeof(buffer)) <= 0)
+            {
+                return std::nullopt;
+            }
+            totals out;
+            out.enabled = buffer[1];
+            out.running = buffer[2];
+            const uint64 count = std::min<uint64>(buffer[0], perf_counter_count);
+            for(uint64 n = 0; n < count; n++)
+            {
+                for(std::size_t i = 0; i < perf_counter_count; i++)
+                {
+                    if(m_fds[i] != -1 && m_ids[i] == buffer[4 + 2 * n])
+                    {
+                        out.values[i] = buffer[3 + 2 * n];
+                        out.valid[i] = true;
+                    }
+                }
+            }
+            return out;
+        }
+
+        static void configure(perf_counter counter, perf_event_attr& attr)
+        {
+            constexpr auto cache = [](uint64 id, uint64 op, uint64 result) { return id | (op << 8) | (result << 16); };
+            switch(counter)
+            {
+                case perf_counter::cycles:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                    break;
+                case perf_counter::instructions:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                    break;
+                case perf_counter::l1d_misses:
+                    attr.type = PERF_TYPE_HW_CACHE;
+                    attr.config = cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                        PERF_COUNT_HW_CACHE_RESULT_MISS);
+                    break;
+                case perf_counter::llc_misses:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                    break;
+                case perf_counter::branch_misses:
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                    break;
+                case perf_counter::count:
+                    break;
+            }
+        }
+#endif
+
+        int m_leader = -1;
+        std::array<int, perf_counter_count> m_fds = {-1, -1, -1, -1, -1};
+        std::array<uint64, perf_counter_count> m_ids {};
+        totals m_start;
+        perf_result m_result;
+    };
+}
@@ -0,0 +1,478 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// xoshiro256++ by David Blackman and Sebastiano Vigna (public domain): https://prng.di.unimi.it/
+// pcg64 (XSL-RR 128/64) by Melissa O'Neill, licensed under Apache 2.0: https://www.pcg-random.org/
+// Bounded integers use Daniel Lemire's nearly divisionless method: https://arxiv.org/abs/1805.10941
+
+#pragma once
+
+#include "types.hpp"
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <limits>
+#include <random>
+#include <span>
+#include <type_traits>
+
+namespace raoe::random
+{
+    // Any engine that produces a full 64 bits per call.  All of the distributions below assume this.
+    template <typename T>
+    concept engine64 = std::uniform_random_bit_generator<T> && std::same_as<typename T::result_type, uint64> &&
+                       (T::min() == 0) && (T::max() == std::numeric_limits<uint64>::max());
+
+    inline constexpr uint64 default_seed = 0x9E3779B97F4A7C15ull;
+
+    // splitmix64.  Not meant to be used directly, this is what expands a single 64 bit seed into the larger state of
+    // the other engines.
+    class splitmix64
+    {
+      public:
+        using result_type = uint64;
+
+        constexpr explicit splitmix64(uint64 seed = default_seed) noexcept
+            : m_state(seed)
+        {
+        }
+
+        static constexpr result_type min() noexcept { return 0; }
+        static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+        constexpr result_type operator()() noexcept
+        {
+            uint64 z = (m_state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+      private:
+        uint64 m_state;
+    };
+
+    // xoshiro256++
+    // The general purpose engine.  256 bits of state, period of 2^256 - 1, and very fast.
+    // jump() advances the engine 2^128 steps, long_jump() 2^192 steps, so a single seed can be split into
+    // non-overlapping streams for each thread.
+    class xoshiro256pp
+    {
+      public:
+        using result_type = uint64;
+        using state_type = std::array<uint64, 4>;
+
+        constexpr explicit xoshiro256pp(uint64 seed = default_seed) noexcept { reseed(seed); }
+        constexpr explicit xoshiro256pp(const state_type& state) noexcept
+            : m_state(state)
+        {
+        }
+
+        static constexpr result_type min() noexcept { return 0; }
+        static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+        constexpr void reseed(uint64 seed) noexcept
+        {
+            splitmix64 expander(seed);
+            for(uint64& s : m_state)
+            {
+                s = expander();
+            }
+        }
+
+        constexpr result_type operator()() noexcept
+        {
+            const uint64 result = std::rotl(m_state[0] + m_state[3], 23) + m_state[0];
+            const uint64 t = m_state[1] << 17;
+
+            m_state[2] ^= m_state[0];
+            m_state[3] ^= m_state[1];
+            m_state[1] ^= m_state[2];
+            m_state[0] ^= m_state[3];
+
+            m_state[2] ^= t;
+            m_state[3] = std::rotl(m_state[3], 45);
+
+            return result;
+        }
+
+        constexpr void discard(uint64 count) noexcept
+        {
+            for(uint64 i = 0; i < count; i++)
+            {
+                (*this)();
+            }
+        }
+
+        // Equivalent to 2^128 calls to operator().  Use this to generate 2^128 non-overlapping sequences.
+        constexpr void jump() noexcept
+        {
+            apply_jump({0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull});
+        }
+
+        // Equivalent to 2^192 calls to operator().  Use this to generate 2^64 starting points, each of which can be
+        // jump()ed to create 2^64 more non-overlapping sequences.
+        constexpr void long_jump() noexcept
+        {
+            apply_jump({0x76e15d3efefdcbbfull, 0xc5004e441c522fb3ull, 0x77710069854ee241ull, 0x39109bb02acbe635ull});
+        }
+
+        // Returns a copy of this engine and jumps this one forward, so the two never overlap.
+        // Calling this once per worker gives each worker its own stream.
+        [[nodiscard]] constexpr xoshiro256pp split() noexcept
+        {
+            xoshiro256pp stream = *this;
+            jump();
+            return stream;
+        }
+
+        constexpr void fill(std::span<uint64> out) noexcept
+        {
+            for(uint64& value : out)
+            {
+                value = (*this)();
+            }
+        }
+
+        [[nodiscard]] constexpr const state_type& state() const noexcept { return m_state; }
+
+        constexpr bool operator==(const xoshiro256pp& other) const noexcept = default;
+
+      private:
+        constexpr void apply_jump(const state_type& polynomial) noexcept
+        {
+            state_type result {};
+            for(uint64 word : polynomial)
+            {
+                for(int32 bit = 0; bit < 64; bit++)
+                {
+                    if(word & (uint64(1) << bit))
+                    {
+                        for(std::size_t i = 0; i < result.size(); i++)
+                        {
+                            result[i] ^= m_state[i];
+                        }
+                    }
+                    (*this)();
+                }
+            }
+            m_state = result;
+        }
+
+        state_type m_state {};
+    };
+
+    // xoshiro256++ running TLanes independent streams side by side, with the state laid out per word rather than per
+    // stream.  The lanes are seeded by jump()ing, so they never overlap.  Each lane's step is the same handful of
+    // add/xor/shift/rotate operations, which the compiler turns into SIMD when bulk filling.
+    // The output of fill() is the lanes interleaved, so it is not the same sequence as a single xoshiro256pp.
+    template <std::size_t TLanes = 4>
+    class xoshiro256pp_wide
+    {
+      public:
+        using result_type = uint64;
+        static constexpr std::size_t lanes = TLanes;
+
+        constexpr explicit xoshiro256pp_wide(uint64 seed = default_seed) noexcept
+            : xoshiro256pp_wide(xoshiro256pp(seed))
+        {
+        }
+
+        constexpr explicit xoshiro256pp_wide(xoshiro256pp base) noexcept
+        {
+            for(std::size_t lane = 0; lane < TLanes; lane++)
+            {
+                const auto state = base.split().state();
+                m_s0[lane] = state[0];
+                m_s1[lane] = state[1];
+                m_s2[lane] = state[2];
+                m_s3[lane] = state[3];
+            }
+        }
+
+        static constexpr result_type min() noexcept { return 0; }
+        static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+        // Single values come out of a small buffer that is refilled one full step of all lanes at a time
+        constexpr result_type operator()() noexcept
+        {
+            if(m_buffered == 0)
+            {
+                step(m_buffer.data());
+                m_buffered = TLanes;
+            }
+            return m_buffer[TLanes - m_buffered--];
+        }
+
+        constexpr void fill(std::span<uint64> out) noexcept
+        {
+            const std::size_t whole_steps = out.size() - (out.size() % TLanes);
+            for(std::size_t i = 0; i < whole_steps; i += TLanes)
+            {
+                step(out.data() + i);
+            }
+            for(uint64& value : out.subspan(whole_steps))
+            {
+                value = (*this)();
+            }
+        }
+
+      private:
+        constexpr void step(uint64* out) noexcept
+        {
+            for(std::size_t lane = 0; lane < TLanes; lane++)
+            {
+                out[lane] = std::rotl(m_s0[lane] + m_s3[lane], 23) + m_s0[lane];
+            }
+            for(std::size_t lane = 0; lane < TLanes; lane++)
+            {
+                const uint64 t = m_s1[lane] << 17;
+                m_s2[lane] ^= m_s0[lane];
+                m_s3[lane] ^= m_s1[lane];
+                m_s1[lane] ^= m_s2[lane];
+                m_s0[lane] ^= m_s3[lane];
+                m_s2[lane] ^= t;
+                m_s3[lane] = std::rotl(m_s3[lane], 45);
+            }
+        }
+
+        alignas(64) std::array<uint64, TLanes> m_s0 {};
+        alignas(64) std::array<uint64, TLanes> m_s1 {};
+        alignas(64) std::array<uint64, TLanes> m_s2 {};
+        alignas(64) std::array<uint64, TLanes> m_s3 {};
+        std::array<uint64, TLanes> m_buffer {};
+        std::size_t m_buffered = 0;
+    };
+
+    namespace _internal
+    {
+        // Just enough of an unsigned 128 bit integer for the pcg LCG.
+        struct uint128
+        {
+            uint64 high = 0;
+            uint64 low = 0;
+
+            constexpr uint128 operator+(const uint128& other) const noexcept
+            {
+                const uint64 new_low = low + other.low;
+                return {high + other.high + (new_low < low ? 1u : 0u), new_low};
+            }
+
+            constexpr uint128 operator*(const uint128& other) const noexcept
+            {
+                const auto [carry, new_low] = raoe::mul_wide(low, other.low);
+                return {carry + high * other.low + low * other.high, new_low};
+            }
+
+            constexpr uint128 operator-() const noexcept { return uint128 {~high, ~low} + uint128 {0, 1}; }
+
+            constexpr bool operator==(const uint128& other) const noexcept = default;
+        };
+    }
+
+    // pcg64 (XSL-RR output over a 128 bit LCG)
+    // Slower than xoshiro256pp, but supports 2^127 selectable streams and O(log n) advance()
+    // jump() advances 2^64 steps and long_jump() 2^96 steps, to match xoshiro256pp's api.
+    class pcg64
+    {
+        using uint128 = _internal::uint128;
+        static constexpr uint128 multiplier = {2549297995355413924ull, 4865540595714422341ull};
+        static constexpr uint128 default_increment = {6364136223846793005ull, 1442695040888963407ull};
+
+      public:
+        using result_type = uint64;
+
+        constexpr explicit pcg64(uint64 seed = default_seed) noexcept
+            : m_increment(default_increment)
+        {
+            step();
+            m_state = m_state + uint128 {0, seed};
+            step();
+        }
+
+        // Seed with a stream selector.  Two engines with the same seed but different streams produce unrelated
+        // sequences.
+        constexpr pcg64(uint64 seed, uint64 stream) noexcept
+            : m_increment {stream >> 63, (stream << 1) | 1u}
+        {
+            step();
+            m_state = m_state + uint128 {0, seed};
+            step();
+        }
+
+        static constexpr result_type min() noexcept { return 0; }
+        static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+        constexpr result_type operator()() noexcept
+        {
+            step();
+            return std::rotr(m_state.high ^ m_state.low, static_cast<int32>(m_state.high >> 58u));
+        }
+
+        // Advance the engine by delta steps in O(log delta).
+        constexpr void advance(uint64 delta_high, uint64 delta_low) noexcept
+        {
+            uint128 current_mult = multiplier;
+            uint128 current_plus = m_increment;
+            uint128 acc_mult = {0, 1};
+            uint128 acc_plus = {0, 0};
+            uint128 delta = {delta_high, delta_low};
+            while(delta.high != 0 || delta.low != 0)
+            {
+                if(delta.low & 1u)
+                {
+                    acc_mult = acc_mult * current_mult;
+                    acc_plus = acc_plus * current_mult + current_plus;
+                }
+                current_plus = (current_mult + uint128 {0, 1}) * current_plus;
+                current_mult = current_mult * current_mult;
+                delta = {delta.high >> 1, (delta.low >> 1) | (delta.high << 63)};
+            }
+            m_state = acc_mult * m_state + acc_plus;
+        }
+
+        constexpr void advance(uint64 delta) noexcept { advance(0, delta); }
+
+        constexpr void discard(uint64 count) noexcept { advance(count); }
+
+        constexpr void jump() noexcept { advance(1, 0); }
+        constexpr void long_jump() noexcept { advance(uint64(1) << 32, 0); }
+
+        [[nodiscard]] constexpr pcg64 split() noexcept
+        {
+            pcg64 stream = *this;
+            jump();
+            return stream;
+        }
+
+        constexpr void fill(std::span<uint64> out) noexcept
+        {
+            for(uint64& value : out)
+            {
+                value = (*this)();
+            }
+        }
+
+        constexpr bool operator==(const pcg64& other) const noexcept = default;
+
+      private:
+        constexpr void step() noexcept { m_state = m_state * multiplier + m_increment; }
+
+        uint128 m_state {};
+        uint128 m_increment {};
+    };
+
+    // Returns an engine seeded from std::random_device.  For when you want randomness, not reproducibility.
+    template <typename TEngine = xoshiro256pp>
+    [[nodiscard]] inline TEngine make_seeded_engine()
+    {
+        std::random_device device;
+        const uint64 seed = (static_cast<uint64>(device()) << 32) ^ static_cast<uint64>(device());
+        return TEngine(seed);
+    }
+
+    // A per-thread engine seeded from std::random_device on first use.
+    [[nodiscard]] inline xoshiro256pp& thread_engine()
+    {
+        thread_local xoshiro256pp engine = make_seeded_engine<xoshiro256pp>();
+        return engine;
+    }
+
+    // Uniform integer in [0, range).  Unbiased.  Uses a single multiply for almost every call, and only falls back to
+    // a modulo when the low half of the product lands in the (small) rejection zone.
+    // range must be non-zero.
+    template <engine64 TEngine>
+    [[nodiscard]] constexpr uint64 bounded(TEngine& engine, uint64 range) noexcept
+    {
+        auto product = raoe::mul_wide(engine(), range);
+        if(product.low < range)
+        {
+            const uint64 threshold = (0 - range) % range;
+            while(product.low < threshold)
+            {
+                product = raoe::mul_wide(engine(), range);
+            }
+        }
+        return product.high;
+    }
+
+    // Uniform integer in [min, max], inclusive on both ends like std::uniform_int_distribution
+    template <std::integral T, engine64 TEngine>
+    [[nodiscard]] constexpr T uniform_int(TEngine& engine, T min, T max) noexcept
+    {
+        using unsigned_t = std::make_unsigned_t<T>;
+        // Narrower than int, the subtraction happens in int and can go negative, so cast it back before widening
+        const uint64 span =
+            static_cast<uint64>(static_cast<unsigned_t>(static_cast<unsigned_t>(max) - static_cast<unsigned_t>(min)));
+        if(span == std::numeric_limits<uint64>::max())
+        {
+            return static_cast<T>(engine());
+        }
+        return static_cast<T>(static_cast<unsigned_t>(min) + static_cast<unsigned_t>(bounded(engine, span + 1)));
+    }
+
+    // Uniform real in [0, 1).  Uses the top mantissa-width bits of the engine output, so every value is equally
+    // likely and exactly representable.
+    template <std::floating_point T, engine64 TEngine>
+    [[nodiscard]] constexpr T uniform_real(TEngine& engine) noexcept
+    {
+        constexpr int32 bits = std::numeric_limits<T>::digits < 64 ? std::numeric_limits<T>::digits : 64;
+        constexpr T scale = T(1) / static_cast<T>(uint64(1) << (bits - 1)) / T(2);
+        return static_cast<T>(engine() >> (64 - bits)) * scale;
+    }
+
+    // Uniform real in [min, max)
+    template <std::floating_point T, engine64 TEngine>
+    [[nodiscard]] constexpr T uniform_real(TEngine& engine, T min, T max) noexcept
+    {
+        return min + (max - min) * uniform_real<T>(engine);
+    }
+
+    template <typename T>
+    concept fixed_point = requires(T t) {
+        {
+            t.raw()
+        } -> std::integral;
+        {
+            T::make_from_raw(t.raw())
+        } -> std::same_as<T>;
+    };
+
+    // Uniform raoe::fixed in [min, max], inclusive.  Works entirely on the raw representation, so the results are
+    // bit-identical across platforms for deterministic simulation.
+    template <fixed_point T, engine64 TEngine>
+    [[nodiscard]] constexpr T uniform_fixed(TEngine& engine, T min, T max) noexcept
+    {
+        return T::make_from_raw(uniform_int(engine, min.raw(), max.raw()));
+    }
+
+    // Uniform raoe::fixed in [0, 1)
+    template <fixed_point T, engine64 TEngine>
+    [[nodiscard]] constexpr T uniform_fixed(TEngine& engine) noexcept
+    {
+        using raw_t = decltype(std::declval<T>().raw());
+        const raw_t one = T(1).raw();
+        return T::make_from_raw(uniform_int<raw_t>(engine, 0, one - 1));
+    }
+
+    // true with the given probability
+    template <engine64 TEngine>
+    [[nodiscard]] constexpr bool chance(TEngine& engine, double probability) noexcept
+    {
+        return uniform_real<double>(engine) < probability;
+    }
+}
@@ -0,0 +1,601 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/cvar.hpp"
+#include "core/symbols.hpp"
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define RAOE_SAMPLING_PROFILER_SUPPORTED 1
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+// Older glibc doesn't name the thread id member of sigevent
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+// A sampling profiler that runs inside the process, so it works where perf doesn't (shipped builds, locked down
+// machines, consoles that happen to be Linux).
+//
+// Every registered thread gets a timer on its own CPU clock that sends it SIGPROF at the sample rate.  The signal
+// handler walks the frame pointers and drops the stack into a preallocated lock free buffer, and a background thread
+// folds the samples together.  Threads that never registered aren't sampled (start() registers the calling thread).
+//     raoe::debug::sampling_profiler::register_this_thread(); // in each worker's startup
+//     raoe::debug::sampling_profiler::get().start(1000);
+//     ...
+//     raoe::debug::sampling_profiler::get().stop();
+//     raoe::debug::sampling_profiler::get().write_folded(out); // flamegraph.pl out > flame.svg
+//
+// Or from the console: `debug:profiler true`, then `debug:profiler false`.
+//
+// Stacks are only as good as the frame pointers, so build with -fno-omit-frame-pointer (and -rdynamic, so dladdr can
+// name the functions in the executable).  Only Linux on x86_64 and arm64 is supported; everywhere else start() returns
+// false.
+namespace raoe::debug
+{
+    class sampling_profiler
+    {
+      public:
+        static constexpr std::size_t max_depth = 64;
+        static constexpr std::size_t buffer_slots = 4096;
+
+        struct function_report
+        {
+            std::string name;
+            uint64 self_samples = 0;  // samples where this function was running
+            uint64 total_samples = 0; // samples where this function was anywhere on the stack
+        };
+
+        static sampling_profiler& get()
+        {
+            static sampling_profiler instance;
+            return instance;
+        }
+
+        ~sampling_profiler() { stop(); }
+
+        sampling_profiler(const sampling_profiler&) = delete;
+        sampling_profiler& operator=(const sampling_profiler&) = delete;
+
+        // Starts sampling every registered thread (and registers the calling one).  Returns false if the platform
+        // isn't supported or it couldn't set up the signal handler.  Calling it while running changes the rate.
+        bool start(uint32 frequency_hz = 1000)
+        {
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+            if(frequency_hz == 0)
+            {
+                return false;
+            }
+            std::scoped_lock lock(m_control_mutex);
+            if(!install_handler())
+            {
+                return false;
+            }
+            if(!m_aggregator.joinable())
+            {
+                m_aggregator = std::jthread([this](std::stop_token stop) { aggregate_loop(stop); });
+            }
+
+            m_interval_ns = 1'000'000'000 / frequency_hz;
+            s_running.store(true, std::memory_order_release);
+            register_this_thread();
+            std::scoped_lock threads_lock(m_threads_mutex);
+            for(auto& thread : m_threads)
+            {
+                arm(thread.timer, m_interval_ns);
+            }
+            return true;
+#else
+            (void)frequency_hz;
+            return false;
+#endif
+        }
+
+        // Stops sampling and folds in whatever is still in the buffer.  The results stay around until reset().
+        void stop()
+        {
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+            std::scoped_lock lock(m_control_mutex);
+            s_running.store(false, std::memory_order_release);
+            {
+                std::scoped_lock threads_lock(m_threads_mutex);
+                for(auto& thread : m_threads)
+                {
+                    arm(thread.timer, 0);
+                }
+            }
+            if(m_aggregator.joinable())
+            {
+                m_aggregator.request_stop();
+                m_wake.notify_all();
+                m_aggregator.join();
+                m_aggregator = {};
+            }
+            drain();
+#endif
+        }
+
+        [[nodiscard]] bool running() const noexcept { return s_running.load(std::memory_order_acquire); }
+
+        // Registers the calling thread to be sampled, until it exits or unregisters.  Cheap to call more than once.
+        static void register_this_thread()
+        {
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+            thread_local thread_registration registration;
+            registration.attach();
+#endif
+        }
+
+        static void unregister_this_thread()
+        {
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+            get().remove_thread(static_cast<int32>(::syscall(SYS_gettid)));
+#endif
+        }
+
+        // Throws away everything collected so far
+        void reset()
+        {
+            drain();
+            std::scoped_lock lock(m_data_mutex);
+            m_stacks.clear();
+            m_sample_count = 0;
+        }
+
+        [[nodiscard]] uint64 sample_count()
+        {
+            drain();
+            std::scoped_lock lock(m_data_mutex);
+            return m_sample_count;
+        }
+
+        // Samples thrown away because the buffer was full
+        [[nodiscard]] uint64 dropped() const noexcept { return s_dropped.load(std::memory_order_relaxed); }
+
+        // One line per unique stack, root first: "main;update;physics::step 42".  This is what flamegraph.pl and
+        // speedscope read.
+        void write_folded(std::ostream& to)
+        {
+            drain();
+            std::scoped_lock lock(m_data_mutex);
+
+            // Different addresses in the same function fold into one line
+            std::unordered_map<std::string, uint64> folded;
+            std::string line;
+            for(const auto& [stack, count] : m_stacks)
+            {
+                line.clear();
+                for(std::size_t i = stack.size(); i-- > 0;)
+                {
+                    line.append(symbol(stack[i], i != 0));
+                    if(i != 0)
+                    {
+                        line.push_back(';');
+                    }
+                }
+                folded[line] += count;
+            }
+            for(const auto& [stack, count] : folded)
+            {
+                to << stack << ' ' << count << '\n';
+            }
+        }
+
+        // The top count functions by self samples
+        [[nodiscard]] std::vector<function_report> top_functions(std::size_t count = 20)
+        {
+            drain();
+            std::scoped_lock lock(m_data_mutex);
+            std::unordered_map<std::string, function_report> functions;
+            std::unordered_set<std::string> seen;
+            for(const auto& [stack, samples] : m_stacks)
+            {
+                seen.clear();
+                for(std::size_t i = 0; i < stack.size(); i++)
+                {
+                    const std::string& name = symbol(stack[i], i != 0);
+                    auto& report = functions[name];
+                    if(i == 0)
+                    {
+                        report.self_samples += samples;
+                    }
+                    if(seen.insert(name).second)
+                    {
+                        report.total_samples += samples;
+                    }
+                }
+            }
+
+            std::vector<function_report> result;
+            result.reserve(functions.size());
+            for(auto& [name, report] : functions)
+            {
+                report.name = name;
+                result.push_back(std::move(report));
+            }
+            std::sort(result.begin(), result.end(), [](const function_report& a, const function_report& b) {
+                return a.self_samples != b.self_samples ? a.self_samples > b.self_samples
+                                                        : a.total_samples > b.total_samples;
+            });
+            if(result.size() > count)
+            {
+                result.resize(count);
+            }
+            return result;
+        }
+
+        // top_functions() as a table
+        void write_report(std::ostream& to, std::size_t count = 20)
+        {
+            const uint64 total = std::max<uint64>(sample_count(), 1);
+            to << std::format("{:>7} {:>7}  {}\n", "self%", "total%", "function");
+            for(const auto& function : top_functions(count))
+            {
+                to << std::format("{:>6.2f}% {:>6.2f}%  {}\n", 100.0 * function.self_samples / total,
+                                  100.0 * function.total_samples / total, function.name);
+            }
+        }
+
+      private:
+        sampling_profiler() = default;
+
+        struct stack_hash
+        {
+            std::size_t operator()(const std::vector<uintptr_t>& stack) const noexcept
+            {
+                std::size_t hash = 14695981039346656037ull;
+                for(uintptr_t frame : stack)
+                {
+                    hash = (hash ^ frame) * 1099511628211ull;
+                }
+                return hash;
+            }
+        };
+
+        // One slot of the sample buffer.  sequence works like Vyukov's bounded queue: it says whether the slot is
+        // free for the producer at a given position, or full and ready for the consumer.
+        struct sample_slot
+        {
+            std::atomic<uint64> sequence = 0;
+            uint32 depth = 0;
+            uint32 weight = 0;
+            std::array<uintptr_t, max_depth> frames;
+        };
+
+        // Pulls everything out of the sample buffer into m_stacks.  Only the aggregator thread and callers holding
+        // m_drain_mutex run this, so there's a single consumer.
+        void drain()
+        {
+            std::scoped_lock drain_lock(m_drain_mutex);
+            sample_slot* slots = s_slots.load(std::memory_order_acquire);
+            if(slots == nullptr)
+            {
+                return;
+            }
+
+            std::vector<uintptr_t> stack;
+            std::scoped_lock lock(m_data_mutex);
+            while(true)
+            {
+                sample_slot& slot = slots[m_read_position & (buffer_slots - 1)];
+                if(slot.sequence.load(std::memory_order_acquire) != m_read_position + 1)
+                {
+                    break;
+                }
+                stack.assign(slot.frames.begin(), slot.frames.begin() + slot.depth);
+                const uint32 weight = slot.weight;
+                slot.sequence.store(m_read_position + buffer_slots, std::memory_order_release);
+                m_read_position++;
+                if(!stack.empty())
+                {
+                    m_stacks[stack] += weight;
+                    m_sample_count += weight;
+                }
+            }
+        }
+
+        void aggregate_loop(std::stop_token stop)
+        {
+            std::mutex wait_mutex;
+            while(!stop.stop_requested())
+            {
+                drain();
+                std::unique_lock lock(wait_mutex);
+                m_wake.wait_for(lock, stop, std::chrono::milliseconds(20), [] { return false; });
+            }
+        }
+
+        // Caller holds m_data_mutex
+        const std::string& symbol(uintptr_t address, bool return_address)
+        {
+            auto [found, inserted] = m_symbols.try_emplace(address);
+            if(inserted)
+            {
+                found->second = symbol_name(reinterpret_cast<const void*>(address), return_address);
+            }
+            return found->second;
+        }
+
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+        struct thread_entry
+        {
+            int32 tid;
+            timer_t timer;
+        };
+
+        // Lives in a thread_local, so the timer goes away when the thread does
+        struct thread_registration
+        {
+            bool attached = false;
+
+            void attach()
+            {
+                if(!attached)
+                {
+                    attached = get().add_thread();
+                }
+            }
+
+            ~thread_registration()
+            {
+                if(attached)
+                {
+                    unregister_this_thread();
+                }
+            }
+        };
+
+        // Where this thread's stack ends, so the unwinder never reads past it.  Zero means unknown, so only the
+        // leaf gets recorded.
+        static inline thread_local uintptr_t t_stack_low = 0;
+        static inline thread_local uintptr_t t_stack_high = 0;
+
+        static inline std::atomic<bool> s_running = false;
+        static inline std::atomic<sample_slot*> s_slots = nullptr;
+        static inline std::atomic<uint64> s_write_position = 0;
+        static inline std::atomic<uint64> s_dropped = 0;
+
+        bool add_thread()
+        {
+            pthread_attr_t attr;
+            if(::pthread_getattr_np(::pthread_self(), &attr) == 0)
+            {
+                void* base = nullptr;
+                std::size_t size = 0;
+                if(::pthread_attr_getstack(&attr, &base, &size) == 0)
+                {
+                    t_stack_low = reinterpret_cast<uintptr_t>(base);
+                    t_stack_high = t_stack_low + size;
+                }
+                ::pthread_attr_destroy(&attr);
+            }
+
+            thread_entry entry {static_cast<int32>(::syscall(SYS_gettid)), {}};
+            sigevent event {};
+            event.sigev_notify = SIGEV_THREAD_ID;
+            event.sigev_signo = SIGPROF;
+            event.sigev_notify_thread_id = entry.tid;
+            if(::timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &entry.timer) != 0)
+            {
+                return false;
+            }
+
+            std::scoped_lock lock(m_threads_mutex);
+            if(running())
+            {
+                arm(entry.timer, m_interval_ns);
+            }
+            m_threads.push_back(entry);
+            return true;
+        }
+
+        void remove_thread(int32 tid)
+        {
+            std::scoped_lock lock(m_threads_mutex);
+            std::erase_if(m_threads, [tid](const thread_entry& entry) {
+                if(entry.tid != tid)
+                {
+                    return false;
+                }
+                ::timer_delete(entry.timer);
+                return true;
+            });
+        }
+
+        static void arm(timer_t timer, int64 interval_ns)
+        {
+            itimerspec spec {};
+            spec.it_interval.tv_sec = interval_ns / 1'000'000'000;
+            spec.it_interval.tv_nsec = interval_ns % 1'000'000'000;
+            spec.it_value = spec.it_interval;
+            ::timer_settime(timer, 0, &spec, nullptr);
+        }
+
+        // The handler is installed once and left in place.  Restoring the old one on stop() would race with signals
+        // that are already pending, and the default action for SIGPROF is to kill the process.
+        bool install_handler()
+        {
+            if(m_handler_installed)
+            {
+                return true;
+            }
+            if(m_slot_storage == nullptr)
+            {
+                m_slot_storage = std::make_unique<sample_slot[]>(buffer_slots);
+                for(std::size_t i = 0; i < buffer_slots; i++)
+                {
+                    m_slot_storage[i].sequence.store(i, std::memory_order_relaxed);
+                }
+                s_slots.store(m_slot_storage.get(), std::memory_order_release);
+            }
+
+            struct sigaction action {};
+            action.sa_sigaction = &on_signal;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            m_handler_installed = ::sigaction(SIGPROF, &action, nullptr) == 0;
+            return m_handler_installed;
+        }
+
+        // Runs in signal context: no locks, no allocation, only atomics and reads of the interrupted stack
+        static void on_signal(int, siginfo_t* info, void* context)
+        {
+            if(!s_running.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+            sample_slot* slots = s_slots.load(std::memory_order_acquire);
+            if(slots == nullptr)
+            {
+                return;
+            }
+            const int saved_errno = errno;
+
+            uint64 position = s_write_position.load(std::memory_order_relaxed);
+            sample_slot* slot = nullptr;
+            while(true)
+            {
+                slot = &slots[position & (buffer_slots - 1)];
+                const uint64 sequence = slot->sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<int64>(sequence - position);
+                if(difference == 0)
+                {
+                    if(s_write_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if(difference < 0)
+                {
+                    s_dropped.fetch_add(1, std::memory_order_relaxed);
+                    errno = saved_errno;
+                    return;
+                }
+                else
+                {
+                    position = s_write_position.load(std::memory_order_relaxed);
+                }
+            }
+
+            // The kernel only checks CPU clock timers once a tick, so at high rates one signal can stand in for
+            // several expirations.  Counting those keeps the totals in proportion to CPU time.
+            slot->weight = 1 + static_cast<uint32>(std::max(info->si_overrun, 0));
+            slot->depth = unwind(static_cast<const ucontext_t*>(context), slot->frames);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            errno = saved_errno;
+        }
+
+        static uint32 unwind(const ucontext_t* context, std::array<uintptr_t, max_depth>& frames)
+        {
+#if defined(__x86_64__)
+            const auto pc = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+            auto fp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RBP]);
+            const auto sp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RSP]);
+#else
+            const auto pc = static_cast<uintptr_t>(context->uc_mcontext.pc);
+            auto fp = static_cast<uintptr_t>(context->uc_mcontext.regs[29]);
+            const auto sp = static_cast<uintptr_t>(context->uc_mcontext.sp);
+#endif
+            uint32 depth = 0;
+            frames[depth++] = pc;
+
+            // A frame is [saved frame pointer][return address], and callers are always higher up the stack
+            const uintptr_t low = std::max(sp, t_stack_low);
+            const uintptr_t high = t_stack_high;
+            while(depth < max_depth && fp >= low && fp + 2 * sizeof(uintptr_t) <= high &&
+                  fp % alignof(uintptr_t) == 0)
+            {
+                const auto* frame = reinterpret_cast<const uintptr_t*>(fp);
+                const uintptr_t next = frame[0];
+                const uintptr_t return_address = frame[1];
+                if(return_address == 0)
+                {
+                    break;
+                }
+                frames[depth++] = return_address;
+                if(next <= fp)
+                {
+                    break;
+                }
+                fp = next;
+            }
+            return depth;
+        }
+
+        std::unique_ptr<sample_slot[]> m_slot_storage;
+        bool m_handler_installed = false;
+        std::mutex m_threads_mutex;
+        std::vector<thread_entry> m_threads;
+#else
+        static inline std::atomic<bool> s_running = false;
+        static inline std::atomic<sample_slot*> s_slots = nullptr;
+        static inline std::atomic<uint64> s_dropped = 0;
+#endif
+
+        std::mutex m_control_mutex;
+        std::mutex m_drain_mutex;
+        std::mutex m_data_mutex;
+        std::condition_variable_any m_wake;
+        std::jthread m_aggregator;
+        int64 m_interval_ns = 1'000'000;
+        uint64 m_read_position = 0;
+        uint64 m_sample_count = 0;
+        std::unordered_map<std::vector<uintptr_t>, uint64, stack_hash> m_stacks;
+        std::unordered_map<uintptr_t, std::string> m_symbols;
+    };
+
+    // Console control: `debug:profiler_hz 500`, `debug:profiler true`, and later `debug:profiler false`
+    inline cvar<uint32> profiler_hz {"debug:profiler_hz", 1000, "Sample rate of the sampling profiler"};
+    inline cvar<bool> profiler_enabled {"debug:profiler", false, "Runs the sampling profiler on registered threads"};
+
+    namespace _internal
+    {
+        inline const std::size_t profiler_command = profiler_enabled.on_change([](const bool& enabled) {
+            if(enabled)
+            {
+                sampling_profiler::get().start(profiler_hz.get());
+            }
+            else
+            {
+                sampling_profiler::get().stop();
+            }
+        });
+    }
+}
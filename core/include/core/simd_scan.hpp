@@ -0,0 +1,217 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Bitmask scanning of 64 byte blocks, the building block of the csv and json readers.
+// Each block is compared against a character and the result is a 64 bit mask, with bit i set if byte i matched.
+// Structural characters can then be found with bit tricks instead of a branch per byte.
+// The technique is from simdjson/simdcsv by Geoff Langdale and Daniel Lemire.
+
+#pragma once
+
+#include "types.hpp"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define RAOE_SIMD_SCAN_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define RAOE_SIMD_SCAN_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define RAOE_SIMD_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__PCLMUL__)
+#include <wmmintrin.h>
+#endif
+
+namespace raoe::simd
+{
+    inline constexpr std::size_t block_size = 64;
+
+    // 64 bytes of input, loaded once and compared against as many characters as needed
+    class block64
+    {
+      public:
+        // p must point to at least 64 readable bytes
+        explicit block64(const char* p) noexcept
+        {
+#if defined(RAOE_SIMD_SCAN_AVX2)
+            m_lanes[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            m_lanes[1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+#elif defined(RAOE_SIMD_SCAN_SSE2)
+            for(int32 i = 0; i < 4; i++)
+            {
+                m_lanes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+            }
+#elif defined(RAOE_SIMD_SCAN_NEON)
+            for(int32 i = 0; i < 4; i++)
+            {
+                m_lanes[i] = vld1q_u8(reinterpret_cast<const uint8_t*>(p + i * 16));
+            }
+#else
+            std::memcpy(m_bytes, p, block_size);
+#endif
+        }
+
+        // Bit i is set if byte i == c
+        [[nodiscard]] uint64 eq(char c) const noexcept
+        {
+#if defined(RAOE_SIMD_SCAN_AVX2)
+            const __m256i needle = _mm256_set1_epi8(c);
+            const uint64 low = static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(m_lanes[0], needle)));
+            const uint64 high = static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(m_lanes[1], needle)));
+            return low | (high << 32);
+#elif defined(RAOE_SIMD_SCAN_SSE2)
+            const __m128i needle = _mm_set1_epi8(c);
+            uint64 mask = 0;
+            for(int32 i = 0; i < 4; i++)
+            {
+                const uint64 lane = static_cast<uint16>(_mm_movemask_epi8(_mm_cmpeq_epi8(m_lanes[i], needle)));
+                mask |= lane << (i * 16);
+            }
+            return mask;
+#elif defined(RAOE_SIMD_SCAN_NEON)
+            const uint8x16_t needle = vdupq_n_u8(static_cast<uint8_t>(c));
+            uint64 mask = 0;
+            for(int32 i = 0; i < 4; i++)
+            {
+                mask |= movemask(vceqq_u8(m_lanes[i], needle)) << (i * 16);
+            }
+            return mask;
+#else
+            uint64 mask = 0;
+            for(std::size_t i = 0; i < block_size; i++)
+            {
+                mask |= static_cast<uint64>(m_bytes[i] == c) << i;
+            }
+            return mask;
+#endif
+        }
+
+        // Bit i is set if byte i is <= c (unsigned).  Used to find whitespace and control characters.
+        [[nodiscard]] uint64 le(char c) const noexcept
+        {
+#if defined(RAOE_SIMD_SCAN_AVX2)
+            const __m256i limit = _mm256_set1_epi8(c);
+            const __m256i low_max = _mm256_max_epu8(m_lanes[0], limit);
+            const __m256i high_max = _mm256_max_epu8(m_lanes[1], limit);
+            const uint64 low = static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low_max, limit)));
+            const uint64 high = static_cast<uint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high_max, limit)));
+            return low | (high << 32);
+#elif defined(RAOE_SIMD_SCAN_SSE2)
+            const __m128i limit = _mm_set1_epi8(c);
+            uint64 mask = 0;
+            for(int32 i = 0; i < 4; i++)
+            {
+                const __m128i lane_max = _mm_max_epu8(m_lanes[i], limit);
+                const uint64 lane = static_cast<uint16>(_mm_movemask_epi8(_mm_cmpeq_epi8(lane_max, limit)));
+                mask |= lane << (i * 16);
+            }
+            return mask;
+#elif defined(RAOE_SIMD_SCAN_NEON)
+            const uint8x16_t limit = vdupq_n_u8(static_cast<uint8_t>(c));
+            uint64 mask = 0;
+            for(int32 i = 0; i < 4; i++)
+            {
+                mask |= movemask(vcleq_u8(m_lanes[i], limit)) << (i * 16);
+            }
+            return mask;
+#else
+            uint64 mask = 0;
+            for(std::size_t i = 0; i < block_size; i++)
+            {
+                mask |= static_cast<uint64>(static_cast<uint8>(m_bytes[i]) <= static_cast<uint8>(c)) << i;
+            }
+            return mask;
+#endif
+        }
+
+      private:
+#if defined(RAOE_SIMD_SCAN_NEON)
+        // NEON has no movemask.  Weight each matching byte by its bit position, then add neighbours together until
+        // there is one byte per 8 inputs.
+        static uint64 movemask(uint8x16_t matched) noexcept
+        {
+            const uint8x16_t weights = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+            const uint8x16_t weighted = vandq_u8(matched, weights);
+            uint8x8_t summed = vpadd_u8(vget_low_u8(weighted), vget_high_u8(weighted));
+            summed = vpadd_u8(summed, summed);
+            summed = vpadd_u8(summed, summed);
+            return vget_lane_u16(vreinterpret_u16_u8(summed), 0);
+        }
+#endif
+
+#if defined(RAOE_SIMD_SCAN_AVX2)
+        __m256i m_lanes[2];
+#elif defined(RAOE_SIMD_SCAN_SSE2)
+        __m128i m_lanes[4];
+#elif defined(RAOE_SIMD_SCAN_NEON)
+        uint8x16_t m_lanes[4];
+#else
+        char m_bytes[block_size];
+#endif
+    };
+
+    // Bit i of the result is the xor of bits 0..i of the input.
+    // Given a mask of quote characters, this is the mask of everything between an opening quote and its closing one
+    [[nodiscard]] inline uint64 prefix_xor(uint64 bits) noexcept
+    {
+#if defined(__PCLMUL__)
+        // Carry-less multiply by all ones is exactly a prefix xor
+        const __m128i result = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<int64>(bits)), _mm_set1_epi8(-1), 0);
+        return static_cast<uint64>(_mm_cvtsi128_si64(result));
+#else
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+#endif
+    }
+
+    // Calls fn(index) for every set bit, lowest first
+    template <typename TFunc>
+    inline void for_each_bit(uint64 bits, TFunc&& fn)
+    {
+        while(bits != 0)
+        {
+            fn(static_cast<uint32>(std::countr_zero(bits)));
+            bits &= bits - 1;
+        }
+    }
+
+    // Loads a block that may run past the end of the input, padding it with fill
+    class padded_block
+    {
+      public:
+        padded_block(const char* p, std::size_t available, char fill) noexcept
+        {
+            std::memset(m_bytes, fill, block_size);
+            std::memcpy(m_bytes, p, available < block_size ? available : block_size);
+        }
+
+        [[nodiscard]] const char* data() const noexcept { return m_bytes; }
+
+      private:
+        char m_bytes[block_size];
+    };
+}
@@ -16,8 +16,15 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #pragma once
 
 #include "core/core.hpp"
+#include <algorithm>
+#include <cstring>
 #include <istream>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <streambuf>
 #include <string_view>
+#include <vector>
 
 namespace raoe::stream
 {
@@ -57,4 +64,291 @@ namespace raoe::stream
     {
         return read_stream_into(into_container, std::basic_string_view<TChar>(from_string));
     }
-}
\ No newline at end of file
+
+    // A streambuf over memory someone else owns.  Reading and writing go straight to the span, nothing is copied into
+    // an internal buffer.  Writes past the end of the span fail (like a full disk) instead of growing.
+    class span_streambuf : public std::streambuf
+    {
+      public:
+        span_streambuf() = default;
+        explicit span_streambuf(std::span<char> buffer) { reset(buffer); }
+        explicit span_streambuf(std::span<const char> buffer) { reset(buffer); }
+
+        span_streambuf(const span_streambuf&) = delete;
+        span_streambuf& operator=(const span_streambuf&) = delete;
+
+        // Points the streambuf at a new writable span.  Both the get and put areas start at the beginning.
+        void reset(std::span<char> buffer)
+        {
+            setg(buffer.data(), buffer.data(), buffer.data() + buffer.size());
+            setp(buffer.data(), buffer.data() + buffer.size());
+        }
+
+        // Points the streambuf at a read only span.  Writing will fail.
+        void reset(std::span<const char> buffer)
+        {
+            // std::streambuf is not const correct, but with no put area nothing will ever write through this pointer
+            char* begin = const_cast<char*>(buffer.data());
+            setg(begin, begin, begin + buffer.size());
+            setp(nullptr, nullptr);
+        }
+
+        // The part of the span that has been written to so far
+        [[nodiscard]] std::span<char> written() const { return std::span<char>(pbase(), pptr()); }
+
+        // The part of the span that hasn't been read yet
+        [[nodiscard]] std::span<const char> remaining() const { return std::span<const char>(gptr(), egptr()); }
+
+      protected:
+        std::streamsize showmanyc() override { return egptr() - gptr(); }
+
+        std::streamsize xsgetn(char* into, std::streamsize count) override
+        {
+            const std::streamsize to_copy = std::min<std::streamsize>(count, egptr() - gptr());
+            if(to_copy > 0)
+            {
+                std::memcpy(into, gptr(), static_cast<std::size_t>(to_copy));
+                setg(eback(), gptr() + to_copy, egptr());
+            }
+            return to_copy;
+        }
+
+        std::streamsize xsputn(const char* from, std::streamsize count) override
+        {
+            const std::streamsize to_copy = std::min<std::streamsize>(count, epptr() - pptr());
+            if(to_copy > 0)
+            {
+                std::memcpy(pptr(), from, static_cast<std::size_t>(to_copy));
+                advance_put(to_copy);
+            }
+            return to_copy;
+        }
+
+        pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode mode) override
+        {
+            pos_type result = pos_type(off_type(-1));
+            if(mode & std::ios_base::in)
+            {
+                result = seek_area(offset, dir, eback(), gptr(), egptr(),
+                                   [this](char* begin, char* at, char* end) { setg(begin, at, end); });
+            }
+            if(mode & std::ios_base::out)
+            {
+                result = seek_area(offset, dir, pbase(), pptr(), epptr(),
+                                   [this](char* begin, char* at, char* end)
+                                   {
+                                       setp(begin, end);
+                                       advance_put(at - begin);
+                                   });
+            }
+            return result;
+        }
+
+        pos_type seekpos(pos_type position, std::ios_base::openmode mode) override
+        {
+            return seekoff(off_type(position), std::ios_base::beg, mode);
+        }
+
+        void advance_put(std::ptrdiff_t count)
+        {
+            // pbump takes an int, so large spans need to be bumped in steps
+            while(count > 0)
+            {
+                const int step = static_cast<int>(std::min<std::ptrdiff_t>(count, std::numeric_limits<int>::max()));
+                pbump(step);
+                count -= step;
+            }
+        }
+
+      private:
+        template <typename TSetter>
+        static pos_type seek_area(off_type offset, std::ios_base::seekdir dir, char* begin, char* current, char* end,
+                                  TSetter&& set)
+        {
+            off_type base = 0;
+            switch(dir)
+            {
+                case std::ios_base::beg: base = 0; break;
+                case std::ios_base::cur: base = current - begin; break;
+                case std::ios_base::end: base = end - begin; break;
+                default: return pos_type(off_type(-1));
+            }
+            const off_type target = base + offset;
+            if(begin == nullptr || target < 0 || target > end - begin)
+            {
+                return pos_type(off_type(-1));
+            }
+            set(begin, begin + target, end);
+            return pos_type(target);
+        }
+    };
+
+    // Grows a caller owned std::vector<std::byte> as it's written to.  The vector's own storage is the put area, so
+    // there is no intermediate copy.  While the stream is writing, the vector may be larger than what was written
+    // (the spare capacity is exposed as the put area).  flush() or destroying the stream trims it back down.
+    class vector_streambuf : public std::streambuf
+    {
+      public:
+        explicit vector_streambuf(std::vector<std::byte>& into)
+            : m_vector(into)
+            , m_written(into.size())
+        {
+            trim();
+        }
+
+        ~vector_streambuf() override { trim(); }
+
+        vector_streambuf(const vector_streambuf&) = delete;
+        vector_streambuf& operator=(const vector_streambuf&) = delete;
+
+        [[nodiscard]] std::size_t written_size() const { return m_written + static_cast<std::size_t>(pptr() - pbase()); }
+
+      protected:
+        int_type overflow(int_type c) override
+        {
+            if(traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                return traits_type::not_eof(c);
+            }
+            expose_capacity(1);
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+
+        std::streamsize xsputn(const char* from, std::streamsize count) override
+        {
+            if(epptr() - pptr() < count)
+            {
+                expose_capacity(static_cast<std::size_t>(count));
+            }
+            std::memcpy(pptr(), from, static_cast<std::size_t>(count));
+            advance(static_cast<std::size_t>(count));
+            return count;
+        }
+
+        int sync() override
+        {
+            trim();
+            return 0;
+        }
+
+      private:
+        void advance(std::size_t count)
+        {
+            while(count > 0)
+            {
+                const int step = static_cast<int>(std::min<std::size_t>(count, std::numeric_limits<int>::max()));
+                pbump(step);
+                count -= static_cast<std::size_t>(step);
+            }
+        }
+
+        // Commits what's been written, then makes sure at least required bytes of spare capacity are writable
+        void expose_capacity(std::size_t required)
+        {
+            m_written = written_size();
+            std::size_t capacity = std::max<std::size_t>(m_vector.capacity(), 256);
+            while(capacity - m_written < required)
+            {
+                capacity *= 2;
+            }
+            m_vector.resize(capacity);
+            char* base = reinterpret_cast<char*>(m_vector.data());
+            setp(base + m_written, base + m_vector.size());
+        }
+
+        void trim()
+        {
+            m_written = written_size();
+            m_vector.resize(m_written);
+            char* base = reinterpret_cast<char*>(m_vector.data());
+            setp(base + m_written, base + m_written);
+        }
+
+        std::vector<std::byte>& m_vector;
+        std::size_t m_written = 0;
+    };
+
+    namespace _internal
+    {
+        // Base-from-member, so the streambuf is constructed before the stream that points at it
+        template <typename TBuf>
+        struct streambuf_holder
+        {
+            template <typename... Args>
+            explicit streambuf_holder(Args&&... args)
+                : m_streambuf(std::forward<Args>(args)...)
+            {
+            }
+            TBuf m_streambuf;
+        };
+    }
+
+    // C++20 stand-in for std::ispanstream.  Reads directly out of memory you already have, eg to feed a buffer to
+    // something that wants a std::istream& without copying it into a std::stringstream.
+    class span_istream : private _internal::streambuf_holder<span_streambuf>, public std::istream
+    {
+      public:
+        explicit span_istream(std::span<const char> buffer)
+            : streambuf_holder(buffer)
+            , std::istream(&m_streambuf)
+        {
+        }
+
+        explicit span_istream(std::span<const std::byte> buffer)
+            : span_istream(std::span<const char>(reinterpret_cast<const char*>(buffer.data()), buffer.size()))
+        {
+        }
+
+        explicit span_istream(std::string_view buffer)
+            : span_istream(std::span<const char>(buffer.data(), buffer.size()))
+        {
+        }
+
+        explicit span_istream(const std::string& buffer)
+            : span_istream(std::string_view(buffer))
+        {
+        }
+
+        // The stream doesn't own its buffer, so it can't be pointed at a temporary
+        explicit span_istream(std::string&& buffer) = delete;
+
+        [[nodiscard]] std::span<const char> remaining() const { return m_streambuf.remaining(); }
+        span_streambuf* rdbuf() const { return const_cast<span_streambuf*>(&m_streambuf); }
+    };
+
+    // C++20 stand-in for std::ospanstream.  Writes into a fixed size span, and sets failbit once it's full.
+    class span_ostream : private _internal::streambuf_holder<span_streambuf>, public std::ostream
+    {
+      public:
+        explicit span_ostream(std::span<char> buffer)
+            : streambuf_holder(buffer)
+            , std::ostream(&m_streambuf)
+        {
+        }
+
+        explicit span_ostream(std::span<std::byte> buffer)
+            : span_ostream(std::span<char>(reinterpret_cast<char*>(buffer.data()), buffer.size()))
+        {
+        }
+
+        [[nodiscard]] std::span<char> written() const { return m_streambuf.written(); }
+        span_streambuf* rdbuf() const { return const_cast<span_streambuf*>(&m_streambuf); }
+    };
+
+    // Appends to a caller owned std::vector<std::byte>.  The vector is only guaranteed to be exactly the written size
+    // after flush() or when the stream is destroyed.
+    class vector_ostream : private _internal::streambuf_holder<vector_streambuf>, public std::ostream
+    {
+      public:
+        explicit vector_ostream(std::vector<std::byte>& into)
+            : streambuf_holder(into)
+            , std::ostream(&m_streambuf)
+        {
+        }
+
+        [[nodiscard]] std::size_t written_size() const { return m_streambuf.written_size(); }
+        vector_streambuf* rdbuf() const { return const_cast<vector_streambuf*>(&m_streambuf); }
+    };
+}
@@ -18,10 +18,10 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #include <algorithm>
 #include <locale>
 #include <cctype>
-#include <sstream>
 #include <iterator>
+#include <string>
+#include <string_view>
 #include <vector>
-#include <algorithm>
 
  namespace raoe::string
 {    
@@ -76,14 +76,20 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 
     inline void split(const std::string& s, char delim, std::output_iterator<std::string> auto out_itr)
     {
-        std::istringstream iss(s);
-        std::string item;
-        while(std::getline(iss, item, delim))
+        std::string_view remaining(s);
+        while(!remaining.empty())
         {
+            const std::size_t end = remaining.find(delim);
+            const std::string_view item = remaining.substr(0, end);
             if(!item.empty())
             {
-                *out_itr++ = item;
+                *out_itr++ = std::string(item);
+            }
+            if(end == std::string_view::npos)
+            {
+                return;
             }
+            remaining.remove_prefix(end + 1);
         }
     }
 
@@ -0,0 +1,65 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/types.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RAOE_SYMBOLS_USE_DLADDR 1
+#include <cxxabi.h>
+#include <dlfcn.h>
+#endif
+
+namespace raoe::debug
+{
+    // Best effort name for a code address: the demangled function name if the dynamic symbol table has one (build with
+    // -rdynamic to get the executable's own functions), otherwise module+offset, otherwise the raw address.
+    // return_address is for addresses that came off the stack, which point just after the call instruction.
+    inline std::string symbol_name(const void* address, bool return_address = false)
+    {
+        const auto lookup = reinterpret_cast<uintptr_t>(address) - (return_address ? 1 : 0);
+#ifdef RAOE_SYMBOLS_USE_DLADDR
+        Dl_info info {};
+        if(::dladdr(reinterpret_cast<void*>(lookup), &info) != 0)
+        {
+            if(info.dli_sname != nullptr)
+            {
+                int status = 0;
+                char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                std::string name = status == 0 && demangled != nullptr ? demangled : info.dli_sname;
+                std::free(demangled);
+                return name;
+            }
+            if(info.dli_fname != nullptr)
+            {
+                std::string_view module = info.dli_fname;
+                if(const auto slash = module.find_last_of('/'); slash != std::string_view::npos)
+                {
+                    module.remove_prefix(slash + 1);
+                }
+                return std::format("{}+{:#x}", module, lookup - reinterpret_cast<uintptr_t>(info.dli_fbase));
+            }
+        }
+#endif
+        return std::format("{:#x}", lookup);
+    }
+}
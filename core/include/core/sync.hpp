@@ -0,0 +1,730 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include "core/types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Locks and friends.
+//
+//   mutex            - futex based, spins a little (adaptively) before sleeping.  The default choice.
+//   ticket_spinlock  - fair (first come first served) spinlock, for tiny critical sections that are rarely contended
+//   rw_spinlock      - many readers or one writer, writers go first when both are waiting
+//   seqlock<T>       - a T that's written rarely and read constantly; readers never block writers
+//   event, latch     - waiting for something to happen, on std::atomic::wait
+//
+// They all work with std::scoped_lock / std::unique_lock / std::shared_lock.  Give any of them a name and it becomes
+// instrumented: acquisitions, how often it was contended and how long it was waited on go into lock_stats under that
+// name, and lock_stats::report() lists the worst offenders.  Unnamed ones don't pay for any of that.
+//     raoe::sync::mutex m_cache_lock {"asset cache"};
+namespace raoe::sync
+{
+    namespace _internal
+    {
+        inline void cpu_relax() noexcept
+        {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+            _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+            asm volatile("yield");
+#endif
+        }
+
+        // Spinning only makes sense if the holder can be running at the same time
+        inline bool can_spin() noexcept
+        {
+            static const bool multi_core = std::thread::hardware_concurrency() > 1;
+            return multi_core;
+        }
+
+        inline uint64 now_ns() noexcept
+        {
+            return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                           std::chrono::steady_clock::now().time_since_epoch())
+                                           .count());
+        }
+
+        inline void futex_wait(std::atomic<uint32>& word, uint32 expected) noexcept
+        {
+#if defined(__linux__)
+            static_assert(sizeof(std::atomic<uint32>) == sizeof(uint32));
+            ::syscall(SYS_futex, reinterpret_cast<uint32*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+            word.wait(expected, std::memory_order_relaxed);
+#endif
+        }
+
+        inline void futex_wake_one(std::atomic<uint32>& word) noexcept
+        {
+#if defined(__linux__)
+            ::syscall(SYS_futex, reinterpret_cast<uint32*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+            word.notify_one();
+#endif
+        }
+    }
+
+    struct lock_report
+    {
+        std::string name;
+        uint64 acquisitions = 0;
+        uint64 contentions = 0; // acquisitions that had to wait
+        uint64 wait_ns = 0;
+        uint64 max_wait_ns = 0;
+    };
+
+    // Counters for every lock with a given name.  Several locks can share a name (every instance of some class,
+    // say), and they'll be reported together.
+    class lock_stats
+    {
+      public:
+        // The stats for name, created the first time it's asked for.  The reference is good forever.
+        static lock_stats& named(std::string_view name)
+        {
+            auto& all = registry();
+            std::scoped_lock lock(all.mutex);
+            for(const auto& stats : all.stats)
+            {
+                if(stats->m_name == name)
+                {
+                    return *stats;
+                }
+            }
+            return *all.stats.emplace_back(std::unique_ptr<lock_stats>(new lock_stats(name)));
+        }
+
+        // Every named lock, longest total wait first
+        static std::vector<lock_report> report()
+        {
+            std::vector<lock_report> result;
+            {
+                auto& all = registry();
+                std::scoped_lock lock(all.mutex);
+                for(const auto& stats : all.stats)
+                {
+                    result.push_back(stats->snapshot());
+                }
+            }
+            std::sort(result.begin(), result.end(),
+                      [](const lock_report& a, const lock_report& b) { return a.wait_ns > b.wait_ns; });
+            return result;
+        }
+
+        static void write_report(std::ostream& to)
+        {
+            to << std::format("{:>12} {:>12} {:>12} {:>12}  {}\n", "acquired", "contended", "wait ms", "max wait us",
+                              "lock");
+            for(const auto& entry : report())
+            {
+                to << std::format("{:>12} {:>12} {:>12.3f} {:>12.1f}  {}\n", entry.acquisitions, entry.contentions,
+                                  entry.wait_ns / 1e6, entry.max_wait_ns / 1e3, entry.name);
+            }
+        }
+
+        static void reset_all()
+        {
+            auto& all = registry();
+            std::scoped_lock lock(all.mutex);
+            for(const auto& stats : all.stats)
+            {
+                stats->reset();
+            }
+        }
+
+        [[nodiscard]] std::string_view name() const noexcept { return m_name; }
+
+        [[nodiscard]] lock_report snapshot() const
+        {
+            return {m_name, m_acquisitions.load(std::memory_order_relaxed),
+                    m_contentions.load(std::memory_order_relaxed), m_wait_ns.load(std::memory_order_relaxed),
+                    m_max_wait_ns.load(std::memory_order_relaxed)};
+        }
+
+        void reset() noexcept
+        {
+            m_acquisitions.store(0, std::memory_order_relaxed);
+            m_contentions.store(0, std::memory_order_relaxed);
+            m_wait_ns.store(0, std::memory_order_relaxed);
+            m_max_wait_ns.store(0, std::memory_order_relaxed);
+        }
+
+        void record_acquire() noexcept { m_acquisitions.fetch_add(1, std::memory_order_relaxed); }
+
+        void record_wait(uint64 ns) noexcept
+        {
+            m_contentions.fetch_add(1, std::memory_order_relaxed);
+            m_wait_ns.fetch_add(ns, std::memory_order_relaxed);
+            uint64 max = m_max_wait_ns.load(std::memory_order_relaxed);
+            while(ns > max && !m_max_wait_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+            {
+            }
+        }
+
+      private:
+        explicit lock_stats(std::string_view name)
+            : m_name(name)
+        {
+        }
+
+        struct stats_registry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<lock_stats>> stats;
+        };
+
+        static stats_registry& registry()
+        {
+            static stats_registry instance;
+            return instance;
+        }
+
+        std::string m_name;
+        std::atomic<uint64> m_acquisitions = 0;
+        std::atomic<uint64> m_contentions = 0;
+        std::atomic<uint64> m_wait_ns = 0;
+        std::atomic<uint64> m_max_wait_ns = 0;
+    };
+
+    namespace _internal
+    {
+        // Times the slow path of an instrumented lock.  Does nothing if stats is null.
+        class wait_timer
+        {
+          public:
+            explicit wait_timer(lock_stats* stats) noexcept
+                : m_stats(stats)
+                , m_start(stats != nullptr ? now_ns() : 0)
+            {
+            }
+
+            ~wait_timer()
+            {
+                if(m_stats != nullptr)
+                {
+                    m_stats->record_wait(now_ns() - m_start);
+                }
+            }
+
+            wait_timer(const wait_timer&) = delete;
+            wait_timer& operator=(const wait_timer&) = delete;
+
+          private:
+            lock_stats* m_stats;
+            uint64 m_start;
+        };
+
+        inline lock_stats* stats_for(std::string_view name)
+        {
+            return name.empty() ? nullptr : &lock_stats::named(name);
+        }
+    }
+
+    // Ulrich Drepper's three state futex mutex (0 unlocked, 1 locked, 2 locked with sleepers), with a bounded spin
+    // before sleeping.  The spin length adapts to how long it has recently taken to get the lock, like glibc's
+    // PTHREAD_MUTEX_ADAPTIVE_NP.
+    class mutex
+    {
+        static constexpr int32 max_spins = 200;
+
+      public:
+        mutex() noexcept = default;
+        explicit mutex(std::string_view name)
+            : m_stats(_internal::stats_for(name))
+        {
+        }
+
+        mutex(const mutex&) = delete;
+        mutex& operator=(const mutex&) = delete;
+
+        void lock() noexcept
+        {
+            uint32 expected = 0;
+            if(!m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                lock_slow();
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+        bool try_lock() noexcept
+        {
+            uint32 expected = 0;
+            if(m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                if(m_stats != nullptr)
+                {
+                    m_stats->record_acquire();
+                }
+                return true;
+            }
+            return false;
+        }
+
+        void unlock() noexcept
+        {
+            if(m_state.exchange(0, std::memory_order_release) == 2)
+            {
+                _internal::futex_wake_one(m_state);
+            }
+        }
+
+      private:
+        void lock_slow() noexcept
+        {
+            _internal::wait_timer timer(m_stats);
+
+            if(_internal::can_spin())
+            {
+                const int32 estimate = m_spin_estimate.load(std::memory_order_relaxed);
+                const int32 limit = std::min(max_spins, estimate * 2 + 10);
+                for(int32 spins = 0; spins < limit; spins++)
+                {
+                    _internal::cpu_relax();
+                    uint32 expected = 0;
+                    if(m_state.load(std::memory_order_relaxed) == 0 &&
+                       m_state.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    {
+                        m_spin_estimate.store(estimate + (spins - estimate) / 8, std::memory_order_relaxed);
+                        return;
+                    }
+                }
+                m_spin_estimate.store(estimate + (limit - estimate) / 8, std::memory_order_relaxed);
+            }
+
+            // Claim it as contended, so whoever unlocks knows to wake someone
+            while(m_state.exchange(2, std::memory_order_acquire) != 0)
+            {
+                _internal::futex_wait(m_state, 2);
+            }
+        }
+
+        std::atomic<uint32> m_state = 0;
+        std::atomic<int32> m_spin_estimate = 0;
+        lock_stats* m_stats = nullptr;
+    };
+
+    // A fair spinlock: each locker takes a ticket and waits for it to be served.  Waiters back off in proportion to
+    // how far back in line they are, and yield if it's taking a long time (so it degrades instead of livelocking when
+    // there are more threads than cores).
+    class ticket_spinlock
+    {
+      public:
+        ticket_spinlock() noexcept = default;
+        explicit ticket_spinlock(std::string_view name)
+            : m_stats(_internal::stats_for(name))
+        {
+        }
+
+        ticket_spinlock(const ticket_spinlock&) = delete;
+        ticket_spinlock& operator=(const ticket_spinlock&) = delete;
+
+        void lock() noexcept
+        {
+            const uint32 ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+            if(m_serving.load(std::memory_order_acquire) != ticket)
+            {
+                wait_for(ticket);
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+        bool try_lock() noexcept
+        {
+            uint32 serving = m_serving.load(std::memory_order_acquire);
+            if(!m_next.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed))
+            {
+                return false;
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+            return true;
+        }
+
+        void unlock() noexcept
+        {
+            m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+      private:
+        void wait_for(uint32 ticket) noexcept
+        {
+            _internal::wait_timer timer(m_stats);
+            uint32 rounds = 0;
+            while(true)
+            {
+                const uint32 serving = m_serving.load(std::memory_order_acquire);
+                if(serving == ticket)
+                {
+                    return;
+                }
+                if(!_internal::can_spin() || ++rounds > 64)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for(uint32 i = 0, pause = 32 * (ticket - serving); i < pause; i++)
+                {
+                    _internal::cpu_relax();
+                }
+            }
+        }
+
+        std::atomic<uint32> m_next = 0;
+        std::atomic<uint32> m_serving = 0;
+        lock_stats* m_stats = nullptr;
+    };
+
+    // Readers share, writers are exclusive.  A waiting writer stops new readers from getting in, so a steady stream
+    // of readers can't starve it.
+    class rw_spinlock
+    {
+        static constexpr uint32 writer = 1;
+        static constexpr uint32 writer_waiting = 2;
+        static constexpr uint32 reader = 4;
+
+      public:
+        rw_spinlock() noexcept = default;
+        explicit rw_spinlock(std::string_view name)
+            : m_stats(_internal::stats_for(name))
+        {
+        }
+
+        rw_spinlock(const rw_spinlock&) = delete;
+        rw_spinlock& operator=(const rw_spinlock&) = delete;
+
+        void lock() noexcept
+        {
+            if(!try_lock_unrecorded())
+            {
+                _internal::wait_timer timer(m_stats);
+                uint32 rounds = 0;
+                while(!try_lock_unrecorded())
+                {
+                    if((m_state.load(std::memory_order_relaxed) & writer_waiting) == 0)
+                    {
+                        m_state.fetch_or(writer_waiting, std::memory_order_relaxed);
+                    }
+                    backoff(rounds);
+                }
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+        bool try_lock() noexcept
+        {
+            if(!try_lock_unrecorded())
+            {
+                return false;
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+            return true;
+        }
+
+        void unlock() noexcept { m_state.fetch_and(~writer, std::memory_order_release); }
+
+        void lock_shared() noexcept
+        {
+            if(!try_lock_shared_unrecorded())
+            {
+                _internal::wait_timer timer(m_stats);
+                uint32 rounds = 0;
+                while(!try_lock_shared_unrecorded())
+                {
+                    backoff(rounds);
+                }
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+        bool try_lock_shared() noexcept
+        {
+            if(!try_lock_shared_unrecorded())
+            {
+                return false;
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+            return true;
+        }
+
+        void unlock_shared() noexcept { m_state.fetch_sub(reader, std::memory_order_release); }
+
+      private:
+        // Takes it if there's nobody in it, clearing the waiting flag (which any other waiting writer sets again)
+        bool try_lock_unrecorded() noexcept
+        {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            return (state & ~writer_waiting) == 0 &&
+                   m_state.compare_exchange_strong(state, writer, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        bool try_lock_shared_unrecorded() noexcept
+        {
+            uint32 state = m_state.load(std::memory_order_relaxed);
+            return (state & (writer | writer_waiting)) == 0 &&
+                   m_state.compare_exchange_strong(state, state + reader, std::memory_order_acquire,
+                                                   std::memory_order_relaxed);
+        }
+
+        static void backoff(uint32& rounds) noexcept
+        {
+            if(!_internal::can_spin() || ++rounds > 64)
+            {
+                std::this_thread::yield();
+                return;
+            }
+            for(uint32 i = 0; i < rounds * 8; i++)
+            {
+                _internal::cpu_relax();
+            }
+        }
+
+        std::atomic<uint32> m_state = 0;
+        lock_stats* m_stats = nullptr;
+    };
+
+    // A sequence lock.  Writers bump the sequence to odd, write, then bump it to even.  Readers copy the value and
+    // retry if the sequence was odd or changed underneath them, so reads never block a writer and never take a lock.
+    // Writers are serialized against each other by the sequence itself.  With a name, acquisitions are writes and
+    // contentions are reads that had to retry.
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    class seqlock
+    {
+        // The value lives in relaxed atomic words, so a torn read isn't a data race, just a retry
+        static constexpr std::size_t word_count = (sizeof(T) + sizeof(uint64) - 1) / sizeof(uint64);
+
+      public:
+        seqlock() noexcept
+            requires std::is_default_constructible_v<T>
+            : seqlock(T {})
+        {
+        }
+
+        explicit seqlock(const T& value, std::string_view name = {})
+            : m_stats(_internal::stats_for(name))
+        {
+            store_words(value, 0);
+        }
+
+        seqlock(const seqlock&) = delete;
+        seqlock& operator=(const seqlock&) = delete;
+
+        [[nodiscard]] T load() const noexcept
+        {
+            uint64 words[word_count];
+            bool retried = false;
+            while(true)
+            {
+                const uint32 before = m_sequence.load(std::memory_order_acquire);
+                if((before & 1) == 0)
+                {
+                    for(std::size_t i = 0; i < word_count; i++)
+                    {
+                        words[i] = m_words[i].load(std::memory_order_relaxed);
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(m_sequence.load(std::memory_order_relaxed) == before)
+                    {
+                        if(retried && m_stats != nullptr)
+                        {
+                            m_stats->record_wait(0);
+                        }
+                        T value;
+                        std::memcpy(&value, words, sizeof(T));
+                        return value;
+                    }
+                }
+                retried = true;
+                _internal::cpu_relax();
+            }
+        }
+
+        void store(const T& value) noexcept
+        {
+            // Taking the sequence from even to odd is what makes this the one writer
+            uint32 sequence = m_sequence.load(std::memory_order_relaxed);
+            while((sequence & 1) != 0 ||
+                  !m_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed))
+            {
+                _internal::cpu_relax();
+                sequence = m_sequence.load(std::memory_order_relaxed);
+            }
+            store_words(value, sequence);
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+      private:
+        // The sequence is already odd (or this is the constructor)
+        void store_words(const T& value, uint32 sequence) noexcept
+        {
+            uint64 words[word_count] = {};
+            std::memcpy(words, &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_release);
+            for(std::size_t i = 0; i < word_count; i++)
+            {
+                m_words[i].store(words[i], std::memory_order_relaxed);
+            }
+            m_sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        std::atomic<uint32> m_sequence {0};
+        std::atomic<uint64> m_words[word_count] {};
+        lock_stats* m_stats = nullptr;
+    };
+
+    // Stays set until reset().  wait() returns straight away while it's set.
+    class event
+    {
+      public:
+        explicit event(bool initially_set = false, std::string_view name = {})
+            : m_state(initially_set ? 1 : 0)
+            , m_stats(_internal::stats_for(name))
+        {
+        }
+
+        event(const event&) = delete;
+        event& operator=(const event&) = delete;
+
+        void set() noexcept
+        {
+            m_state.store(1, std::memory_order_release);
+            m_state.notify_all();
+        }
+
+        void reset() noexcept { m_state.store(0, std::memory_order_relaxed); }
+
+        [[nodiscard]] bool is_set() const noexcept { return m_state.load(std::memory_order_acquire) != 0; }
+
+        void wait() const noexcept
+        {
+            if(!is_set())
+            {
+                _internal::wait_timer timer(m_stats);
+                while(m_state.load(std::memory_order_acquire) == 0)
+                {
+                    m_state.wait(0, std::memory_order_acquire);
+                }
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+      private:
+        std::atomic<uint32> m_state;
+        lock_stats* m_stats;
+    };
+
+    // Counts down once; wait() blocks until it reaches zero.  Like std::latch, plus the instrumentation.
+    class latch
+    {
+      public:
+        explicit latch(uint32 count, std::string_view name = {})
+            : m_count(count)
+            , m_stats(_internal::stats_for(name))
+        {
+        }
+
+        latch(const latch&) = delete;
+        latch& operator=(const latch&) = delete;
+
+        void count_down(uint32 n = 1) noexcept
+        {
+            if(m_count.fetch_sub(n, std::memory_order_acq_rel) == n)
+            {
+                m_count.notify_all();
+            }
+        }
+
+        [[nodiscard]] bool try_wait() const noexcept { return m_count.load(std::memory_order_acquire) == 0; }
+
+        void wait() const noexcept
+        {
+            uint32 count = m_count.load(std::memory_order_acquire);
+            if(count != 0)
+            {
+                _internal::wait_timer timer(m_stats);
+                while(count != 0)
+                {
+                    m_count.wait(count, std::memory_order_acquire);
+                    count = m_count.load(std::memory_order_acquire);
+                }
+            }
+            if(m_stats != nullptr)
+            {
+                m_stats->record_acquire();
+            }
+        }
+
+        void arrive_and_wait(uint32 n = 1) noexcept
+        {
+            count_down(n);
+            wait();
+        }
+
+      private:
+        std::atomic<uint32> m_count;
+        lock_stats* m_stats;
+    };
+}
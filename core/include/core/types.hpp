@@ -19,8 +19,12 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #include "check.hpp"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
+#include <cstring>
 #include <span>
+#include <string_view>
 #include <type_traits>
 
 using uint8 = uint8_t;
@@ -90,6 +94,35 @@ namespace raoe
         auto value_rep = std::bit_cast<std::array<uint8, sizeof(T)>>(value);
         std::ranges::reverse(value_rep);
         return std::bit_cast<T>(value_rep);
+#endif
+    }
+
+    struct wide_product
+    {
+        uint64 high;
+        uint64 low;
+    };
+
+    // Full 64x64 -> 128 bit multiply.  Uses the compiler's 128 bit integer when available, falling back to a portable
+    // 32 bit limb multiply (which is also what runs at compile time on compilers without __int128)
+    [[nodiscard]] constexpr wide_product mul_wide(uint64 a, uint64 b) noexcept
+    {
+#if defined(__SIZEOF_INT128__)
+        const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        return {static_cast<uint64>(product >> 64), static_cast<uint64>(product)};
+#else
+        const uint64 a_lo = a & 0xFFFFFFFFull;
+        const uint64 a_hi = a >> 32;
+        const uint64 b_lo = b & 0xFFFFFFFFull;
+        const uint64 b_hi = b >> 32;
+
+        const uint64 lo_lo = a_lo * b_lo;
+        const uint64 hi_lo = a_hi * b_lo;
+        const uint64 lo_hi = a_lo * b_hi;
+        const uint64 hi_hi = a_hi * b_hi;
+
+        const uint64 cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFull) + lo_hi;
+        return {hi_hi + (hi_lo >> 32) + (cross >> 32), (cross << 32) | (lo_lo & 0xFFFFFFFFull)};
 #endif
     }
 }
@@ -125,6 +158,40 @@ namespace raoe
     {
         return std::rotl(seed, std::numeric_limits<std::size_t>::digits / 3) ^ distribute(std::hash<T> {}(v));
     }
+
+    // A string hash that's the same on every platform, compiler and run (std::hash promises none of that), for
+    // anything that gets written to disk or has to agree between builds.  Eight bytes per step.
+    [[nodiscard]] inline constexpr uint64 stable_hash(std::string_view text, uint64 seed = 0) noexcept
+    {
+        constexpr uint64 golden = 0x9e3779b97f4a7c15;
+        // Little endian, whatever the machine is
+        auto read = [&](std::size_t at, std::size_t count) {
+            uint64 word = 0;
+            // An empty string can have a null data(), and memcpy doesn't want one even for nothing
+            if(count == 0)
+            {
+                return word;
+            }
+            if(!std::is_constant_evaluated() && std::endian::native == std::endian::little)
+            {
+                std::memcpy(&word, text.data() + at, count);
+                return word;
+            }
+            for(std::size_t b = 0; b < count; b++)
+            {
+                word |= uint64 {static_cast<unsigned char>(text[at + b])} << (b * 8);
+            }
+            return word;
+        };
+
+        uint64 hash = distribute(seed ^ (text.size() * golden));
+        std::size_t i = 0;
+        for(; i + 8 <= text.size(); i += 8)
+        {
+            hash = distribute(hash ^ read(i, 8)) + golden;
+        }
+        return distribute(hash ^ read(i, text.size() - i));
+    }
 }
 
 // notnull from the C++ gsl
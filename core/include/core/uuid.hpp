@@ -19,13 +19,14 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #include <algorithm>
 #include <array>
 #include <charconv>
+#include <chrono>
 #include <cstring>
 #include <format>
-#include <random>
 #include <span>
 #include <type_traits>
 
 #include "parse.hpp"
+#include "random.hpp"
 #include "string.hpp"
 #include "types.hpp"
 
@@ -34,6 +35,7 @@ namespace raoe
     struct uuid
     {
         friend uuid make_random_uuid_v4();
+        friend uuid make_uuid_v7();
         friend std::hash<uuid>;
         friend std::formatter<uuid>;
 
@@ -153,6 +155,8 @@ namespace raoe
 
         constexpr std::strong_ordering operator<=>(const uuid& other) const { return m_bytes <=> other.m_bytes; }
 
+        [[nodiscard]] constexpr std::span<const uint8, 16> bytes() const noexcept { return m_bytes; }
+
         bool operator==(const uuid& other) const noexcept = default;
         bool operator!=(const uuid& other) const noexcept = default;
         bool operator>(const uuid& other) const noexcept = default;
@@ -166,15 +170,11 @@ namespace raoe
 
     inline uuid make_random_uuid_v4()
     {
-        std::random_device r;
-        std::mt19937_64 gen(r());
-        std::uniform_int_distribution<> dis(0, 255);
+        auto& engine = raoe::random::thread_engine();
+        const std::array<uint64, 2> words = {engine(), engine()};
 
         uuid id;
-        for(int i = 0; i < 16; i++)
-        {
-            id.m_bytes[i] = dis(gen);
-        }
+        std::memcpy(id.m_bytes.data(), words.data(), id.m_bytes.size());
 
         // variant must be 10xxxxxxx
         id.m_bytes[8] &= 0xBF;
@@ -187,6 +187,34 @@ namespace raoe
         return id;
     }
 
+    // A version 7 uuid: the top 48 bits are the unix time in milliseconds and the rest is random, so ids made later
+    // sort later.  Good for keys in anything sorted, which gets to append them instead of inserting all over.
+    inline uuid make_uuid_v7()
+    {
+        const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        auto& engine = raoe::random::thread_engine();
+        const std::array<uint64, 2> words = {engine(), engine()};
+
+        uuid id;
+        std::memcpy(id.m_bytes.data(), words.data(), id.m_bytes.size());
+        for(int i = 0; i < 6; i++)
+        {
+            id.m_bytes[i] = static_cast<uint8>(static_cast<uint64>(now) >> (40 - 8 * i));
+        }
+
+        // variant must be 10xxxxxxx
+        id.m_bytes[8] &= 0xBF;
+        id.m_bytes[8] |= 0x80;
+
+        // version must be 0111xxxx
+        id.m_bytes[6] &= 0x7F;
+        id.m_bytes[6] |= 0x70;
+
+        return id;
+    }
+
     /// create a uuid that is unique without caring about the mode or how it's generated
     /// this should be the uuid best suited for the platform (ie: on windows it will be windows format TODO: this)
     /// or it will be a random v4 uuid if there is no well suited platform uuid (TODO: this is actually what it always
@@ -197,7 +225,7 @@ namespace raoe
         return make_random_uuid_v4();
     }
 
-    inline bool from_string(std::string_view arg, uuid& id)
+    inline bool from_string(std::string_view arg, uuid& id, std::string_view fmt = {})
     {
         // If we are smaller than 36 characters, we can't be a valid uuid
         if(arg.size() < 36)
@@ -0,0 +1,1241 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include "core/bloom_filter.hpp"
+#include "core/check.hpp"
+#include "core/journal.hpp"
+#include "core/mapped_file.hpp"
+#include "core/types.hpp"
+#include "core/uuid.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <compare>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A map from uuid to bytes that lives on the disk and can be far bigger than memory, as a log structured merge tree.
+//
+// Writes go into the journal and a sorted map in memory (the memtable).  Once that's big enough a background thread
+// writes it out as a sorted table: 4KB blocks of entries, an index with each block's first key, and a Bloom filter.
+// Tables are mapped, so a lookup that misses the memtable is a filter check, a binary search of the index and a scan
+// of one block, per table it might be in.  The same thread merges tables down into levels that are each ten times
+// bigger than the one above, and don't overlap within a level, so there's only ever a few tables to look in.  Keys
+// compare as 128 bit numbers (the bytes in order), so version 7 ids arrive in order and their tables mostly get moved
+// down a level instead of rewritten.
+//     raoe::uuid_store profiles(raoe::fs::write_dir() / "profiles");
+//     profiles.put(player.id, raoe::as_bytes(player.profile));
+//     if(auto bytes = profiles.get(id)) load_profile(*bytes);
+namespace raoe
+{
+    namespace _internal::uuid_store_format
+    {
+        inline constexpr uint32 table_magic = 0x54534152;    // "RAST"
+        inline constexpr uint32 manifest_magic = 0x4d534152; // "RASM"
+        inline constexpr uint32 version = 1;
+        // The size an erased key is written with
+        inline constexpr uint32 erased = ~uint32 {0};
+
+        struct key
+        {
+            uint64 high;
+            uint64 low;
+
+            [[nodiscard]] static key from(const uuid& id) noexcept
+            {
+                key k {0, 0};
+                for(std::size_t i = 0; i < 8; i++)
+                {
+                    k.high = (k.high << 8) | id.bytes()[i];
+                    k.low = (k.low << 8) | id.bytes()[i + 8];
+                }
+                return k;
+            }
+
+            [[nodiscard]] uint64 hash() const noexcept { return distribute(high ^ distribute(low)); }
+
+            auto operator<=>(const key&) const = default;
+        };
+
+        struct entry_header
+        {
+            uint64 high;
+            uint64 low;
+            uint32 size;
+            uint32 reserved;
+        };
+
+        struct index_entry
+        {
+            // The first key in the block
+            uint64 high;
+            uint64 low;
+            uint64 offset;
+            uint64 size;
+            uint64 checksum;
+        };
+
+        struct table_footer
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 count;
+            uint64 index_offset;
+            uint64 index_count;
+            uint64 bloom_offset;
+            uint64 bloom_words;
+            uint64 bloom_capacity;
+            key min;
+            key max;
+            uint64 checksum;
+        };
+
+        struct manifest_header
+        {
+            uint32 magic;
+            uint32 version;
+            uint64 count;
+            uint64 checksum;
+        };
+
+        struct manifest_entry
+        {
+            uint64 number;
+            uint64 level;
+        };
+
+        static_assert(sizeof(entry_header) == 24 && sizeof(index_entry) == 40 && sizeof(table_footer) == 96 &&
+                          sizeof(manifest_header) == 24 && sizeof(manifest_entry) == 16,
+                      "uuid_store's file layout has padding in it");
+
+        template <typename T>
+        [[nodiscard]] T read(std::span<const std::byte> bytes, std::size_t at) noexcept
+        {
+            T value;
+            std::memcpy(&value, bytes.data() + at, sizeof(T));
+            return value;
+        }
+
+        template <typename T>
+        void append(std::vector<std::byte>& out, const T& value)
+        {
+            const auto bytes = std::as_bytes(std::span(&value, 1));
+            out.insert(out.end(), bytes.begin(), bytes.end());
+        }
+
+        [[nodiscard]] inline std::string table_name(uint64 number)
+        {
+            constexpr std::string_view digits = "0123456789abcdef";
+            std::string name(16, '0');
+            for(std::size_t i = 16; i-- > 0; number >>= 4)
+            {
+                name[i] = digits[number & 0xf];
+            }
+            return name + ".sst";
+        }
+
+        [[nodiscard]] inline std::optional<uint64> table_number(std::string_view name)
+        {
+            if(name.size() != 20 || !name.ends_with(".sst"))
+            {
+                return std::nullopt;
+            }
+            uint64 number = 0;
+            for(const char c : name.substr(0, 16))
+            {
+                const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+                if(digit < 0)
+                {
+                    return std::nullopt;
+                }
+                number = (number << 4) | static_cast<uint64>(digit);
+            }
+            return number;
+        }
+
+        // A sorted table on the disk, mapped.  Retired tables delete their file once the last lookup using them is
+        // done with them.
+        class table
+        {
+          public:
+            struct entry
+            {
+                key id;
+                bool erased;
+                std::span<const std::byte> bytes;
+            };
+
+            [[nodiscard]] static std::shared_ptr<table> open(const std::filesystem::path& path, uint64 number)
+            {
+                mapped_file file(path);
+                if(file.size() < sizeof(table_footer))
+                {
+                    return nullptr;
+                }
+                const auto bytes = file.bytes();
+                const auto footer = read<table_footer>(bytes, bytes.size() - sizeof(table_footer));
+                const uint64 end = bytes.size() - sizeof(table_footer);
+                if(footer.magic != table_magic || footer.version != version || footer.index_offset > end ||
+                   footer.index_count > (end - footer.index_offset) / sizeof(index_entry) ||
+                   footer.bloom_offset != footer.index_offset + footer.index_count * sizeof(index_entry) ||
+                   footer.bloom_words != (end - footer.bloom_offset) / sizeof(uint32) ||
+                   journal_format::hash_bytes(bytes.subspan(footer.index_offset, end - footer.index_offset),
+                                              footer.count) != footer.checksum)
+                {
+                    return nullptr;
+                }
+                std::vector<uint32> words(footer.bloom_words);
+                if(!words.empty())
+                {
+                    std::memcpy(words.data(), bytes.data() + footer.bloom_offset, words.size() * sizeof(uint32));
+                }
+                return std::shared_ptr<table>(new table(path, number, std::move(file), footer,
+                                                        bloom_filter(words, footer.bloom_capacity, footer.count)));
+            }
+
+            ~table()
+            {
+                m_file.close();
+                if(m_retired.load(std::memory_order_acquire))
+                {
+                    std::error_code ec;
+                    std::filesystem::remove(m_path, ec);
+                }
+            }
+
+            table(const table&) = delete;
+            table& operator=(const table&) = delete;
+
+            void retire() noexcept { m_retired.store(true, std::memory_order_release); }
+
+            [[nodiscard]] uint64 number() const noexcept { return m_number; }
+            [[nodiscard]] key min() const noexcept { return m_footer.min; }
+            [[nodiscard]] key max() const noexcept { return m_footer.max; }
+            [[nodiscard]] uint64 count() const noexcept { return m_footer.count; }
+            [[nodiscard]] uint64 size() const noexcept { return m_file.size(); }
+            [[nodiscard]] bool overlaps(const key& min, const key& max) const noexcept
+            {
+                return !(max < m_footer.min || m_footer.max < min);
+            }
+
+            // nullopt if the key isn't in the table (or the block it'd be in is damaged)
+            [[nodiscard]] std::optional<entry> find(const key& id) const
+            {
+                if(id < m_footer.min || m_footer.max < id || !m_bloom.may_contain(id.hash()))
+                {
+                    return std::nullopt;
+                }
+                // The last block starting at or before the key
+                std::size_t low = 0;
+                std::size_t high = m_footer.index_count;
+                while(low < high)
+                {
+                    const std::size_t middle = low + (high - low) / 2;
+                    const index_entry block = block_at(middle);
+                    if(id < key {block.high, block.low})
+                    {
+                        high = middle;
+                    }
+                    else
+                    {
+                        low = middle + 1;
+                    }
+                }
+                if(low == 0)
+                {
+                    return std::nullopt;
+                }
+                const index_entry block = block_at(low - 1);
+                if(!check_block(block))
+                {
+                    return std::nullopt;
+                }
+                for(std::size_t at = block.offset; at < block.offset + block.size;)
+                {
+                    const auto [found, next] = entry_at(at);
+                    if(found.id == id)
+                    {
+                        return found;
+                    }
+                    if(id < found.id)
+                    {
+                        break;
+                    }
+                    at = next;
+                }
+                return std::nullopt;
+            }
+
+            // Every block's checksum; what compaction checks before it copies a table
+            [[nodiscard]] bool check() const
+            {
+                for(std::size_t i = 0; i < m_footer.index_count; i++)
+                {
+                    if(!check_block(block_at(i)))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // The entry that starts at, and where the next one does.  Entries are one after another from 0 to
+            // data_end().
+            [[nodiscard]] std::pair<entry, std::size_t> entry_at(std::size_t at) const
+            {
+                const auto header = read<entry_header>(m_file.bytes(), at);
+                const std::size_t size = header.size == erased ? 0 : header.size;
+                return {entry {key {header.high, header.low}, header.size == erased,
+                               m_file.bytes().subspan(at + sizeof(header), size)},
+                        at + sizeof(header) + size};
+            }
+
+            [[nodiscard]] std::size_t data_end() const noexcept { return m_footer.index_offset; }
+
+          private:
+            table(std::filesystem::path path, uint64 number, mapped_file file, const table_footer& footer,
+                  bloom_filter bloom)
+                : m_path(std::move(path))
+                , m_number(number)
+                , m_file(std::move(file))
+                , m_footer(footer)
+                , m_bloom(std::move(bloom))
+            {
+            }
+
+            [[nodiscard]] index_entry block_at(std::size_t i) const noexcept
+            {
+                return read<index_entry>(m_file.bytes(), m_footer.index_offset + i * sizeof(index_entry));
+            }
+
+            [[nodiscard]] bool check_block(const index_entry& block) const
+            {
+                return block.offset <= data_end() && block.size <= data_end() - block.offset &&
+                       journal_format::hash_bytes(m_file.bytes().subspan(block.offset, block.size), block.offset) ==
+                           block.checksum;
+            }
+
+            std::filesystem::path m_path;
+            uint64 m_number;
+            mapped_file m_file;
+            table_footer m_footer;
+            bloom_filter m_bloom;
+            std::atomic<bool> m_retired = false;
+        };
+
+        // Writes a table, entries in key order
+        class table_writer
+        {
+          public:
+            table_writer(std::filesystem::path path, std::size_t block_size)
+                : m_path(std::move(path))
+                , m_block_size(block_size)
+            {
+                std::error_code ec;
+                std::filesystem::remove(m_path, ec);
+                m_file = journal_format::append_file(m_path);
+                m_ok = m_file.is_open();
+            }
+
+            // Removes the file unless it was finished
+            ~table_writer()
+            {
+                if(!m_finished)
+                {
+                    m_file.close();
+                    std::error_code ec;
+                    std::filesystem::remove(m_path, ec);
+                }
+            }
+
+            table_writer(const table_writer&) = delete;
+            table_writer& operator=(const table_writer&) = delete;
+
+            void add(const key& id, bool is_erased, std::span<const std::byte> bytes)
+            {
+                check_if(bytes.size() < erased, "uuid_store: a value can't be 4GB or more");
+                if(m_block_bytes == 0)
+                {
+                    m_block_first = id;
+                }
+                if(m_count == 0)
+                {
+                    m_min = id;
+                }
+                m_max = id;
+                m_count++;
+                m_hashes.push_back(id.hash());
+
+                const uint32 size = is_erased ? erased : static_cast<uint32>(bytes.size());
+                append(m_pending, entry_header {id.high, id.low, size, 0});
+                m_pending.insert(m_pending.end(), bytes.begin(), bytes.end());
+                m_block_bytes += sizeof(entry_header) + bytes.size();
+                if(m_block_bytes >= m_block_size)
+                {
+                    end_block();
+                }
+            }
+
+            [[nodiscard]] uint64 count() const noexcept { return m_count; }
+            [[nodiscard]] uint64 size() const noexcept { return m_written + m_pending.size(); }
+
+            // Writes the index, filter and footer, and syncs it
+            [[nodiscard]] bool finish(double false_positive_rate)
+            {
+                if(m_block_bytes != 0)
+                {
+                    end_block();
+                }
+                bloom_filter bloom(m_hashes.size(), false_positive_rate);
+                for(const uint64 hash : m_hashes)
+                {
+                    bloom.insert(hash);
+                }
+                const std::vector<uint32> words = bloom.words();
+
+                table_footer footer {table_magic, version, m_count, size(), m_index.size() / sizeof(index_entry),
+                                     0, words.size(), m_hashes.size(), m_min, m_max, 0};
+                const std::size_t tail = m_pending.size();
+                m_pending.insert(m_pending.end(), m_index.begin(), m_index.end());
+                footer.bloom_offset = footer.index_offset + m_index.size();
+                const auto bloom_bytes = std::as_bytes(std::span(words));
+                m_pending.insert(m_pending.end(), bloom_bytes.begin(), bloom_bytes.end());
+                footer.checksum =
+                    journal_format::hash_bytes(std::span(m_pending).subspan(tail), footer.count);
+                append(m_pending, footer);
+                write_pending();
+                m_ok = m_ok && m_file.sync();
+                m_file.close();
+                m_finished = m_ok;
+                return m_ok;
+            }
+
+          private:
+            void end_block()
+            {
+                const std::size_t start = m_pending.size() - m_block_bytes;
+                const uint64 offset = m_written + start;
+                append(m_index, index_entry {m_block_first.high, m_block_first.low, offset, m_block_bytes,
+                                             journal_format::hash_bytes(std::span(m_pending).subspan(start), offset)});
+                m_block_bytes = 0;
+                // Only whole blocks go out, so the one being built is always all in m_pending
+                if(m_pending.size() >= 1024 * 1024)
+                {
+                    write_pending();
+                }
+            }
+
+            void write_pending()
+            {
+                m_ok = m_ok && m_file.write(m_pending);
+                m_written += m_pending.size();
+                m_pending.clear();
+            }
+
+            std::filesystem::path m_path;
+            std::size_t m_block_size;
+            journal_format::append_file m_file;
+            bool m_ok = false;
+            bool m_finished = false;
+            std::vector<std::byte> m_pending;
+            uint64 m_written = 0;
+            std::vector<std::byte> m_index;
+            std::vector<uint64> m_hashes;
+            std::size_t m_block_bytes = 0;
+            key m_block_first {0, 0};
+            key m_min {0, 0};
+            key m_max {0, 0};
+            uint64 m_count = 0;
+        };
+    }
+
+    class uuid_store
+    {
+      public:
+        struct options
+        {
+            // How much a power cut can lose.  sync makes put() and erase() wait for the disk (with everyone else
+            // that's waiting at the same time).
+            journal::durability durability = journal::durability::periodic;
+            // The memtable is written out as a table once it's about this big
+            std::size_t memtable_size = 64 * 1024 * 1024;
+            // Compaction cuts what it writes into tables about this big
+            uint64 table_size = 64 * 1024 * 1024;
+            std::size_t block_size = 4096;
+            // How many freshly written tables can pile up before they're merged into level 1
+            std::size_t level0_tables = 4;
+            // Level 1 can be this big, and each level after that ten times the one before
+            uint64 level1_size = 256 * 1024 * 1024;
+            double false_positive_rate = 0.01;
+        };
+
+        struct statistics
+        {
+            uint64 flushes = 0;
+            uint64 compactions = 0;
+            // Tables moved down a level without being rewritten, which is what in order keys mostly get
+            uint64 moves = 0;
+            uint64 bytes_compacted = 0;
+            // How many tables each level has
+            std::vector<std::size_t> tables;
+        };
+
+        explicit uuid_store(std::filesystem::path directory)
+            : uuid_store(std::move(directory), options {})
+        {
+        }
+
+        uuid_store(std::filesystem::path directory, options opts)
+            : m_directory(std::move(directory))
+            , m_options(std::move(opts))
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(m_directory, ec);
+            open_tables();
+
+            journal::options log;
+            // Sync is done here, after the memtable's updated, so that appends can share a sync without racing
+            // each other into the memtable
+            log.durability = m_options.durability == journal::durability::sync ? journal::durability::buffered
+                                                                                : m_options.durability;
+            log.compact_after = std::numeric_limits<uint64>::max();
+            log.take_snapshot = [this] {
+                return journal::snapshot {m_flushed_through.load(std::memory_order_acquire), {}};
+            };
+            m_journal.emplace(m_directory / "journal", std::move(log));
+            m_journal->replay([](std::span<const std::byte>) {},
+                              [&](const journal::record& r) {
+                                  namespace format = _internal::uuid_store_format;
+                                  if(r.bytes.size() < sizeof(format::key))
+                                  {
+                                      return;
+                                  }
+                                  const auto id = format::read<format::key>(r.bytes, 0);
+                                  apply(id, r.type == erase_record ? std::nullopt
+                                                                   : std::optional(r.bytes.subspan(sizeof(id))));
+                              });
+            m_worker = std::jthread([this](std::stop_token stop) { work(stop); });
+        }
+
+        // Whatever's still in the memtable is in the journal, and comes back from it next time
+        ~uuid_store()
+        {
+            m_worker.request_stop();
+            m_worker.join();
+        }
+
+        uuid_store(const uuid_store&) = delete;
+        uuid_store& operator=(const uuid_store&) = delete;
+
+        // False if it couldn't be written (and with durability::sync, synced)
+        bool put(const uuid& id, std::span<const std::byte> bytes) { return write(id, bytes); }
+        bool erase(const uuid& id) { return write(id, std::nullopt); }
+
+        [[nodiscard]] std::optional<std::vector<std::byte>> get(const uuid& id) const
+        {
+            const auto found = find(_internal::uuid_store_format::key::from(id), true);
+            return found ? *found : std::nullopt;
+        }
+
+        [[nodiscard]] bool contains(const uuid& id) const
+        {
+            const auto found = find(_internal::uuid_store_format::key::from(id), false);
+            return found && found->has_value();
+        }
+
+        // False once a write has failed, or if the manifest was missing or damaged when it was opened.  Nothing more
+        // gets written after that, and the tables on disk are left as they are.
+        [[nodiscard]] bool ok() const
+        {
+            std::scoped_lock lock(m_mutex);
+            return !m_failed;
+        }
+
+        // Waits until everything written so far is on the disk, whatever the durability
+        bool sync() { return m_journal->flush(); }
+
+        // Writes the memtable out as a table and waits for the compaction that sets off to finish.  Never needed,
+        // but handy before measuring or copying the files somewhere.
+        bool flush()
+        {
+            std::unique_lock lock(m_mutex);
+            m_room.wait(lock, [&] { return m_immutable == nullptr || m_failed; });
+            if(!m_memtable.empty() && !m_failed)
+            {
+                freeze();
+            }
+            m_idle.wait(lock, [&] { return (m_immutable == nullptr && !m_working) || m_failed; });
+            return !m_failed;
+        }
+
+        [[nodiscard]] statistics stats() const
+        {
+            std::scoped_lock lock(m_mutex);
+            statistics stats = m_stats;
+            for(const auto& level : m_version->levels)
+            {
+                stats.tables.push_back(level.size());
+            }
+            return stats;
+        }
+
+      private:
+        using key = _internal::uuid_store_format::key;
+        using table = _internal::uuid_store_format::table;
+        using memtable = std::map<key, std::optional<std::vector<std::byte>>>;
+
+        static constexpr uint32 put_record = 0;
+        static constexpr uint32 erase_record = 1;
+        static constexpr std::size_t max_levels = 7;
+
+        // The tables at one moment.  Level 0 is newest first and can overlap; the rest are in key order and don't.
+        // Lookups hold on to one while they read, so compaction never changes one, it makes a new one.
+        using table_list = std::vector<std::shared_ptr<table>>;
+        struct version
+        {
+            std::vector<table_list> levels = std::vector<table_list>(1);
+
+            [[nodiscard]] uint64 level_size(std::size_t level) const
+            {
+                uint64 size = 0;
+                for(const auto& t : levels[level])
+                {
+                    size += t->size();
+                }
+                return size;
+            }
+        };
+
+        // The tables in one level (or one level 0 table) read in order, for merging
+        struct run
+        {
+            explicit run(table_list in_tables)
+                : tables(std::move(in_tables))
+            {
+            }
+
+            table_list tables;
+            std::size_t reading = 0;
+            std::size_t at = 0;
+            std::optional<table::entry> current;
+
+            void next()
+            {
+                while(reading < tables.size() && at >= tables[reading]->data_end())
+                {
+                    reading++;
+                    at = 0;
+                }
+                if(reading == tables.size())
+                {
+                    current.reset();
+                    return;
+                }
+                auto [found, after] = tables[reading]->entry_at(at);
+                current = found;
+                at = after;
+            }
+        };
+
+        struct compaction
+        {
+            std::size_t level = 0;
+            // Newest first
+            table_list inputs;
+            // What they overlap in the level below
+            table_list below;
+        };
+
+        bool write(const uuid& id, std::optional<std::span<const std::byte>> bytes)
+        {
+            const key k = key::from(id);
+            std::vector<std::byte> record(sizeof(k) + (bytes ? bytes->size() : 0));
+            std::memcpy(record.data(), &k, sizeof(k));
+            if(bytes && !bytes->empty())
+            {
+                std::memcpy(record.data() + sizeof(k), bytes->data(), bytes->size());
+            }
+            {
+                std::unique_lock lock(m_mutex);
+                // Both memtables full means the worker's behind; wait for it
+                m_room.wait(lock, [&] {
+                    return m_memtable_bytes < m_options.memtable_size || !m_immutable || m_failed;
+                });
+                if(m_failed || !m_journal->append(bytes ? put_record : erase_record, record))
+                {
+                    return false;
+                }
+                apply(k, bytes);
+                if(m_memtable_bytes >= m_options.memtable_size && !m_immutable)
+                {
+                    freeze();
+                }
+            }
+            return m_options.durability != journal::durability::sync || m_journal->flush();
+        }
+
+        void apply(const key& k, std::optional<std::span<const std::byte>> bytes)
+        {
+            // A rough guess at a map node's overhead
+            constexpr std::size_t node_size = 64;
+            auto [it, added] = m_memtable.try_emplace(k);
+            if(added)
+            {
+                m_memtable_bytes += sizeof(key) + node_size;
+            }
+            else if(it->second)
+            {
+                m_memtable_bytes -= it->second->size();
+            }
+            if(bytes)
+            {
+                it->second.emplace(bytes->begin(), bytes->end());
+                m_memtable_bytes += bytes->size();
+            }
+            else
+            {
+                it->second.reset();
+            }
+        }
+
+        // Hands the memtable to the worker, with the journal's last record as what it'll cover
+        void freeze()
+        {
+            m_immutable = std::make_shared<const memtable>(std::move(m_memtable));
+            m_immutable_through = m_journal->last_sequence();
+            m_memtable.clear();
+            m_memtable_bytes = 0;
+            m_work.notify_one();
+        }
+
+        // nullopt if it's nowhere, an empty optional if it's been erased.  Without copy, what's there comes back empty.
+        [[nodiscard]] std::optional<std::optional<std::vector<std::byte>>> find(const key& k, bool copy) const
+        {
+            auto result = [&](bool erased, std::span<const std::byte> bytes) {
+                std::optional<std::optional<std::vector<std::byte>>> found(std::in_place);
+                if(!erased)
+                {
+                    found->emplace(copy ? bytes.size() : 0);
+                    std::ranges::copy(bytes.first(found->value().size()), found->value().begin());
+                }
+                return found;
+            };
+
+            std::shared_ptr<const version> current;
+            {
+                std::scoped_lock lock(m_mutex);
+                for(const memtable* mem : {&m_memtable, m_immutable.get()})
+                {
+                    if(mem == nullptr)
+                    {
+                        continue;
+                    }
+                    if(const auto it = mem->find(k); it != mem->end())
+                    {
+                        return result(!it->second, it->second ? std::span(*it->second) : std::span<const std::byte>());
+                    }
+                }
+                current = m_version;
+            }
+
+            for(const auto& t : current->levels[0])
+            {
+                if(const auto found = t->find(k))
+                {
+                    return result(found->erased, found->bytes);
+                }
+            }
+            for(std::size_t level = 1; level < current->levels.size(); level++)
+            {
+                // The last table starting at or before the key
+                const auto& tables = current->levels[level];
+                const auto after =
+                    std::ranges::upper_bound(tables, k, std::less {}, [](const auto& t) { return t->min(); });
+                if(after == tables.begin())
+                {
+                    continue;
+                }
+                if(const auto found = (*std::prev(after))->find(k))
+                {
+                    return result(found->erased, found->bytes);
+                }
+            }
+            return std::nullopt;
+        }
+
+        void open_tables()
+        {
+            namespace format = _internal::uuid_store_format;
+            std::error_code ec;
+            std::vector<format::manifest_entry> listed;
+            bool have_manifest = false;
+            {
+                const mapped_file manifest(m_directory / "manifest");
+                if(manifest.size() >= sizeof(format::manifest_header))
+                {
+                    const auto header = format::read<format::manifest_header>(manifest.bytes(), 0);
+                    const auto entries = manifest.bytes().subspan(sizeof(header));
+                    if(header.magic == format::manifest_magic && header.version == format::version &&
+                       entries.size() == header.count * sizeof(format::manifest_entry) &&
+                       _internal::journal_format::hash_bytes(entries, header.count) == header.checksum)
+                    {
+                        have_manifest = true;
+                        for(std::size_t i = 0; i < header.count; i++)
+                        {
+                            listed.push_back(
+                                format::read<format::manifest_entry>(entries, i * sizeof(format::manifest_entry)));
+                        }
+                    }
+                }
+            }
+
+            // Anything the manifest doesn't list is from a flush or compaction that didn't finish.  Without a manifest
+            // that checks out there's no telling which tables those are, and the journal has already let go of what's
+            // in them, so they're all left alone and nothing more gets written.
+            const bool damaged = !have_manifest && std::filesystem::exists(m_directory / "manifest", ec);
+            bool unlisted = false;
+            for(const auto& file : std::filesystem::directory_iterator(m_directory, ec))
+            {
+                const std::string name = file.path().filename().string();
+                const auto number = format::table_number(name);
+                if(number)
+                {
+                    m_next_table = std::max(m_next_table, *number + 1);
+                }
+                if(name.ends_with(".tmp"))
+                {
+                    std::filesystem::remove(file.path(), ec);
+                }
+                else if(number && std::ranges::none_of(listed, [&](const auto& e) { return e.number == *number; }))
+                {
+                    unlisted = true;
+                    if(have_manifest)
+                    {
+                        std::filesystem::remove(file.path(), ec);
+                    }
+                }
+            }
+            m_failed = damaged || (!have_manifest && unlisted);
+
+            auto opened = std::make_shared<version>();
+            for(const auto& e : listed)
+            {
+                // A table that's gone or damaged takes its keys with it; the rest of the store is still good
+                auto t = table::open(m_directory / format::table_name(e.number), e.number);
+                if(!t || e.level >= max_levels)
+                {
+                    continue;
+                }
+                if(opened->levels.size() <= e.level)
+                {
+                    opened->levels.resize(e.level + 1);
+                }
+                opened->levels[e.level].push_back(std::move(t));
+            }
+            std::ranges::sort(opened->levels[0], std::greater {}, [](const auto& t) { return t->number(); });
+            for(std::size_t level = 1; level < opened->levels.size(); level++)
+            {
+                std::ranges::sort(opened->levels[level], std::less {}, [](const auto& t) { return t->min(); });
+            }
+            m_version = std::move(opened);
+        }
+
+        [[nodiscard]] bool write_manifest(const version& v)
+        {
+            namespace format = _internal::uuid_store_format;
+            std::vector<std::byte> entries;
+            for(std::size_t level = 0; level < v.levels.size(); level++)
+            {
+                for(const auto& t : v.levels[level])
+                {
+                    format::append(entries, format::manifest_entry {t->number(), level});
+                }
+            }
+            const uint64 count = entries.size() / sizeof(format::manifest_entry);
+            std::vector<std::byte> bytes;
+            format::append(bytes, format::manifest_header {format::manifest_magic, format::version, count,
+                                                           _internal::journal_format::hash_bytes(entries, count)});
+            bytes.insert(bytes.end(), entries.begin(), entries.end());
+
+            const std::filesystem::path temp = m_directory / "manifest.tmp";
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            {
+                _internal::journal_format::append_file out(temp);
+                if(!out.is_open() || !out.write(bytes) || !out.sync())
+                {
+                    return false;
+                }
+            }
+            std::filesystem::rename(temp, m_directory / "manifest", ec);
+            _internal::journal_format::sync_directory(m_directory);
+            return !ec;
+        }
+
+        // Makes v current once the manifest says so
+        [[nodiscard]] bool install(std::shared_ptr<version> v)
+        {
+            if(!write_manifest(*v))
+            {
+                return false;
+            }
+            std::scoped_lock lock(m_mutex);
+            m_version = std::move(v);
+            return true;
+        }
+
+        void work(std::stop_token stop)
+        {
+            std::unique_lock lock(m_mutex);
+            while(!stop.stop_requested())
+            {
+                if(m_failed)
+                {
+                    m_working = false;
+                    m_idle.notify_all();
+                    m_room.notify_all();
+                    m_work.wait(lock, stop, [] { return false; });
+                    return;
+                }
+                if(m_immutable)
+                {
+                    m_working = true;
+                    const std::shared_ptr<const memtable> mem = m_immutable;
+                    const uint64 through = m_immutable_through;
+                    lock.unlock();
+                    const bool flushed = flush_table(*mem);
+                    if(flushed)
+                    {
+                        m_flushed_through.store(through, std::memory_order_release);
+                        // The journal only needs to keep what's still in memory
+                        m_journal->compact();
+                    }
+                    lock.lock();
+                    if(flushed)
+                    {
+                        m_immutable.reset();
+                        m_stats.flushes++;
+                    }
+                    else
+                    {
+                        m_failed = true;
+                    }
+                    m_room.notify_all();
+                    continue;
+                }
+                const std::shared_ptr<const version> current = m_version;
+                if(auto picked = m_stuck ? std::nullopt : pick(*current))
+                {
+                    m_working = true;
+                    lock.unlock();
+                    const bool compacted = compact(*current, *picked, stop);
+                    lock.lock();
+                    m_stuck = m_stuck || (!compacted && !stop.stop_requested());
+                    continue;
+                }
+                m_working = false;
+                m_idle.notify_all();
+                m_work.wait(lock, stop, [&] { return m_immutable != nullptr; });
+            }
+            m_working = false;
+        }
+
+        // Writes a memtable out as a level 0 table
+        [[nodiscard]] bool flush_table(const memtable& mem)
+        {
+            namespace format = _internal::uuid_store_format;
+            const uint64 number = m_next_table++;
+            const std::filesystem::path path = m_directory / format::table_name(number);
+            {
+                format::table_writer out(path, m_options.block_size);
+                for(const auto& [k, bytes] : mem)
+                {
+                    out.add(k, !bytes, bytes ? std::span<const std::byte>(*bytes) : std::span<const std::byte>());
+                }
+                if(!out.finish(m_options.false_positive_rate))
+                {
+                    return false;
+                }
+            }
+            auto t = table::open(path, number);
+            if(!t)
+            {
+                return false;
+            }
+            auto next = std::make_shared<version>(*m_version);
+            next->levels[0].insert(next->levels[0].begin(), std::move(t));
+            return install(std::move(next));
+        }
+
+        [[nodiscard]] std::optional<compaction> pick(const version& v)
+        {
+            auto overlapping = [&](std::size_t level, const key& min, const key& max) {
+                table_list found;
+                if(level < v.levels.size())
+                {
+                    std::ranges::copy_if(v.levels[level], std::back_inserter(found),
+                                         [&](const auto& t) { return t->overlaps(min, max); });
+                }
+                return found;
+            };
+
+            if(v.levels[0].size() >= m_options.level0_tables)
+            {
+                // The oldest on its own, if it doesn't overlap level 1 and it can just move down
+                const auto& oldest = v.levels[0].back();
+                if(overlapping(1, oldest->min(), oldest->max()).empty())
+                {
+                    return compaction {0, {oldest}, {}};
+                }
+                key min = oldest->min();
+                key max = oldest->max();
+                for(const auto& t : v.levels[0])
+                {
+                    min = std::min(min, t->min());
+                    max = std::max(max, t->max());
+                }
+                return compaction {0, v.levels[0], overlapping(1, min, max)};
+            }
+
+            uint64 limit = m_options.level1_size;
+            for(std::size_t level = 1; level + 1 < max_levels && level < v.levels.size(); level++, limit *= 10)
+            {
+                if(v.level_size(level) <= limit)
+                {
+                    continue;
+                }
+                // Take turns around the level, so every part of it gets pushed down in time
+                const auto& tables = v.levels[level];
+                const auto it =
+                    std::ranges::find_if(tables, [&](const auto& t) { return m_compact_after[level] < t->min(); });
+                const auto& picked = it == tables.end() ? tables.front() : *it;
+                m_compact_after[level] = picked->max();
+                return compaction {level, {picked}, overlapping(level + 1, picked->min(), picked->max())};
+            }
+            return std::nullopt;
+        }
+
+        // Merges a compaction's tables into the level below, or moves it if there's nothing to merge with
+        [[nodiscard]] bool compact(const version& current, const compaction& c, std::stop_token stop)
+        {
+            namespace format = _internal::uuid_store_format;
+            const std::size_t to = c.level + 1;
+            auto next = std::make_shared<version>(current);
+            if(next->levels.size() <= to)
+            {
+                next->levels.resize(to + 1);
+            }
+            auto drop = [](table_list& from, const table_list& gone) {
+                std::erase_if(from, [&](const auto& t) { return std::ranges::find(gone, t) != gone.end(); });
+            };
+            auto sort_level = [&] {
+                std::ranges::sort(next->levels[to], std::less {}, [](const auto& t) { return t->min(); });
+            };
+            drop(next->levels[c.level], c.inputs);
+            drop(next->levels[to], c.below);
+
+            if(c.below.empty() && c.inputs.size() == 1)
+            {
+                next->levels[to].push_back(c.inputs.front());
+                sort_level();
+                if(!install(std::move(next)))
+                {
+                    return false;
+                }
+                std::scoped_lock lock(m_mutex);
+                m_stats.moves++;
+                return true;
+            }
+
+            // Nothing older than the level below means erased keys don't need remembering any more
+            const auto deeper = current.levels.begin() + std::min<std::ptrdiff_t>(to + 1, std::ssize(current.levels));
+            const bool bottom = std::all_of(deeper, current.levels.end(), [](const table_list& l) { return l.empty(); });
+            std::vector<run> runs;
+            for(const auto& t : c.inputs)
+            {
+                runs.emplace_back(table_list {t});
+            }
+            runs.emplace_back(c.below);
+            for(run& r : runs)
+            {
+                for(const auto& t : r.tables)
+                {
+                    if(!t->check())
+                    {
+                        return false;
+                    }
+                }
+                r.next();
+            }
+
+            table_list outputs;
+            std::optional<format::table_writer> out;
+            uint64 out_number = 0;
+            uint64 written = 0;
+            auto finish = [&] {
+                if(!out)
+                {
+                    return true;
+                }
+                if(out->count() == 0)
+                {
+                    out.reset();
+                    return true;
+                }
+                if(!out->finish(m_options.false_positive_rate))
+                {
+                    return false;
+                }
+                written += out->size();
+                out.reset();
+                auto t = table::open(m_directory / format::table_name(out_number), out_number);
+                if(!t)
+                {
+                    return false;
+                }
+                outputs.push_back(std::move(t));
+                return true;
+            };
+            // Half written or unused outputs get deleted rather than left for the next open to find
+            auto abandon = [&] {
+                out.reset();
+                for(const auto& t : outputs)
+                {
+                    t->retire();
+                }
+                return false;
+            };
+
+            for(uint64 merged = 0;; merged++)
+            {
+                if(merged % 4096 == 0 && stop.stop_requested())
+                {
+                    return abandon();
+                }
+                // The smallest key, from the newest run that has it
+                run* newest = nullptr;
+                for(run& r : runs)
+                {
+                    if(r.current && (!newest || r.current->id < newest->current->id))
+                    {
+                        newest = &r;
+                    }
+                }
+                if(!newest)
+                {
+                    break;
+                }
+                const table::entry e = *newest->current;
+                for(run& r : runs)
+                {
+                    if(r.current && r.current->id == e.id)
+                    {
+                        r.next();
+                    }
+                }
+                if(e.erased && bottom)
+                {
+                    continue;
+                }
+                if(out && out->size() >= m_options.table_size && !finish())
+                {
+                    return abandon();
+                }
+                if(!out)
+                {
+                    out_number = m_next_table++;
+                    out.emplace(m_directory / format::table_name(out_number), m_options.block_size);
+                }
+                out->add(e.id, e.erased, e.bytes);
+            }
+            if(!finish())
+            {
+                return abandon();
+            }
+
+            next->levels[to].insert(next->levels[to].end(), outputs.begin(), outputs.end());
+            sort_level();
+            if(!install(std::move(next)))
+            {
+                return abandon();
+            }
+            for(const auto& t : c.inputs)
+            {
+                t->retire();
+            }
+            for(const auto& t : c.below)
+            {
+                t->retire();
+            }
+            std::scoped_lock lock(m_mutex);
+            m_stats.compactions++;
+            m_stats.bytes_compacted += written;
+            return true;
+        }
+
+        std::filesystem::path m_directory;
+        options m_options;
+
+        mutable std::mutex m_mutex;
+        // Wakes the worker
+        std::condition_variable_any m_work;
+        // Wakes writers waiting for the worker to take the memtable
+        std::condition_variable m_room;
+        // Wakes flush() once the worker has nothing to do
+        std::condition_variable m_idle;
+        memtable m_memtable;
+        std::size_t m_memtable_bytes = 0;
+        // The memtable being written out, and the last journal record in it
+        std::shared_ptr<const memtable> m_immutable;
+        uint64 m_immutable_through = 0;
+        std::shared_ptr<const version> m_version;
+        bool m_working = false;
+        // A write failed; nothing more gets written
+        bool m_failed = false;
+        // A compaction found a damaged table, so there's no more compacting; lookups and flushes carry on
+        bool m_stuck = false;
+        statistics m_stats;
+
+        // Only the worker touches these once it's started
+        uint64 m_next_table = 0;
+        std::array<key, max_levels> m_compact_after {};
+
+        // Everything up to here in the journal is in a table
+        std::atomic<uint64> m_flushed_through = 0;
+        std::optional<journal> m_journal;
+        std::jthread m_worker;
+    };
+}
@@ -183,6 +183,13 @@ namespace raoe
         std::string_view::size_type m_hash_pos;
     };
 
+    // A tag parses from any string the constructor accepts.  Returns false if it came out invalid.
+    inline bool from_string(std::string_view arg, tag& value, std::string_view fmt = {})
+    {
+        value = tag(arg);
+        return static_cast<bool>(value);
+    }
+
     namespace assets
     {
         using tag = raoe::tag;
@@ -28,4 +28,5 @@ export import "core/from_string.hpp";
 export import "core/parse.hpp";
 export import "core/debug.hpp";
 export import "core/uuid.hpp";
-export import "core/function_ref.hpp";
\ No newline at end of file
+export import "core/function_ref.hpp";
+export import "core/function.hpp";
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// The hooks aren't installed in the benchmark executable (that would skew every other benchmark), so this calls the
+// tracked allocation path directly to see what it adds on top of malloc.
+#define RAOE_CORE_TRACK_ALLOCATIONS 1
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/allocation_tracker.hpp"
+
+#include <array>
+#include <cstdlib>
+
+namespace
+{
+    constexpr std::size_t batch = 1000;
+
+    // Different sizes and three call sites, so it isn't one table row and one malloc bin
+    template <typename TAlloc, typename TFree>
+    std::size_t churn(TAlloc&& allocate, TFree&& release)
+    {
+        std::array<void*, batch> blocks;
+        for(std::size_t i = 0; i < batch; i++)
+        {
+            blocks[i] = allocate(16 + (i * 24) % 512, i % 3);
+        }
+        for(void* block : blocks)
+        {
+            release(block);
+        }
+        return blocks.size();
+    }
+
+    const std::array<int, 3> fake_sites = {0, 1, 2};
+}
+
+// 1000 allocations and frees per run
+TEST_CASE("Tracked allocation overhead", "[ALLOCATION_TRACKER][benchmark]")
+{
+    raoe::test::counted_benchmark("malloc / free", batch, [&] {
+        return churn([](std::size_t size, std::size_t) { return std::malloc(size); }, [](void* p) { std::free(p); });
+    });
+
+    raoe::test::counted_benchmark("tracked_allocate / tracked_free", batch, [&] {
+        return churn(
+            [](std::size_t size, std::size_t site) {
+                return raoe::debug::_internal::tracked_allocate(size, alignof(std::max_align_t), &fake_sites[site]);
+            },
+            [](void* p) { raoe::debug::_internal::tracked_free(p); });
+    });
+
+    raoe::test::counted_benchmark("tracked, inside an allocation scope", batch, [&] {
+        RAOE_ALLOCATION_SCOPE("bench");
+        return churn(
+            [](std::size_t size, std::size_t site) {
+                return raoe::debug::_internal::tracked_allocate(size, alignof(std::max_align_t), &fake_sites[site]);
+            },
+            [](void* p) { raoe::debug::_internal::tracked_free(p); });
+    });
+}
@@ -0,0 +1,162 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// This installs the hooks for the whole test executable, which is fine; everything else just gets counted too.
+#define RAOE_CORE_TRACK_ALLOCATIONS 1
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/allocation_tracker.hpp"
+#include "core/string.hpp"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+RAOE_DEFINE_ALLOCATION_HOOKS()
+
+namespace
+{
+    const raoe::debug::allocation_site* find_site(const raoe::debug::allocation_report& report, std::string_view tag)
+    {
+        for(const auto& site : report.sites)
+        {
+            if(site.tag.starts_with(tag))
+            {
+                return &site;
+            }
+        }
+        return nullptr;
+    }
+}
+
+TEST_CASE("Allocations In Scope", "[allocation_tracker]")
+{
+    const std::string text = "  some padded text that is too long for small string optimization  ";
+
+    {
+        raoe::debug::allocations_in_scope allocations;
+        const std::string_view trimmed = raoe::string::trim(std::string_view(text));
+        CHECK(trimmed.size() < text.size());
+        CHECK(allocations.count() == 0);
+        CHECK(allocations.bytes() == 0);
+        CHECK(allocations.expect_at_most(0));
+    }
+
+    {
+        raoe::debug::allocations_in_scope allocations;
+        const std::string trimmed = raoe::string::trim_c(text);
+        CHECK(allocations.count() >= 1);
+        CHECK(allocations.bytes() >= trimmed.size());
+    }
+
+    {
+        raoe::debug::allocations_in_scope allocations;
+        const auto parts = raoe::string::split(text, ' ');
+        CHECK(allocations.count() >= 1);
+        CHECK(allocations.expect_at_most(allocations.count()));
+    }
+}
+
+TEST_CASE("Allocation Sites And Live Bytes", "[allocation_tracker]")
+{
+    raoe::debug::allocation_tracker::reset();
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    {
+        RAOE_ALLOCATION_SCOPE("test blocks");
+        for(int i = 0; i < 10; i++)
+        {
+            blocks.push_back(std::make_unique<char[]>(1000));
+        }
+    }
+
+    auto report = raoe::debug::allocation_tracker::snapshot();
+    const auto* site = find_site(report, "test blocks");
+    REQUIRE(site != nullptr);
+    CHECK(site->allocations >= 10); // the vector growing counts too
+    CHECK(site->bytes >= 10000);
+    CHECK(site->live_bytes >= 10000);
+    CHECK(site->tag.find("allocation_tracker_test.cpp") != std::string::npos);
+    CHECK(report.live_bytes >= 10000);
+    CHECK(report.peak_bytes >= report.live_bytes);
+    CHECK(report.allocations >= site->allocations);
+
+    blocks.clear();
+    blocks.shrink_to_fit();
+    report = raoe::debug::allocation_tracker::snapshot();
+    site = find_site(report, "test blocks");
+    REQUIRE(site != nullptr);
+    CHECK(site->live_bytes == 0);
+    CHECK(site->live_allocations == 0);
+}
+
+TEST_CASE("Allocation Peak And Cross Thread Frees", "[allocation_tracker]")
+{
+    raoe::debug::allocation_tracker::reset();
+    const uint64 before = raoe::debug::allocation_tracker::snapshot().live_bytes;
+
+    {
+        auto big = std::make_unique<char[]>(1 << 20);
+        big[0] = 1;
+    }
+    auto report = raoe::debug::allocation_tracker::snapshot();
+    CHECK(report.peak_bytes >= before + (1 << 20));
+    CHECK(report.live_bytes < before + (1 << 20));
+
+    // Allocated on one thread, freed on another: the site still sees the free
+    std::unique_ptr<char[]> handed_over;
+    std::thread worker([&] {
+        RAOE_ALLOCATION_SCOPE("worker handoff");
+        handed_over = std::make_unique<char[]>(4096);
+    });
+    worker.join();
+
+    report = raoe::debug::allocation_tracker::snapshot();
+    const auto* site = find_site(report, "worker handoff");
+    REQUIRE(site != nullptr);
+    CHECK(site->live_bytes == 4096);
+
+    handed_over.reset();
+    report = raoe::debug::allocation_tracker::snapshot();
+    site = find_site(report, "worker handoff");
+    REQUIRE(site != nullptr);
+    CHECK(site->live_bytes == 0);
+}
+
+TEST_CASE("Allocation Hooks Respect Alignment", "[allocation_tracker]")
+{
+    struct alignas(128) aligned
+    {
+        char data[200];
+    };
+
+    raoe::debug::allocations_in_scope allocations;
+    auto one = std::make_unique<aligned>();
+    auto many = std::make_unique<aligned[]>(3);
+    CHECK(reinterpret_cast<uintptr_t>(one.get()) % 128 == 0);
+    CHECK(reinterpret_cast<uintptr_t>(many.get()) % 128 == 0);
+    CHECK(allocations.count() == 2);
+    CHECK(allocations.bytes() >= 4 * sizeof(aligned));
+
+    // Past what a 16 bit offset could hold
+    constexpr std::size_t page = 65536;
+    void* big = ::operator new(100, std::align_val_t {page});
+    CHECK(reinterpret_cast<uintptr_t>(big) % page == 0);
+    CHECK(allocations.count() == 3);
+    ::operator delete(big, std::align_val_t {page});
+}
@@ -0,0 +1,188 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/asset_registry.hpp"
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    constexpr int asset_count = 20000;
+    constexpr int lookups = 100000;
+
+    // The three maps we used to fill at startup
+    struct scanned_assets
+    {
+        struct info
+        {
+            std::string name;
+            std::string path;
+        };
+        std::unordered_map<raoe::uuid, info> by_id;
+        std::unordered_map<std::string, raoe::uuid> by_name;
+        std::unordered_map<std::string, raoe::uuid> by_path;
+    };
+
+    // 20k asset files, each starting with its uuid and tag, spread over 100 directories
+    struct asset_tree
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_asset_registry_bench";
+        std::filesystem::path registry_file = root / "registry.bin";
+        std::vector<raoe::uuid> ids;
+        std::vector<std::string> names;
+        std::vector<std::string> paths;
+
+        asset_tree()
+        {
+            std::filesystem::remove_all(root);
+            raoe::asset_registry registry;
+            for(int i = 0; i < asset_count; i++)
+            {
+                ids.push_back(raoe::make_uuid());
+                names.push_back(std::format("game#texture:textures/set_{}/texture_{}", i % 100, i));
+                paths.push_back(std::format("assets/set_{}/texture_{}.tex", i % 100, i));
+                std::filesystem::create_directories(root / std::format("assets/set_{}", i % 100));
+                std::ofstream(root / paths.back()) << std::format("{}\n{}\n", ids.back(), names.back());
+                registry.insert_or_assign(ids.back(), raoe::tag(names.back()), paths.back());
+            }
+            registry.save(registry_file, 1);
+        }
+        ~asset_tree() { std::filesystem::remove_all(root); }
+
+        // Rebuild at startup: walk the tree and read every asset's header
+        [[nodiscard]] scanned_assets scan() const
+        {
+            scanned_assets assets;
+            for(const auto& file : std::filesystem::recursive_directory_iterator(root / "assets"))
+            {
+                if(!file.is_regular_file())
+                {
+                    continue;
+                }
+                std::ifstream in(file.path());
+                std::string id_text;
+                std::string name;
+                std::getline(in, id_text);
+                std::getline(in, name);
+                raoe::uuid id;
+                raoe::from_string(id_text, id);
+                const std::string path = std::filesystem::relative(file.path(), root).generic_string();
+                assets.by_name.emplace(name, id);
+                assets.by_path.emplace(path, id);
+                assets.by_id.emplace(id, scanned_assets::info {name, path});
+            }
+            return assets;
+        }
+    };
+
+    std::vector<int> lookup_order()
+    {
+        std::vector<int> order;
+        uint32 state = 12345;
+        for(int i = 0; i < lookups; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            order.push_back(static_cast<int>((state >> 8) % asset_count));
+        }
+        return order;
+    }
+}
+
+TEST_CASE("Asset registry startup, 20k assets", "[asset_registry][benchmark]")
+{
+    const asset_tree tree;
+    REQUIRE(tree.scan().by_id.size() == asset_count);
+    REQUIRE(raoe::asset_registry::open(tree.registry_file, 1)->size() == asset_count);
+
+    raoe::test::counted_benchmark("scan the tree into three unordered_maps", asset_count, [&] {
+        return tree.scan().by_id.size();
+    });
+    raoe::test::counted_benchmark("asset_registry::open", asset_count, [&] {
+        return raoe::asset_registry::open(tree.registry_file, 1)->size();
+    });
+}
+
+// 100k lookups by each key.  Divide by 100k for the cost of one.
+TEST_CASE("Asset registry lookups, 20k assets", "[asset_registry][benchmark]")
+{
+    const asset_tree tree;
+    const scanned_assets maps = tree.scan();
+    const auto registry = raoe::asset_registry::open(tree.registry_file, 1);
+    std::vector<raoe::tag> tags;
+    for(const std::string& name : tree.names)
+    {
+        tags.emplace_back(name);
+    }
+    const std::vector<int> order = lookup_order();
+
+    raoe::test::counted_benchmark("unordered_map, by tag", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += maps.by_id.find(maps.by_name.find(tags[i])->second)->second.path.size();
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("asset_registry, by tag", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += registry->find(tags[i])->path.size();
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("unordered_map, by path", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += maps.by_path.find(tree.paths[i])->second == tree.ids[i];
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("asset_registry, by path", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += registry->find_path(tree.paths[i])->id == tree.ids[i];
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("unordered_map, by uuid", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += maps.by_id.find(tree.ids[i])->second.name.size();
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("asset_registry, by uuid", lookups, [&] {
+        std::size_t found = 0;
+        for(int i : order)
+        {
+            found += registry->find(tree.ids[i])->name.size();
+        }
+        return found;
+    });
+}
@@ -0,0 +1,174 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/asset_registry.hpp"
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    raoe::uuid uuid_of(uint32 n)
+    {
+        return raoe::uuid(n, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    }
+
+    raoe::asset_registry make_registry(uint32 count)
+    {
+        raoe::asset_registry registry;
+        for(uint32 i = 0; i < count; i++)
+        {
+            REQUIRE(registry.insert_or_assign(uuid_of(i), raoe::tag(std::format("game:asset_{}", i)),
+                                              std::format("assets/{}.bin", i)));
+        }
+        return registry;
+    }
+}
+
+TEST_CASE("Asset Registry - Lookups by every key", "[asset_registry]")
+{
+    raoe::asset_registry registry;
+    REQUIRE(registry.empty());
+    REQUIRE_FALSE(registry.find(raoe::tag("game:grass")));
+
+    const raoe::uuid grass = raoe::make_uuid();
+    const raoe::uuid stone = raoe::make_uuid();
+    REQUIRE(registry.insert_or_assign(grass, raoe::tag("game:grass"), "textures/grass.png"));
+    REQUIRE(registry.insert_or_assign(stone, raoe::tag("game:stone"), "textures/stone.png"));
+    REQUIRE(registry.size() == 2);
+
+    REQUIRE(registry.find(grass)->path == "textures/grass.png");
+    REQUIRE(registry.find(raoe::tag("game:stone"))->id == stone);
+    REQUIRE(registry.find_path("textures/grass.png")->name == "game:grass");
+    REQUIRE_FALSE(registry.find_path("textures/dirt.png"));
+
+    // Names and paths belong to one asset at a time
+    REQUIRE_FALSE(registry.insert_or_assign(raoe::make_uuid(), raoe::tag("game:grass"), "elsewhere.png"));
+    REQUIRE_FALSE(registry.insert_or_assign(stone, raoe::tag("game:stone"), "textures/grass.png"));
+    REQUIRE(registry.size() == 2);
+
+    // Renaming frees the old name
+    REQUIRE(registry.insert_or_assign(grass, raoe::tag("game:lawn"), "textures/grass.png"));
+    REQUIRE_FALSE(registry.find(raoe::tag("game:grass")));
+    REQUIRE(registry.find(raoe::tag("game:lawn"))->id == grass);
+    REQUIRE(registry.size() == 2);
+
+    REQUIRE(registry.erase(grass));
+    REQUIRE_FALSE(registry.erase(grass));
+    REQUIRE_FALSE(registry.find_path("textures/grass.png"));
+    REQUIRE(registry.size() == 1);
+}
+
+TEST_CASE("Asset Registry - Serialized images", "[asset_registry]")
+{
+    const raoe::asset_registry built = make_registry(5000);
+    const std::vector<std::byte> bytes = built.serialize(42);
+
+    REQUIRE_FALSE(raoe::asset_registry::from_bytes(bytes, 41));
+    auto registry = raoe::asset_registry::from_bytes(bytes, 42);
+    REQUIRE(registry);
+    REQUIRE(registry->size() == 5000);
+    REQUIRE(registry->pending_changes() == 0);
+    for(uint32 i = 0; i < 5000; i++)
+    {
+        const auto by_id = registry->find(uuid_of(i));
+        REQUIRE(by_id);
+        REQUIRE(by_id->name == std::format("game:asset_{}", i));
+        REQUIRE(registry->find(raoe::tag(std::format("game:asset_{}", i)))->id == uuid_of(i));
+        REQUIRE(registry->find_path(std::format("assets/{}.bin", i))->id == uuid_of(i));
+    }
+    REQUIRE_FALSE(registry->find(uuid_of(5000)));
+    REQUIRE_FALSE(registry->find(raoe::tag("game:asset_5000")));
+    REQUIRE_FALSE(registry->find_path("assets/5000.bin"));
+
+    // Changes on top of an image
+    REQUIRE(registry->erase(uuid_of(7)));
+    REQUIRE(registry->insert_or_assign(uuid_of(8), raoe::tag("game:renamed"), "assets/8.bin"));
+    REQUIRE(registry->insert_or_assign(uuid_of(9000), raoe::tag("game:asset_7"), "assets/7.bin"));
+    REQUIRE(registry->size() == 5000);
+    REQUIRE(registry->find(raoe::tag("game:asset_7"))->id == uuid_of(9000));
+    REQUIRE_FALSE(registry->find(raoe::tag("game:asset_8")));
+    REQUIRE(registry->find(raoe::tag("game:renamed"))->id == uuid_of(8));
+    std::size_t seen = 0;
+    registry->for_each([&](const raoe::asset_registry::entry&) { seen++; });
+    REQUIRE(seen == 5000);
+
+    // Erasing and bringing back
+    REQUIRE(registry->erase(uuid_of(8)));
+    REQUIRE(registry->insert_or_assign(uuid_of(8), raoe::tag("game:asset_8"), "assets/8.bin"));
+    REQUIRE(registry->size() == 5000);
+
+    // The overlay folds back into an image
+    registry->compact();
+    REQUIRE(registry->pending_changes() == 0);
+    REQUIRE(registry->size() == 5000);
+    REQUIRE(registry->find(raoe::tag("game:asset_7"))->id == uuid_of(9000));
+    REQUIRE(registry->find(raoe::tag("game:asset_8"))->id == uuid_of(8));
+    REQUIRE_FALSE(registry->find(uuid_of(7)));
+
+    // Damage is caught when loading, not when looking things up
+    std::vector<std::byte> damaged = bytes;
+    damaged.resize(damaged.size() - 1);
+    REQUIRE_FALSE(raoe::asset_registry::from_bytes(damaged, 42));
+    damaged = bytes;
+    // The first record's name offset
+    damaged[40 + 16] = std::byte {0xff};
+    damaged[40 + 19] = std::byte {0xff};
+    REQUIRE_FALSE(raoe::asset_registry::from_bytes(damaged, 42));
+    REQUIRE_FALSE(raoe::asset_registry::from_bytes({}, 42));
+}
+
+TEST_CASE("Asset Registry - Save and open", "[asset_registry]")
+{
+    const auto file = std::filesystem::temp_directory_path() / "raoe_asset_registry_test.bin";
+    std::filesystem::remove(file);
+    REQUIRE_FALSE(raoe::asset_registry::open(file, 1));
+
+    REQUIRE(make_registry(1000).save(file, 1));
+    {
+        const raoe::mapped_file mapped(file);
+        REQUIRE(mapped.is_open());
+        REQUIRE(mapped.size() == std::filesystem::file_size(file));
+    }
+    REQUIRE_FALSE(raoe::asset_registry::open(file, 2));
+
+    auto registry = raoe::asset_registry::open(file, 1);
+    REQUIRE(registry);
+    REQUIRE(registry->find(raoe::tag("game:asset_999"))->path == "assets/999.bin");
+
+    // Enough changes and it compacts by itself, off the mapped file and into memory
+    for(uint32 i = 0; i < 2000; i++)
+    {
+        REQUIRE(registry->insert_or_assign(uuid_of(i), raoe::tag(std::format("game:changed_{}", i)), ""));
+    }
+    REQUIRE(registry->pending_changes() < 2000);
+    REQUIRE(registry->size() == 2000);
+
+    // Saving over the file it was opened from is fine
+    REQUIRE(registry->save(file, 3));
+    const auto reopened = raoe::asset_registry::open(file, 3);
+    REQUIRE(reopened);
+    REQUIRE(reopened->size() == 2000);
+    REQUIRE(reopened->find(raoe::tag("game:changed_1500"))->id == uuid_of(1500));
+    REQUIRE(reopened->find(uuid_of(10))->path.empty());
+    REQUIRE_FALSE(reopened->find_path("assets/10.bin"));
+    std::filesystem::remove(file);
+}
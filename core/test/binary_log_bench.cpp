@@ -0,0 +1,72 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/binary_log.hpp"
+
+#include "spdlog/sinks/null_sink.h"
+#include "spdlog/spdlog.h"
+
+#include <memory>
+
+namespace
+{
+    constexpr int calls_per_run = 100;
+}
+
+// Each benchmark is 100 log calls, so divide the mean by 100 for the cost of one.  spdlog formats on the calling
+// thread (into a null sink, so no IO is counted for either side); the binary log only copies its arguments.
+TEST_CASE("Hot path log calls", "[BINARY_LOG][benchmark]")
+{
+    // Big enough that nothing gets dropped between drains, which would make the binary log look faster than it is
+    raoe::binary_log::logger::get().set_ring_size(std::size_t(1) << 28);
+    const raoe::tag asset("raoe:textures/grass");
+
+    auto null_logger = std::make_shared<spdlog::logger>("bench", std::make_shared<spdlog::sinks::null_sink_mt>());
+    null_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] %v");
+
+    raoe::test::counted_benchmark("spdlog, null sink", calls_per_run, [&] {
+        for(int i = 0; i < calls_per_run; i++)
+        {
+            null_logger->info("frame {} took {:.3f}ms, loaded {}", i, 16.6, std::string_view(asset));
+        }
+    });
+
+    auto log_calls = [&] {
+        for(int i = 0; i < calls_per_run; i++)
+        {
+            raoe::binary_log::info("frame {} took {:.3f}ms, loaded {}", i, 16.6, asset);
+        }
+    };
+
+    // Advanced, so draining the ring between samples isn't timed.  That's also why the counters are separate.
+    BENCHMARK_ADVANCED("binary_log")(Catch::Benchmark::Chronometer meter)
+    {
+        meter.measure(log_calls);
+        raoe::binary_log::logger::get().drain([](const raoe::binary_log::message&) {});
+    };
+    raoe::test::print_counters("binary_log", calls_per_run, log_calls);
+    raoe::binary_log::logger::get().drain([](const raoe::binary_log::message&) {});
+
+    raoe::binary_log::logger::get().set_min_level(raoe::binary_log::level::warn);
+    raoe::test::counted_benchmark("binary_log, filtered out", calls_per_run, log_calls);
+    raoe::binary_log::logger::get().set_min_level(raoe::binary_log::level::trace);
+
+    CHECK(raoe::binary_log::logger::get().dropped() == 0);
+}
@@ -0,0 +1,234 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/binary_log.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::vector<std::string> drain_text()
+    {
+        std::vector<std::string> lines;
+        raoe::binary_log::logger::get().drain(
+            [&](const raoe::binary_log::message& msg) { lines.push_back(msg.text()); });
+        return lines;
+    }
+}
+
+TEST_CASE("Binary Log Argument Types", "[binary_log]")
+{
+    drain_text();
+
+    const raoe::uuid id(0x12345678, 0x9abc, 0xdef0, {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef});
+    const raoe::tag name("raoe:player");
+    const raoe::fixed<int32, 16> half(0.5f);
+    const std::string owned = "owned";
+
+    raoe::binary_log::info("ints {} {} {}", -5, uint8(200), std::numeric_limits<int64>::min());
+    raoe::binary_log::info("float {:.3f} bool {}", 3.14159, true);
+    raoe::binary_log::info("strings {} {} {:>4}", "literal", owned, std::string_view("ab"));
+    raoe::binary_log::info("uuid {} tag {} fixed {}", id, name, half);
+    raoe::binary_log::info("braces {{}} and {}", 1);
+    raoe::binary_log::info("missing {} {}", 1);
+
+    const auto lines = drain_text();
+    REQUIRE(lines.size() == 6);
+    CHECK(lines[0] == "ints -5 200 -9223372036854775808");
+    CHECK(lines[1] == "float 3.142 bool true");
+    CHECK(lines[2] == "strings literal owned   ab");
+    CHECK(lines[3] == std::format("uuid {} tag raoe:player fixed 0.5", id));
+    CHECK(lines[4] == "braces {} and 1");
+    CHECK(lines[5] == "missing 1 {?}");
+}
+
+TEST_CASE("Binary Log Levels", "[binary_log]")
+{
+    auto& logger = raoe::binary_log::logger::get();
+    drain_text();
+
+    logger.set_min_level(raoe::binary_log::level::warn);
+    raoe::binary_log::debug("skipped {}", 1);
+    raoe::binary_log::info("skipped {}", 2);
+    raoe::binary_log::warn("kept {}", 3);
+    raoe::binary_log::critical("kept {}", 4);
+    logger.set_min_level(raoe::binary_log::level::trace);
+
+    std::vector<raoe::binary_log::level> levels;
+    logger.drain([&](const raoe::binary_log::message& msg) { levels.push_back(msg.lvl); });
+    REQUIRE(levels.size() == 2);
+    CHECK(levels[0] == raoe::binary_log::level::warn);
+    CHECK(levels[1] == raoe::binary_log::level::critical);
+}
+
+TEST_CASE("Binary Log Ring Wraps And Drops", "[binary_log]")
+{
+    raoe::binary_log::thread_ring ring(4096);
+    std::vector<uint32> seen;
+
+    // Records of odd sizes, drained as we go, so the ring wraps a bunch of times
+    for(uint32 i = 0; i < 1000; i++)
+    {
+        const std::size_t size = 4 + (i * 37) % 300;
+        std::byte* out = ring.reserve(size);
+        REQUIRE(out != nullptr);
+        std::memcpy(out, &i, sizeof(i));
+        ring.commit();
+        if(i % 7 == 0)
+        {
+            ring.drain([&](std::span<const std::byte> payload) {
+                uint32 value;
+                std::memcpy(&value, payload.data(), sizeof(value));
+                seen.push_back(value);
+            });
+        }
+    }
+    ring.drain([&](std::span<const std::byte> payload) {
+        uint32 value;
+        std::memcpy(&value, payload.data(), sizeof(value));
+        seen.push_back(value);
+    });
+    REQUIRE(seen.size() == 1000);
+    for(uint32 i = 0; i < 1000; i++)
+    {
+        CHECK(seen[i] == i);
+    }
+
+    // Without a consumer it fills up, and then drops
+    std::size_t written = 0;
+    while(ring.reserve(100) != nullptr)
+    {
+        ring.commit();
+        written++;
+    }
+    CHECK(written > 0);
+    CHECK(ring.dropped() == 1);
+    CHECK(ring.drain([](std::span<const std::byte>) {}) == written);
+}
+
+TEST_CASE("Binary Log File Round Trip", "[binary_log]")
+{
+    drain_text();
+
+    std::ostringstream file;
+    raoe::binary_log::binary_sink sink(file);
+
+    std::thread worker([] {
+        for(int i = 0; i < 100; i++)
+        {
+            raoe::binary_log::warn("worker {} of {}", i, 100);
+        }
+    });
+    worker.join();
+    for(int i = 0; i < 10; i++)
+    {
+        raoe::binary_log::error("main {} {}", i, raoe::tag("raoe:main"));
+    }
+    CHECK(sink.drain() == 110);
+
+    const std::string data = file.str();
+    std::vector<raoe::binary_log::decoded_message> decoded;
+    raoe::binary_log::decoder decoder;
+    CHECK(decoder.decode(std::span<const std::byte>(reinterpret_cast<const std::byte*>(data.data()), data.size()),
+                         [&](const raoe::binary_log::decoded_message& msg) { decoded.push_back(msg); }));
+
+    REQUIRE(decoded.size() == 110);
+    std::size_t workers = 0;
+    for(const auto& msg : decoded)
+    {
+        CHECK(msg.file.ends_with("binary_log_test.cpp"));
+        CHECK(msg.unix_nanoseconds > 0);
+        if(msg.lvl == raoe::binary_log::level::warn)
+        {
+            CHECK(msg.text == std::format("worker {} of 100", workers));
+            workers++;
+        }
+        else
+        {
+            CHECK(msg.lvl == raoe::binary_log::level::error);
+            CHECK(msg.text.ends_with(" raoe:main"));
+        }
+    }
+    CHECK(workers == 100);
+
+    // Cut off partway through, it still decodes what it can and says so
+    std::size_t partial = 0;
+    const std::string truncated = data.substr(0, data.size() - 30);
+    raoe::binary_log::decoder partial_decoder;
+    CHECK_FALSE(partial_decoder.decode(
+        std::span<const std::byte>(reinterpret_cast<const std::byte*>(truncated.data()), truncated.size()),
+        [&](const raoe::binary_log::decoded_message&) { partial++; }));
+    CHECK(partial > 0);
+    CHECK(partial < 110);
+}
+
+TEST_CASE("Binary Log Sinks Draining At Once", "[binary_log]")
+{
+    drain_text();
+    const uint64 dropped_before = raoe::binary_log::logger::get().dropped();
+
+    // The text sink's thread and the binary sink both pull from the same rings, so every message has to come out of
+    // exactly one of them
+    std::atomic<std::size_t> as_text = 0;
+    std::size_t as_binary = 0;
+    std::ostringstream file;
+    {
+        raoe::binary_log::binary_sink sink(file);
+        raoe::binary_log::text_sink text(std::chrono::milliseconds(0),
+                                         [&](raoe::binary_log::level, std::string_view, const auto&) { as_text++; });
+        std::atomic<bool> done = false;
+        std::jthread worker([&done] {
+            for(int i = 0; i < 20000; i++)
+            {
+                raoe::binary_log::info("message {}", i);
+            }
+            done = true;
+        });
+        while(!done)
+        {
+            as_binary += sink.drain();
+        }
+    }
+    const uint64 dropped = raoe::binary_log::logger::get().dropped() - dropped_before;
+    CHECK(as_text + as_binary + dropped == 20000);
+}
+
+TEST_CASE("Binary Log Rings Of Finished Threads Go Away", "[binary_log]")
+{
+    drain_text();
+    raoe::binary_log::info("this thread has a ring");
+    const std::size_t before = raoe::binary_log::logger::get().ring_count();
+
+    for(int i = 0; i < 20; i++)
+    {
+        std::thread([i] { raoe::binary_log::info("short lived {}", i); }).join();
+    }
+    CHECK(raoe::binary_log::logger::get().ring_count() == before + 20);
+
+    // Nothing they logged is lost on the way
+    const auto lines = drain_text();
+    REQUIRE(lines.size() == 21);
+    CHECK(lines.back() == "short lived 19");
+    CHECK(raoe::binary_log::logger::get().ring_count() == before);
+}
@@ -0,0 +1,151 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/bloom_filter.hpp"
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    constexpr int mount_count = 50;
+    constexpr int files_per_mount = 200;
+
+    // 50 directories standing in for 50 directory mounts.  A PhysFS miss asks each mount in turn, which for a
+    // directory is a stat() of the real path; that's what the unfiltered case does here.
+    struct mounts
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_bloom_filter_bench";
+        std::vector<std::filesystem::path> directories;
+        raoe::bloom_filter filter;
+
+        mounts()
+            : filter(mount_count * files_per_mount)
+        {
+            std::filesystem::remove_all(root);
+            for(int m = 0; m < mount_count; m++)
+            {
+                directories.push_back(root / std::format("mount_{}", m));
+                std::filesystem::create_directories(directories.back() / "textures");
+                for(int f = 0; f < files_per_mount; f++)
+                {
+                    const std::string name = std::format("textures/mod{}_{}.png", m, f);
+                    std::ofstream(directories.back() / name);
+                    filter.insert(name);
+                }
+                filter.insert("textures");
+            }
+        }
+        ~mounts() { std::filesystem::remove_all(root); }
+
+        [[nodiscard]] bool exists_unfiltered(const std::string& path) const
+        {
+            for(const auto& directory : directories)
+            {
+                std::error_code ec;
+                if(std::filesystem::exists(directory / path, ec))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool exists_filtered(const std::string& path) const
+        {
+            return filter.may_contain(path) && exists_unfiltered(path);
+        }
+    };
+
+    // Mostly misses: the "is there an override for this?" probes a mod loader makes for every asset
+    std::vector<std::string> probes(int count, int hit_every)
+    {
+        std::vector<std::string> result;
+        for(int i = 0; i < count; i++)
+        {
+            result.push_back(i % hit_every == 0
+                                 ? std::format("textures/mod{}_{}.png", i % mount_count, i % files_per_mount)
+                                 : std::format("textures/override_{}.png", i));
+        }
+        return result;
+    }
+}
+
+// 1000 probes, 1 in 100 a hit.  Divide the mean by 1000 for the cost of one.
+TEST_CASE("Miss heavy exists() over 50 mounts", "[bloom_filter][benchmark]")
+{
+    mounts all;
+    const std::vector<std::string> paths = probes(1000, 100);
+
+    raoe::test::counted_benchmark("stat every mount", paths.size(), [&] {
+        int found = 0;
+        for(const auto& path : paths)
+        {
+            found += all.exists_unfiltered(path) ? 1 : 0;
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("bloom_filter, then stat every mount", paths.size(), [&] {
+        int found = 0;
+        for(const auto& path : paths)
+        {
+            found += all.exists_filtered(path) ? 1 : 0;
+        }
+        return found;
+    });
+}
+
+// 100k probes against 10k members, half hits
+TEST_CASE("Membership probes", "[bloom_filter][benchmark]")
+{
+    raoe::bloom_filter filter(10000);
+    std::unordered_set<std::string> set;
+    for(int i = 0; i < 10000; i++)
+    {
+        filter.insert(std::format("textures/mod_{}.png", i));
+        set.insert(std::format("textures/mod_{}.png", i));
+    }
+    std::vector<std::string> paths;
+    for(int i = 0; i < 100000; i++)
+    {
+        paths.push_back(std::format("textures/mod_{}.png", i % 20000));
+    }
+
+    raoe::test::counted_benchmark("unordered_set<string>::contains", paths.size(), [&] {
+        int found = 0;
+        for(const auto& path : paths)
+        {
+            found += set.contains(path) ? 1 : 0;
+        }
+        return found;
+    });
+    raoe::test::counted_benchmark("bloom_filter::may_contain", paths.size(), [&] {
+        int found = 0;
+        for(const auto& path : paths)
+        {
+            found += filter.may_contain(path) ? 1 : 0;
+        }
+        return found;
+    });
+}
@@ -0,0 +1,127 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/bloom_filter.hpp"
+
+#include <atomic>
+#include <format>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Bloom Filter - No false negatives", "[bloom_filter]")
+{
+    raoe::bloom_filter filter(10000);
+    for(int i = 0; i < 10000; i++)
+    {
+        filter.insert(std::format("textures/block_{}.png", i));
+    }
+    REQUIRE(filter.inserted() == 10000);
+    for(int i = 0; i < 10000; i++)
+    {
+        REQUIRE(filter.may_contain(std::format("textures/block_{}.png", i)));
+    }
+
+    filter.clear();
+    REQUIRE(filter.inserted() == 0);
+    REQUIRE_FALSE(filter.may_contain("textures/block_0.png"));
+}
+
+TEST_CASE("Bloom Filter - False positive rate", "[bloom_filter]")
+{
+    for(double target : {0.01, 0.001})
+    {
+        raoe::bloom_filter filter(20000, target);
+        for(uint64 i = 0; i < 20000; i++)
+        {
+            filter.insert(raoe::distribute(i));
+        }
+        int false_positives = 0;
+        constexpr int probes = 200000;
+        for(uint64 i = 0; i < probes; i++)
+        {
+            false_positives += filter.may_contain(raoe::distribute(1000000 + i)) ? 1 : 0;
+        }
+        // Blocking costs a little over the textbook rate; the sizing pays that back, so it should land near target
+        const double rate = static_cast<double>(false_positives) / probes;
+        REQUIRE(rate < target * 1.5);
+    }
+}
+
+TEST_CASE("Bloom Filter - Empty and moved from filters", "[bloom_filter]")
+{
+    // No storage means no way to say no
+    raoe::bloom_filter empty;
+    REQUIRE(empty.may_contain("anything"));
+    empty.insert("anything");
+    REQUIRE(empty.size_in_bytes() == 0);
+
+    raoe::bloom_filter filter(100);
+    filter.insert("one");
+    raoe::bloom_filter moved = std::move(filter);
+    REQUIRE(moved.may_contain("one"));
+    REQUIRE_FALSE(moved.may_contain("two"));
+    REQUIRE(moved.inserted() == 1);
+    REQUIRE(moved.capacity() == 100);
+}
+
+TEST_CASE("Bloom Filter - Concurrent insert and probe", "[bloom_filter]")
+{
+    raoe::bloom_filter filter(40000);
+    std::atomic<bool> missed = false;
+    std::vector<std::jthread> threads;
+    for(int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t] {
+            for(uint64 i = 0; i < 10000; i++)
+            {
+                const uint64 key = raoe::distribute(static_cast<uint64>(t) * 10000 + i);
+                filter.insert(key);
+                // Our own inserts are always visible to us
+                if(!filter.may_contain(key))
+                {
+                    missed = true;
+                }
+            }
+        });
+    }
+    threads.clear();
+
+    REQUIRE_FALSE(missed.load());
+    REQUIRE(filter.inserted() == 40000);
+    for(uint64 i = 0; i < 40000; i++)
+    {
+        REQUIRE(filter.may_contain(raoe::distribute(i)));
+    }
+}
+
+TEST_CASE("Bloom Filter - Saved and loaded", "[bloom_filter]")
+{
+    raoe::bloom_filter filter(1000);
+    for(uint64 i = 0; i < 1000; i++)
+    {
+        filter.insert(raoe::distribute(i));
+    }
+    const raoe::bloom_filter loaded(filter.words(), filter.capacity(), filter.inserted());
+    REQUIRE(loaded.size_in_bytes() == filter.size_in_bytes());
+    REQUIRE(loaded.inserted() == 1000);
+    for(uint64 i = 0; i < 20000; i++)
+    {
+        REQUIRE(loaded.may_contain(raoe::distribute(i)) == filter.may_contain(raoe::distribute(i)));
+    }
+}
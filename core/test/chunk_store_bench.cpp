@@ -0,0 +1,120 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/chunk_store.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    constexpr std::size_t save_size = 64 * 1024 * 1024;
+    // Between autosaves a few dozen things in the world change, which touches about 3% of the save
+    constexpr int edits_per_autosave = 32;
+
+    struct game_save
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_chunk_store_bench";
+        std::vector<std::byte> bytes = std::vector<std::byte>(save_size);
+        uint32 state = 12345;
+        uint64 full_bytes_written = 0;
+        raoe::chunk_store::save_stats last;
+
+        game_save()
+        {
+            std::filesystem::remove_all(root);
+            std::filesystem::create_directories(root);
+            for(std::byte& b : bytes)
+            {
+                b = std::byte(next() >> 24);
+            }
+        }
+        ~game_save() { std::filesystem::remove_all(root); }
+
+        uint32 next() { return state = state * 1664525u + 1013904223u; }
+
+        void play()
+        {
+            for(int i = 0; i < edits_per_autosave; i++)
+            {
+                const std::size_t at = next() % (save_size - 64);
+                for(std::size_t j = 0; j < 64; j++)
+                {
+                    bytes[at + j] ^= std::byte(next() >> 24);
+                }
+            }
+        }
+
+        // What autosaving was: the whole thing through an ofstream
+        void write_whole()
+        {
+            std::ofstream out(root / "autosave.sav", std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            full_bytes_written = bytes.size();
+        }
+
+        void save_chunked(raoe::chunk_store& store)
+        {
+            raoe::chunk_store::writer out(store, "autosave");
+            out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            last = *out.commit();
+        }
+    };
+}
+
+TEST_CASE("Autosave a 64MB save", "[chunk_store][benchmark]")
+{
+    game_save save;
+    raoe::chunk_store store(save.root / "fast", raoe::chunk_store::options {.durable = false});
+    raoe::chunk_store durable_store(save.root / "durable");
+
+    const auto start = std::chrono::steady_clock::now();
+    save.save_chunked(store);
+    const auto first = std::chrono::steady_clock::now() - start;
+    save.save_chunked(durable_store);
+    REQUIRE(store.load("autosave") == save.bytes);
+
+    raoe::test::counted_benchmark("whole file through an ofstream", 1, [&] {
+        save.play();
+        save.write_whole();
+        return save.full_bytes_written;
+    });
+    raoe::test::counted_benchmark("chunk_store", 1, [&] {
+        save.play();
+        save.save_chunked(store);
+        return save.last.bytes_written;
+    });
+    raoe::test::counted_benchmark("chunk_store, durable", 1, [&] {
+        save.play();
+        save.save_chunked(durable_store);
+        return save.last.bytes_written;
+    });
+
+    REQUIRE(durable_store.load("autosave") == save.bytes);
+    std::cout << std::format("  first save {}ms; after that, each autosave wrote {}KB in {} of {} chunks, against "
+                             "{}KB for the whole file\n",
+                             std::chrono::duration_cast<std::chrono::milliseconds>(first).count(),
+                             save.last.bytes_written / 1024, save.last.new_chunks, save.last.chunks,
+                             save.full_bytes_written / 1024);
+}
@@ -0,0 +1,288 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/chunk_store.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::vector<std::byte> random_bytes(std::size_t size, uint32 seed)
+    {
+        std::vector<std::byte> bytes(size);
+        for(std::byte& b : bytes)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            b = std::byte(seed >> 24);
+        }
+        return bytes;
+    }
+
+    // Small chunks, so the tests don't need megabytes
+    const raoe::chunk_store::options small {.min_chunk = 256, .average_chunk = 1024, .max_chunk = 4096, .durable = false};
+
+    std::vector<std::size_t> cuts(std::span<const std::byte> bytes)
+    {
+        const raoe::_internal::chunk_store_format::chunker chunker(small.min_chunk, small.average_chunk,
+                                                                   small.max_chunk);
+        std::vector<std::size_t> sizes;
+        while(!bytes.empty())
+        {
+            sizes.push_back(chunker.cut(bytes));
+            bytes = bytes.subspan(sizes.back());
+        }
+        return sizes;
+    }
+
+    struct temp_store
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_chunk_store_test";
+
+        temp_store() { std::filesystem::remove_all(root); }
+        ~temp_store() { std::filesystem::remove_all(root); }
+
+        [[nodiscard]] std::vector<std::filesystem::path> packs() const
+        {
+            std::vector<std::filesystem::path> files;
+            for(const auto& file : std::filesystem::directory_iterator(root / "packs"))
+            {
+                files.push_back(file.path());
+            }
+            return files;
+        }
+    };
+}
+
+TEST_CASE("Chunk Store - Cuts follow the content", "[chunk_store]")
+{
+    const std::vector<std::byte> bytes = random_bytes(256 * 1024, 1);
+    const std::vector<std::size_t> sizes = cuts(bytes);
+    std::set<std::size_t> ends;
+    std::size_t end = 0;
+    for(std::size_t size : sizes)
+    {
+        REQUIRE(size <= small.max_chunk);
+        end += size;
+        ends.insert(end);
+    }
+    REQUIRE(end == bytes.size());
+    // All but the last are at least min_chunk
+    REQUIRE(std::ranges::all_of(sizes.begin(), sizes.end() - 1, [](std::size_t s) { return s >= small.min_chunk; }));
+    const std::size_t average = bytes.size() / sizes.size();
+    REQUIRE(average > small.average_chunk / 2);
+    REQUIRE(average < small.average_chunk * 2);
+
+    // Put a few bytes in at the front, and the cuts after it land in the same places
+    std::vector<std::byte> shifted = random_bytes(10, 2);
+    shifted.insert(shifted.end(), bytes.begin(), bytes.end());
+    std::size_t shared = 0;
+    end = 0;
+    for(std::size_t size : cuts(shifted))
+    {
+        end += size;
+        shared += end >= 10 && ends.contains(end - 10);
+    }
+    REQUIRE(shared >= sizes.size() - 3);
+
+    // Runs of the same byte still get cut at max_chunk
+    const std::vector<std::byte> zeroes(20000);
+    REQUIRE(cuts(zeroes).front() == small.max_chunk);
+}
+
+TEST_CASE("Chunk Store - Saving again only writes what changed", "[chunk_store]")
+{
+    const temp_store temp;
+    std::vector<std::byte> bytes = random_bytes(512 * 1024, 3);
+    {
+        raoe::chunk_store store(temp.root, small);
+        REQUIRE_FALSE(store.contains("slot_1"));
+        REQUIRE_FALSE(store.load("slot_1"));
+
+        const auto first = store.save("slot_1", bytes);
+        REQUIRE(first);
+        REQUIRE(first->size == bytes.size());
+        REQUIRE(first->new_chunks == first->chunks);
+        REQUIRE(first->bytes_written > bytes.size());
+
+        // The same bytes again write nothing but the manifest
+        const auto again = store.save("slot_1", bytes);
+        REQUIRE(again->new_chunks == 0);
+        REQUIRE(again->bytes_written < 1024 * 24);
+
+        // Flip some bytes in one spot and put some in at another
+        bytes[100000] ^= std::byte {0xff};
+        bytes.insert(bytes.begin() + 300000, 100, std::byte {7});
+        const auto changed = store.save("slot_1", bytes);
+        REQUIRE(changed->new_chunks >= 2);
+        REQUIRE(changed->new_chunks <= 6);
+        REQUIRE(store.load("slot_1") == bytes);
+    }
+
+    // A new store finds the chunks that are already there
+    raoe::chunk_store store(temp.root, small);
+    REQUIRE(store.load("slot_1") == bytes);
+    REQUIRE(store.save("slot_2", bytes)->new_chunks == 0);
+    REQUIRE(store.erase("slot_2"));
+    REQUIRE_FALSE(store.erase("slot_2"));
+    REQUIRE_FALSE(store.contains("slot_2"));
+
+    // Everything's still used
+    REQUIRE(store.collect_garbage() == 0);
+    REQUIRE(temp.packs().size() == 2);
+
+    // Replace most of the save.  The pack with the edits goes, and what's left of the first is copied out.
+    const std::vector<std::byte> replaced = random_bytes(384 * 1024, 6);
+    std::ranges::copy(replaced, bytes.begin());
+    REQUIRE(store.save("slot_1", bytes));
+    const uint64 freed = store.collect_garbage();
+    REQUIRE(freed > 384 * 1024);
+    REQUIRE(freed < 600 * 1024);
+    REQUIRE(temp.packs().size() == 2);
+    REQUIRE(store.load("slot_1") == bytes);
+    REQUIRE(store.collect_garbage() == 0);
+    REQUIRE(raoe::chunk_store(temp.root, small).load("slot_1") == bytes);
+
+    // Empty saves are fine too
+    REQUIRE(store.save("empty", {})->chunks == 0);
+    REQUIRE(store.load("empty")->empty());
+}
+
+TEST_CASE("Chunk Store - A repack that doesn't finish loses nothing", "[chunk_store]")
+{
+    const temp_store temp;
+    raoe::chunk_store store(temp.root, small);
+    // Two saves share what's left of the first pack once slot_1 moves on
+    std::vector<std::byte> bytes = random_bytes(256 * 1024, 7);
+    const std::vector<std::byte> kept(bytes.begin(), bytes.begin() + 64 * 1024);
+    REQUIRE(store.save("slot_1", bytes));
+    REQUIRE(store.save("slot_2", kept));
+    REQUIRE(store.save("slot_3", kept));
+    bytes = random_bytes(256 * 1024, 8);
+    REQUIRE(store.save("slot_1", bytes));
+
+    // Something's in the way of slot_3's new manifest, so only slot_2 gets pointed at the copy
+    std::filesystem::create_directory(temp.root / "slot_3.manifest.tmp");
+    store.collect_garbage();
+    REQUIRE(store.load("slot_2") == kept);
+    REQUIRE(store.load("slot_3") == kept);
+
+    // The chunks are in both packs now, and neither can go
+    std::filesystem::remove(temp.root / "slot_3.manifest.tmp");
+    store.collect_garbage();
+    REQUIRE(store.load("slot_1") == bytes);
+    REQUIRE(store.load("slot_2") == kept);
+    REQUIRE(store.load("slot_3") == kept);
+    REQUIRE(raoe::chunk_store(temp.root, small).load("slot_3") == kept);
+}
+
+TEST_CASE("Chunk Store - Streams", "[chunk_store]")
+{
+    const temp_store temp;
+    raoe::chunk_store store(temp.root, small);
+    const std::vector<std::byte> bytes = random_bytes(100000, 4);
+
+    // Written a bit at a time, it chunks the same as all at once
+    {
+        raoe::chunk_store::writer out(store, "streamed");
+        for(std::size_t i = 0; i < bytes.size(); i += 333)
+        {
+            out.write(reinterpret_cast<const char*>(bytes.data() + i),
+                      static_cast<std::streamsize>(std::min<std::size_t>(333, bytes.size() - i)));
+        }
+        REQUIRE(out);
+        const auto stats = out.commit();
+        REQUIRE(stats);
+        REQUIRE(stats->size == bytes.size());
+        REQUIRE(stats->chunks == cuts(bytes).size());
+    }
+    REQUIRE(store.save("whole", bytes)->new_chunks == 0);
+
+    // Not committed, not saved
+    {
+        raoe::chunk_store::writer out(store, "abandoned");
+        out.write(reinterpret_cast<const char*>(bytes.data()), 20000);
+        const std::string junk(20000, '!');
+        out << junk;
+    }
+    REQUIRE_FALSE(store.contains("abandoned"));
+    REQUIRE(temp.packs().size() == 1);
+
+    raoe::chunk_store::reader in(store, "streamed");
+    REQUIRE(in.is_open());
+    REQUIRE(in.size() == bytes.size());
+    std::vector<std::byte> read(bytes.size());
+    REQUIRE(in.read(reinterpret_cast<char*>(read.data()), static_cast<std::streamsize>(read.size())));
+    REQUIRE(read == bytes);
+    REQUIRE(in.get() == std::char_traits<char>::eof());
+
+    // Seeking goes to the right chunk
+    in.clear();
+    for(std::size_t at : {std::size_t {50000}, std::size_t {3}, std::size_t {99999}, std::size_t {77777}})
+    {
+        REQUIRE(in.seekg(static_cast<std::streamoff>(at)));
+        REQUIRE(in.tellg() == static_cast<std::streamoff>(at));
+        REQUIRE(std::byte(in.get()) == bytes[at]);
+    }
+    REQUIRE(in.seekg(-10, std::ios_base::end));
+    REQUIRE(std::byte(in.get()) == bytes[bytes.size() - 10]);
+
+    raoe::chunk_store::reader missing(store, "missing");
+    REQUIRE_FALSE(missing.is_open());
+    REQUIRE_FALSE(missing);
+}
+
+TEST_CASE("Chunk Store - Damage is noticed", "[chunk_store]")
+{
+    const temp_store temp;
+    raoe::chunk_store store(temp.root, small);
+    const std::vector<std::byte> bytes = random_bytes(50000, 5);
+    const auto saved = store.save("slot_1", bytes);
+    REQUIRE(saved);
+
+    // Scribble on the first chunk
+    const std::filesystem::path victim = temp.packs().front();
+    {
+        std::fstream scribble(victim, std::ios::binary | std::ios::in | std::ios::out);
+        scribble.seekp(10);
+        scribble.put('!');
+        scribble.put('?');
+    }
+    REQUIRE_FALSE(store.load("slot_1"));
+    raoe::chunk_store::reader in(store, "slot_1");
+    REQUIRE(in.is_open());
+    std::vector<char> read(bytes.size());
+    in.read(read.data(), static_cast<std::streamsize>(read.size()));
+    REQUIRE(in.bad());
+
+    // With the pack gone, saving again writes it all again
+    std::filesystem::remove(victim);
+    raoe::chunk_store fresh(temp.root, small);
+    REQUIRE(fresh.save("slot_1", bytes)->new_chunks == saved->chunks);
+    REQUIRE(fresh.load("slot_1") == bytes);
+
+    // A damaged manifest is no save at all
+    {
+        std::ofstream(temp.root / "slot_1.manifest", std::ios::binary | std::ios::app) << "trailing junk";
+    }
+    REQUIRE_FALSE(fresh.load("slot_1"));
+}
@@ -0,0 +1,155 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/concurrent_map.hpp"
+#include "tag/tag.hpp"
+
+#include <format>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // What the caches look like today
+    struct mutex_map
+    {
+        std::mutex mutex;
+        std::unordered_map<raoe::tag, int> values;
+
+        std::optional<int> find(const raoe::tag& key)
+        {
+            std::scoped_lock lock(mutex);
+            if(auto it = values.find(key); it != values.end())
+            {
+                return it->second;
+            }
+            return std::nullopt;
+        }
+
+        void insert_or_assign(const raoe::tag& key, int value)
+        {
+            std::scoped_lock lock(mutex);
+            values.insert_or_assign(key, value);
+        }
+    };
+
+    constexpr int key_count = 4096;
+    constexpr int total_ops = 256000;
+
+    const std::vector<raoe::tag>& keys()
+    {
+        static const std::vector<raoe::tag> instance = [] {
+            std::vector<raoe::tag> result;
+            for(int i = 0; i < key_count; i++)
+            {
+                result.emplace_back(std::format("bench:block_{}", i));
+            }
+            return result;
+        }();
+        return instance;
+    }
+
+    // total_ops operations split over `threads` threads, one in `write_every` a write
+    template <typename TMap>
+    int64 run(TMap& map, int threads, int write_every)
+    {
+        std::vector<std::jthread> workers;
+        std::vector<int64> sums(threads);
+        for(int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t] {
+                const auto& all = keys();
+                int64 sum = 0;
+                uint32 index = static_cast<uint32>(t) * 2654435761u;
+                for(int i = 0; i < total_ops / threads; i++)
+                {
+                    index = index * 1664525u + 1013904223u;
+                    const raoe::tag& key = all[(index >> 8) % key_count];
+                    if(i % write_every == 0)
+                    {
+                        map.insert_or_assign(key, i);
+                    }
+                    else
+                    {
+                        sum += map.find(key).value_or(0);
+                    }
+                }
+                sums[t] = sum;
+            });
+        }
+        workers.clear();
+        int64 total = 0;
+        for(int64 sum : sums)
+        {
+            total += sum;
+        }
+        return total;
+    }
+
+    template <typename TMap>
+    void fill(TMap& map)
+    {
+        for(int i = 0; i < key_count; i++)
+        {
+            map.insert_or_assign(keys()[i], i);
+        }
+    }
+}
+
+// Divide the mean by 256k for the cost of one operation
+TEST_CASE("Tag keyed cache, 1 write in 20", "[concurrent_map][benchmark]")
+{
+    for(int threads : {1, 4, 16, 64})
+    {
+        mutex_map locked;
+        fill(locked);
+        raoe::test::counted_benchmark(std::format("mutex + unordered_map ({} threads)", threads), total_ops, [&] {
+            return run(locked, threads, 20);
+        });
+
+        raoe::concurrent_map<raoe::tag, int> sharded;
+        fill(sharded);
+        raoe::test::counted_benchmark(std::format("concurrent_map ({} threads)", threads), total_ops, [&] {
+            return run(sharded, threads, 20);
+        });
+    }
+}
+
+TEST_CASE("Tag keyed cache, 1 write in 2", "[concurrent_map][benchmark]")
+{
+    for(int threads : {1, 4, 16, 64})
+    {
+        mutex_map locked;
+        fill(locked);
+        raoe::test::counted_benchmark(std::format("mutex + unordered_map ({} threads)", threads), total_ops, [&] {
+            return run(locked, threads, 2);
+        });
+
+        raoe::concurrent_map<raoe::tag, int> sharded;
+        fill(sharded);
+        raoe::test::counted_benchmark(std::format("concurrent_map ({} threads)", threads), total_ops, [&] {
+            return run(sharded, threads, 2);
+        });
+    }
+}
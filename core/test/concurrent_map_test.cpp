@@ -0,0 +1,179 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/concurrent_map.hpp"
+#include "tag/tag.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Concurrent Map - Basics", "[concurrent_map]")
+{
+    raoe::concurrent_map<std::string, int> map(4);
+    REQUIRE(map.shard_count() == 4);
+    REQUIRE(map.empty());
+
+    REQUIRE(map.insert_or_assign("one", 1));
+    REQUIRE(map.insert_or_assign(std::string("two"), 2));
+    REQUIRE_FALSE(map.insert_or_assign("one", 11));
+    REQUIRE(map.size() == 2);
+
+    // string_view lookups don't build a std::string
+    REQUIRE(map.find("one"sv) == 11);
+    REQUIRE(map.contains("two"sv));
+    REQUIRE_FALSE(map.find("three"sv).has_value());
+
+    REQUIRE(map.update("two"sv, [](int& value) { value *= 10; }));
+    int seen = 0;
+    REQUIRE(map.visit("two"sv, [&](const int& value) { seen = value; }));
+    REQUIRE(seen == 20);
+    REQUIRE_FALSE(map.visit("three"sv, [&](const int&) { seen = -1; }));
+
+    REQUIRE(map.erase("one"sv));
+    REQUIRE_FALSE(map.erase("one"sv));
+    REQUIRE(map.size() == 1);
+
+    map.clear();
+    REQUIRE(map.empty());
+}
+
+TEST_CASE("Concurrent Map - Tag keys", "[concurrent_map]")
+{
+    raoe::concurrent_map<raoe::tag, int> map;
+    map.insert_or_assign(raoe::tag("raoe:stone"), 1);
+    map.find_or_emplace(raoe::tag("mod:dirt"), 2);
+
+    REQUIRE(map.find(raoe::tag("stone")) == 1);
+    REQUIRE(map.find("raoe:stone"sv) == 1);
+    REQUIRE(map.find("mod:dirt"sv) == 2);
+    // Lookups by string_view are by the tag's full form
+    REQUIRE_FALSE(map.contains("stone"sv));
+}
+
+TEST_CASE("Concurrent Map - find_or_emplace constructs once", "[concurrent_map]")
+{
+    struct counted
+    {
+        explicit counted(std::atomic<int>& constructions)
+            : id(++constructions)
+        {
+        }
+        int id;
+    };
+
+    constexpr int threads = 8;
+    constexpr int keys = 200;
+    std::atomic<int> constructions = 0;
+    std::atomic<int> factory_calls = 0;
+    raoe::concurrent_map<int, counted> map(8);
+    raoe::concurrent_map<std::string, int> made(8);
+
+    std::vector<std::vector<int>> ids(threads, std::vector<int>(keys));
+    std::vector<std::jthread> workers;
+    for(int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t] {
+            for(int k = 0; k < keys; k++)
+            {
+                auto [value, inserted] = map.find_or_emplace(k, std::ref(constructions));
+                ids[t][k] = value.id;
+                made.find_or_emplace_with(std::to_string(k), [&] { return ++factory_calls; });
+            }
+        });
+    }
+    workers.clear();
+
+    // Every thread got the same value for each key
+    for(int t = 1; t < threads; t++)
+    {
+        REQUIRE(ids[t] == ids[0]);
+    }
+    REQUIRE(map.size() == keys);
+    REQUIRE(constructions.load() == keys);
+    REQUIRE(factory_calls.load() == keys);
+    REQUIRE(made.size() == keys);
+}
+
+TEST_CASE("Concurrent Map - A slow factory only holds up its own key", "[concurrent_map]")
+{
+    // One shard, so everything would be stuck behind the factory if it ran under the lock
+    raoe::concurrent_map<int, std::string> map(1);
+    raoe::sync::event loading;
+    raoe::sync::event loaded;
+    std::atomic<int> factory_calls = 0;
+    auto load = [&] {
+        factory_calls++;
+        loading.set();
+        loaded.wait();
+        return std::string("texture");
+    };
+
+    std::string first;
+    std::string second;
+    std::jthread loader([&] { first = map.find_or_emplace_with(1, load); });
+    loading.wait();
+    std::jthread waiter([&] { second = map.find_or_emplace_with(1, load); });
+
+    REQUIRE(map.insert_or_assign(2, "other"));
+    REQUIRE(map.find(2) == "other");
+    REQUIRE_FALSE(map.contains(1));
+
+    loaded.set();
+    loader.join();
+    waiter.join();
+    REQUIRE(first == "texture");
+    REQUIRE(second == "texture");
+    REQUIRE(factory_calls.load() == 1);
+    REQUIRE(map.find(1) == "texture");
+}
+
+TEST_CASE("Concurrent Map - Snapshot under writes", "[concurrent_map]")
+{
+    raoe::concurrent_map<int, int> map(16);
+    for(int i = 0; i < 1000; i++)
+    {
+        map.insert_or_assign(i, i);
+    }
+
+    std::atomic<bool> done = false;
+    std::jthread writer([&] {
+        for(int i = 1000; !done.load(); i++)
+        {
+            map.insert_or_assign(i, i);
+            map.erase(i - 500);
+        }
+    });
+
+    for(int round = 0; round < 50; round++)
+    {
+        auto snapshot = map.snapshot();
+        // Whatever it caught, every entry is whole and unique
+        std::sort(snapshot.begin(), snapshot.end());
+        REQUIRE(std::adjacent_find(snapshot.begin(), snapshot.end(),
+                                   [](const auto& a, const auto& b) { return a.first == b.first; }) ==
+                snapshot.end());
+        REQUIRE(std::all_of(snapshot.begin(), snapshot.end(), [](const auto& e) { return e.first == e.second; }));
+    }
+    done = true;
+}
@@ -0,0 +1,115 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "core/const_math.hpp"
+#include "core/types.hpp"
+
+#include <cmath>
+
+using Catch::Matchers::WithinAbs;
+using Catch::Matchers::WithinRel;
+
+TEST_CASE("Integer pow", "[CONST_MATH]")
+{
+    STATIC_REQUIRE(raoe::pow(2, 10) == 1024);
+    STATIC_REQUIRE(raoe::pow(3ull, 40) == 12157665459056928801ull);
+    STATIC_REQUIRE(raoe::pow(7, 0) == 1);
+    STATIC_REQUIRE(raoe::pow(2.0, -2) == 0.25);
+    STATIC_REQUIRE(raoe::pow(2.0, int8(-3)) == 0.125);
+    STATIC_REQUIRE(raoe::pow(2.0, int16(-1)) == 0.5);
+    STATIC_REQUIRE(raoe::pow(2.0, int8(-128)) == 1.0 / raoe::pow(2.0, 128));
+}
+
+TEST_CASE("isqrt and ilog2", "[CONST_MATH]")
+{
+    STATIC_REQUIRE(raoe::isqrt(0u) == 0u);
+    STATIC_REQUIRE(raoe::isqrt(15u) == 3u);
+    STATIC_REQUIRE(raoe::isqrt(16u) == 4u);
+    STATIC_REQUIRE(raoe::isqrt(~uint64(0)) == 0xFFFFFFFFull);
+    STATIC_REQUIRE(raoe::ilog2(1u) == 0);
+    STATIC_REQUIRE(raoe::ilog2(1024u) == 10);
+    STATIC_REQUIRE(raoe::ilog2(1023u) == 9);
+
+    for(uint64 i = 0; i < 100000; i++)
+    {
+        const uint64 root = raoe::isqrt(i);
+        REQUIRE(root * root <= i);
+        REQUIRE((root + 1) * (root + 1) > i);
+    }
+}
+
+TEST_CASE("Floating point functions match cmath", "[CONST_MATH]")
+{
+    for(double x = 0.001; x < 1000.0; x *= 1.37)
+    {
+        CHECK_THAT(raoe::sqrt(x), WithinRel(std::sqrt(x), 1e-15));
+        CHECK_THAT(raoe::log(x), WithinAbs(std::log(x), 1e-14));
+    }
+
+    for(double x = -50.0; x < 50.0; x += 0.173)
+    {
+        CHECK_THAT(raoe::exp(x), WithinRel(std::exp(x), 1e-14));
+    }
+
+    for(double x = -20.0; x < 20.0; x += 0.0917)
+    {
+        CHECK_THAT(raoe::sin(x), WithinAbs(std::sin(x), 1e-14));
+        CHECK_THAT(raoe::cos(x), WithinAbs(std::cos(x), 1e-14));
+    }
+
+    for(float x = -10.0f; x < 10.0f; x += 0.31f)
+    {
+        CHECK_THAT(raoe::sin(x), WithinAbs(std::sin(x), 1e-6));
+        CHECK_THAT(raoe::exp(x), WithinRel(std::exp(x), 1e-6));
+    }
+
+    REQUIRE(std::isnan(raoe::sqrt(-1.0)));
+    REQUIRE(std::isnan(raoe::log(-1.0)));
+    REQUIRE(raoe::exp(1000.0) == std::numeric_limits<double>::infinity());
+    REQUIRE(raoe::exp(-1000.0) == 0.0);
+}
+
+TEST_CASE("Compile time tables", "[CONST_MATH]")
+{
+    constexpr std::size_t table_size = 256;
+    constexpr auto sin_table = raoe::make_table<table_size>(
+        [](std::size_t i) { return raoe::sin(static_cast<double>(i) * 2.0 * 3.14159265358979323846 / table_size); });
+    STATIC_REQUIRE(sin_table.size() == table_size);
+    STATIC_REQUIRE(sin_table[0] == 0.0);
+
+    for(std::size_t i = 0; i < table_size; i++)
+    {
+        CHECK_THAT(sin_table[i], WithinAbs(std::sin(static_cast<double>(i) * 2.0 * 3.14159265358979323846 / table_size),
+                                           1e-14));
+    }
+
+    // crc32 table, the classic use case
+    constexpr auto crc_table = raoe::make_table<256>(
+        [](std::size_t i)
+        {
+            uint32 crc = static_cast<uint32>(i);
+            for(int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1u) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            }
+            return crc;
+        });
+    STATIC_REQUIRE(crc_table[1] == 0x77073096u);
+    STATIC_REQUIRE(crc_table[255] == 0x2D02EF8Du);
+}
@@ -0,0 +1,110 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/csv.hpp"
+#include "core/stream.hpp"
+#include "core/string.hpp"
+
+#include <string>
+#include <vector>
+
+// 64 MiB of balance-table-like rows.  Divide 0.0625 GB by the reported mean to get GB/s.
+TEST_CASE("Reading a CSV table (64 MiB)", "[CSV][benchmark]")
+{
+    std::string payload;
+    payload.reserve(64 << 20);
+    for(int i = 0; payload.size() < (64 << 20); i++)
+    {
+        payload += std::to_string(i);
+        payload += ",\"item ";
+        payload += std::to_string(i % 977);
+        payload += ", rare\",";
+        payload += std::to_string((i * 7919) % 100000);
+        payload += ",";
+        payload += std::to_string(i % 1000);
+        payload += ".25,game:loot_table\n";
+    }
+
+    raoe::test::counted_benchmark("split lines, split cells, from_string", payload.size(), [&] {
+        std::vector<std::string_view> lines;
+        raoe::string::split(std::string_view(payload), '\n', std::back_inserter(lines));
+        std::int64_t sum = 0;
+        std::vector<std::string_view> cells;
+        for(std::string_view line : lines)
+        {
+            cells.clear();
+            raoe::string::split(line, ',', std::back_inserter(cells));
+            int cost = 0;
+            if(cells.size() > 3 && raoe::from_string(cells[3], cost))
+            {
+                sum += cost;
+            }
+        }
+        return sum;
+    });
+
+    raoe::test::counted_benchmark("csv::reader over memory", payload.size(), [&] {
+        raoe::csv::reader reader {std::string_view(payload)};
+        std::int64_t sum = 0;
+        for(auto row : reader)
+        {
+            int cost = 0;
+            if(row.size() > 2 && raoe::from_string(row[2], cost))
+            {
+                sum += cost;
+            }
+        }
+        return sum;
+    });
+
+    raoe::test::counted_benchmark("csv::reader over a stream", payload.size(), [&] {
+        raoe::stream::span_istream stream(payload);
+        raoe::csv::reader reader(stream);
+        std::int64_t sum = 0;
+        for(auto row : reader)
+        {
+            int cost = 0;
+            if(row.size() > 2 && raoe::from_string(row[2], cost))
+            {
+                sum += cost;
+            }
+        }
+        return sum;
+    });
+
+    raoe::test::counted_benchmark("csv::read_column", payload.size(), [&] {
+        raoe::csv::reader reader {std::string_view(payload)};
+        std::vector<int> costs(1 << 16);
+        std::int64_t sum = 0;
+        while(true)
+        {
+            auto result = raoe::csv::read_column(reader, 2, std::span(costs));
+            for(std::size_t i = 0; i < result.rows; i++)
+            {
+                sum += costs[i];
+            }
+            if(result.rows < costs.size())
+            {
+                break;
+            }
+        }
+        return sum;
+    });
+}
@@ -0,0 +1,150 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/csv.hpp"
+#include "core/fixed.hpp"
+#include "core/stream.hpp"
+#include "core/uuid.hpp"
+#include "tag/tag.hpp"
+
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Rows and quoted cells", "[CSV]")
+{
+    raoe::csv::reader reader("name,desc,cost\r\n"
+                             "sword,\"sharp, pointy\",10\r\n"
+                             "\n"
+                             "shield,\"says \"\"hi\"\"\nover two lines\",\r\n"
+                             "last,no newline,3"sv);
+
+    std::vector<std::vector<std::string>> rows;
+    for(auto row : reader)
+    {
+        rows.emplace_back(row.begin(), row.end());
+    }
+
+    REQUIRE(rows.size() == 4);
+    REQUIRE(rows[0] == std::vector<std::string> {"name", "desc", "cost"});
+    REQUIRE(rows[1] == std::vector<std::string> {"sword", "sharp, pointy", "10"});
+    REQUIRE(rows[2] == std::vector<std::string> {"shield", "says \"hi\"\nover two lines", ""});
+    REQUIRE(rows[3] == std::vector<std::string> {"last", "no newline", "3"});
+    REQUIRE(reader.row_number() == 4);
+}
+
+TEST_CASE("Rows straddling blocks", "[CSV]")
+{
+    // Long quoted cells cross both the 64 byte scan blocks and the 128 byte stream blocks
+    std::string input;
+    std::vector<std::string> expected;
+    for(int i = 0; i < 400; i++)
+    {
+        expected.push_back(std::string(static_cast<std::size_t>((i * 53) % 300), static_cast<char>('a' + i % 26)));
+        if(i % 3 == 0)
+        {
+            expected.back() += ",\"quoted\"";
+        }
+        input += std::to_string(i) + ",\"";
+        for(char c : expected.back())
+        {
+            input += c;
+            if(c == '"')
+            {
+                input += '"';
+            }
+        }
+        input += "\"\n";
+    }
+
+    for(std::size_t block_size : {std::size_t(128), raoe::csv::reader::default_block_size})
+    {
+        raoe::stream::span_istream stream(input);
+        raoe::csv::reader reader(stream, {}, block_size);
+        std::size_t index = 0;
+        std::span<const std::string_view> row;
+        while(reader.next(row))
+        {
+            REQUIRE(index < expected.size());
+            REQUIRE(row.size() == 2);
+            REQUIRE(row[0] == std::to_string(index));
+            REQUIRE(row[1] == expected[index]);
+            index++;
+        }
+        REQUIRE(index == expected.size());
+    }
+}
+
+TEST_CASE("Typed columns", "[CSV]")
+{
+    using fixed_t = raoe::fixed<int32, 16>;
+    raoe::csv::reader reader("id\tcount\tweight\tprice\titem\n"
+                             "123e4567-e89b-12d3-a456-426614174000\t7\t0.5\t12.25\tgame:sword\n"
+                             "123e4567-e89b-12d3-a456-426614174001\t-3\t2.25\t-0.125\tshield\n"
+                             "bad\tnope\t1\t1\tgame:bow\n"sv,
+                             raoe::csv::tab_separated);
+
+    auto header = reader.read_header();
+    REQUIRE(header.size() == 5);
+    REQUIRE(reader.column_index("price") == 3);
+    REQUIRE_FALSE(reader.column_index("missing").has_value());
+
+    std::span<const std::string_view> row;
+    REQUIRE(reader.next(row));
+    raoe::uuid id;
+    int count = 0;
+    float weight = 0;
+    fixed_t price;
+    raoe::tag item;
+    REQUIRE(raoe::csv::parse_row(row, id, count, weight, price, item));
+    REQUIRE(std::format("{}", id) == "123e4567-e89b-12d3-a456-426614174000");
+    REQUIRE(count == 7);
+    REQUIRE(weight == 0.5f);
+    REQUIRE(price == fixed_t(12.25));
+    REQUIRE(item == raoe::tag("game:sword"));
+
+    std::vector<int> counts(8);
+    std::vector<fixed_t> prices(8);
+    auto result = raoe::csv::read_columns(reader, {1, 3}, std::span(counts), std::span(prices));
+    REQUIRE(result.rows == 2);
+    REQUIRE(result.failed == 1);
+    REQUIRE(counts[0] == -3);
+    REQUIRE(counts[1] == 0);
+    REQUIRE(prices[0] == fixed_t(-0.125));
+    REQUIRE(prices[1] == fixed_t(1));
+}
+
+TEST_CASE("Fixed point from_string", "[CSV]")
+{
+    using fixed_t = raoe::fixed<int32, 16>;
+    fixed_t value;
+    REQUIRE(raoe::from_string("3.75", value));
+    REQUIRE(value == fixed_t(3.75));
+    REQUIRE(raoe::from_string("-.5", value));
+    REQUIRE(value == fixed_t(-0.5));
+    REQUIRE(raoe::from_string("42", value));
+    REQUIRE(value == fixed_t(42));
+    // 0.1 isn't representable, so it rounds to the nearest raw value
+    REQUIRE(raoe::from_string("0.1", value));
+    REQUIRE(value.raw() == 6554);
+    REQUIRE_FALSE(raoe::from_string("", value));
+    REQUIRE_FALSE(raoe::from_string("1.2.3", value));
+    REQUIRE_FALSE(raoe::from_string("40000", value));
+}
@@ -0,0 +1,104 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/cvar.hpp"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // What tuning values used to be: a map from name to string-ish value behind one mutex
+    struct mutex_map
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, float> values;
+
+        float get(const std::string& name)
+        {
+            std::scoped_lock lock(mutex);
+            return values[name];
+        }
+    };
+
+    struct wide_tuning
+    {
+        float values[6] = {};
+    };
+
+    bool from_string(std::string_view, wide_tuning&) { return false; }
+
+    inline raoe::cvar<float> bench_gravity {"bench:gravity", 9.8f};
+    inline raoe::cvar<wide_tuning> bench_wide {"bench:wide", wide_tuning {}};
+
+    constexpr int reader_threads = 16;
+    constexpr int reads_per_thread = 200000;
+
+    template <typename TFunc>
+    double run_readers(TFunc&& read)
+    {
+        std::vector<std::thread> threads;
+        std::vector<double> sums(reader_threads);
+        for(int t = 0; t < reader_threads; t++)
+        {
+            threads.emplace_back([&, t] {
+                double sum = 0;
+                for(int i = 0; i < reads_per_thread; i++)
+                {
+                    sum += read();
+                }
+                sums[t] = sum;
+            });
+        }
+        for(auto& thread : threads)
+        {
+            thread.join();
+        }
+        double total = 0;
+        for(double sum : sums)
+        {
+            total += sum;
+        }
+        return total;
+    }
+}
+
+// 16 threads x 200k reads each.  Divide the mean by 3.2M for the cost of one read (thread startup included).
+TEST_CASE("Reading tuning values from 16 threads", "[CVAR][benchmark]")
+{
+    mutex_map map;
+    map.values["physics:gravity"] = 9.8f;
+    const std::string key = "physics:gravity";
+
+    raoe::test::counted_benchmark("mutex protected map", reader_threads * reads_per_thread, [&] {
+        return run_readers([&] { return map.get(key); });
+    });
+
+    raoe::test::counted_benchmark("cvar<float> (atomic load)", reader_threads * reads_per_thread, [&] {
+        return run_readers([] { return bench_gravity.get(); });
+    });
+
+    raoe::test::counted_benchmark("cvar<24 byte struct> (seqlock)", reader_threads * reads_per_thread, [&] {
+        return run_readers([] { return bench_wide.get().values[5]; });
+    });
+}
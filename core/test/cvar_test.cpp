@@ -0,0 +1,161 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/cvar.hpp"
+#include "core/fixed.hpp"
+#include "core/stream.hpp"
+
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct tuning
+    {
+        float a = 0;
+        float b = 0;
+        float c = 0;
+        float d = 0;
+    };
+
+    // Four floats at once, so readers can tell if they saw a torn write
+    bool from_string(std::string_view text, tuning& value)
+    {
+        std::vector<std::string_view> parts;
+        raoe::string::split(text, ',', std::back_inserter(parts));
+        return parts.size() == 4 && raoe::from_string(parts[0], value.a) && raoe::from_string(parts[1], value.b) &&
+               raoe::from_string(parts[2], value.c) && raoe::from_string(parts[3], value.d);
+    }
+
+    inline raoe::cvar<float> test_gravity {"test:gravity", 9.8f, "Downward acceleration"};
+    inline raoe::cvar<bool> test_enabled {"test:enabled", false};
+    inline raoe::cvar<std::string> test_greeting {"test:greeting", "hello world"};
+    inline raoe::cvar<raoe::fixed<int32, 16>> test_price {"test:price", raoe::fixed<int32, 16>(2.5)};
+}
+
+TEST_CASE("Registration and setting from strings", "[CVAR]")
+{
+    auto& registry = raoe::cvar_registry::get();
+    REQUIRE(registry.find("test:gravity") == &test_gravity);
+    REQUIRE(registry.find("test:missing") == nullptr);
+    REQUIRE(test_gravity.description() == "Downward acceleration");
+
+    REQUIRE(registry.set("test:gravity", "1.6"));
+    REQUIRE(test_gravity.get() == 1.6f);
+    REQUIRE_FALSE(registry.set("test:gravity", "heavy"));
+    REQUIRE(test_gravity.get() == 1.6f);
+    REQUIRE_FALSE(registry.set("test:missing", "1"));
+
+    REQUIRE(registry.set("test:enabled", "on"));
+    REQUIRE(test_enabled);
+    REQUIRE(registry.set("test:price", "-0.75"));
+    REQUIRE(test_price.get() == raoe::fixed<int32, 16>(-0.75));
+
+    test_gravity.reset();
+    REQUIRE(test_gravity.get() == 9.8f);
+    {
+        raoe::cvar<int> scoped {"test:scoped", 1};
+        REQUIRE(registry.find("test:scoped") == &scoped);
+    }
+    REQUIRE(registry.find("test:scoped") == nullptr);
+}
+
+TEST_CASE("Change callbacks", "[CVAR]")
+{
+    std::vector<float> seen;
+    const auto id = test_gravity.on_change([&](const float& value) { seen.push_back(value); });
+    test_gravity = 3.0f;
+    REQUIRE(raoe::cvar_registry::get().set("test:gravity", "4"));
+    test_gravity.remove_callback(id);
+    test_gravity = 5.0f;
+    REQUIRE(seen == std::vector<float> {3.0f, 4.0f});
+    test_gravity.reset();
+}
+
+TEST_CASE("Load and save", "[CVAR]")
+{
+    auto& registry = raoe::cvar_registry::get();
+    const std::string config = "# tuning\n"
+                               "test:gravity 2.5   # moon-ish\n"
+                               "test:greeting \"good morning\"\n"
+                               "test:enabled true\n"
+                               "test:nonexistent 4\n"
+                               "\n";
+    raoe::stream::span_istream in(config);
+    const auto result = registry.load(in);
+    REQUIRE(result.applied == 3);
+    REQUIRE(result.failed == 1);
+    REQUIRE(test_gravity.get() == 2.5f);
+    REQUIRE(test_greeting.get() == "good morning");
+
+    std::vector<std::byte> saved;
+    raoe::stream::vector_ostream out(saved);
+    registry.save(out);
+    out.flush();
+    const std::string text(reinterpret_cast<const char*>(saved.data()), saved.size());
+    REQUIRE(text.find("test:greeting \"good morning\"\n") != std::string::npos);
+    REQUIRE(text.find("test:gravity 2.5\n") != std::string::npos);
+
+    // And it reads back
+    test_gravity.reset();
+    test_greeting.reset();
+    raoe::stream::span_istream again(text);
+    REQUIRE(registry.load(again).failed == 0);
+    REQUIRE(test_gravity.get() == 2.5f);
+    REQUIRE(test_greeting.get() == "good morning");
+
+    test_gravity.reset();
+    test_greeting.reset();
+    test_enabled.reset();
+}
+
+TEST_CASE("Seqlocked reads are never torn", "[CVAR]")
+{
+    raoe::cvar<tuning> wide {"test:wide", tuning {}};
+    std::atomic<bool> stop = false;
+    std::atomic<int> torn = 0;
+    std::vector<std::thread> readers;
+    for(int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&] {
+            while(!stop.load())
+            {
+                const tuning value = wide.get();
+                if(value.a != value.b || value.b != value.c || value.c != value.d)
+                {
+                    torn++;
+                }
+            }
+        });
+    }
+    for(int i = 0; i < 20000; i++)
+    {
+        const float f = static_cast<float>(i);
+        wide = tuning {f, f, f, f};
+    }
+    stop = true;
+    for(auto& reader : readers)
+    {
+        reader.join();
+    }
+    REQUIRE(torn.load() == 0);
+    REQUIRE(raoe::cvar_registry::get().set("test:wide", "1,2,3,4"));
+    REQUIRE(wide.get().d == 4.0f);
+}
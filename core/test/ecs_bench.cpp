@@ -0,0 +1,177 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/ecs.hpp"
+#include "core/subclass_map.hpp"
+
+#include <vector>
+
+namespace
+{
+    constexpr int entity_count = 1000000;
+
+    // The subclass_map way: every component derives from one base and lives in its own shared_ptr
+    struct component_base
+    {
+        virtual ~component_base() = default;
+    };
+
+    struct position : component_base
+    {
+        position(float x_, float y_)
+            : x(x_)
+            , y(y_)
+        {
+        }
+        float x;
+        float y;
+    };
+
+    struct velocity : component_base
+    {
+        velocity(float x_, float y_)
+            : x(x_)
+            , y(y_)
+        {
+        }
+        float x;
+        float y;
+    };
+
+    struct health : component_base
+    {
+        explicit health(int v)
+            : value(v)
+        {
+        }
+        int value;
+    };
+
+    // Same data, no base class
+    struct ecs_position
+    {
+        float x;
+        float y;
+    };
+
+    struct ecs_velocity
+    {
+        float x;
+        float y;
+    };
+
+    struct ecs_health
+    {
+        int value;
+    };
+}
+
+// 1M entities with a position and a velocity: move every one of them
+TEST_CASE("Iterate 1M entities", "[ecs][benchmark]")
+{
+    std::vector<raoe::subclass_map<component_base>> maps(entity_count);
+    raoe::ecs::world world;
+    for(int i = 0; i < entity_count; i++)
+    {
+        maps[i].insert<position>(static_cast<float>(i), 0.0f);
+        maps[i].insert<velocity>(1.0f, 2.0f);
+        world.create(ecs_position {static_cast<float>(i), 0}, ecs_velocity {1, 2});
+    }
+
+    raoe::test::counted_benchmark("subclass_map per entity", entity_count, [&] {
+        for(auto& map : maps)
+        {
+            auto p = map.find<position>().lock();
+            auto v = map.find<velocity>().lock();
+            if(p && v)
+            {
+                p->x += v->x;
+                p->y += v->y;
+            }
+        }
+        return maps.size();
+    });
+    raoe::test::counted_benchmark("world::each", entity_count, [&] {
+        world.each<ecs_position, const ecs_velocity>([](ecs_position& p, const ecs_velocity& v) {
+            p.x += v.x;
+            p.y += v.y;
+        });
+        return world.size();
+    });
+    raoe::test::counted_benchmark("world::parallel_each", entity_count, [&] {
+        world.parallel_each<ecs_position, const ecs_velocity>([](ecs_position& p, const ecs_velocity& v) {
+            p.x += v.x;
+            p.y += v.y;
+        });
+        return world.size();
+    });
+}
+
+// Give all 1M a third component, then take it away again
+TEST_CASE("Add and remove a component on 1M entities", "[ecs][benchmark]")
+{
+    std::vector<raoe::subclass_map<component_base>> maps(entity_count);
+    raoe::ecs::world world;
+    std::vector<raoe::ecs::entity> entities;
+    entities.reserve(entity_count);
+    for(int i = 0; i < entity_count; i++)
+    {
+        maps[i].insert<position>(static_cast<float>(i), 0.0f);
+        maps[i].insert<velocity>(1.0f, 2.0f);
+        entities.push_back(world.create(ecs_position {static_cast<float>(i), 0}, ecs_velocity {1, 2}));
+    }
+
+    raoe::test::counted_benchmark("subclass_map per entity", entity_count, [&] {
+        for(int i = 0; i < entity_count; i++)
+        {
+            maps[i].insert<health>(i);
+        }
+        for(auto& map : maps)
+        {
+            map.erase<health>();
+        }
+        return maps.size();
+    });
+    raoe::test::counted_benchmark("world::insert and world::erase", entity_count, [&] {
+        for(int i = 0; i < entity_count; i++)
+        {
+            world.insert<ecs_health>(entities[i], i);
+        }
+        for(auto e : entities)
+        {
+            world.erase<ecs_health>(e);
+        }
+        return world.size();
+    });
+    // Kept between runs, like a game would keep one per frame
+    raoe::ecs::command_buffer commands;
+    raoe::test::counted_benchmark("command_buffer, applied", entity_count, [&] {
+        world.each<const ecs_position>([&](raoe::ecs::entity e, const ecs_position&) {
+            commands.insert_or_assign(e, ecs_health {1});
+        });
+        world.apply(commands);
+        for(auto e : entities)
+        {
+            commands.erase<ecs_health>(e);
+        }
+        world.apply(commands);
+        return world.size();
+    });
+}
@@ -0,0 +1,256 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/ecs.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct position
+    {
+        float x = 0;
+        float y = 0;
+    };
+
+    struct velocity
+    {
+        float x = 0;
+        float y = 0;
+    };
+
+    struct name
+    {
+        std::string value;
+    };
+
+    // Counts how many are alive, to catch leaks and double destroys
+    struct tracked
+    {
+        static inline int alive = 0;
+
+        explicit tracked(int v)
+            : value(std::make_unique<int>(v))
+        {
+            alive++;
+        }
+        tracked(tracked&& other) noexcept
+            : value(std::move(other.value))
+        {
+            alive++;
+        }
+        tracked& operator=(tracked&&) noexcept = default;
+        ~tracked() { alive--; }
+
+        std::unique_ptr<int> value;
+    };
+}
+
+TEST_CASE("ECS - Insert, find and erase", "[ecs]")
+{
+    raoe::ecs::world world;
+    const auto e = world.create();
+    REQUIRE(world.alive(e));
+    REQUIRE(world.size() == 1);
+    REQUIRE_FALSE(world.contains<position>(e));
+
+    position* p = world.insert<position>(e, 1.0f, 2.0f);
+    REQUIRE(p != nullptr);
+    REQUIRE(p->x == 1.0f);
+    REQUIRE(world.insert<position>(e, 3.0f, 4.0f) == nullptr);
+    REQUIRE(world.find<position>(e)->x == 1.0f);
+
+    world.insert<name>(e, "bob");
+    world.insert<velocity>(e, 5.0f, 6.0f);
+    // Moving archetypes keeps every value
+    REQUIRE(world.find<position>(e)->y == 2.0f);
+    REQUIRE(world.find<name>(e)->value == "bob");
+    REQUIRE(world.find<const velocity>(e)->x == 5.0f);
+
+    REQUIRE(world.erase<name>(e));
+    REQUIRE_FALSE(world.erase<name>(e));
+    REQUIRE_FALSE(world.contains<name>(e));
+    REQUIRE(world.find<position>(e)->x == 1.0f);
+
+    world.insert_or_assign(e, position {7, 8});
+    REQUIRE(world.find<position>(e)->x == 7.0f);
+
+    // Ids depend on the name alone
+    REQUIRE(raoe::ecs::component_id<position>() == raoe::ecs::component_id<position>());
+    REQUIRE(raoe::ecs::component_id<position>() != raoe::ecs::component_id<velocity>());
+}
+
+TEST_CASE("ECS - Destroy and reuse", "[ecs]")
+{
+    raoe::ecs::world world;
+    std::vector<raoe::ecs::entity> entities;
+    for(int i = 0; i < 100; i++)
+    {
+        entities.push_back(world.create(position {static_cast<float>(i), 0}, name {std::to_string(i)}));
+    }
+    // The empty one, position, then position and name
+    REQUIRE(world.archetype_count() == 3);
+
+    // Removing rows from the middle moves others into them; they should all still find their own values
+    for(int i = 0; i < 100; i += 3)
+    {
+        REQUIRE(world.destroy(entities[i]));
+        REQUIRE_FALSE(world.destroy(entities[i]));
+        REQUIRE_FALSE(world.alive(entities[i]));
+        REQUIRE(world.find<position>(entities[i]) == nullptr);
+    }
+    for(int i = 0; i < 100; i++)
+    {
+        if(i % 3 != 0)
+        {
+            REQUIRE(world.find<name>(entities[i])->value == std::to_string(i));
+            REQUIRE(world.find<position>(entities[i])->x == static_cast<float>(i));
+        }
+    }
+    REQUIRE(world.size() == 66);
+
+    // A reused slot gets a new generation, so the old handle stays dead
+    const auto reused = world.create(velocity {});
+    REQUIRE(reused.index == entities[99].index);
+    REQUIRE(reused != entities[99]);
+    REQUIRE_FALSE(world.alive(entities[99]));
+    REQUIRE(world.alive(reused));
+}
+
+TEST_CASE("ECS - Iteration", "[ecs]")
+{
+    raoe::ecs::world world;
+    for(int i = 0; i < 1000; i++)
+    {
+        const auto e = world.create(position {static_cast<float>(i), 0}, velocity {1, 2});
+        if(i % 2 == 0)
+        {
+            world.insert<name>(e, "even");
+        }
+    }
+    world.create(position {});
+
+    int moving = 0;
+    world.each<position, const velocity>([&](position& p, const velocity& v) {
+        p.x += v.x;
+        p.y += v.y;
+        moving++;
+    });
+    REQUIRE(moving == 1000);
+
+    int named = 0;
+    world.each<const name>([&](raoe::ecs::entity e, const name& n) {
+        REQUIRE(n.value == "even");
+        REQUIRE(world.find<position>(e)->y == 2.0f);
+        named++;
+    });
+    REQUIRE(named == 500);
+
+    // Small chunks, so several threads really do split it
+    raoe::ecs::world big;
+    for(std::size_t i = 0; i < raoe::ecs::world::chunk_rows * 4 + 10; i++)
+    {
+        big.create(position {1, 0}, velocity {2, 0});
+    }
+    std::atomic<std::size_t> visited = 0;
+    big.parallel_each<position, const velocity>(
+        [&](position& p, const velocity& v) {
+            p.x += v.x;
+            visited.fetch_add(1, std::memory_order_relaxed);
+        },
+        4);
+    REQUIRE(visited == raoe::ecs::world::chunk_rows * 4 + 10);
+    big.each<const position>([](const position& p) { REQUIRE(p.x == 3.0f); });
+}
+
+TEST_CASE("ECS - Command buffers", "[ecs]")
+{
+    raoe::ecs::world world;
+    std::vector<raoe::ecs::entity> entities;
+    for(int i = 0; i < 10; i++)
+    {
+        entities.push_back(world.create(position {static_cast<float>(i), 0}));
+    }
+
+    raoe::ecs::command_buffer commands;
+    world.each<const position>([&](raoe::ecs::entity e, const position& p) {
+        if(static_cast<int>(p.x) % 2 == 0)
+        {
+            commands.insert_or_assign(e, velocity {p.x, 0});
+        }
+        else
+        {
+            commands.destroy(e);
+        }
+        commands.create(name {"spawned"});
+    });
+    REQUIRE(commands.size() == 20);
+    REQUIRE(world.size() == 10);
+
+    // A destroy recorded twice, and an erase on something that'll be gone by then, are both fine
+    commands.destroy(entities[1]);
+    commands.erase<position>(entities[3]);
+    commands.erase<position>(entities[4]);
+
+    world.apply(commands);
+    REQUIRE(commands.empty());
+    REQUIRE(world.size() == 15);
+    REQUIRE(world.find<velocity>(entities[2])->x == 2.0f);
+    REQUIRE_FALSE(world.alive(entities[3]));
+    REQUIRE_FALSE(world.contains<position>(entities[4]));
+    REQUIRE(world.contains<velocity>(entities[4]));
+
+    int spawned = 0;
+    world.each<const name>([&](const name&) { spawned++; });
+    REQUIRE(spawned == 10);
+}
+
+TEST_CASE("ECS - Component lifetimes", "[ecs]")
+{
+    tracked::alive = 0;
+    {
+        raoe::ecs::world world;
+        std::vector<raoe::ecs::entity> entities;
+        for(int i = 0; i < 200; i++)
+        {
+            entities.push_back(world.create(tracked {i}));
+        }
+        REQUIRE(tracked::alive == 200);
+
+        // Growing columns and moving between archetypes relocate without leaking
+        for(int i = 0; i < 200; i += 2)
+        {
+            world.insert<position>(entities[i]);
+        }
+        REQUIRE(tracked::alive == 200);
+        for(int i = 0; i < 200; i += 4)
+        {
+            world.erase<tracked>(entities[i]);
+        }
+        REQUIRE(tracked::alive == 150);
+        world.destroy(entities[1]);
+        REQUIRE(tracked::alive == 149);
+        REQUIRE(*world.find<tracked>(entities[2])->value == 2);
+        REQUIRE(*world.find<tracked>(entities[199])->value == 199);
+    }
+    // The world cleans up what's left
+    REQUIRE(tracked::alive == 0);
+}
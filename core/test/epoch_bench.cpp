@@ -0,0 +1,121 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/epoch.hpp"
+
+#include <atomic>
+#include <format>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct settings
+    {
+        int64 values[8] = {};
+    };
+
+    constexpr int reads_per_thread = 200000;
+    constexpr int writes = 2000;
+
+    // `readers` threads reading the current settings while one thread replaces them `writes` times
+    template <typename TRead, typename TWrite>
+    int64 run(int readers, TRead&& read, TWrite&& write)
+    {
+        std::vector<std::jthread> threads;
+        std::vector<int64> sums(readers);
+        for(int t = 0; t < readers; t++)
+        {
+            threads.emplace_back([&, t] {
+                int64 sum = 0;
+                for(int i = 0; i < reads_per_thread; i++)
+                {
+                    sum += read(i & 7);
+                }
+                sums[t] = sum;
+            });
+        }
+        for(int i = 0; i < writes; i++)
+        {
+            write(i);
+        }
+        threads.clear();
+        int64 total = 0;
+        for(int64 sum : sums)
+        {
+            total += sum;
+        }
+        return total;
+    }
+}
+
+TEST_CASE("Guard cost", "[epoch][benchmark]")
+{
+    std::atomic<settings*> current = new settings;
+
+    raoe::test::counted_benchmark("epoch::guard + load", 1, [&] {
+        raoe::epoch::guard guard;
+        return current.load(std::memory_order_acquire)->values[3];
+    });
+
+    std::atomic<std::shared_ptr<settings>> shared = std::make_shared<settings>();
+    raoe::test::counted_benchmark("atomic<shared_ptr> load", 1, [&] {
+        return shared.load(std::memory_order_acquire)->values[3];
+    });
+
+    delete current.load();
+}
+
+// Divide the mean by readers x 200k for the cost of one read (with a writer swapping in new settings the whole time)
+TEST_CASE("Readers with a writer swapping the pointer", "[epoch][benchmark]")
+{
+    for(int readers : {1, 4, 8})
+    {
+        std::atomic<settings*> current = new settings;
+        raoe::test::counted_benchmark(std::format("epoch ({} readers)", readers), readers * reads_per_thread, [&] {
+            return run(
+                readers,
+                [&](int index) {
+                    raoe::epoch::guard guard;
+                    return current.load(std::memory_order_acquire)->values[index];
+                },
+                [&](int i) {
+                    auto* next = new settings;
+                    next->values[i & 7] = i;
+                    raoe::epoch::retire(current.exchange(next, std::memory_order_acq_rel));
+                });
+        });
+        raoe::epoch::synchronize();
+        delete current.load();
+
+        std::atomic<std::shared_ptr<settings>> shared = std::make_shared<settings>();
+        raoe::test::counted_benchmark(std::format("atomic<shared_ptr> ({} readers)", readers),
+                                      readers * reads_per_thread, [&] {
+            return run(
+                readers, [&](int index) { return shared.load(std::memory_order_acquire)->values[index]; },
+                [&](int i) {
+                    auto next = std::make_shared<settings>();
+                    next->values[i & 7] = i;
+                    shared.store(std::move(next), std::memory_order_release);
+                });
+        });
+    }
+}
@@ -0,0 +1,214 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/epoch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    std::atomic<int> g_live_nodes = 0;
+
+    struct node
+    {
+        explicit node(int64 value)
+            : value(value)
+            , check(~value)
+        {
+            g_live_nodes++;
+        }
+        ~node()
+        {
+            // Anyone reading a freed node would see this (and ASan/TSan would complain first)
+            value = check = 0x5a5a5a5a;
+            g_live_nodes--;
+        }
+        int64 value;
+        int64 check;
+    };
+
+    // Retires the one behind it when it's freed, like a list handing back its tail
+    struct chained
+    {
+        node value;
+        chained* next;
+    };
+
+    void retire_chained(chained* c)
+    {
+        raoe::epoch::retire(c, [](void* pointer) {
+            auto* freed = static_cast<chained*>(pointer);
+            if(freed->next != nullptr)
+            {
+                retire_chained(freed->next);
+            }
+            delete freed;
+        });
+    }
+}
+
+TEST_CASE("Epoch - Retired pointers wait for guards", "[epoch]")
+{
+    raoe::epoch::synchronize();
+    const int live_before = g_live_nodes.load();
+
+    std::atomic<node*> shared = new node(1);
+    raoe::sync::event pinned;
+    raoe::sync::event release;
+    int64 seen = 0;
+
+    std::jthread reader([&] {
+        raoe::epoch::guard guard;
+        const node* current = shared.load(std::memory_order_acquire);
+        pinned.set();
+        release.wait();
+        seen = current->value;
+    });
+    pinned.wait();
+
+    raoe::epoch::retire(shared.exchange(new node(2), std::memory_order_acq_rel));
+    raoe::epoch::collect();
+    raoe::epoch::collect();
+    raoe::epoch::collect();
+    // The reader is still pinned, so the old node can't have gone
+    REQUIRE(g_live_nodes.load() == live_before + 2);
+
+    release.set();
+    reader.join();
+    REQUIRE(seen == 1);
+
+    raoe::epoch::synchronize();
+    REQUIRE(g_live_nodes.load() == live_before + 1);
+    delete shared.load();
+}
+
+TEST_CASE("Epoch - Guards nest", "[epoch]")
+{
+    raoe::epoch::synchronize();
+    const uint64 before = raoe::epoch::current_epoch();
+    {
+        raoe::epoch::guard outer;
+        {
+            raoe::epoch::guard inner;
+        }
+        // Still pinned by the outer guard, so the epoch can only move one step past where we pinned
+        raoe::epoch::collect();
+        raoe::epoch::collect();
+        raoe::epoch::collect();
+        REQUIRE(raoe::epoch::current_epoch() <= before + 1);
+    }
+    raoe::epoch::collect();
+    raoe::epoch::collect();
+    REQUIRE(raoe::epoch::current_epoch() >= before + 2);
+}
+
+TEST_CASE("Epoch - Deleters that retire", "[epoch]")
+{
+    raoe::epoch::synchronize();
+    const int live_before = g_live_nodes.load();
+
+    // Enough that the retires from inside the deleters grow the list being reclaimed
+    for(int i = 0; i < 100; i++)
+    {
+        retire_chained(new chained {node(i), new chained {node(i), new chained {node(i), nullptr}}});
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        raoe::epoch::synchronize();
+    }
+    REQUIRE(g_live_nodes.load() == live_before);
+}
+
+TEST_CASE("Epoch - Stress", "[epoch]")
+{
+    raoe::epoch::synchronize();
+    const int live_before = g_live_nodes.load();
+    const uint64 retired_before = raoe::epoch::retired_count();
+
+    constexpr int readers = 4;
+    constexpr int writers = 2;
+    constexpr int swaps_per_writer = 20000;
+
+    std::atomic<node*> shared = new node(0);
+    std::atomic<bool> done = false;
+    std::atomic<bool> corrupt = false;
+
+    std::vector<std::jthread> threads;
+    for(int r = 0; r < readers; r++)
+    {
+        threads.emplace_back([&] {
+            while(!done.load(std::memory_order_relaxed))
+            {
+                raoe::epoch::guard guard;
+                const node* current = shared.load(std::memory_order_acquire);
+                if(current->check != ~current->value)
+                {
+                    corrupt = true;
+                }
+            }
+        });
+    }
+    std::vector<std::jthread> writer_threads;
+    for(int w = 0; w < writers; w++)
+    {
+        writer_threads.emplace_back([&, w] {
+            for(int64 i = 0; i < swaps_per_writer; i++)
+            {
+                node* old = shared.exchange(new node(i * writers + w), std::memory_order_acq_rel);
+                raoe::epoch::retire(old);
+            }
+            // Exiting with garbage still in this thread's batch hands it to the shared list
+        });
+    }
+    writer_threads.clear();
+    done = true;
+    threads.clear();
+
+    REQUIRE_FALSE(corrupt.load());
+    REQUIRE(raoe::epoch::retired_count() - retired_before == writers * swaps_per_writer);
+
+    raoe::epoch::synchronize();
+    REQUIRE(g_live_nodes.load() == live_before + 1);
+    delete shared.load();
+}
+
+TEST_CASE("Epoch - Reclaim handler", "[epoch]")
+{
+    raoe::epoch::synchronize();
+    const int live_before = g_live_nodes.load();
+
+    int calls = 0;
+    raoe::epoch::set_reclaim_handler([&] { calls++; });
+
+    // A full batch goes to the handler instead of being freed here
+    for(int i = 0; i < 64; i++)
+    {
+        raoe::epoch::retire(new node(i));
+    }
+    REQUIRE(calls == 1);
+    REQUIRE(g_live_nodes.load() == live_before + 64);
+
+    raoe::epoch::set_reclaim_handler({});
+
+    // What the scheduled job would do
+    std::jthread job([] { raoe::epoch::synchronize(); });
+    job.join();
+    REQUIRE(g_live_nodes.load() == live_before);
+}
@@ -0,0 +1,143 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/event_bus.hpp"
+
+#include <format>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    constexpr int event_types = 1000;
+    constexpr int subscribers = 10000;
+    constexpr int publishes = 100000;
+
+    struct payload
+    {
+        int64 value;
+        uint32 entity;
+    };
+
+    // The string keyed kind: hash the name, find the vector, call through std::function
+    class string_bus
+    {
+      public:
+        void subscribe(const std::string& name, std::function<void(const payload&)> handler)
+        {
+            m_handlers[name].push_back(std::move(handler));
+        }
+
+        void publish(const std::string& name, const payload& p)
+        {
+            if(auto it = m_handlers.find(name); it != m_handlers.end())
+            {
+                for(const auto& handler : it->second)
+                {
+                    handler(p);
+                }
+            }
+        }
+
+      private:
+        std::unordered_map<std::string, std::vector<std::function<void(const payload&)>>> m_handlers;
+    };
+
+    std::string event_name(int i)
+    {
+        return std::format("game#kind_{}:event_{}", i % 7, i);
+    }
+
+    // Which event each publish hits: a fixed pseudo random order
+    std::vector<int> publish_order()
+    {
+        std::vector<int> order;
+        uint32 state = 12345;
+        for(int i = 0; i < publishes; i++)
+        {
+            state = state * 1664525u + 1013904223u;
+            order.push_back(static_cast<int>((state >> 8) % event_types));
+        }
+        return order;
+    }
+}
+
+// 100k publishes over 1k events with 10 subscribers each.  Divide the mean by 100k for the cost of one publish.
+TEST_CASE("Publish to 1k events, 10k subscribers", "[event_bus][benchmark]")
+{
+    const std::vector<int> order = publish_order();
+    int64 sink = 0;
+
+    string_bus strings;
+    std::vector<std::string> names;
+    for(int i = 0; i < event_types; i++)
+    {
+        names.push_back(event_name(i));
+    }
+    for(int s = 0; s < subscribers; s++)
+    {
+        strings.subscribe(names[s % event_types], [&sink, s](const payload& p) { sink += p.value + s; });
+    }
+
+    raoe::event_bus bus;
+    std::vector<raoe::event_id<payload>> ids;
+    for(int i = 0; i < event_types; i++)
+    {
+        ids.push_back(bus.event<payload>(raoe::tag(names[i])));
+    }
+    for(int s = 0; s < subscribers; s++)
+    {
+        // Half of them listen untyped, which resolves to the same events
+        const std::string name = s % 2 == 0 ? names[s % event_types] : std::format("game:event_{}", s % event_types);
+        bus.subscribe<payload>(raoe::tag(name), [&sink, s](const payload& p) { sink += p.value + s; });
+    }
+
+    raoe::test::counted_benchmark("string keyed map of std::function vectors", publishes, [&] {
+        for(int i : order)
+        {
+            strings.publish(names[i], payload {i, 0});
+        }
+        return sink;
+    });
+    // Only a tenth as many, since each one builds a tag
+    raoe::test::counted_benchmark("event_bus::publish by tag (10k publishes)", publishes / 10, [&] {
+        for(int i = 0; i < publishes / 10; i++)
+        {
+            bus.publish(raoe::tag(names[order[i]]), payload {i, 0});
+        }
+        return sink;
+    });
+    raoe::test::counted_benchmark("event_bus::publish by event_id", publishes, [&] {
+        for(int i : order)
+        {
+            bus.publish(ids[i], payload {i, 0});
+        }
+        return sink;
+    });
+    raoe::test::counted_benchmark("event_bus::enqueue + dispatch_deferred", publishes, [&] {
+        for(int i : order)
+        {
+            bus.enqueue(ids[i], payload {i, 0});
+        }
+        return bus.dispatch_deferred();
+    });
+}
@@ -0,0 +1,197 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/event_bus.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct damage
+    {
+        int amount = 0;
+        std::string source;
+    };
+}
+
+TEST_CASE("Event Bus - Publish and subscribe", "[event_bus]")
+{
+    raoe::event_bus bus;
+    const auto hit = bus.event<damage>("game:hit");
+    REQUIRE(hit == bus.event<damage>("game:hit"));
+    REQUIRE(bus.handler_count(hit) == 0);
+
+    // Nobody listening is fine
+    bus.publish(hit, damage {1, "nobody"});
+
+    std::vector<std::string> seen;
+    const auto first = bus.subscribe<damage>("game:hit", [&](const damage& d) { seen.push_back("first " + d.source); });
+    bus.subscribe<damage>("game:hit", [&](const damage& d) { seen.push_back("second " + d.source); });
+    bus.subscribe<damage>("game:heal", [&](const damage& d) { seen.push_back("heal " + d.source); });
+    REQUIRE(bus.handler_count(hit) == 2);
+    REQUIRE(bus.handler_count(raoe::event_id<damage>()) == 0);
+
+    bus.publish(hit, damage {5, "sword"});
+    REQUIRE(seen == std::vector<std::string> {"first sword", "second sword"});
+
+    bus.unsubscribe(first);
+    bus.unsubscribe(first);
+    seen.clear();
+    bus.publish(hit, damage {5, "axe"});
+    REQUIRE(seen == std::vector<std::string> {"second axe"});
+
+    // By tag, for the odd one off
+    seen.clear();
+    bus.publish(raoe::tag("game:heal"), damage {3, "potion"});
+    REQUIRE(seen == std::vector<std::string> {"heal potion"});
+    REQUIRE(bus.event_count() == 2);
+    REQUIRE(bus.subscription_count() == 2);
+}
+
+TEST_CASE("Event Bus - Typed tags match like tag::matches", "[event_bus]")
+{
+    raoe::event_bus bus;
+    int any = 0, melee = 0, ranged = 0;
+    bus.subscribe<int>("game:hit", [&](const int& v) { any += v; });
+    bus.subscribe<int>("game#melee:hit", [&](const int& v) { melee += v; });
+
+    // Events looked up after the subscriptions pick them up, and subscriptions made after pick up the events
+    const auto melee_hit = bus.event<int>("game#melee:hit");
+    const auto ranged_hit = bus.event<int>("game#ranged:hit");
+    const auto untyped_hit = bus.event<int>("game:hit");
+    bus.subscribe<int>("game#ranged:hit", [&](const int& v) { ranged += v; });
+
+    bus.publish(melee_hit, 1);
+    bus.publish(ranged_hit, 10);
+    bus.publish(untyped_hit, 100);
+    REQUIRE(any == 111);
+    REQUIRE(melee == 101);
+    REQUIRE(ranged == 110);
+
+    // Same name, other namespace: nothing to do with us
+    const auto other = bus.event<float>("other:hit");
+    bus.publish(other, 1.0f);
+    REQUIRE(any == 111);
+}
+
+TEST_CASE("Event Bus - Changing subscriptions from a handler", "[event_bus]")
+{
+    raoe::event_bus bus;
+    const auto tick = bus.event<int>("game:tick");
+    int once = 0, added = 0;
+    raoe::event_bus::subscription self = 0;
+    self = bus.subscribe<int>("game:tick", [&](const int&) {
+        once++;
+        bus.unsubscribe(self);
+        bus.subscribe<int>("game:tick", [&](const int&) { added++; });
+    });
+
+    // The list being walked doesn't change under us, so the new handler waits for the next publish
+    bus.publish(tick, 0);
+    REQUIRE(once == 1);
+    REQUIRE(added == 0);
+    bus.publish(tick, 0);
+    REQUIRE(once == 1);
+    REQUIRE(added == 1);
+    raoe::epoch::synchronize();
+}
+
+TEST_CASE("Event Bus - Deferred dispatch", "[event_bus]")
+{
+    raoe::event_bus bus;
+    const auto spawn = bus.event<int>("game:spawn");
+    std::vector<int> seen;
+    bus.subscribe<int>("game:spawn", [&](const int& v) {
+        seen.push_back(v);
+        if(v == 0)
+        {
+            // Queued from a handler: waits for the next sync point
+            bus.enqueue(spawn, -1);
+        }
+    });
+
+    constexpr int threads = 4;
+    constexpr int per_thread = 1000;
+    std::vector<std::jthread> workers;
+    for(int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t] {
+            for(int i = 0; i < per_thread; i++)
+            {
+                bus.enqueue(spawn, t * per_thread + i);
+            }
+        });
+    }
+    workers.clear();
+    REQUIRE(seen.empty());
+
+    REQUIRE(bus.dispatch_deferred() == threads * per_thread);
+    REQUIRE(seen.size() == threads * per_thread);
+    // Each thread's events come out in the order it queued them
+    for(int t = 0; t < threads; t++)
+    {
+        int last = -1;
+        for(int v : seen)
+        {
+            if(v / per_thread == t)
+            {
+                REQUIRE(v > last);
+                last = v;
+            }
+        }
+    }
+
+    seen.clear();
+    REQUIRE(bus.dispatch_deferred() == 1);
+    REQUIRE(seen == std::vector<int> {-1});
+    REQUIRE(bus.dispatch_deferred() == 0);
+}
+
+TEST_CASE("Event Bus - Publish while subscribing", "[event_bus]")
+{
+    raoe::event_bus bus;
+    const auto ping = bus.event<int>("game:ping");
+    std::atomic<int> calls = 0;
+    std::atomic<bool> done = false;
+
+    std::jthread publisher([&] {
+        while(!done)
+        {
+            bus.publish(ping, 1);
+        }
+    });
+    std::vector<raoe::event_bus::subscription> ids;
+    for(int i = 0; i < 200; i++)
+    {
+        ids.push_back(bus.subscribe<int>("game:ping", [&](const int& v) { calls += v; }));
+        if(i % 3 == 0)
+        {
+            bus.unsubscribe(ids[i / 2]);
+        }
+    }
+    done = true;
+    publisher.join();
+
+    const int before = calls;
+    bus.publish(ping, 1);
+    REQUIRE(calls - before == static_cast<int>(bus.handler_count(ping)));
+    raoe::epoch::synchronize();
+}
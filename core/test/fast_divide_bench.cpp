@@ -0,0 +1,112 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/fast_divide.hpp"
+#include "core/fixed.hpp"
+#include "core/random.hpp"
+
+#include <vector>
+
+namespace
+{
+    template <typename T>
+    std::vector<T> make_numerators()
+    {
+        raoe::random::xoshiro256pp engine(1);
+        std::vector<T> values(1 << 16);
+        for(T& v : values)
+        {
+            v = static_cast<T>(engine());
+        }
+        return values;
+    }
+
+    // Keeps the divisor opaque to the optimizer, so the native path really is a hardware divide
+    template <typename T>
+    T runtime_divisor(T value)
+    {
+        volatile T opaque = value;
+        return opaque;
+    }
+
+    template <typename T>
+    void bench_type(const char* native_name, const char* scalar_name, const char* batch_name)
+    {
+        const auto numerators = make_numerators<T>();
+        std::vector<T> out(numerators.size());
+        const T divisor = runtime_divisor<T>(1337);
+        const raoe::fast_divider<T> divider(divisor);
+
+        raoe::test::counted_benchmark(native_name, numerators.size(), [&] {
+            for(std::size_t i = 0; i < numerators.size(); i++)
+            {
+                out[i] = numerators[i] / divisor;
+            }
+            return out.back();
+        });
+
+        raoe::test::counted_benchmark(scalar_name, numerators.size(), [&] {
+            for(std::size_t i = 0; i < numerators.size(); i++)
+            {
+                out[i] = divider.divide(numerators[i]);
+            }
+            return out.back();
+        });
+
+        raoe::test::counted_benchmark(batch_name, numerators.size(), [&] {
+            divider.divide(numerators, out);
+            return out.back();
+        });
+    }
+}
+
+TEST_CASE("Division by a runtime invariant", "[FAST_DIVIDE][benchmark]")
+{
+    bench_type<uint32>("native uint32", "fast_divider<uint32>", "fast_divider<uint32> batch");
+    bench_type<int32>("native int32", "fast_divider<int32>", "fast_divider<int32> batch");
+    bench_type<uint64>("native uint64", "fast_divider<uint64>", "fast_divider<uint64> batch");
+    bench_type<int64>("native int64", "fast_divider<int64>", "fast_divider<int64> batch");
+}
+
+TEST_CASE("Fixed point division by a reused divisor", "[FAST_DIVIDE][benchmark]")
+{
+    using fixed_t = raoe::fixed<int64, 16>;
+    std::vector<fixed_t> values;
+    for(int32 i = 0; i < (1 << 16); i++)
+    {
+        values.push_back(fixed_t::make_from_raw(i * 7919));
+    }
+    std::vector<fixed_t> out(values.size());
+    const fixed_t divisor(runtime_divisor(3.75));
+    const raoe::fixed_divider<fixed_t> divider(divisor);
+
+    raoe::test::counted_benchmark("fixed operator/", values.size(), [&] {
+        for(std::size_t i = 0; i < values.size(); i++)
+        {
+            out[i] = values[i] / divisor;
+        }
+        return out.back();
+    });
+
+    raoe::test::counted_benchmark("fixed_divider", values.size(), [&] {
+        divider.divide(values, out);
+        return out.back();
+    });
+}
@@ -0,0 +1,147 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/fast_divide.hpp"
+#include "core/fixed.hpp"
+#include "core/random.hpp"
+
+#include <limits>
+#include <vector>
+
+namespace
+{
+    template <typename T>
+    std::vector<T> interesting_values()
+    {
+        using limits = std::numeric_limits<T>;
+        std::vector<T> values = {1, 2, 3, 5, 7, 10, 11, 64, 100, 641, 1000, 4096, 65535, 65536, 65537,
+                                 limits::max(), static_cast<T>(limits::max() - 1), static_cast<T>(limits::max() / 2),
+                                 static_cast<T>(limits::max() / 3)};
+        if constexpr(std::is_signed_v<T>)
+        {
+            const std::size_t positive = values.size();
+            for(std::size_t i = 0; i < positive; i++)
+            {
+                values.push_back(static_cast<T>(-values[i]));
+            }
+            values.push_back(limits::min());
+            values.push_back(static_cast<T>(limits::min() + 1));
+        }
+
+        raoe::random::xoshiro256pp engine(17);
+        for(int i = 0; i < 200; i++)
+        {
+            T value = static_cast<T>(engine() >> raoe::random::bounded(engine, sizeof(T) * 8));
+            values.push_back(value == 0 ? T(1) : value);
+        }
+        return values;
+    }
+
+    template <typename T>
+    void check_against_native()
+    {
+        const auto values = interesting_values<T>();
+        for(T divisor : values)
+        {
+            const raoe::fast_divider<T> divider(divisor);
+            for(T numerator : values)
+            {
+                // The only overflowing signed division, same as the native operator
+                if constexpr(std::is_signed_v<T>)
+                {
+                    if(numerator == std::numeric_limits<T>::min() && divisor == -1)
+                    {
+                        continue;
+                    }
+                }
+                REQUIRE(divider.divide(numerator) == numerator / divisor);
+                REQUIRE(numerator % divider == numerator % divisor);
+            }
+            for(T numerator = 0; numerator < 300; numerator++)
+            {
+                REQUIRE(numerator / divider == numerator / divisor);
+            }
+        }
+    }
+}
+
+TEST_CASE("fast_divider matches native division", "[FAST_DIVIDE]")
+{
+    check_against_native<uint32>();
+    check_against_native<int32>();
+    check_against_native<uint64>();
+    check_against_native<int64>();
+}
+
+TEST_CASE("fast_divider batch divide", "[FAST_DIVIDE]")
+{
+    std::vector<int32> numerators;
+    for(int32 i = -5000; i < 5000; i += 7)
+    {
+        numerators.push_back(i * 977);
+    }
+    std::vector<int32> quotients(numerators.size());
+    std::vector<int32> remainders(numerators.size());
+
+    for(int32 divisor : {1, -1, 3, -3, 8, -8, 1000, -12345, 7919})
+    {
+        const raoe::fast_divider<int32> divider(divisor);
+        divider.divide(numerators, quotients);
+        divider.modulo(numerators, remainders);
+        for(std::size_t i = 0; i < numerators.size(); i++)
+        {
+            REQUIRE(quotients[i] == numerators[i] / divisor);
+            REQUIRE(remainders[i] == numerators[i] % divisor);
+        }
+    }
+
+    std::vector<uint64> unsigned_numerators = {0, 1, 99, 1ull << 40, ~0ull, 123456789012345ull};
+    std::vector<uint64> unsigned_quotients(unsigned_numerators.size());
+    for(uint64 divisor : {1ull, 7ull, 1024ull, 1000000007ull, ~0ull})
+    {
+        const raoe::fast_divider<uint64> divider(divisor);
+        divider.divide(unsigned_numerators, unsigned_quotients);
+        for(std::size_t i = 0; i < unsigned_numerators.size(); i++)
+        {
+            REQUIRE(unsigned_quotients[i] == unsigned_numerators[i] / divisor);
+        }
+    }
+}
+
+TEST_CASE("fast_divider at compile time", "[FAST_DIVIDE]")
+{
+    constexpr raoe::fast_divider<uint32> divider(7);
+    STATIC_REQUIRE(divider.divide(100) == 14);
+    STATIC_REQUIRE(divider.modulo(100) == 2);
+}
+
+TEST_CASE("fixed_divider matches fixed division", "[FAST_DIVIDE]")
+{
+    using fixed_t = raoe::fixed<int64, 16>;
+    for(double d : {0.5, 3.0, -2.25, 7.125, 1000.0, -0.01})
+    {
+        const fixed_t divisor(d);
+        const raoe::fixed_divider<fixed_t> divider(divisor);
+        REQUIRE(divider.divisor() == divisor);
+        for(double n = -100.0; n < 100.0; n += 0.77)
+        {
+            const fixed_t numerator(n);
+            REQUIRE((numerator / divider).raw() == (numerator / divisor).raw());
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/function.hpp"
+#include "core/function_ref.hpp"
+#include "core/parse.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr int count = 10000;
+
+    // Three pointers of capture: more than libstdc++'s std::function keeps inline, within raoe::function's default
+    template <typename TFunction>
+    int64 construct_and_call(int64& a, int64& b, int64& c)
+    {
+        int64 sum = 0;
+        for(int i = 0; i < count; i++)
+        {
+            TFunction fn = [&a, &b, &c](int x) { return a + b + c + x; };
+            sum += fn(i);
+        }
+        return sum;
+    }
+
+    template <typename TFunction>
+    int64 call_only(const std::vector<TFunction>& functions)
+    {
+        int64 sum = 0;
+        for(int i = 0; i < count; i++)
+        {
+            sum += functions[i % functions.size()](i);
+        }
+        return sum;
+    }
+
+    template <typename TFunction>
+    std::vector<TFunction> make_functions(int64& a, int64& b, int64& c)
+    {
+        std::vector<TFunction> result;
+        for(int i = 0; i < 16; i++)
+        {
+            result.emplace_back([&a, &b, &c, i](int x) { return a + b + c + x + i; });
+        }
+        return result;
+    }
+
+    int64 call_through_ref(raoe::function_ref<int64(int)> fn)
+    {
+        int64 sum = 0;
+        for(int i = 0; i < count; i++)
+        {
+            sum += fn(i);
+        }
+        return sum;
+    }
+}
+
+// 10k of each; divide the mean by 10k for the cost of one
+TEST_CASE("Construct and call", "[function][benchmark]")
+{
+    int64 a = 1, b = 2, c = 3;
+    raoe::test::counted_benchmark("std::function", count, [&] {
+        return construct_and_call<std::function<int64(int)>>(a, b, c);
+    });
+    raoe::test::counted_benchmark("raoe::function", count, [&] {
+        return construct_and_call<raoe::function<int64(int)>>(a, b, c);
+    });
+}
+
+TEST_CASE("Call", "[function][benchmark]")
+{
+    int64 a = 1, b = 2, c = 3;
+    const auto standard = make_functions<std::function<int64(int)>>(a, b, c);
+    const auto ours = make_functions<raoe::function<int64(int), 32>>(a, b, c);
+    auto lambda = [&a, &b, &c](int x) { return a + b + c + x; };
+
+    raoe::test::counted_benchmark("std::function", count, [&] {
+        return call_only(standard);
+    });
+    raoe::test::counted_benchmark("raoe::function", count, [&] {
+        return call_only(ours);
+    });
+    raoe::test::counted_benchmark("raoe::function_ref", count, [&] {
+        return call_through_ref(lambda);
+    });
+}
+
+TEST_CASE("parse_split", "[function][benchmark]")
+{
+    std::string line;
+    for(int i = 0; i < 200; i++)
+    {
+        line += "word \"two words\" ";
+    }
+    raoe::test::counted_benchmark("parse_split, 600 tokens", 600, [&] {
+        return raoe::core::parse::parse_split(line).size();
+    });
+}
@@ -0,0 +1,188 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/function.hpp"
+#include "core/function_ref.hpp"
+#include "core/parse.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    int add(int a, int b)
+    {
+        return a + b;
+    }
+
+    // Counts how many are alive, to catch leaks and double destroys through moves
+    struct counted
+    {
+        static inline int alive = 0;
+        int value;
+
+        explicit counted(int v)
+            : value(v)
+        {
+            alive++;
+        }
+        counted(const counted& other)
+            : value(other.value)
+        {
+            alive++;
+        }
+        counted(counted&& other) noexcept
+            : value(other.value)
+        {
+            alive++;
+        }
+        ~counted() { alive--; }
+
+        int operator()(int x) const { return value + x; }
+    };
+}
+
+TEST_CASE("Function - Calls what it holds", "[function]")
+{
+    raoe::function<int(int, int)> empty;
+    REQUIRE_FALSE(empty);
+
+    raoe::function<int(int, int)> from_function = add;
+    REQUIRE(from_function);
+    REQUIRE(from_function(2, 3) == 5);
+
+    int (*null_pointer)(int, int) = nullptr;
+    raoe::function<int(int, int)> from_null = null_pointer;
+    REQUIRE_FALSE(from_null);
+
+    int base = 10;
+    raoe::function<int(int)> lambda = [&base](int x) { return base + x; };
+    base = 20;
+    REQUIRE(lambda(1) == 21);
+
+    // Move only captures are fine
+    raoe::function<int()> owning = [p = std::make_unique<int>(7)] { return *p; };
+    raoe::function<int()> moved = std::move(owning);
+    REQUIRE_FALSE(owning);
+    REQUIRE(moved() == 7);
+
+    // A void signature throws the result away
+    raoe::function<void(int, int)> discard = add;
+    discard(1, 2);
+
+    lambda = nullptr;
+    REQUIRE_FALSE(lambda);
+    lambda = [](int x) { return x * 2; };
+    REQUIRE(lambda(4) == 8);
+}
+
+TEST_CASE("Function - Inline and heap storage", "[function]")
+{
+    using small_function = raoe::function<int(int)>;
+    using big_buffer_function = raoe::function<int(int), 64>;
+    auto big = [data = std::array<int, 12> {1, 2, 3}](int x) { return data[2] + x; };
+
+    STATIC_REQUIRE(small_function::stores_inline<counted>);
+    STATIC_REQUIRE_FALSE(small_function::stores_inline<decltype(big)>);
+    STATIC_REQUIRE(big_buffer_function::stores_inline<decltype(big)>);
+
+    small_function heap = big;
+    big_buffer_function inline_big = big;
+    REQUIRE(heap(1) == 4);
+    REQUIRE(inline_big(1) == 4);
+
+    {
+        small_function a = counted(1);
+        raoe::function<int(int), 8> b = counted(2); // still fits
+        raoe::function<int(int), 8> c = [payload = counted(3), pad = std::array<int, 8> {}](int x) {
+            return payload(x) + pad[0];
+        };
+        REQUIRE(counted::alive == 3);
+
+        small_function a2 = std::move(a);
+        auto c2 = std::move(c);
+        REQUIRE(counted::alive == 3);
+        REQUIRE(a2(1) == 2);
+        REQUIRE(b(1) == 3);
+        REQUIRE(c2(1) == 4);
+
+        swap(a, a2);
+        REQUIRE(a(0) == 1);
+        REQUIRE_FALSE(a2);
+
+        a = counted(5);
+        REQUIRE(counted::alive == 3);
+        REQUIRE(a(0) == 5);
+    }
+    REQUIRE(counted::alive == 0);
+}
+
+TEST_CASE("Function - Holds callbacks in a vector", "[function]")
+{
+    std::vector<raoe::function<void(std::string&)>> callbacks;
+    for(int i = 0; i < 20; i++)
+    {
+        callbacks.emplace_back([i](std::string& out) { out += std::to_string(i % 10); });
+    }
+    std::string out;
+    for(const auto& callback : callbacks)
+    {
+        callback(out);
+    }
+    REQUIRE(out == "01234567890123456789");
+}
+
+TEST_CASE("Function Ref - Refers without owning", "[function]")
+{
+    auto call = [](raoe::function_ref<int(int, int)> fn) { return fn(3, 4); };
+    REQUIRE(call(add) == 7);
+    REQUIRE(call(&add) == 7);
+
+    int (*pointer)(int, int) = add;
+    raoe::function_ref<int(int, int)> from_pointer = pointer;
+    pointer = nullptr; // held by value, so this doesn't matter
+    REQUIRE(from_pointer(1, 1) == 2);
+
+    int calls = 0;
+    auto counter = [&calls](int a, int b) {
+        calls++;
+        return a * b;
+    };
+    REQUIRE(call(counter) == 12);
+    REQUIRE(calls == 1);
+
+    const counted plus_one(1);
+    raoe::function_ref<int(int)> to_const = plus_one;
+    REQUIRE(to_const(1) == 2);
+
+    // Copies refer to the same thing
+    raoe::function_ref<int(int, int)> original = counter;
+    raoe::function_ref<int(int, int)> copy = original;
+    copy(1, 1);
+    REQUIRE(calls == 2);
+
+    raoe::function<int(int, int)> owned = add;
+    REQUIRE(call(owned) == 7);
+
+    // What parse_split scans with
+    const auto split = raoe::core::parse::parse_split("one \"two three\" four");
+    REQUIRE(split.size() == 3);
+    REQUIRE(split[1] == "two three");
+}
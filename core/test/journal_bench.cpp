@@ -0,0 +1,116 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/journal.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr int updates = 256;
+    constexpr int threads = 8;
+    // A progress update or telemetry event
+    constexpr std::size_t record_size = 64;
+    // What we used to rewrite for each one
+    constexpr std::size_t state_size = 4096;
+
+    struct temp_dir
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_journal_bench";
+
+        temp_dir()
+        {
+            std::filesystem::remove_all(root);
+            std::filesystem::create_directories(root);
+        }
+        ~temp_dir() { std::filesystem::remove_all(root); }
+    };
+
+    raoe::journal::options with(raoe::journal::durability durability)
+    {
+        return raoe::journal::options {.durability = durability};
+    }
+
+    uint64 append_all(raoe::journal& journal, const std::array<std::byte, record_size>& record, int count)
+    {
+        uint64 last = 0;
+        for(int i = 0; i < count; i++)
+        {
+            last = journal.append(1, record).value_or(0);
+        }
+        return last;
+    }
+}
+
+// 256 updates each.  Divide by 256 for the cost of one.
+TEST_CASE("Journal appends", "[journal][benchmark]")
+{
+    const temp_dir temp;
+    const std::array<std::byte, record_size> record {};
+
+    raoe::test::counted_benchmark("rewriting the whole state through an ofstream", updates, [&] {
+        const std::vector<char> state(state_size);
+        for(int i = 0; i < updates; i++)
+        {
+            std::ofstream out(temp.root / "progress.sav", std::ios::binary | std::ios::trunc);
+            out.write(state.data(), static_cast<std::streamsize>(state.size()));
+        }
+        return state.size();
+    });
+
+    raoe::journal buffered(temp.root / "buffered", with(raoe::journal::durability::buffered));
+    raoe::test::counted_benchmark("buffered", updates, [&] {
+        return append_all(buffered, record, updates);
+    });
+
+    raoe::journal periodic(temp.root / "periodic", with(raoe::journal::durability::periodic));
+    raoe::test::counted_benchmark("periodic", updates, [&] {
+        return append_all(periodic, record, updates);
+    });
+
+    raoe::journal synced(temp.root / "sync", with(raoe::journal::durability::sync));
+    raoe::test::counted_benchmark("sync, one thread", updates, [&] {
+        return append_all(synced, record, updates);
+    });
+
+    raoe::journal shared(temp.root / "shared", with(raoe::journal::durability::sync));
+    raoe::test::counted_benchmark("sync, 8 threads", updates, [&] {
+        std::vector<std::jthread> appenders;
+        for(int t = 0; t < threads; t++)
+        {
+            appenders.emplace_back([&] { append_all(shared, record, updates / threads); });
+        }
+        appenders.clear();
+        return shared.last_sequence();
+    });
+
+    const auto one = synced.stats();
+    const auto eight = shared.stats();
+    std::cout << std::format("  sync: {} records per fsync from one thread, {:.1f} from 8\n",
+                             one.records / std::max<uint64>(one.syncs, 1),
+                             static_cast<double>(eight.records) / static_cast<double>(std::max<uint64>(eight.syncs, 1)));
+}
@@ -0,0 +1,320 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/journal.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct temp_journal
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_journal_test";
+
+        temp_journal() { std::filesystem::remove_all(root); }
+        ~temp_journal() { std::filesystem::remove_all(root); }
+
+        [[nodiscard]] std::vector<std::filesystem::path> segments() const
+        {
+            std::vector<std::filesystem::path> files;
+            for(const auto& file : std::filesystem::directory_iterator(root))
+            {
+                if(file.path().extension() == ".log")
+                {
+                    files.push_back(file.path());
+                }
+            }
+            std::ranges::sort(files);
+            return files;
+        }
+    };
+
+    std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text));
+    }
+
+    std::string text_of(std::span<const std::byte> bytes)
+    {
+        return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+    }
+
+    struct replayed
+    {
+        std::string snapshot;
+        std::vector<raoe::journal::record> records;
+        std::vector<std::string> texts;
+
+        explicit replayed(const raoe::journal& journal)
+        {
+            journal.replay([&](std::span<const std::byte> bytes) { snapshot = text_of(bytes); },
+                           [&](const raoe::journal::record& r) {
+                               records.push_back(r);
+                               texts.push_back(text_of(r.bytes));
+                           });
+        }
+    };
+}
+
+TEST_CASE("Journal - Records come back after reopening", "[journal]")
+{
+    const temp_journal temp;
+    {
+        raoe::journal journal(temp.root);
+        REQUIRE(journal.ok());
+        REQUIRE(journal.last_sequence() == 0);
+        REQUIRE(replayed(journal).records.empty());
+
+        REQUIRE(journal.append(1, bytes_of("level 1")) == 1u);
+        REQUIRE(journal.append(2, bytes_of("")) == 2u);
+        REQUIRE(journal.append(1, bytes_of("level 2")) == 3u);
+        REQUIRE(journal.stats().syncs >= 1);
+    }
+
+    raoe::journal journal(temp.root);
+    REQUIRE(journal.last_sequence() == 3);
+    const replayed got(journal);
+    REQUIRE(got.snapshot.empty());
+    REQUIRE(got.texts == std::vector<std::string> {"level 1", "", "level 2"});
+    REQUIRE(got.records[1].type == 2);
+    REQUIRE(got.records[2].sequence == 3);
+
+    // Numbering carries on
+    REQUIRE(journal.append(1, bytes_of("level 3")) == 4u);
+}
+
+TEST_CASE("Journal - Recovery stops at the last good record", "[journal]")
+{
+    const temp_journal temp;
+    {
+        raoe::journal journal(temp.root, raoe::journal::options {.durability = raoe::journal::durability::buffered});
+        for(int i = 0; i < 10; i++)
+        {
+            journal.append(0, bytes_of("record " + std::to_string(i)));
+        }
+        REQUIRE(journal.flush());
+    }
+    const std::filesystem::path segment = temp.segments().back();
+    const auto size = std::filesystem::file_size(segment);
+
+    SECTION("Half written record")
+    {
+        // As if the process died part way through a write
+        std::filesystem::resize_file(segment, size - 3);
+    }
+    SECTION("Garbage on the end")
+    {
+        std::ofstream(segment, std::ios::binary | std::ios::app) << std::string(100, '\x7f');
+    }
+    SECTION("Damaged record")
+    {
+        std::fstream scribble(segment, std::ios::binary | std::ios::in | std::ios::out);
+        scribble.seekp(static_cast<std::streamoff>(size) - 2);
+        scribble.put('!');
+    }
+
+    {
+        raoe::journal journal(temp.root);
+        REQUIRE(journal.last_sequence() == 9);
+        REQUIRE(replayed(journal).texts.back() == "record 8");
+        REQUIRE(journal.append(0, bytes_of("after")) == 10u);
+    }
+    raoe::journal journal(temp.root);
+    const replayed got(journal);
+    REQUIRE(got.records.size() == 10);
+    REQUIRE(got.texts[8] == "record 8");
+    REQUIRE(got.texts[9] == "after");
+}
+
+TEST_CASE("Journal - Appends from lots of threads share syncs", "[journal]")
+{
+    const temp_journal temp;
+    constexpr uint32 threads = 8;
+    constexpr int per_thread = 200;
+    {
+        raoe::journal journal(temp.root, raoe::journal::options {.segment_size = 4096});
+        // Catch's REQUIRE isn't safe to use off the main thread
+        std::atomic<bool> in_order = true;
+        std::vector<std::jthread> appenders;
+        for(uint32 t = 0; t < threads; t++)
+        {
+            appenders.emplace_back([&journal, &in_order, t] {
+                uint64 previous = 0;
+                for(int i = 0; i < per_thread; i++)
+                {
+                    const auto sequence = journal.append(t, bytes_of(std::to_string(i)));
+                    if(!sequence || *sequence <= previous)
+                    {
+                        in_order = false;
+                        return;
+                    }
+                    previous = *sequence;
+                }
+            });
+        }
+        appenders.clear();
+        REQUIRE(in_order);
+        const auto stats = journal.stats();
+        REQUIRE(stats.records == threads * per_thread);
+        REQUIRE(stats.syncs < stats.records);
+        REQUIRE(temp.segments().size() > 1);
+    }
+
+    // Every thread's records come back in the order it appended them, across all the segments
+    raoe::journal journal(temp.root);
+    const replayed got(journal);
+    REQUIRE(got.records.size() == threads * per_thread);
+    std::vector<int> next(threads, 0);
+    for(std::size_t i = 0; i < got.records.size(); i++)
+    {
+        REQUIRE(got.records[i].sequence == i + 1);
+        REQUIRE(got.texts[i] == std::to_string(next[got.records[i].type]++));
+    }
+}
+
+TEST_CASE("Journal - Compaction", "[journal]")
+{
+    const temp_journal temp;
+    // The state is just every record joined together
+    std::string state;
+    uint64 through = 0;
+    std::mutex state_mutex;
+    auto options = [&] {
+        return raoe::journal::options {
+            .durability = raoe::journal::durability::buffered,
+            .segment_size = 1024,
+            .compact_after = 8 * 1024,
+            .take_snapshot =
+                [&] {
+                    std::scoped_lock lock(state_mutex);
+                    const auto bytes = bytes_of(state);
+                    return raoe::journal::snapshot {through, {bytes.begin(), bytes.end()}};
+                },
+        };
+    };
+
+    {
+        raoe::journal journal(temp.root, options());
+        for(int i = 0; i < 2000; i++)
+        {
+            std::scoped_lock lock(state_mutex);
+            const std::string text = std::to_string(i) + ",";
+            through = *journal.append(0, bytes_of(text));
+            state += text;
+        }
+        // The compactor thread gets to it by itself
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(journal.stats().snapshots == 0 && std::chrono::steady_clock::now() < give_up)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        REQUIRE(journal.stats().snapshots > 0);
+        REQUIRE(journal.flush());
+        REQUIRE(journal.compact());
+        // Only the segment being written to is left
+        REQUIRE(temp.segments().size() == 1);
+
+        std::scoped_lock lock(state_mutex);
+        for(int i = 2000; i < 2010; i++)
+        {
+            const std::string text = std::to_string(i) + ",";
+            journal.append(0, bytes_of(text));
+            state += text;
+        }
+    }
+
+    std::string expected;
+    expected.swap(state);
+    raoe::journal journal(temp.root, options());
+    REQUIRE(journal.last_sequence() == 2010);
+    const replayed got(journal);
+    std::string rebuilt = got.snapshot;
+    for(const std::string& text : got.texts)
+    {
+        rebuilt += text;
+    }
+    REQUIRE(got.records.size() == 10);
+    REQUIRE(rebuilt == expected);
+
+    // A snapshot that's been cut short isn't used, and the segments it would have covered are already gone
+    std::filesystem::resize_file(temp.root / "snapshot", 100);
+    REQUIRE(replayed(journal).snapshot.empty());
+}
+
+TEST_CASE("Journal - A snapshot ahead of the records", "[journal]")
+{
+    const temp_journal temp;
+    auto options = [] {
+        raoe::journal::options opts;
+        opts.durability = raoe::journal::durability::buffered;
+        opts.take_snapshot = [] { return raoe::journal::snapshot {10, {}}; };
+        return opts;
+    };
+    {
+        raoe::journal journal(temp.root, options());
+        for(int i = 0; i < 10; i++)
+        {
+            journal.append(0, bytes_of("record " + std::to_string(i)));
+        }
+        REQUIRE(journal.flush());
+        REQUIRE(journal.compact());
+    }
+    // As if the snapshot was saved but the process died before the last records made it to disk.  Leaves the 16 byte
+    // segment header and the first five records, each a 24 byte header and 8 bytes of text.
+    std::filesystem::resize_file(temp.segments().back(), 16 + 5 * (24 + 8));
+
+    {
+        raoe::journal journal(temp.root, options());
+        REQUIRE(journal.last_sequence() == 10);
+        REQUIRE(journal.append(0, bytes_of("after")) == 11u);
+    }
+    raoe::journal journal(temp.root, options());
+    REQUIRE(journal.last_sequence() == 11);
+    const replayed got(journal);
+    REQUIRE(got.texts == std::vector<std::string> {"after"});
+    REQUIRE(got.records[0].sequence == 11);
+    REQUIRE(journal.append(0, bytes_of("and on")) == 12u);
+}
+
+TEST_CASE("Journal - Periodic syncs", "[journal]")
+{
+    const temp_journal temp;
+    raoe::journal journal(temp.root, raoe::journal::options {.durability = raoe::journal::durability::periodic,
+                                                             .sync_interval = std::chrono::milliseconds(10)});
+    for(int i = 0; i < 100; i++)
+    {
+        REQUIRE(journal.append(0, bytes_of("tick")));
+    }
+    // Nobody flushes, the committer gets to it on its own
+    const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(journal.stats().syncs == 0 && std::chrono::steady_clock::now() < give_up)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    REQUIRE(journal.stats().syncs > 0);
+    REQUIRE(journal.flush());
+    REQUIRE(replayed(journal).records.size() == 100);
+}
@@ -0,0 +1,201 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/json.hpp"
+#include "core/uuid.hpp"
+#include "tag/tag.hpp"
+
+#include <format>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // A minimal DOM parser standing in for the usual parse-everything-then-convert approach.  Every string and number
+    // is copied into the tree before anyone looks at it.
+    struct dom_node
+    {
+        char kind = 'n';
+        std::string text;
+        std::vector<dom_node> items;
+        std::vector<std::pair<std::string, dom_node>> fields;
+
+        const dom_node* find(std::string_view key) const
+        {
+            for(const auto& [name, node] : fields)
+            {
+                if(name == key)
+                {
+                    return &node;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    struct dom_parser
+    {
+        std::string_view in;
+        std::size_t pos = 0;
+
+        void skip_ws()
+        {
+            while(pos < in.size() && (in[pos] == ' ' || in[pos] == '\n' || in[pos] == '\t' || in[pos] == '\r'))
+            {
+                pos++;
+            }
+        }
+
+        std::string parse_string()
+        {
+            std::string out;
+            pos++;
+            while(pos < in.size() && in[pos] != '"')
+            {
+                if(in[pos] == '\\')
+                {
+                    pos++;
+                }
+                out.push_back(in[pos++]);
+            }
+            pos++;
+            return out;
+        }
+
+        dom_node parse()
+        {
+            skip_ws();
+            dom_node node;
+            const char c = in[pos];
+            if(c == '{')
+            {
+                node.kind = 'o';
+                pos++;
+                skip_ws();
+                while(in[pos] != '}')
+                {
+                    skip_ws();
+                    std::string key = parse_string();
+                    skip_ws();
+                    pos++;
+                    node.fields.emplace_back(std::move(key), parse());
+                    skip_ws();
+                    if(in[pos] == ',')
+                    {
+                        pos++;
+                    }
+                }
+                pos++;
+            }
+            else if(c == '[')
+            {
+                node.kind = 'a';
+                pos++;
+                skip_ws();
+                while(in[pos] != ']')
+                {
+                    node.items.push_back(parse());
+                    skip_ws();
+                    if(in[pos] == ',')
+                    {
+                        pos++;
+                    }
+                }
+                pos++;
+            }
+            else if(c == '"')
+            {
+                node.kind = 's';
+                node.text = parse_string();
+            }
+            else
+            {
+                node.kind = 'v';
+                const std::size_t start = pos;
+                while(pos < in.size() && in[pos] != ',' && in[pos] != '}' && in[pos] != ']' && in[pos] != ' ')
+                {
+                    pos++;
+                }
+                node.text = std::string(in.substr(start, pos - start));
+            }
+            return node;
+        }
+    };
+}
+
+// A 16 MiB asset manifest.  Divide 0.016 GB by the reported mean to get GB/s.
+TEST_CASE("Reading an asset manifest (16 MiB)", "[JSON][benchmark]")
+{
+    std::string manifest = "{\"assets\": [\n";
+    for(int i = 0; manifest.size() < (16 << 20); i++)
+    {
+        manifest += std::format(R"(  {{"id": "c940b5f2-0467-4005-8558-{:012x}", "tag": "game:asset_{}", )"
+                                R"("cost": {}, "deps": ["game:asset_{}", "game:asset_{}"], "note": "line\nbreak"}},)"
+                                "\n",
+                                i, i, i % 1000, i / 2, i / 3);
+    }
+    manifest.pop_back();
+    manifest.pop_back();
+    manifest += "\n]}";
+
+    raoe::test::counted_benchmark("DOM, then convert", manifest.size(), [&] {
+        dom_parser parser {manifest};
+        const dom_node root = parser.parse();
+        std::size_t valid = 0;
+        for(const dom_node& asset : root.find("assets")->items)
+        {
+            raoe::uuid id;
+            int cost = 0;
+            valid += raoe::from_string(asset.find("id")->text, id) ? 1 : 0;
+            valid += raoe::from_string(asset.find("cost")->text, cost) ? 1 : 0;
+            valid += raoe::tag(asset.find("tag")->text) ? 1 : 0;
+            for(const dom_node& dep : asset.find("deps")->items)
+            {
+                valid += raoe::tag(dep.text) ? 1 : 0;
+            }
+        }
+        return valid;
+    });
+
+    raoe::test::counted_benchmark("json::document, typed get", manifest.size(), [&] {
+        raoe::json::document doc {std::string_view(manifest)};
+        std::size_t valid = 0;
+        for(raoe::json::value asset : doc["assets"].elements())
+        {
+            raoe::uuid id;
+            int cost = 0;
+            raoe::tag tag;
+            valid += asset["id"].get(id) ? 1 : 0;
+            valid += asset["cost"].get(cost) ? 1 : 0;
+            valid += asset["tag"].get(tag) ? 1 : 0;
+            for(raoe::json::value dep : asset["deps"].elements())
+            {
+                valid += dep.get(tag) ? 1 : 0;
+            }
+        }
+        return valid;
+    });
+
+    raoe::test::counted_benchmark("json::document, index only", manifest.size(), [&] {
+        raoe::json::document doc {std::string_view(manifest)};
+        return doc.valid();
+    });
+}
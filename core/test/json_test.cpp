@@ -0,0 +1,157 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/fixed.hpp"
+#include "core/json.hpp"
+#include "core/stream.hpp"
+#include "core/uuid.hpp"
+#include "tag/tag.hpp"
+
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Objects, arrays and scalars", "[JSON]")
+{
+    raoe::json::document doc(R"({
+        "name": "sword \"of\" doom",
+        "count": 3,
+        "scale": -1.5e2,
+        "enabled": true,
+        "parent": null,
+        "empty": {},
+        "tags": ["game:sword", "game:weapon" , "metal"],
+        "nested": {"inner": [1, [2, 3], {"x": 4}], "after": 5}
+    })"sv);
+
+    REQUIRE(doc.valid());
+    auto root = doc.root();
+    REQUIRE(root.is_object());
+    REQUIRE(root.size() == 8);
+
+    REQUIRE(root["name"].raw_string() == R"(sword \"of\" doom)"sv);
+    std::string name;
+    REQUIRE(root["name"].get(name));
+    REQUIRE(name == "sword \"of\" doom");
+
+    REQUIRE(root["count"].value_or(0) == 3);
+    REQUIRE(root["scale"].value_or(0.0) == -150.0);
+    REQUIRE(root["enabled"].value_or(false));
+    REQUIRE(root["parent"].is_null());
+    REQUIRE(root["empty"].is_object());
+    REQUIRE(root["empty"].size() == 0);
+    REQUIRE_FALSE(root["missing"]);
+    REQUIRE_FALSE(root["missing"]["deeper"].as<int>().has_value());
+    REQUIRE_FALSE(root["name"].as<int>().has_value());
+
+    std::vector<raoe::tag> tags;
+    for(raoe::json::value element : root["tags"].elements())
+    {
+        tags.push_back(element.value_or(raoe::tag()));
+    }
+    REQUIRE(tags.size() == 3);
+    REQUIRE(tags[1] == raoe::tag("game:weapon"));
+    REQUIRE(tags[2] == raoe::tag("raoe:metal"));
+
+    auto nested = root["nested"];
+    REQUIRE(nested["inner"].size() == 3);
+    REQUIRE(nested["inner"][1][1].value_or(0) == 3);
+    REQUIRE(nested["inner"][2]["x"].value_or(0) == 4);
+    REQUIRE(nested["after"].value_or(0) == 5);
+    REQUIRE(nested["inner"].raw() == R"([1, [2, 3], {"x": 4}])"sv);
+
+    std::vector<std::string_view> keys;
+    for(auto [key, value] : nested.fields())
+    {
+        keys.push_back(key);
+    }
+    REQUIRE(keys == std::vector<std::string_view> {"inner", "after"});
+}
+
+TEST_CASE("Typed extraction", "[JSON]")
+{
+    using fixed_t = raoe::fixed<int32, 16>;
+    const std::string manifest =
+        R"({"id": "c940b5f2-0467-4005-8558-468f238b85db", "price": 12.25, "stack": 64, "kind": "game:potion"})";
+    raoe::stream::span_istream stream(manifest);
+    raoe::json::document doc(stream);
+    REQUIRE(doc.valid());
+
+    raoe::uuid id;
+    REQUIRE(doc["id"].get(id));
+    REQUIRE(std::format("{}", id) == "c940b5f2-0467-4005-8558-468f238b85db");
+    REQUIRE(doc["price"].value_or(fixed_t()) == fixed_t(12.25));
+    REQUIRE(doc["stack"].value_or<uint16>(0) == 64);
+    REQUIRE(doc["kind"].value_or(raoe::tag()) == raoe::tag("game:potion"));
+}
+
+TEST_CASE("Escapes", "[JSON]")
+{
+    // Backslash runs across a block boundary, and a string that ends in an escaped backslash
+    std::string json = "[\"" + std::string(61, 'a') + "\\\\\", \"\\u00e9\\ud83d\\ude00\\n\", \"x\\\\\\\"y\"]";
+    raoe::json::document doc {std::string_view(json)};
+    REQUIRE(doc.valid());
+    REQUIRE(doc.root().size() == 3);
+
+    std::string text;
+    REQUIRE(doc.root()[0].get(text));
+    REQUIRE(text == std::string(61, 'a') + "\\");
+    REQUIRE(doc.root()[1].get(text));
+    REQUIRE(text == "\xc3\xa9\xf0\x9f\x98\x80\n");
+    REQUIRE(doc.root()[2].get(text));
+    REQUIRE(text == "x\\\"y");
+}
+
+TEST_CASE("Invalid documents", "[JSON]")
+{
+    REQUIRE_FALSE(raoe::json::document("{\"a\": [1, 2}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\": \"unterminated}"sv).valid());
+    // Balanced, but not put together right
+    REQUIRE_FALSE(raoe::json::document("{\"a\":}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\" 1}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{1: 2}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\": 1,}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\": 1 \"b\": 2}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\": 1, \"b\"}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("[1 2]"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("[1, ]"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("[:]"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("1 2"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{} []"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("{\"a\":}"sv).root());
+    REQUIRE(raoe::json::document("{\"a\": {}, \"b\": [], \"c\": [{}, [1, {\"d\": null}]]}"sv).valid());
+    REQUIRE_FALSE(raoe::json::document("   "sv).valid());
+    REQUIRE_FALSE(raoe::json::document("   "sv).root());
+    REQUIRE(raoe::json::document(" 42 "sv).root().value_or(0) == 42);
+
+    // Fine as far as the brackets go, but not real literals
+    raoe::json::document literals("[tru, txyz, fals, nope, true, false, null]"sv);
+    REQUIRE(literals.valid());
+    bool flag = false;
+    REQUIRE_FALSE(literals.root()[0].get(flag));
+    REQUIRE_FALSE(literals.root()[1].get(flag));
+    REQUIRE_FALSE(literals.root()[2].get(flag));
+    REQUIRE_FALSE(literals.root()[3].is_null());
+    REQUIRE(literals.root()[4].get(flag));
+    REQUIRE(flag);
+    REQUIRE(literals.root()[5].get(flag));
+    REQUIRE_FALSE(flag);
+    REQUIRE(literals.root()[6].is_null());
+}
@@ -0,0 +1,79 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/line_reader.hpp"
+#include "core/stream.hpp"
+
+#include <string>
+
+// 64 MiB of log-like lines.  Divide 0.0625 GB by the reported mean to get GB/s.
+TEST_CASE("Reading lines (64 MiB)", "[LINE_READER][benchmark]")
+{
+    std::string payload;
+    payload.reserve(64 << 20);
+    for(int i = 0; payload.size() < (64 << 20); i++)
+    {
+        payload += "[2024-01-01 00:00:00.000] [info] frame ";
+        payload += std::to_string(i);
+        payload += " took 16.6ms with some extra text to pad it out\n";
+    }
+
+    raoe::test::counted_benchmark("std::getline", payload.size(), [&] {
+        raoe::stream::span_istream stream(payload);
+        std::string line;
+        std::size_t bytes = 0;
+        while(std::getline(stream, line))
+        {
+            bytes += line.size();
+        }
+        return bytes;
+    });
+
+    raoe::test::counted_benchmark("line_reader over a stream", payload.size(), [&] {
+        raoe::stream::span_istream stream(payload);
+        raoe::stream::line_reader reader(stream);
+        std::size_t bytes = 0;
+        for(std::string_view line : reader)
+        {
+            bytes += line.size();
+        }
+        return bytes;
+    });
+
+    raoe::test::counted_benchmark("line_reader over memory", payload.size(), [&] {
+        raoe::stream::line_reader reader {std::string_view(payload)};
+        std::size_t bytes = 0;
+        for(std::string_view line : reader)
+        {
+            bytes += line.size();
+        }
+        return bytes;
+    });
+
+    raoe::test::counted_benchmark("line_reader + tokens", payload.size(), [&] {
+        raoe::stream::line_reader reader {std::string_view(payload)};
+        std::size_t tokens = 0;
+        for(std::string_view line : reader)
+        {
+            tokens += reader.tokens(line).size();
+        }
+        return tokens;
+    });
+}
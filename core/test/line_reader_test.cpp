@@ -0,0 +1,89 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/line_reader.hpp"
+#include "core/stream.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("Lines from a buffer", "[LINE_READER]")
+{
+    raoe::stream::line_reader reader("first\r\nsecond\n\nlast without newline"sv);
+    std::vector<std::string_view> lines;
+    for(std::string_view line : reader)
+    {
+        lines.push_back(line);
+    }
+
+    REQUIRE(lines.size() == 4);
+    REQUIRE(lines[0] == "first"sv);
+    REQUIRE(lines[1] == "second"sv);
+    REQUIRE(lines[2].empty());
+    REQUIRE(lines[3] == "last without newline"sv);
+    REQUIRE(reader.line_number() == 4);
+}
+
+TEST_CASE("Lines straddling blocks", "[LINE_READER]")
+{
+    std::string input;
+    std::vector<std::string> expected;
+    for(int i = 0; i < 500; i++)
+    {
+        // Line lengths vary from 0 up to well past the block size
+        expected.push_back(std::string(static_cast<std::size_t>((i * 37) % 300), static_cast<char>('a' + i % 26)));
+        input += expected.back();
+        input += '\n';
+    }
+
+    raoe::stream::span_istream stream(input);
+    raoe::stream::line_reader reader(stream, '\n', 64);
+    std::size_t index = 0;
+    std::string_view line;
+    while(reader.next(line))
+    {
+        REQUIRE(index < expected.size());
+        REQUIRE(line == expected[index]);
+        index++;
+    }
+    REQUIRE(index == expected.size());
+}
+
+TEST_CASE("Custom delimiter and tokens", "[LINE_READER]")
+{
+    const std::string input = "give player \"iron sword\" 1;teleport 10 20;";
+    raoe::stream::span_istream stream(input);
+    raoe::stream::line_reader reader(stream, ';');
+
+    std::string_view line;
+    REQUIRE(reader.next(line));
+    auto tokens = reader.tokens(line);
+    REQUIRE(tokens.size() == 4);
+    REQUIRE(tokens[0] == "give"sv);
+    REQUIRE(tokens[2] == "iron sword"sv);
+    REQUIRE(tokens[3] == "1"sv);
+
+    REQUIRE(reader.next(line));
+    auto fields = reader.fields(line, ' ');
+    REQUIRE(fields.size() == 3);
+    REQUIRE(fields[1] == "10"sv);
+
+    REQUIRE_FALSE(reader.next(line));
+}
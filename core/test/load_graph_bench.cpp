@@ -0,0 +1,135 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/load_graph.hpp"
+
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // A level: 12k textures, 6k materials using three textures each (shared), and 2k prefabs using two materials and
+    // a texture
+    constexpr int texture_count = 12000;
+    constexpr int material_count = 6000;
+    constexpr int prefab_count = 2000;
+    constexpr std::size_t file_size = 16 * 1024;
+
+    // A read is mostly waiting on the disk, a decode is all CPU
+    std::optional<std::vector<std::byte>> read_asset(std::string_view)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        return std::vector<std::byte>(file_size);
+    }
+
+    bool decode_asset(std::string_view, std::vector<std::byte> data)
+    {
+        const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(10);
+        uint64 sum = 0;
+        while(std::chrono::steady_clock::now() < until)
+        {
+            for(std::byte b : data)
+            {
+                sum += static_cast<uint64>(b);
+            }
+        }
+        return sum == 0;
+    }
+
+    struct level
+    {
+        std::vector<std::string> keys;
+        std::vector<std::vector<std::string_view>> dependencies;
+
+        level()
+        {
+            keys.reserve(texture_count + material_count + prefab_count);
+            dependencies.resize(texture_count + material_count + prefab_count);
+            for(int i = 0; i < texture_count; i++)
+            {
+                keys.push_back(std::format("game#texture:texture_{}", i));
+            }
+            for(int i = 0; i < material_count; i++)
+            {
+                keys.push_back(std::format("game#material:material_{}", i));
+                for(int t = 0; t < 3; t++)
+                {
+                    dependencies[keys.size() - 1].push_back(keys[(i * 7 + t * 3001) % texture_count]);
+                }
+            }
+            for(int i = 0; i < prefab_count; i++)
+            {
+                keys.push_back(std::format("game#prefab:prefab_{}", i));
+                auto& deps = dependencies[keys.size() - 1];
+                deps.push_back(keys[texture_count + (i * 3) % material_count]);
+                deps.push_back(keys[texture_count + (i * 3 + 1) % material_count]);
+                deps.push_back(keys[(i * 11) % texture_count]);
+            }
+        }
+
+        // What we did before: everything in a fixed order (dependencies first), one at a time
+        void load_serially() const
+        {
+            for(const std::string& key : keys)
+            {
+                decode_asset(key, *read_asset(key));
+            }
+        }
+
+        [[nodiscard]] raoe::load_graph::report load_graph() const
+        {
+            raoe::load_graph graph(raoe::load_graph::options {.io_threads = 8});
+            // Added prefabs first, so the graph is what puts dependencies first
+            for(std::size_t i = keys.size(); i-- > 0;)
+            {
+                graph.add(keys[i], dependencies[i], read_asset, decode_asset);
+            }
+            return graph.run();
+        }
+    };
+}
+
+TEST_CASE("Load a 20k asset level", "[load_graph][benchmark]")
+{
+    const level assets;
+
+    raoe::test::counted_benchmark("fixed order, one at a time", assets.keys.size(), [&] {
+        assets.load_serially();
+        return assets.keys.size();
+    });
+    raoe::test::counted_benchmark("load_graph, 8 I/O threads", assets.keys.size(), [&] {
+        return assets.load_graph().loaded;
+    });
+
+    const auto report = assets.load_graph();
+    REQUIRE(report.loaded == assets.keys.size());
+    std::cout << std::format("  load_graph: wall {}ms, critical path {}us over {} assets, read {}ms, decode {}ms, peak "
+                             "{}KB in flight\n",
+                             std::chrono::duration_cast<std::chrono::milliseconds>(report.wall).count(),
+                             std::chrono::duration_cast<std::chrono::microseconds>(report.critical_path_time).count(),
+                             report.critical_path.size(),
+                             std::chrono::duration_cast<std::chrono::milliseconds>(report.read_time).count(),
+                             std::chrono::duration_cast<std::chrono::milliseconds>(report.decode_time).count(),
+                             report.peak_bytes_in_flight / 1024);
+}
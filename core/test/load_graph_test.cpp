@@ -0,0 +1,187 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/load_graph.hpp"
+
+#include <atomic>
+#include <format>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Keeps track of what got read and decoded, and in what order
+    struct loader
+    {
+        std::mutex mutex;
+        std::vector<std::string> decoded;
+        std::atomic<int> reads = 0;
+        // Catch's REQUIRE isn't safe off the test's thread
+        std::atomic<int> wrong_sizes = 0;
+        std::set<std::string> fail_read;
+        std::set<std::string> fail_decode;
+        std::size_t bytes = 16;
+
+        raoe::load_graph::read_function read()
+        {
+            return [this](std::string_view key) -> std::optional<std::vector<std::byte>> {
+                reads++;
+                if(fail_read.contains(std::string(key)))
+                {
+                    return std::nullopt;
+                }
+                return std::vector<std::byte>(bytes);
+            };
+        }
+
+        raoe::load_graph::decode_function decode()
+        {
+            return [this](std::string_view key, std::vector<std::byte> data) {
+                std::scoped_lock lock(mutex);
+                wrong_sizes += data.size() != bytes;
+                decoded.emplace_back(key);
+                return !fail_decode.contains(std::string(key));
+            };
+        }
+
+        [[nodiscard]] std::size_t position(std::string_view key)
+        {
+            std::scoped_lock lock(mutex);
+            return std::ranges::find(decoded, key) - decoded.begin();
+        }
+    };
+}
+
+TEST_CASE("Load Graph - Dependencies load first, once", "[load_graph]")
+{
+    loader assets;
+    raoe::load_graph graph;
+    graph.add("game:lawn", {"game:grass", "game:dirt"}, assets.read(), assets.decode());
+    graph.add("game:garden", {"game:lawn", "game:grass"}, assets.read(), assets.decode());
+    graph.add("game:grass", {}, assets.read(), assets.decode());
+    graph.add("game:dirt", {}, assets.read(), assets.decode());
+    // Already there, so this one's ignored
+    graph.add("game:grass", {"game:nothing"}, assets.read(), assets.decode());
+    REQUIRE(graph.size() == 4);
+
+    const auto report = graph.run();
+    REQUIRE(report.loaded == 4);
+    REQUIRE(report.failed == 0);
+    REQUIRE(assets.reads == 4);
+    REQUIRE(assets.decoded.size() == 4);
+    REQUIRE(assets.wrong_sizes == 0);
+    REQUIRE(assets.position("game:grass") < assets.position("game:lawn"));
+    REQUIRE(assets.position("game:dirt") < assets.position("game:lawn"));
+    REQUIRE(assets.position("game:lawn") < assets.position("game:garden"));
+    REQUIRE(graph.state_of(*graph.find("game:garden")) == raoe::load_graph::state::loaded);
+
+    // The longest chain ends at the garden
+    REQUIRE(report.critical_path.size() == 3);
+    REQUIRE(report.critical_path.back() == "game:garden");
+    REQUIRE(report.critical_path[1] == "game:lawn");
+    REQUIRE(report.critical_path_time <= report.read_time + report.decode_time);
+    REQUIRE(report.peak_bytes_in_flight >= assets.bytes);
+}
+
+TEST_CASE("Load Graph - Failures cancel what depends on them", "[load_graph]")
+{
+    loader assets;
+    assets.fail_read = {"bad_read"};
+    assets.fail_decode = {"bad_decode"};
+    raoe::load_graph graph;
+    graph.add("bad_read", {}, assets.read(), assets.decode());
+    graph.add("bad_decode", {}, assets.read(), assets.decode());
+    graph.add("fine", {}, assets.read(), assets.decode());
+    graph.add("needs_bad_read", {"bad_read", "fine"}, assets.read(), assets.decode());
+    graph.add("needs_bad_decode", {"bad_decode"}, assets.read(), assets.decode());
+    graph.add("further_down", {"needs_bad_decode"}, assets.read(), assets.decode());
+    graph.add("needs_missing", {"never_added"}, assets.read(), assets.decode());
+    // A cycle can't load either
+    graph.add("cycle_a", {"cycle_b"}, assets.read(), assets.decode());
+    graph.add("cycle_b", {"cycle_a"}, assets.read(), assets.decode());
+    graph.add("needs_cycle", {"cycle_a"}, assets.read(), assets.decode());
+
+    const auto report = graph.run();
+    using state = raoe::load_graph::state;
+    REQUIRE(graph.state_of(*graph.find("fine")) == state::loaded);
+    REQUIRE(graph.state_of(*graph.find("bad_read")) == state::failed);
+    REQUIRE(graph.state_of(*graph.find("bad_decode")) == state::failed);
+    REQUIRE(graph.state_of(*graph.find("never_added")) == state::failed);
+    REQUIRE(graph.state_of(*graph.find("needs_bad_read")) == state::cancelled);
+    REQUIRE(graph.state_of(*graph.find("needs_bad_decode")) == state::cancelled);
+    REQUIRE(graph.state_of(*graph.find("further_down")) == state::cancelled);
+    REQUIRE(graph.state_of(*graph.find("needs_missing")) == state::cancelled);
+    REQUIRE(graph.state_of(*graph.find("needs_cycle")) == state::cancelled);
+    REQUIRE(report.loaded == 1);
+    REQUIRE(report.loaded + report.failed + report.cancelled == graph.size());
+    REQUIRE(assets.position("needs_bad_decode") == assets.decoded.size());
+}
+
+TEST_CASE("Load Graph - Cancel", "[load_graph]")
+{
+    loader assets;
+    raoe::load_graph graph(raoe::load_graph::options {.io_threads = 2, .decode_threads = 2});
+    std::atomic<int> decodes = 0;
+    for(int i = 0; i < 1000; i++)
+    {
+        // One long chain
+        const std::string previous = std::format("asset_{}", i - 1);
+        std::vector<std::string_view> deps;
+        if(i > 0)
+        {
+            deps.push_back(previous);
+        }
+        graph.add(std::format("asset_{}", i), deps, assets.read(), [&](std::string_view, std::vector<std::byte>) {
+            if(++decodes == 10)
+            {
+                graph.cancel();
+            }
+            return true;
+        });
+    }
+
+    const auto report = graph.run();
+    REQUIRE(report.loaded == 10);
+    REQUIRE(report.cancelled == 990);
+}
+
+TEST_CASE("Load Graph - Bytes in flight stay under the cap", "[load_graph]")
+{
+    loader assets;
+    assets.bytes = 1000;
+    raoe::load_graph graph(
+        raoe::load_graph::options {.io_threads = 4, .decode_threads = 1, .max_bytes_in_flight = 5000});
+    std::vector<std::string> keys;
+    for(int i = 0; i < 200; i++)
+    {
+        keys.push_back(std::format("texture_{}", i));
+        graph.add(keys.back(), {}, assets.read(), assets.decode());
+    }
+    for(int i = 0; i < 50; i++)
+    {
+        const std::vector<std::string_view> deps {keys[i], keys[i + 50], keys[i + 100], keys[i + 150]};
+        graph.add(std::format("material_{}", i), deps, assets.read(), assets.decode());
+    }
+
+    const auto report = graph.run();
+    REQUIRE(report.loaded == 250);
+    // Each of the four readers can overshoot by one file
+    REQUIRE(report.peak_bytes_in_flight <= 5000 + 3 * assets.bytes);
+}
@@ -0,0 +1,155 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/lru_cache.hpp"
+#include "core/random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // The hand rolled kind: two allocations per entry
+    class list_lru
+    {
+      public:
+        explicit list_lru(std::size_t capacity)
+            : m_capacity(capacity)
+        {
+        }
+
+        template <typename TFactory>
+        uint64* find_or_insert_with(uint64 key, TFactory&& factory)
+        {
+            if(auto it = m_index.find(key); it != m_index.end())
+            {
+                m_hits++;
+                m_order.splice(m_order.begin(), m_order, it->second);
+                return &it->second->second;
+            }
+            m_misses++;
+            if(m_index.size() >= m_capacity)
+            {
+                m_index.erase(m_order.back().first);
+                m_order.pop_back();
+            }
+            m_order.emplace_front(key, factory());
+            m_index.emplace(key, m_order.begin());
+            return &m_order.front().second;
+        }
+
+        [[nodiscard]] double hit_rate() const
+        {
+            return static_cast<double>(m_hits) / static_cast<double>(m_hits + m_misses);
+        }
+
+      private:
+        std::size_t m_capacity;
+        std::list<std::pair<uint64, uint64>> m_order;
+        std::unordered_map<uint64, std::list<std::pair<uint64, uint64>>::iterator> m_index;
+        uint64 m_hits = 0;
+        uint64 m_misses = 0;
+    };
+
+    constexpr std::size_t key_space = 100000;
+    constexpr std::size_t cache_size = 5000;
+    constexpr std::size_t trace_length = 1000000;
+
+    // Zipf(s) over key_space keys, by inverting the CDF.  Keys are scrambled so popularity isn't the key order.
+    std::vector<uint64> zipf_trace(double s, uint64 seed, double scan_fraction = 0)
+    {
+        std::vector<double> cdf(key_space);
+        double sum = 0;
+        for(std::size_t i = 0; i < key_space; i++)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            cdf[i] = sum;
+        }
+        raoe::random::xoshiro256pp rng(seed);
+        std::vector<uint64> trace;
+        trace.reserve(trace_length);
+        uint64 scan_key = key_space * 16;
+        for(std::size_t i = 0; i < trace_length; i++)
+        {
+            if(scan_fraction > 0 && raoe::random::uniform_real<double>(rng) < scan_fraction)
+            {
+                // Seen once, never again
+                trace.push_back(scan_key++);
+                continue;
+            }
+            const double u = raoe::random::uniform_real<double>(rng) * sum;
+            const auto rank = static_cast<uint64>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+            trace.push_back(raoe::distribute(rank + 1));
+        }
+        return trace;
+    }
+
+    template <typename TCache>
+    uint64 replay(TCache& cache, const std::vector<uint64>& trace)
+    {
+        uint64 sum = 0;
+        for(uint64 key : trace)
+        {
+            sum += *cache.find_or_insert_with(key, [key] { return key; });
+        }
+        return sum;
+    }
+
+    void run_trace(const std::string& name, const std::vector<uint64>& trace)
+    {
+        raoe::test::counted_benchmark(std::format("{}: std::list + unordered_map", name), trace.size(), [&] {
+            list_lru cache(cache_size);
+            return replay(cache, trace);
+        });
+        raoe::test::counted_benchmark(std::format("{}: lru_cache, lru", name), trace.size(), [&] {
+            raoe::lru_cache<uint64, uint64> cache(cache_size);
+            return replay(cache, trace);
+        });
+        raoe::test::counted_benchmark(std::format("{}: lru_cache, s3fifo", name), trace.size(), [&] {
+            raoe::lru_cache<uint64, uint64, raoe::cache_policy::s3fifo> cache(cache_size);
+            return replay(cache, trace);
+        });
+
+        // Hit rates, from one more run each
+        list_lru list(cache_size);
+        raoe::lru_cache<uint64, uint64> lru(cache_size);
+        raoe::lru_cache<uint64, uint64, raoe::cache_policy::s3fifo> s3fifo(cache_size);
+        replay(list, trace);
+        replay(lru, trace);
+        replay(s3fifo, trace);
+        std::cout << std::format("  {:<40} hit rate: list {:.1f}%, lru {:.1f}%, s3fifo {:.1f}%\n", name,
+                                 list.hit_rate() * 100, lru.stats().hit_rate() * 100,
+                                 s3fifo.stats().hit_rate() * 100);
+    }
+}
+
+// 1M lookups over 100k keys into a 5k entry cache.  Divide the mean by 1M for the cost of one lookup.
+TEST_CASE("Cache on Zipfian traces", "[lru_cache][benchmark]")
+{
+    run_trace("zipf 0.8", zipf_trace(0.8, 1));
+    run_trace("zipf 1.0", zipf_trace(1.0, 2));
+    run_trace("zipf 1.0 + 30% one-off scan", zipf_trace(1.0, 3, 0.3));
+}
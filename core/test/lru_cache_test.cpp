@@ -0,0 +1,224 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/lru_cache.hpp"
+#include "core/random.hpp"
+#include "tag/tag.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std::literals::string_view_literals;
+
+TEST_CASE("LRU Cache - Evicts least recently used", "[lru_cache]")
+{
+    raoe::lru_cache<int, std::string> cache(3);
+    cache.insert_or_assign(1, "one");
+    cache.insert_or_assign(2, "two");
+    cache.insert_or_assign(3, "three");
+    REQUIRE(cache.size() == 3);
+
+    // Using 1 makes 2 the oldest
+    REQUIRE(*cache.find(1) == "one");
+    cache.insert_or_assign(4, "four");
+    REQUIRE(cache.size() == 3);
+    REQUIRE_FALSE(cache.contains(2));
+    REQUIRE(cache.contains(1));
+    REQUIRE(cache.contains(3));
+    REQUIRE(cache.contains(4));
+
+    // peek doesn't count as a use, so 3 is still the oldest
+    REQUIRE(*cache.peek(3) == "three");
+    cache.insert_or_assign(5, "five");
+    REQUIRE_FALSE(cache.contains(3));
+
+    // Replacing a value keeps one entry
+    REQUIRE(*cache.insert_or_assign(5, "FIVE") == "FIVE");
+    REQUIRE(cache.size() == 3);
+
+    REQUIRE(cache.erase(5));
+    REQUIRE_FALSE(cache.erase(5));
+    REQUIRE(cache.find(5) == nullptr);
+
+    const raoe::cache_stats& stats = cache.stats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.insertions == 5);
+    REQUIRE(stats.evictions == 2);
+}
+
+TEST_CASE("LRU Cache - Byte budget", "[lru_cache]")
+{
+    auto bytes = [](const std::string&, const std::string& value) { return value.size(); };
+    raoe::lru_cache<std::string, std::string, raoe::cache_policy::lru, decltype(bytes)> cache(100, bytes);
+
+    cache.insert_or_assign("a", std::string(40, 'a'));
+    cache.insert_or_assign("b", std::string(40, 'b'));
+    REQUIRE(cache.cost() == 80);
+
+    // 30 more doesn't fit, so the oldest goes
+    cache.insert_or_assign("c", std::string(30, 'c'));
+    REQUIRE(cache.cost() == 70);
+    REQUIRE_FALSE(cache.contains("a"sv));
+
+    // Too big for the whole budget: not cached, and nothing else is evicted for it
+    REQUIRE(cache.insert_or_assign("huge", std::string(101, 'h')) == nullptr);
+    REQUIRE(cache.size() == 2);
+
+    // Growing a value can evict others, but never itself
+    REQUIRE(cache.insert_or_assign("c", std::string(90, 'C')) != nullptr);
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.cost() == 90);
+
+    cache.set_budget(50);
+    REQUIRE(cache.empty());
+    REQUIRE(cache.cost() == 0);
+}
+
+TEST_CASE("LRU Cache - Heterogeneous keys and find_or_insert_with", "[lru_cache]")
+{
+    raoe::lru_cache<raoe::tag, int> cache(8);
+    int loads = 0;
+    auto load = [&] { return ++loads; };
+
+    REQUIRE(*cache.find_or_insert_with(raoe::tag("raoe:stone"), load) == 1);
+    REQUIRE(*cache.find_or_insert_with(raoe::tag("raoe:stone"), load) == 1);
+    REQUIRE(loads == 1);
+    REQUIRE(cache.find("raoe:stone"sv) != nullptr);
+    REQUIRE(cache.stats().hits == 2);
+    REQUIRE(cache.stats().misses == 1);
+}
+
+TEST_CASE("LRU Cache - Matches a reference model", "[lru_cache]")
+{
+    // The slab and index get plenty of reuse and backward shifts, checked against a map of what should be there
+    raoe::lru_cache<uint32, uint32> cache(64);
+    std::unordered_map<uint32, uint32> model;
+    std::vector<uint32> order; // most recent last
+    raoe::random::xoshiro256pp rng(7);
+
+    auto touch = [&](uint32 key) {
+        std::erase(order, key);
+        order.push_back(key);
+    };
+    for(int i = 0; i < 20000; i++)
+    {
+        const auto key = static_cast<uint32>(raoe::random::bounded(rng, 200));
+        const auto op = raoe::random::bounded(rng, 10);
+        if(op < 5)
+        {
+            uint32* found = cache.find(key);
+            REQUIRE((found != nullptr) == model.contains(key));
+            if(found != nullptr)
+            {
+                REQUIRE(*found == model[key]);
+                touch(key);
+            }
+        }
+        else if(op < 9)
+        {
+            cache.insert_or_assign(key, static_cast<uint32>(i));
+            model[key] = static_cast<uint32>(i);
+            touch(key);
+            if(model.size() > 64)
+            {
+                model.erase(order.front());
+                order.erase(order.begin());
+            }
+        }
+        else
+        {
+            REQUIRE(cache.erase(key) == (model.erase(key) == 1));
+            std::erase(order, key);
+        }
+        REQUIRE(cache.size() == model.size());
+    }
+}
+
+TEST_CASE("LRU Cache - S3-FIFO resists scans", "[lru_cache]")
+{
+    constexpr uint32 hot = 50;
+    raoe::lru_cache<uint32, uint32, raoe::cache_policy::lru> lru(100);
+    raoe::lru_cache<uint32, uint32, raoe::cache_policy::s3fifo> s3fifo(100);
+
+    auto run = [&](auto& cache) {
+        // Warm up the hot set, then interleave it with a long scan of keys that are only seen once
+        for(int round = 0; round < 5; round++)
+        {
+            for(uint32 key = 0; key < hot; key++)
+            {
+                cache.find_or_insert_with(key, [&] { return key; });
+            }
+        }
+        cache.reset_stats();
+        for(uint32 scan = 0; scan < 5000; scan++)
+        {
+            cache.find_or_insert_with(1000 + scan, [&] { return scan; });
+            if(scan % 2 == 0)
+            {
+                const uint32 key = (scan / 2) % hot;
+                cache.find_or_insert_with(key, [&] { return key; });
+            }
+        }
+        return cache.stats().hit_rate();
+    };
+
+    const double lru_rate = run(lru);
+    const double s3fifo_rate = run(s3fifo);
+    REQUIRE(s3fifo.size() <= 100);
+    // The scan flushes the hot set out of LRU over and over; S3-FIFO keeps it in the main queue
+    REQUIRE(s3fifo_rate > lru_rate + 0.1);
+}
+
+TEST_CASE("LRU Cache - Concurrent", "[lru_cache]")
+{
+    raoe::concurrent_lru_cache<int, int, raoe::cache_policy::s3fifo> cache(256, 4);
+    REQUIRE(cache.shard_count() == 4);
+
+    std::atomic<int> loads = 0;
+    std::atomic<bool> wrong = false;
+    std::vector<std::jthread> threads;
+    for(int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t] {
+            raoe::random::xoshiro256pp rng(t);
+            for(int i = 0; i < 20000; i++)
+            {
+                const int key = static_cast<int>(raoe::random::bounded(rng, 400));
+                const int value = cache.find_or_insert_with(key, [&] {
+                    loads++;
+                    return key * 3;
+                });
+                if(value != key * 3)
+                {
+                    wrong = true;
+                }
+            }
+        });
+    }
+    threads.clear();
+
+    REQUIRE_FALSE(wrong.load());
+    REQUIRE(cache.size() <= 256);
+    const raoe::cache_stats stats = cache.stats();
+    REQUIRE(stats.hits + stats.misses == 4 * 20000);
+    REQUIRE(stats.misses == static_cast<uint64>(loads.load()));
+}
@@ -0,0 +1,78 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "core/perf_counters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+namespace raoe::test
+{
+    // Runs fn under raoe::debug::perf_counters and prints the IPC and misses per op.  ops is how many operations one
+    // call to fn does, e.g. the number of lines in the payload.  Threads fn starts are counted with it.
+    template <typename TFunc>
+    void print_counters(const std::string& name, std::size_t ops, TFunc&& fn)
+    {
+        auto call = [&] {
+            if constexpr(std::is_void_v<std::invoke_result_t<TFunc&>>)
+            {
+                fn();
+            }
+            else
+            {
+                Catch::Benchmark::deoptimize_value(fn());
+            }
+        };
+        // As many calls as fit in 20ms (and at least 3), so a tiny fn isn't all syscall overhead
+        std::size_t calls = 0;
+        const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+        for(; calls == 0 || std::chrono::steady_clock::now() < until; calls++)
+        {
+            call();
+        }
+        calls = std::max<std::size_t>(calls, 3);
+
+        // Made here rather than kept around, so it only follows the threads fn starts
+        raoe::debug::perf_counters counters(true);
+        {
+            auto scope = counters.measure();
+            for(std::size_t i = 0; i < calls; i++)
+            {
+                call();
+            }
+        }
+        std::cout << std::format("  {:<40} {}\n", name, counters.result().summary(ops * calls));
+    }
+
+    // A Catch benchmark that also reports hardware counters, printed under the benchmark's results.  Every benchmark
+    // in core-bench goes through here (or print_counters, when it needs BENCHMARK_ADVANCED).
+    template <typename TFunc>
+    void counted_benchmark(const std::string& name, std::size_t ops, TFunc&& fn)
+    {
+        BENCHMARK(std::string(name))
+        {
+            return fn();
+        };
+        print_counters(name, ops, fn);
+    }
+}
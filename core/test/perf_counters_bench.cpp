@@ -0,0 +1,91 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/stream.hpp"
+#include "core/string.hpp"
+#include "tag/tag.hpp"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr std::size_t item_count = 10000;
+
+    std::vector<std::string> make_names()
+    {
+        std::vector<std::string> names;
+        names.reserve(item_count);
+        for(std::size_t i = 0; i < item_count; i++)
+        {
+            names.push_back(std::format("raoe:textures/block/stone_{}", i));
+        }
+        return names;
+    }
+
+    std::string make_lines()
+    {
+        std::string lines;
+        for(std::size_t i = 0; i < item_count; i++)
+        {
+            lines += std::format("word{} word{} word{}\n", i, i * 3, i * 7);
+        }
+        return lines;
+    }
+}
+
+// The hot helpers everything else leans on, with counters, so it's obvious whether a change moved cycles, cache
+// misses or branch misses.  Each line under the timings is per item.
+TEST_CASE("Core helpers with hardware counters", "[PERF_COUNTERS][benchmark]")
+{
+    const auto names = make_names();
+    const std::string lines = make_lines();
+
+    raoe::test::counted_benchmark("tag construction", item_count, [&] {
+        std::size_t valid = 0;
+        for(const auto& name : names)
+        {
+            valid += raoe::tag(std::string_view(name)) ? 1 : 0;
+        }
+        return valid;
+    });
+
+    raoe::test::counted_benchmark("raoe::string::split, string_view out", item_count, [&] {
+        std::vector<std::string_view> parts;
+        raoe::string::split(std::string_view(lines), '\n', std::back_inserter(parts));
+        return parts.size();
+    });
+
+    raoe::test::counted_benchmark("raoe::string::split, string out", item_count, [&] {
+        return raoe::string::split(lines, '\n').size();
+    });
+
+    raoe::test::counted_benchmark("span_istream getline", item_count, [&] {
+        raoe::stream::span_istream stream(lines);
+        std::string line;
+        std::size_t count = 0;
+        while(std::getline(stream, line))
+        {
+            count++;
+        }
+        return count;
+    });
+}
@@ -0,0 +1,94 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/perf_counters.hpp"
+
+using raoe::debug::perf_counter;
+
+namespace
+{
+    [[gnu::noinline]] uint64 busy_loop(uint64 n)
+    {
+        volatile uint64 sum = 0;
+        for(uint64 i = 0; i < n; i++)
+        {
+            sum = sum + i;
+        }
+        return sum;
+    }
+}
+
+TEST_CASE("Perf Counters Measure Or Degrade", "[perf_counters]")
+{
+    raoe::debug::perf_counters counters;
+
+    {
+        auto scope = counters.measure();
+        busy_loop(1'000'000);
+    }
+    const auto& result = counters.result();
+
+    if(!counters.available())
+    {
+        // No PMU (a VM, perf_event_paranoid, not Linux): everything reads as missing, nothing blows up
+        for(std::size_t i = 0; i < raoe::debug::perf_counter_count; i++)
+        {
+            CHECK_FALSE(result.valid[i]);
+            CHECK(result.values[i] == 0);
+        }
+        CHECK(result.instructions_per_cycle() == 0);
+        CHECK(result.summary(100) == "no hardware counters available");
+        return;
+    }
+
+    if(counters.available(perf_counter::instructions))
+    {
+        // A million iterations is at least a few million instructions
+        CHECK(result.has(perf_counter::instructions));
+        CHECK(result[perf_counter::instructions] > 3'000'000);
+        CHECK(result.per_op(perf_counter::instructions, 1'000'000) > 3.0);
+    }
+    if(counters.available(perf_counter::cycles) && counters.available(perf_counter::instructions))
+    {
+        CHECK(result.instructions_per_cycle() > 0);
+        CHECK(result.summary(1).starts_with("IPC "));
+    }
+
+    // Counting only happens inside a scope
+    busy_loop(10'000'000);
+    CHECK(counters.result()[perf_counter::instructions] == result[perf_counter::instructions]);
+}
+
+TEST_CASE("Perf Result Summary", "[perf_counters]")
+{
+    raoe::debug::perf_result result;
+    result.values = {2000, 5000, 10, 1, 4};
+    result.valid = {true, true, true, false, true};
+
+    CHECK(result.instructions_per_cycle() == 2.5);
+    CHECK(result.per_op(perf_counter::branch_misses, 2) == 2.0);
+    CHECK(result.summary(10) == "IPC 2.50, 200 cycles/op, 500 instructions/op, 1 L1d misses/op, 0.4 branch misses/op");
+
+    raoe::debug::perf_result sum = result;
+    sum += result;
+    CHECK(sum[perf_counter::cycles] == 4000);
+    CHECK(sum.instructions_per_cycle() == 2.5);
+
+    result.running_fraction = 0.5;
+    CHECK(result.summary(10).ends_with("(multiplexed, 50% coverage)"));
+}
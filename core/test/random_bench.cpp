@@ -0,0 +1,112 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/random.hpp"
+
+#include <random>
+#include <vector>
+
+static constexpr std::size_t bench_count = 1 << 16;
+
+TEST_CASE("Raw 64 bit output", "[RANDOM][benchmark]")
+{
+    std::vector<uint64> values(bench_count);
+
+    raoe::test::counted_benchmark("std::mt19937_64", bench_count, [&] {
+        std::mt19937_64 engine(1);
+        for(uint64& v : values)
+        {
+            v = engine();
+        }
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("xoshiro256pp", bench_count, [&] {
+        raoe::random::xoshiro256pp engine(1);
+        engine.fill(values);
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("pcg64", bench_count, [&] {
+        raoe::random::pcg64 engine(1);
+        engine.fill(values);
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("xoshiro256pp_wide<4> fill", bench_count, [&] {
+        raoe::random::xoshiro256pp_wide<4> engine(1);
+        engine.fill(values);
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("xoshiro256pp_wide<8> fill", bench_count, [&] {
+        raoe::random::xoshiro256pp_wide<8> engine(1);
+        engine.fill(values);
+        return values.back();
+    });
+}
+
+TEST_CASE("Bounded integers", "[RANDOM][benchmark]")
+{
+    std::vector<int32> values(bench_count);
+
+    raoe::test::counted_benchmark("std::uniform_int_distribution + mt19937_64", bench_count, [&] {
+        std::mt19937_64 engine(1);
+        std::uniform_int_distribution<int32> dist(0, 999);
+        for(int32& v : values)
+        {
+            v = dist(engine);
+        }
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("raoe::random::uniform_int + xoshiro256pp", bench_count, [&] {
+        raoe::random::xoshiro256pp engine(1);
+        for(int32& v : values)
+        {
+            v = raoe::random::uniform_int(engine, 0, 999);
+        }
+        return values.back();
+    });
+}
+
+TEST_CASE("Uniform doubles", "[RANDOM][benchmark]")
+{
+    std::vector<double> values(bench_count);
+
+    raoe::test::counted_benchmark("std::uniform_real_distribution + mt19937_64", bench_count, [&] {
+        std::mt19937_64 engine(1);
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        for(double& v : values)
+        {
+            v = dist(engine);
+        }
+        return values.back();
+    });
+
+    raoe::test::counted_benchmark("raoe::random::uniform_real + xoshiro256pp", bench_count, [&] {
+        raoe::random::xoshiro256pp engine(1);
+        for(double& v : values)
+        {
+            v = raoe::random::uniform_real<double>(engine);
+        }
+        return values.back();
+    });
+}
@@ -0,0 +1,179 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/fixed.hpp"
+#include "core/random.hpp"
+
+#include <array>
+#include <vector>
+
+TEST_CASE("xoshiro256pp reference output", "[RANDOM]")
+{
+    raoe::random::xoshiro256pp engine(std::array<uint64, 4> {1, 2, 3, 4});
+    REQUIRE(engine() == 41943041ull);
+    REQUIRE(engine() == 58720359ull);
+    REQUIRE(engine() == 3588806011781223ull);
+}
+
+TEST_CASE("pcg64 reference output", "[RANDOM]")
+{
+    raoe::random::pcg64 engine(42, 54);
+    REQUIRE(engine() == 0x86b1da1d72062b68ull);
+    REQUIRE(engine() == 0x1304aa46c9853d39ull);
+    REQUIRE(engine() == 0xa3670e9e0dd50358ull);
+}
+
+TEST_CASE("pcg64 advance matches stepping", "[RANDOM]")
+{
+    raoe::random::pcg64 advanced(7, 3);
+    raoe::random::pcg64 stepped(7, 3);
+    advanced.advance(12345);
+    for(int i = 0; i < 12345; i++)
+    {
+        stepped();
+    }
+    REQUIRE(advanced == stepped);
+    REQUIRE(advanced() == stepped());
+}
+
+TEST_CASE("jump produces distinct streams", "[RANDOM]")
+{
+    raoe::random::xoshiro256pp engine(1234);
+    auto first = engine.split();
+    auto second = engine.split();
+    REQUIRE(first != second);
+    REQUIRE(first() != second());
+
+    raoe::random::xoshiro256pp a(99);
+    raoe::random::xoshiro256pp b(99);
+    a.long_jump();
+    REQUIRE(a != b);
+}
+
+TEST_CASE("wide engine lanes match jumped streams", "[RANDOM]")
+{
+    raoe::random::xoshiro256pp base(5);
+    raoe::random::xoshiro256pp_wide<4> wide(base);
+
+    std::array<uint64, 4 * 8 + 3> values {};
+    wide.fill(values);
+
+    std::array<raoe::random::xoshiro256pp, 4> lanes = {base.split(), base.split(), base.split(), base.split()};
+    for(std::size_t i = 0; i < 4 * 8; i++)
+    {
+        REQUIRE(values[i] == lanes[i % 4]());
+    }
+}
+
+TEST_CASE("bounded integers stay in range", "[RANDOM]")
+{
+    raoe::random::xoshiro256pp engine(42);
+    std::array<int32, 7> histogram {};
+    for(int i = 0; i < 70000; i++)
+    {
+        const int32 value = raoe::random::uniform_int(engine, -3, 3);
+        REQUIRE(value >= -3);
+        REQUIRE(value <= 3);
+        histogram[value + 3]++;
+    }
+    for(int32 count : histogram)
+    {
+        REQUIRE(count > 9000);
+        REQUIRE(count < 11000);
+    }
+
+    REQUIRE(raoe::random::uniform_int<uint8>(engine, 0, 255) <= 255);
+    REQUIRE(raoe::random::uniform_int<int64>(engine, INT64_MIN, INT64_MAX) != 0);
+}
+
+TEST_CASE("narrow integers stay in range", "[RANDOM]")
+{
+    // These get promoted to int along the way, which mustn't leak into the range
+    raoe::random::xoshiro256pp engine(3);
+    for(int i = 0; i < 20000; i++)
+    {
+        const int8 small = raoe::random::uniform_int<int8>(engine, -100, 50);
+        REQUIRE(small >= -100);
+        REQUIRE(small <= 50);
+        const int16 medium = raoe::random::uniform_int<int16>(engine, -1000, 1000);
+        REQUIRE(medium >= -1000);
+        REQUIRE(medium <= 1000);
+        const uint8 byte = raoe::random::uniform_int<uint8>(engine, 10, 20);
+        REQUIRE(byte >= 10);
+        REQUIRE(byte <= 20);
+        const uint16 word = raoe::random::uniform_int<uint16>(engine, 1000, 60000);
+        REQUIRE(word >= 1000);
+        REQUIRE(word <= 60000);
+    }
+
+    using fixed_t = raoe::fixed<int16, 8>;
+    const fixed_t min(-20);
+    const fixed_t max(10);
+    for(int i = 0; i < 20000; i++)
+    {
+        const fixed_t value = raoe::random::uniform_fixed(engine, min, max);
+        REQUIRE(value >= min);
+        REQUIRE(value <= max);
+    }
+}
+
+TEST_CASE("uniform reals are in [0, 1)", "[RANDOM]")
+{
+    raoe::random::pcg64 engine(11);
+    for(int i = 0; i < 10000; i++)
+    {
+        const double d = raoe::random::uniform_real<double>(engine);
+        const float f = raoe::random::uniform_real<float>(engine);
+        REQUIRE(d >= 0.0);
+        REQUIRE(d < 1.0);
+        REQUIRE(f >= 0.0f);
+        REQUIRE(f < 1.0f);
+    }
+}
+
+TEST_CASE("fixed distributions are deterministic", "[RANDOM]")
+{
+    using fixed_t = raoe::fixed<int32, 16>;
+    raoe::random::xoshiro256pp a(8);
+    raoe::random::xoshiro256pp b(8);
+    const fixed_t min(-2);
+    const fixed_t max(2);
+    for(int i = 0; i < 1000; i++)
+    {
+        const fixed_t value = raoe::random::uniform_fixed(a, min, max);
+        REQUIRE(value.raw() == raoe::random::uniform_fixed(b, min, max).raw());
+        REQUIRE(value >= min);
+        REQUIRE(value <= max);
+
+        const fixed_t unit = raoe::random::uniform_fixed<fixed_t>(a);
+        REQUIRE(unit == raoe::random::uniform_fixed<fixed_t>(b));
+        REQUIRE(unit >= fixed_t(0));
+        REQUIRE(unit < fixed_t(1));
+    }
+}
+
+TEST_CASE("engines are usable at compile time", "[RANDOM]")
+{
+    constexpr uint64 value = []
+    {
+        raoe::random::xoshiro256pp engine(3);
+        engine.jump();
+        return raoe::random::bounded(engine, 10);
+    }();
+    STATIC_REQUIRE(value < 10);
+}
@@ -0,0 +1,74 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/sampling_profiler.hpp"
+#include "core/string.hpp"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Something that looks like real work: lots of small calls and allocations
+    uint64 workload()
+    {
+        uint64 total = 0;
+        std::string text;
+        std::vector<std::string> tokens;
+        for(int i = 0; i < 20000; i++)
+        {
+            text = std::to_string(i * 7919) + "," + std::to_string(i) + "," + std::to_string(i % 13);
+            tokens.clear();
+            raoe::string::split(text, ',', std::back_inserter(tokens));
+            for(const auto& token : tokens)
+            {
+                total += token.size();
+            }
+        }
+        return total;
+    }
+}
+
+// The same workload with and without the profiler sampling this thread.  The difference between the two is the
+// profiler's overhead, which should stay within a few percent at 1kHz.
+TEST_CASE("Sampling profiler overhead", "[SAMPLING_PROFILER][benchmark]")
+{
+    auto& profiler = raoe::debug::sampling_profiler::get();
+
+    raoe::test::counted_benchmark("workload, not profiled", 1, [&] {
+        return workload();
+    });
+
+    REQUIRE(profiler.start(1000));
+    raoe::test::counted_benchmark("workload, profiled at 1kHz", 1, [&] {
+        return workload();
+    });
+
+    profiler.stop();
+    REQUIRE(profiler.start(10000));
+    raoe::test::counted_benchmark("workload, profiled at 10kHz", 1, [&] {
+        return workload();
+    });
+    profiler.stop();
+
+    CHECK(profiler.sample_count() > 0);
+    profiler.reset();
+}
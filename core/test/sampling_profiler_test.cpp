@@ -0,0 +1,133 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/sampling_profiler.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+    // Burns CPU for a while, since the timers run on CPU time rather than wall time
+    [[gnu::noinline]] double spin_for(std::chrono::milliseconds duration)
+    {
+        volatile double sink = 0;
+        const auto end = std::chrono::steady_clock::now() + duration;
+        while(std::chrono::steady_clock::now() < end)
+        {
+            for(int i = 0; i < 1000; i++)
+            {
+                sink = sink + i * 0.5;
+            }
+        }
+        return sink;
+    }
+}
+
+#ifdef RAOE_SAMPLING_PROFILER_SUPPORTED
+TEST_CASE("Sampling Profiler Collects Samples", "[sampling_profiler]")
+{
+    auto& profiler = raoe::debug::sampling_profiler::get();
+    profiler.reset();
+
+    REQUIRE(profiler.start(1000));
+    CHECK(profiler.running());
+    spin_for(std::chrono::milliseconds(300));
+    profiler.stop();
+    CHECK_FALSE(profiler.running());
+
+    // 300ms of CPU at 1kHz, give or take timer slack on a busy machine
+    const uint64 samples = profiler.sample_count();
+    CHECK(samples > 100);
+    CHECK(samples < 400);
+
+    // Nothing more comes in once it's stopped
+    spin_for(std::chrono::milliseconds(50));
+    CHECK(profiler.sample_count() == samples);
+
+    // Every sample shows up in exactly one folded line
+    std::ostringstream folded;
+    profiler.write_folded(folded);
+    std::istringstream lines(folded.str());
+    std::string line;
+    uint64 folded_total = 0;
+    while(std::getline(lines, line))
+    {
+        const auto space = line.find_last_of(' ');
+        REQUIRE(space != std::string::npos);
+        folded_total += std::stoull(line.substr(space + 1));
+    }
+    CHECK(folded_total == samples);
+
+    const auto top = profiler.top_functions(5);
+    REQUIRE_FALSE(top.empty());
+    CHECK(top.size() <= 5);
+    CHECK(top[0].self_samples > 0);
+    CHECK(top[0].total_samples >= top[0].self_samples);
+
+    profiler.reset();
+    CHECK(profiler.sample_count() == 0);
+}
+
+TEST_CASE("Sampling Profiler Threads", "[sampling_profiler]")
+{
+    auto& profiler = raoe::debug::sampling_profiler::get();
+    profiler.reset();
+    REQUIRE(profiler.start(1000));
+
+    // A registered thread gets sampled, one that never registers doesn't
+    std::thread registered([] {
+        raoe::debug::sampling_profiler::register_this_thread();
+        spin_for(std::chrono::milliseconds(200));
+    });
+    registered.join();
+    profiler.stop();
+    const uint64 with_worker = profiler.sample_count();
+    CHECK(with_worker > 50);
+
+    profiler.reset();
+    REQUIRE(profiler.start(1000));
+    std::thread unregistered([] { spin_for(std::chrono::milliseconds(200)); });
+    unregistered.join();
+    profiler.stop();
+    CHECK(profiler.sample_count() < with_worker / 2);
+    profiler.reset();
+}
+
+TEST_CASE("Sampling Profiler Console Control", "[sampling_profiler]")
+{
+    auto& profiler = raoe::debug::sampling_profiler::get();
+    profiler.reset();
+
+    auto& registry = raoe::cvar_registry::get();
+    CHECK(registry.set("debug:profiler_hz", "500"));
+    CHECK(registry.set("debug:profiler", "true"));
+    CHECK(profiler.running());
+    spin_for(std::chrono::milliseconds(200));
+    CHECK(registry.set("debug:profiler", "false"));
+    CHECK_FALSE(profiler.running());
+
+    const uint64 samples = profiler.sample_count();
+    CHECK(samples > 30);
+    CHECK(samples < 150);
+    raoe::debug::profiler_hz.reset();
+    profiler.reset();
+}
+#endif
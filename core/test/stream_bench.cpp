@@ -0,0 +1,117 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/stream.hpp"
+#include "core/string.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string make_payload()
+    {
+        std::string payload;
+        for(int i = 0; i < 100000; i++)
+        {
+            payload += "word";
+            payload += std::to_string(i);
+            payload += (i % 10 == 9) ? '\n' : ' ';
+        }
+        return payload;
+    }
+}
+
+TEST_CASE("Adapting a buffer to std::istream", "[STREAM][benchmark]")
+{
+    const std::string payload = make_payload();
+
+    raoe::test::counted_benchmark("std::stringstream getline", 10000, [&] {
+        std::stringstream stream(payload);
+        std::string line;
+        std::size_t lines = 0;
+        while(std::getline(stream, line))
+        {
+            lines++;
+        }
+        return lines;
+    });
+
+    raoe::test::counted_benchmark("span_istream getline", 10000, [&] {
+        raoe::stream::span_istream stream(payload);
+        std::string line;
+        std::size_t lines = 0;
+        while(std::getline(stream, line))
+        {
+            lines++;
+        }
+        return lines;
+    });
+
+    raoe::test::counted_benchmark("std::stringstream read", payload.size(), [&] {
+        std::stringstream stream(payload);
+        std::string out(payload.size(), '\0');
+        stream.read(out.data(), static_cast<std::streamsize>(out.size()));
+        return out.size();
+    });
+
+    raoe::test::counted_benchmark("span_istream read", payload.size(), [&] {
+        raoe::stream::span_istream stream(payload);
+        std::string out(payload.size(), '\0');
+        stream.read(out.data(), static_cast<std::streamsize>(out.size()));
+        return out.size();
+    });
+}
+
+TEST_CASE("Writing into a byte buffer", "[STREAM][benchmark]")
+{
+    raoe::test::counted_benchmark("std::ostringstream then copy out", 100000, [&] {
+        std::ostringstream stream;
+        for(int i = 0; i < 100000; i++)
+        {
+            stream << i << ' ';
+        }
+        const std::string str = stream.str();
+        std::vector<std::byte> bytes(str.size());
+        std::memcpy(bytes.data(), str.data(), str.size());
+        return bytes.size();
+    });
+
+    raoe::test::counted_benchmark("vector_ostream", 100000, [&] {
+        std::vector<std::byte> bytes;
+        raoe::stream::vector_ostream stream(bytes);
+        for(int i = 0; i < 100000; i++)
+        {
+            stream << i << ' ';
+        }
+        stream.flush();
+        return bytes.size();
+    });
+}
+
+TEST_CASE("Splitting a string", "[STREAM][benchmark]")
+{
+    const std::string payload = make_payload();
+
+    raoe::test::counted_benchmark("raoe::string::split", 100000, [&] {
+        return raoe::string::split(payload, ' ').size();
+    });
+}
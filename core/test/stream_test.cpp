@@ -18,7 +18,9 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 
 #include "core/stream.hpp"
 
+#include <array>
 #include <sstream>
+#include <string>
 
 TEST_CASE("Test String Stream", "[STREAM]")
 {
@@ -47,4 +49,61 @@ TEST_CASE("Test String View Case", "[STREAM]")
     {
         REQUIRE(container[i] == std::byte(test_words[i]));
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Span istream reads without copying", "[STREAM]")
+{
+    const std::string_view test_words = "some words\nand another line";
+    raoe::stream::span_istream stream(test_words);
+
+    std::string first_line;
+    std::getline(stream, first_line);
+    REQUIRE(first_line == "some words");
+    REQUIRE(stream.remaining().data() == test_words.data() + first_line.size() + 1);
+
+    std::vector<std::byte> container;
+    raoe::stream::read_stream_into(std::back_inserter(container), stream);
+    REQUIRE(container.size() == std::string_view("and another line").size());
+
+    stream.clear();
+    stream.seekg(5);
+    std::string word;
+    stream >> word;
+    REQUIRE(word == "words");
+}
+
+TEST_CASE("Span ostream fails when full", "[STREAM]")
+{
+    std::array<char, 8> buffer {};
+    raoe::stream::span_ostream stream {std::span<char>(buffer)};
+    stream << "1234";
+    REQUIRE(stream.good());
+    REQUIRE(std::string_view(stream.written().data(), stream.written().size()) == "1234");
+
+    stream << "56789";
+    REQUIRE(stream.fail());
+    REQUIRE(stream.written().size() == buffer.size());
+
+    stream.clear();
+    stream.seekp(0);
+    stream << "ab";
+    REQUIRE(std::string_view(buffer.data(), 4) == "ab34");
+}
+
+TEST_CASE("Vector ostream grows the caller's vector", "[STREAM]")
+{
+    std::vector<std::byte> bytes = {std::byte('>')};
+    {
+        raoe::stream::vector_ostream stream(bytes);
+        for(int i = 0; i < 1000; i++)
+        {
+            stream << i << ',';
+        }
+        stream.flush();
+        REQUIRE(bytes.size() == stream.written_size());
+        stream.write("end", 3);
+    }
+
+    const std::string_view written(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    REQUIRE(written.starts_with(">0,1,2,"));
+    REQUIRE(written.ends_with("998,999,end"));
+}
@@ -0,0 +1,180 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "perf_bench.hpp"
+
+#include "core/sync.hpp"
+
+#include <format>
+#include <latch>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr int total_ops = 400000;
+
+    // total_ops lock/work/unlock rounds split across `threads` threads.  The work is a few dozen dependent adds
+    // outside the lock and one inside it, so more threads means more contention, not just more work.
+    template <typename TFunc>
+    uint64 run_threads(int threads, TFunc&& locked)
+    {
+        std::vector<std::jthread> workers;
+        std::vector<uint64> sums(threads);
+        std::latch start(threads);
+        for(int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t] {
+                start.arrive_and_wait();
+                uint64 sum = 0;
+                for(int i = 0; i < total_ops / threads; i++)
+                {
+                    for(int k = 0; k < 32; k++)
+                    {
+                        sum = sum * 31 + k;
+                    }
+                    locked(sum);
+                }
+                sums[t] = sum;
+            });
+        }
+        workers.clear();
+        uint64 total = 0;
+        for(uint64 sum : sums)
+        {
+            total += sum;
+        }
+        return total;
+    }
+
+    template <typename Lock>
+    void bench_exclusive(const char* name, int threads)
+    {
+        Lock lock;
+        uint64 shared = 0;
+        raoe::test::counted_benchmark(std::format("{} ({} threads)", name, threads), total_ops, [&] {
+            run_threads(threads, [&](uint64 value) {
+                std::scoped_lock guard(lock);
+                shared += value;
+            });
+            return shared;
+        });
+    }
+
+    // Mostly readers: one in 16 rounds writes
+    template <typename Lock>
+    void bench_read_mostly(const char* name, int threads)
+    {
+        Lock lock;
+        uint64 shared[4] = {};
+        raoe::test::counted_benchmark(std::format("{} ({} threads)", name, threads), total_ops, [&] {
+            return run_threads(threads, [&](uint64 value) {
+                if((value & 15) == 0)
+                {
+                    std::scoped_lock guard(lock);
+                    shared[value & 3] += value;
+                }
+                else
+                {
+                    std::shared_lock guard(lock);
+                    (void)shared[value & 3];
+                }
+            });
+        });
+    }
+
+    struct named_mutex : raoe::sync::mutex
+    {
+        named_mutex()
+            : raoe::sync::mutex("sync bench")
+        {
+        }
+    };
+}
+
+// Divide the mean by 400k for the cost of one round.  Results on a machine with fewer cores than threads mostly
+// measure how well each lock behaves when the holder gets descheduled.
+TEST_CASE("Exclusive locks under contention", "[sync][benchmark]")
+{
+    for(int threads : {1, 2, 4, 8})
+    {
+        bench_exclusive<std::mutex>("std::mutex", threads);
+        bench_exclusive<raoe::sync::mutex>("sync::mutex", threads);
+        bench_exclusive<named_mutex>("sync::mutex, instrumented", threads);
+        bench_exclusive<raoe::sync::ticket_spinlock>("sync::ticket_spinlock", threads);
+        bench_exclusive<raoe::sync::rw_spinlock>("sync::rw_spinlock", threads);
+    }
+}
+
+TEST_CASE("Shared locks, 1 write in 16", "[sync][benchmark]")
+{
+    for(int threads : {1, 2, 4, 8})
+    {
+        bench_read_mostly<std::shared_mutex>("std::shared_mutex", threads);
+        bench_read_mostly<raoe::sync::rw_spinlock>("sync::rw_spinlock", threads);
+    }
+}
+
+TEST_CASE("Waking a waiting thread", "[sync][benchmark]")
+{
+    constexpr int rounds = 2000;
+
+    raoe::test::counted_benchmark("std::latch", rounds, [&] {
+        int woken = 0;
+        for(int i = 0; i < rounds; i++)
+        {
+            std::latch done(1);
+            std::jthread waiter([&] {
+                done.wait();
+                woken++;
+            });
+            done.count_down();
+        }
+        return woken;
+    });
+
+    raoe::test::counted_benchmark("sync::latch", rounds, [&] {
+        int woken = 0;
+        for(int i = 0; i < rounds; i++)
+        {
+            raoe::sync::latch done(1);
+            std::jthread waiter([&] {
+                done.wait();
+                woken++;
+            });
+            done.count_down();
+        }
+        return woken;
+    });
+
+    raoe::test::counted_benchmark("sync::event", rounds, [&] {
+        int woken = 0;
+        for(int i = 0; i < rounds; i++)
+        {
+            raoe::sync::event done;
+            std::jthread waiter([&] {
+                done.wait();
+                woken++;
+            });
+            done.set();
+        }
+        return woken;
+    });
+}
@@ -0,0 +1,257 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/sync.hpp"
+
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Hammers a plain (non-atomic) counter from several threads; any lost update means the lock let two in at once
+    template <typename Lock>
+    void check_exclusive(Lock& lock)
+    {
+        constexpr int threads = 4;
+        constexpr int iterations = 20000;
+        int counter = 0;
+        std::vector<std::jthread> workers;
+        for(int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&] {
+                for(int i = 0; i < iterations; i++)
+                {
+                    std::scoped_lock guard(lock);
+                    counter++;
+                }
+            });
+        }
+        workers.clear();
+        REQUIRE(counter == threads * iterations);
+    }
+}
+
+TEST_CASE("Sync - Locks are exclusive", "[sync]")
+{
+    SECTION("mutex")
+    {
+        raoe::sync::mutex lock;
+        check_exclusive(lock);
+        REQUIRE(lock.try_lock());
+        REQUIRE_FALSE(lock.try_lock());
+        lock.unlock();
+    }
+    SECTION("ticket_spinlock")
+    {
+        raoe::sync::ticket_spinlock lock;
+        check_exclusive(lock);
+        REQUIRE(lock.try_lock());
+        REQUIRE_FALSE(lock.try_lock());
+        lock.unlock();
+    }
+    SECTION("rw_spinlock")
+    {
+        raoe::sync::rw_spinlock lock;
+        check_exclusive(lock);
+
+        // Readers share, but keep a writer out
+        REQUIRE(lock.try_lock_shared());
+        REQUIRE(lock.try_lock_shared());
+        REQUIRE_FALSE(lock.try_lock());
+        lock.unlock_shared();
+        lock.unlock_shared();
+        REQUIRE(lock.try_lock());
+        REQUIRE_FALSE(lock.try_lock_shared());
+        lock.unlock();
+    }
+}
+
+TEST_CASE("Sync - rw_spinlock readers see whole writes", "[sync]")
+{
+    raoe::sync::rw_spinlock lock;
+    std::array<int, 8> values {};
+    std::atomic<bool> torn = false;
+    std::atomic<bool> done = false;
+
+    std::vector<std::jthread> readers;
+    for(int t = 0; t < 3; t++)
+    {
+        readers.emplace_back([&] {
+            while(!done.load())
+            {
+                std::shared_lock guard(lock);
+                for(int value : values)
+                {
+                    if(value != values[0])
+                    {
+                        torn = true;
+                    }
+                }
+            }
+        });
+    }
+    for(int i = 1; i <= 5000; i++)
+    {
+        std::scoped_lock guard(lock);
+        values.fill(i);
+    }
+    done = true;
+    readers.clear();
+    REQUIRE_FALSE(torn.load());
+    REQUIRE(values[7] == 5000);
+}
+
+TEST_CASE("Sync - seqlock", "[sync]")
+{
+    struct triple
+    {
+        int64 a, b, c;
+    };
+    raoe::sync::seqlock<triple> value({0, 0, 0});
+    std::atomic<bool> done = false;
+    std::atomic<bool> torn = false;
+
+    std::jthread reader([&] {
+        while(!done.load())
+        {
+            const triple seen = value.load();
+            if(seen.a != seen.b || seen.b != seen.c)
+            {
+                torn = true;
+            }
+        }
+    });
+
+    // Two writers at once have to stay serialized by the seqlock itself
+    std::vector<std::jthread> writers;
+    for(int64 t = 0; t < 2; t++)
+    {
+        writers.emplace_back([&, t] {
+            for(int64 i = 0; i < 20000; i++)
+            {
+                const int64 v = i * 2 + t;
+                value.store({v, v, v});
+            }
+        });
+    }
+    writers.clear();
+    done = true;
+    reader.join();
+
+    REQUIRE_FALSE(torn.load());
+    const triple last = value.load();
+    REQUIRE(last.a == last.c);
+
+    raoe::sync::seqlock<int64> defaulted;
+    REQUIRE(defaulted.load() == 0);
+}
+
+TEST_CASE("Sync - event and latch", "[sync]")
+{
+    SECTION("event")
+    {
+        raoe::sync::event ready;
+        REQUIRE_FALSE(ready.is_set());
+
+        int payload = 0;
+        int seen = 0;
+        std::jthread waiter([&] {
+            ready.wait();
+            seen = payload;
+        });
+        payload = 42;
+        ready.set();
+        waiter.join();
+        REQUIRE(seen == 42);
+
+        // Stays set, so waiting again doesn't block
+        ready.wait();
+        REQUIRE(ready.is_set());
+        ready.reset();
+        REQUIRE_FALSE(ready.is_set());
+    }
+    SECTION("latch")
+    {
+        constexpr int threads = 4;
+        raoe::sync::latch started(threads + 1);
+        std::atomic<int> arrived = 0;
+        std::vector<std::jthread> workers;
+        for(int t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&] {
+                arrived++;
+                started.arrive_and_wait();
+            });
+        }
+        REQUIRE_FALSE(started.try_wait());
+        started.arrive_and_wait();
+        REQUIRE(arrived.load() == threads);
+        REQUIRE(started.try_wait());
+    }
+}
+
+TEST_CASE("Sync - Named locks record contention", "[sync]")
+{
+    auto& stats = raoe::sync::lock_stats::named("sync test lock");
+    stats.reset();
+    REQUIRE(&raoe::sync::lock_stats::named("sync test lock") == &stats);
+
+    raoe::sync::mutex lock("sync test lock");
+    check_exclusive(lock);
+    lock.lock();
+    lock.unlock();
+
+    raoe::sync::lock_report report = stats.snapshot();
+    REQUIRE(report.name == "sync test lock");
+    REQUIRE(report.acquisitions == 4 * 20000 + 1);
+    REQUIRE(report.max_wait_ns <= report.wait_ns);
+
+    // Force at least one contended acquire
+    lock.lock();
+    std::jthread waiter([&] {
+        lock.lock();
+        lock.unlock();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lock.unlock();
+    waiter.join();
+
+    report = stats.snapshot();
+    REQUIRE(report.contentions >= 1);
+    REQUIRE(report.max_wait_ns >= 1000000);
+
+    // Other named locks share the registry, and unnamed ones never show up
+    raoe::sync::ticket_spinlock other("sync test other");
+    other.lock();
+    other.unlock();
+    bool found = false;
+    for(const auto& entry : raoe::sync::lock_stats::report())
+    {
+        found = found || (entry.name == "sync test other" && entry.acquisitions == 1);
+        REQUIRE_FALSE(entry.name.empty());
+    }
+    REQUIRE(found);
+
+    std::ostringstream text;
+    raoe::sync::lock_stats::write_report(text);
+    REQUIRE(text.str().find("sync test lock") != std::string::npos);
+}
@@ -0,0 +1,200 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/perf_counters.hpp"
+#include "core/uuid_store.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    constexpr std::size_t key_count = 10'000'000;
+    constexpr std::size_t lookups = 1'000'000;
+    // What we do now makes a file per key, which is hopeless long before 10M; this many shows what each one costs
+    constexpr std::size_t file_count = 100'000;
+    constexpr std::size_t value_size = 100;
+
+    struct temp_dir
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_uuid_store_bench";
+
+        temp_dir()
+        {
+            std::filesystem::remove_all(root);
+            std::filesystem::create_directories(root);
+        }
+        ~temp_dir() { std::filesystem::remove_all(root); }
+    };
+
+    // Times each call, and prints how many a second, how long the slow ones took and the hardware counters per call
+    class latencies
+    {
+      public:
+        explicit latencies(std::size_t count)
+        {
+            m_nanoseconds.reserve(count);
+            m_counters.start();
+        }
+
+        template <typename TFunc>
+        void time(TFunc&& func)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            func();
+            m_nanoseconds.push_back(static_cast<uint32>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                    .count()));
+        }
+
+        void print(std::string_view what)
+        {
+            const raoe::debug::perf_result counted = m_counters.stop();
+            uint64 total = 0;
+            for(const uint32 ns : m_nanoseconds)
+            {
+                total += ns;
+            }
+            std::ranges::sort(m_nanoseconds);
+            auto at = [&](double fraction) {
+                const double last = static_cast<double>(m_nanoseconds.size() - 1);
+                return m_nanoseconds[static_cast<std::size_t>(fraction * last)];
+            };
+            std::cout << std::format("  {:<36} {:>9.0f}/s  p50 {:>6.1f}us  p99 {:>7.1f}us  p99.9 {:>8.1f}us\n", what,
+                                     1e9 * static_cast<double>(m_nanoseconds.size()) / static_cast<double>(total),
+                                     at(0.5) / 1000.0, at(0.99) / 1000.0, at(0.999) / 1000.0);
+            std::cout << std::format("  {:<36} {}\n", "", counted.summary(m_nanoseconds.size()));
+        }
+
+      private:
+        std::vector<uint32> m_nanoseconds;
+        raoe::debug::perf_counters m_counters;
+    };
+
+    std::string value_of(std::size_t i)
+    {
+        std::string value = std::format("{}", i);
+        value.resize(value_size, '.');
+        return value;
+    }
+
+    std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text));
+    }
+}
+
+TEST_CASE("UUID store with 10M keys", "[uuid_store][benchmark]")
+{
+    const temp_dir temp;
+    std::vector<raoe::uuid> ids(key_count);
+    std::ranges::generate(ids, raoe::make_uuid_v7);
+    uint32 state = 12345;
+    auto pick = [&] { return (state = state * 1664525u + 1013904223u) % key_count; };
+
+    {
+        latencies timing(file_count);
+        for(std::size_t i = 0; i < file_count; i++)
+        {
+            const std::string value = value_of(i);
+            timing.time([&] {
+                std::ofstream(temp.root / std::format("{}.bin", ids[i]), std::ios::binary)
+                    .write(value.data(), static_cast<std::streamsize>(value.size()));
+            });
+        }
+        timing.print(std::format("file per uuid, put ({}k files)", file_count / 1000));
+
+        latencies reads(lookups / 10);
+        for(std::size_t i = 0; i < lookups / 10; i++)
+        {
+            reads.time([&] {
+                std::ifstream in(temp.root / std::format("{}.bin", ids[pick() % file_count]), std::ios::binary);
+                std::string value(value_size, '\0');
+                in.read(value.data(), static_cast<std::streamsize>(value.size()));
+            });
+        }
+        reads.print("file per uuid, get");
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    raoe::uuid_store store(temp.root / "store");
+    {
+        latencies timing(key_count);
+        for(std::size_t i = 0; i < key_count; i++)
+        {
+            const std::string value = value_of(i);
+            timing.time([&] { store.put(ids[i], bytes_of(value)); });
+        }
+        timing.print("uuid_store, put (v7 ids)");
+    }
+    REQUIRE(store.flush());
+    const auto stats = store.stats();
+    std::cout << std::format("  loaded in {}s with {} flushes, {} moves and {} compactions ({}MB); tables per level:",
+                             std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start)
+                                 .count(),
+                             stats.flushes, stats.moves, stats.compactions, stats.bytes_compacted / (1024 * 1024));
+    for(const std::size_t tables : stats.tables)
+    {
+        std::cout << ' ' << tables;
+    }
+    std::cout << '\n';
+
+    {
+        latencies timing(lookups);
+        std::size_t found = 0;
+        for(std::size_t i = 0; i < lookups; i++)
+        {
+            const std::size_t which = pick();
+            std::optional<std::vector<std::byte>> got;
+            timing.time([&] { got = store.get(ids[which]); });
+            const std::string expected = value_of(which);
+            found += got && std::ranges::equal(*got, bytes_of(expected));
+        }
+        REQUIRE(found == lookups);
+        timing.print("uuid_store, get");
+    }
+    {
+        latencies timing(lookups);
+        std::size_t found = 0;
+        for(std::size_t i = 0; i < lookups; i++)
+        {
+            const raoe::uuid missing = raoe::make_random_uuid_v4();
+            timing.time([&] { found += store.contains(missing); });
+        }
+        REQUIRE(found == 0);
+        timing.print("uuid_store, get of a missing key");
+    }
+    {
+        // Overwrite random keys, which lands all over the tree instead of at the end
+        latencies timing(lookups);
+        for(std::size_t i = 0; i < lookups; i++)
+        {
+            const std::size_t which = pick();
+            const std::string value = value_of(which);
+            timing.time([&] { store.put(ids[which], bytes_of(value)); });
+        }
+        timing.print("uuid_store, overwrite random keys");
+    }
+}
@@ -0,0 +1,308 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "core/uuid_store.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // Tiny everything, so a few thousand keys go through every level
+    const raoe::uuid_store::options small {
+        .durability = raoe::journal::durability::buffered,
+        .memtable_size = 16 * 1024,
+        .table_size = 16 * 1024,
+        .block_size = 512,
+        .level0_tables = 2,
+        .level1_size = 64 * 1024,
+    };
+
+    struct temp_store
+    {
+        std::filesystem::path root = std::filesystem::temp_directory_path() / "raoe_uuid_store_test";
+
+        temp_store() { std::filesystem::remove_all(root); }
+        ~temp_store() { std::filesystem::remove_all(root); }
+
+        [[nodiscard]] std::vector<std::filesystem::path> tables() const
+        {
+            std::vector<std::filesystem::path> files;
+            for(const auto& file : std::filesystem::directory_iterator(root))
+            {
+                if(file.path().extension() == ".sst")
+                {
+                    files.push_back(file.path());
+                }
+            }
+            return files;
+        }
+    };
+
+    std::span<const std::byte> bytes_of(const std::string& text)
+    {
+        return std::as_bytes(std::span(text));
+    }
+
+    std::optional<std::string> text_of(const std::optional<std::vector<std::byte>>& bytes)
+    {
+        if(!bytes)
+        {
+            return std::nullopt;
+        }
+        return std::string(reinterpret_cast<const char*>(bytes->data()), bytes->size());
+    }
+
+    // Every key's latest value, or nullopt for ones that were erased
+    using model = std::unordered_map<raoe::uuid, std::optional<std::string>>;
+
+    void require_matches(const raoe::uuid_store& store, const model& expected)
+    {
+        for(const auto& [id, value] : expected)
+        {
+            REQUIRE(text_of(store.get(id)) == value);
+            REQUIRE(store.contains(id) == value.has_value());
+        }
+    }
+}
+
+TEST_CASE("UUID Store - Put, get and erase", "[uuid_store]")
+{
+    const temp_store temp;
+    const raoe::uuid first = raoe::make_uuid();
+    const raoe::uuid second = raoe::make_uuid();
+    {
+        raoe::uuid_store store(temp.root, small);
+        REQUIRE_FALSE(store.get(first));
+        REQUIRE(store.put(first, bytes_of("one")));
+        REQUIRE(store.put(second, bytes_of("two")));
+        REQUIRE(store.put(first, bytes_of("uno")));
+        REQUIRE(text_of(store.get(first)) == "uno");
+
+        // Still found once it's in a table, and an erase in the memtable hides it
+        REQUIRE(store.flush());
+        REQUIRE(temp.tables().size() == 1);
+        REQUIRE(text_of(store.get(second)) == "two");
+        REQUIRE(store.erase(second));
+        REQUIRE_FALSE(store.get(second));
+        REQUIRE_FALSE(store.contains(second));
+        REQUIRE(store.put(raoe::uuid(), {}));
+        REQUIRE(store.get(raoe::uuid())->empty());
+    }
+
+    // The erase and the empty value were only in the journal
+    raoe::uuid_store store(temp.root, small);
+    REQUIRE(text_of(store.get(first)) == "uno");
+    REQUIRE_FALSE(store.contains(second));
+    REQUIRE(store.contains(raoe::uuid()));
+}
+
+TEST_CASE("UUID Store - Compaction keeps the latest of everything", "[uuid_store]")
+{
+    const temp_store temp;
+    model expected;
+    std::vector<raoe::uuid> ids;
+    for(int i = 0; i < 3000; i++)
+    {
+        ids.push_back(raoe::make_random_uuid_v4());
+    }
+    {
+        raoe::uuid_store store(temp.root, small);
+        // Write everything, then write a third of it again and erase another third
+        for(int round = 0; round < 2; round++)
+        {
+            for(std::size_t i = 0; i < ids.size(); i++)
+            {
+                if(round == 1 && i % 3 == 1)
+                {
+                    REQUIRE(store.erase(ids[i]));
+                    expected[ids[i]] = std::nullopt;
+                }
+                else if(round == 0 || i % 3 == 0)
+                {
+                    const std::string value = std::format("value {} from round {}", i, round);
+                    REQUIRE(store.put(ids[i], bytes_of(value)));
+                    expected[ids[i]] = value;
+                }
+            }
+        }
+        require_matches(store, expected);
+        REQUIRE(store.flush());
+        const auto stats = store.stats();
+        REQUIRE(stats.compactions > 0);
+        REQUIRE(stats.tables.size() >= 3);
+        REQUIRE(stats.tables[0] < small.level0_tables);
+        require_matches(store, expected);
+    }
+
+    // Only tables the manifest lists are left, and they have everything
+    raoe::uuid_store store(temp.root, small);
+    std::size_t listed = 0;
+    for(const std::size_t count : store.stats().tables)
+    {
+        listed += count;
+    }
+    REQUIRE(temp.tables().size() == listed);
+    require_matches(store, expected);
+}
+
+TEST_CASE("UUID Store - In order keys move down without being rewritten", "[uuid_store]")
+{
+    const temp_store temp;
+    raoe::uuid_store store(temp.root, small);
+    model expected;
+    for(int i = 0; i < 2000; i++)
+    {
+        // Version 7 ids made in the same millisecond only share a prefix, so make them in order by hand
+        const std::array<uint64, 2> words = {raoe::distribute(uint64 {7}), static_cast<uint64>(i)};
+        std::array<uint8, 16> bytes;
+        for(std::size_t b = 0; b < 16; b++)
+        {
+            bytes[b] = static_cast<uint8>(words[b / 8] >> (56 - 8 * (b % 8)));
+        }
+        const raoe::uuid id(bytes);
+        const std::string value = std::format("{:40}", i);
+        REQUIRE(store.put(id, bytes_of(value)));
+        expected[id] = value;
+    }
+    REQUIRE(store.flush());
+    const auto stats = store.stats();
+    REQUIRE(stats.moves > 0);
+    REQUIRE(stats.compactions == 0);
+    require_matches(store, expected);
+}
+
+TEST_CASE("UUID Store - Left over and damaged files", "[uuid_store]")
+{
+    const temp_store temp;
+    model expected;
+    {
+        raoe::uuid_store store(temp.root, small);
+        for(int i = 0; i < 200; i++)
+        {
+            const raoe::uuid id = raoe::make_uuid();
+            const std::string value = std::format("value {}", i);
+            store.put(id, bytes_of(value));
+            expected[id] = value;
+        }
+        REQUIRE(store.flush());
+    }
+
+    // As if a flush died before the manifest was written
+    const std::filesystem::path stray = temp.root / "00000000000000ff.sst";
+    std::ofstream(stray) << "half a table";
+    {
+        raoe::uuid_store store(temp.root, small);
+        REQUIRE(store.ok());
+        REQUIRE_FALSE(std::filesystem::exists(stray));
+        require_matches(store, expected);
+    }
+
+    // A manifest that doesn't check out can't say which tables are stray, so every one of them stays
+    const std::filesystem::path manifest = temp.root / "manifest";
+    const std::size_t table_count = temp.tables().size();
+    std::filesystem::copy_file(manifest, temp.root / "manifest.good");
+    std::filesystem::resize_file(manifest, std::filesystem::file_size(manifest) - 1);
+    {
+        raoe::uuid_store store(temp.root, small);
+        REQUIRE_FALSE(store.ok());
+        REQUIRE_FALSE(store.put(raoe::make_uuid(), bytes_of("lost")));
+    }
+    REQUIRE(temp.tables().size() == table_count);
+    std::filesystem::rename(temp.root / "manifest.good", manifest);
+    {
+        raoe::uuid_store store(temp.root, small);
+        require_matches(store, expected);
+    }
+
+    // Damage one block in every table; the keys in those blocks go missing but nothing else does
+    for(const auto& table : temp.tables())
+    {
+        std::fstream scribble(table, std::ios::binary | std::ios::in | std::ios::out);
+        scribble.seekp(30);
+        scribble.put('!');
+    }
+    raoe::uuid_store store(temp.root, small);
+    std::size_t found = 0;
+    for(const auto& [id, value] : expected)
+    {
+        const auto got = text_of(store.get(id));
+        REQUIRE((!got || got == value));
+        found += got.has_value();
+    }
+    REQUIRE(found < expected.size());
+    REQUIRE(found > expected.size() / 2);
+}
+
+TEST_CASE("UUID Store - Readers and writers at once", "[uuid_store]")
+{
+    const temp_store temp;
+    raoe::uuid_store store(temp.root, small);
+    constexpr int writers = 4;
+    constexpr int per_writer = 1000;
+    std::vector<std::vector<raoe::uuid>> ids(writers);
+    for(auto& list : ids)
+    {
+        for(int i = 0; i < per_writer; i++)
+        {
+            list.push_back(raoe::make_uuid());
+        }
+    }
+
+    // Catch's REQUIRE isn't safe to use off the main thread
+    std::atomic<bool> ok = true;
+    std::atomic<int> done = 0;
+    {
+        std::vector<std::jthread> threads;
+        for(int w = 0; w < writers; w++)
+        {
+            threads.emplace_back([&, w] {
+                for(int i = 0; i < per_writer; i++)
+                {
+                    ok = ok && store.put(ids[w][i], bytes_of(std::format("{} {}", w, i)));
+                }
+                done++;
+            });
+        }
+        // Anything a writer has put has to be there, whichever table it's got to by now
+        threads.emplace_back([&] {
+            while(done < writers)
+            {
+                for(int w = 0; w < writers; w++)
+                {
+                    const auto got = text_of(store.get(ids[w][0]));
+                    ok = ok && (!got || got == std::format("{} 0", w));
+                }
+            }
+        });
+    }
+    REQUIRE(ok);
+    for(int w = 0; w < writers; w++)
+    {
+        for(int i = 0; i < per_writer; i += 7)
+        {
+            REQUIRE(text_of(store.get(ids[w][i])) == std::format("{} {}", w, i));
+        }
+    }
+}
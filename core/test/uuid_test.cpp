@@ -17,7 +17,9 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #include <catch2/catch_test_macros.hpp>
 #include <iostream>
 
+#include <chrono>
 #include <format>
+#include <thread>
 
 #include "core/uuid.hpp"
 
@@ -43,4 +45,13 @@ TEST_CASE("Multiple Random are not the same", "[UUID]")
     raoe::uuid id1 = raoe::make_random_uuid_v4();
     raoe::uuid id2 = raoe::make_random_uuid_v4();
     REQUIRE(id1 != id2);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Version 7 sort by when they were made", "[UUID]")
+{
+    const raoe::uuid first = raoe::make_uuid_v7();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    const raoe::uuid second = raoe::make_uuid_v7();
+    REQUIRE(first < second);
+    REQUIRE((first.bytes()[6] & 0xF0) == 0x70);
+}
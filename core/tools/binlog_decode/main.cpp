@@ -0,0 +1,59 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Turns a log written by raoe::binary_log::binary_sink back into text.
+//     binlog-decode game.blog > game.log
+
+#include "core/binary_log.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+int main(int argc, char** argv)
+{
+    if(argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <file>\n";
+        return 2;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if(!file)
+    {
+        std::cerr << "couldn't open " << argv[1] << "\n";
+        return 1;
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    raoe::binary_log::decoder decoder;
+    const bool ok = decoder.decode(
+        std::span<const std::byte>(reinterpret_cast<const std::byte*>(data.data()), data.size()),
+        [](const raoe::binary_log::decoded_message& msg) {
+            const auto time = std::chrono::sys_time<std::chrono::microseconds>(
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::nanoseconds(msg.unix_nanoseconds)));
+            std::cout << std::format("[{:%F %T}] [{}] {} ({}:{})\n", time, raoe::binary_log::to_string(msg.lvl),
+                                     msg.text, msg.file, msg.line);
+        });
+
+    if(!ok)
+    {
+        std::cerr << argv[1] << " is not a binary log, or is truncated\n";
+        return 1;
+    }
+    return 0;
+}
@@ -249,6 +249,27 @@ namespace raoe::fs
     void delete_path(const path& path);
     bool exists(const path& path);
 
+    // exists() checks a Bloom filter of every mounted path before asking PhysFS, so misses don't have to visit every
+    // mount.  It's filled in the background as things are mounted (exists() skips it until then) and kept up to date
+    // by mkdir, delete_path and ofstream.  Call rebuild_path_filter() if mounts change behind our back.
+    void rebuild_path_filter();
+    // For a directory in the write dir that gets written to with std::filesystem (where a chunk_store, journal or
+    // uuid_store lives): exists() checks misses under it on disk instead of trusting the filter.
+    void unfiltered_write_dir(const path& directory);
+    // Blocks until every mount is in the filter
+    void wait_for_path_filter();
+    // On by default
+    void set_path_filter_enabled(bool enabled);
+
+    // A hash of what's mounted where, and when each mount last changed on disk, for telling whether something built
+    // from a scan of the mounts (like an asset_registry) is stale.  A directory's time only moves when something
+    // directly in it is added or removed, so call rebuild on anything cached after edits deeper down.
+    [[nodiscard]] uint64 mount_fingerprint();
+
+    // The real directory PhysFS writes to (the pref dir init_fs set up), for things that need real files, like
+    // mapped_file or chunk_store.  Empty if there isn't one.
+    [[nodiscard]] std::filesystem::path write_dir();
+
     enum class file_type
     {
         regular,
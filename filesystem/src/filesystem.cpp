@@ -19,7 +19,20 @@ Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
 #include "physfs.h"
 #include "fs/filesystem.hpp"
 
+#include "core/bloom_filter.hpp"
+#include "core/epoch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <streambuf>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 namespace raoe::fs
 {
@@ -34,6 +47,452 @@ namespace raoe::fs
         return value;
     }
 
+    namespace
+    {
+        // Paths as the path filter sees them: no leading or trailing slash, ASCII lowercased (so a case insensitive
+        // host can't turn into a false negative).  Anything PhysFS would clean up or reject itself comes back empty,
+        // and goes straight to PhysFS.
+        std::optional<uint64> filter_hash(std::string_view path)
+        {
+            while(!path.empty() && path.front() == '/')
+            {
+                path.remove_prefix(1);
+            }
+            while(!path.empty() && path.back() == '/')
+            {
+                path.remove_suffix(1);
+            }
+            char buffer[256];
+            if(path.empty() || path.size() > sizeof(buffer))
+            {
+                return std::nullopt;
+            }
+            std::size_t segment_start = 0;
+            for(std::size_t i = 0; i <= path.size(); i++)
+            {
+                const char c = i < path.size() ? path[i] : '/';
+                if(c == '/')
+                {
+                    const std::string_view segment = path.substr(segment_start, i - segment_start);
+                    if(segment.empty() || segment == "." || segment == "..")
+                    {
+                        return std::nullopt;
+                    }
+                    segment_start = i + 1;
+                }
+                else if(c == '\\' || c == ':')
+                {
+                    return std::nullopt;
+                }
+                if(i < path.size())
+                {
+                    buffer[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+                }
+            }
+            return bloom_filter::hash(std::string_view(buffer, path.size()));
+        }
+
+        // Hashes a path and every directory above it, since exists() is true for those too
+        void add_with_parents(std::string_view path, std::vector<uint64>& into)
+        {
+            for(std::size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1))
+            {
+                if(auto hash = filter_hash(path.substr(0, slash)))
+                {
+                    into.push_back(*hash);
+                }
+            }
+            if(auto hash = filter_hash(path))
+            {
+                into.push_back(*hash);
+            }
+        }
+
+        std::string_view trim_slashes(std::string_view path)
+        {
+            while(!path.empty() && path.front() == '/')
+            {
+                path.remove_prefix(1);
+            }
+            while(!path.empty() && path.back() == '/')
+            {
+                path.remove_suffix(1);
+            }
+            return path;
+        }
+
+        std::string join_virtual(std::string_view mount_point, std::string_view relative)
+        {
+            if(mount_point.empty())
+            {
+                return std::string(relative);
+            }
+            return std::string(mount_point) + "/" + std::string(relative);
+        }
+
+        struct mounted
+        {
+            std::filesystem::path real;
+            std::string mount_point;
+        };
+
+        // Where the write dir is, and the virtual directories under it that get written to around PhysFS
+        struct write_mount
+        {
+            std::filesystem::path real;
+            std::string mount_point;
+            std::vector<std::string> unfiltered;
+        };
+
+        [[nodiscard]] bool is_under(std::string_view path, std::string_view directory)
+        {
+            return directory.empty() || (path.starts_with(directory) &&
+                                         (path.size() == directory.size() || path[directory.size()] == '/'));
+        }
+
+        // Every path in every mount, in a Bloom filter, so exists() can answer "no" without asking each mount in turn.
+        //
+        // A worker thread walks mounts as they come in and adds them to the filter, or builds a fresh one when it
+        // fills up or too much of it has been deleted.  Until every mount is in, exists() skips the filter.  Readers
+        // hold an epoch guard, so the worker can swap filters under them.
+        //
+        // Directories in the write dir that get written to behind our back (std::filesystem, the chunk store, the
+        // journal) are registered with unfiltered_write_dir(), and a miss under one of those is checked on disk rather
+        // than trusted.  That's one stat, not PhysFS asking every mount, and every other miss stays a hash.
+        class path_filter
+        {
+          public:
+            static path_filter& get()
+            {
+                static path_filter instance;
+                return instance;
+            }
+
+            path_filter(const path_filter&) = delete;
+            path_filter& operator=(const path_filter&) = delete;
+
+            ~path_filter()
+            {
+                m_worker.request_stop();
+                m_changed.notify_all();
+                if(m_worker.joinable())
+                {
+                    m_worker.join();
+                }
+                delete m_filter.load(std::memory_order_relaxed);
+            }
+
+            // false: definitely not there.  true: ask PhysFS.
+            [[nodiscard]] bool may_exist(std::string_view path) const
+            {
+                if(!m_ready.load(std::memory_order_acquire) || !m_enabled.load(std::memory_order_relaxed))
+                {
+                    return true;
+                }
+                const std::optional<uint64> hash = filter_hash(path);
+                if(!hash)
+                {
+                    return true;
+                }
+                {
+                    epoch::guard guard;
+                    const bloom_filter* filter = m_filter.load(std::memory_order_acquire);
+                    if(filter == nullptr || filter->may_contain(*hash))
+                    {
+                        return true;
+                    }
+                }
+                return in_unfiltered_dir(path);
+            }
+
+            void set_write_mount(std::filesystem::path real, std::string_view mount_point)
+            {
+                std::scoped_lock lock(m_mutex);
+                m_write_mount.store(std::make_shared<const write_mount>(
+                                        write_mount {std::move(real), std::string(trim_slashes(mount_point)), {}}),
+                                    std::memory_order_release);
+            }
+
+            void add_unfiltered_dir(std::string_view directory)
+            {
+                std::scoped_lock lock(m_mutex);
+                const std::shared_ptr<const write_mount> current = m_write_mount.load(std::memory_order_acquire);
+                if(current == nullptr)
+                {
+                    return;
+                }
+                auto next = std::make_shared<write_mount>(*current);
+                next->unfiltered.push_back(join_virtual(next->mount_point, trim_slashes(directory)));
+                m_write_mount.store(std::move(next), std::memory_order_release);
+            }
+
+            void add_mount(std::filesystem::path real, std::string mount_point)
+            {
+                std::scoped_lock lock(m_mutex);
+                m_mounts.push_back(mounted {std::move(real), std::string(trim_slashes(mount_point))});
+                m_ready.store(false, std::memory_order_release);
+                start_worker();
+                m_changed.notify_all();
+            }
+
+            void add_path(std::string_view path)
+            {
+                std::vector<uint64> hashes;
+                add_with_parents(path, hashes);
+                std::scoped_lock lock(m_mutex);
+                bloom_filter* filter = m_filter.load(std::memory_order_relaxed);
+                for(uint64 hash : hashes)
+                {
+                    if(filter != nullptr)
+                    {
+                        filter->insert(hash);
+                    }
+                    if(m_building)
+                    {
+                        m_added_while_building.push_back(hash);
+                    }
+                }
+                if(filter != nullptr && filter->inserted() > filter->capacity())
+                {
+                    request_rebuild_locked();
+                }
+            }
+
+            void removed_path()
+            {
+                std::scoped_lock lock(m_mutex);
+                // Deleted paths stay false positives, which only costs speed.  Once a quarter of the filter is stale
+                // it's worth a rebuild.
+                const bloom_filter* filter = m_filter.load(std::memory_order_relaxed);
+                if(filter != nullptr && ++m_stale * 4 > filter->inserted())
+                {
+                    request_rebuild_locked();
+                }
+            }
+
+            void request_rebuild()
+            {
+                std::scoped_lock lock(m_mutex);
+                request_rebuild_locked();
+            }
+
+            void wait()
+            {
+                std::unique_lock lock(m_mutex);
+                m_idle.wait(lock, [this] { return !busy_locked(); });
+            }
+
+            void set_enabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+          private:
+            path_filter()
+            {
+                // The epoch domain has to outlive us, since the worker waits on it to free filters until it's joined
+                (void)epoch::current_epoch();
+            }
+
+            [[nodiscard]] bool in_unfiltered_dir(std::string_view path) const
+            {
+                const std::shared_ptr<const write_mount> mount = m_write_mount.load(std::memory_order_acquire);
+                path = trim_slashes(path);
+                if(mount == nullptr ||
+                   std::ranges::none_of(mount->unfiltered, [&](const std::string& dir) { return is_under(path, dir); }))
+                {
+                    return false;
+                }
+                path = trim_slashes(path.substr(mount->mount_point.size()));
+                std::error_code ec;
+                return std::filesystem::exists(
+                    mount->real / std::u8string_view(reinterpret_cast<const char8_t*>(path.data()), path.size()), ec);
+            }
+
+            bool busy_locked() const { return m_full_rebuild || m_building || m_covered < m_mounts.size(); }
+
+            void request_rebuild_locked()
+            {
+                if(!m_full_rebuild && !m_mounts.empty())
+                {
+                    m_full_rebuild = true;
+                    start_worker();
+                    m_changed.notify_all();
+                }
+            }
+
+            void start_worker()
+            {
+                if(!m_worker.joinable())
+                {
+                    m_worker = std::jthread([this](std::stop_token stop) { run(stop); });
+                }
+            }
+
+            void run(std::stop_token stop)
+            {
+                std::unique_lock lock(m_mutex);
+                while(!stop.stop_requested())
+                {
+                    m_changed.wait(lock, stop, [this] { return m_full_rebuild || m_covered < m_mounts.size(); });
+                    if(stop.stop_requested())
+                    {
+                        break;
+                    }
+
+                    bloom_filter* current = m_filter.load(std::memory_order_relaxed);
+                    if(!m_full_rebuild && current != nullptr)
+                    {
+                        // One new mount: walk it and add it to the filter we have, if it fits
+                        const mounted next = m_mounts[m_covered];
+                        lock.unlock();
+                        std::vector<uint64> hashes;
+                        walk(next, hashes, stop);
+                        lock.lock();
+                        if(current->inserted() + hashes.size() > current->capacity())
+                        {
+                            m_full_rebuild = true;
+                            continue;
+                        }
+                        for(uint64 hash : hashes)
+                        {
+                            current->insert(hash);
+                        }
+                        m_covered++;
+                    }
+                    else
+                    {
+                        // Everything from scratch.  Writes that land while we walk go into the old filter (which
+                        // stays correct) and get replayed into the new one.
+                        m_full_rebuild = false;
+                        m_building = true;
+                        m_added_while_building.clear();
+                        const std::vector<mounted> mounts = m_mounts;
+                        lock.unlock();
+                        std::vector<uint64> hashes;
+                        for(const mounted& mount : mounts)
+                        {
+                            walk(mount, hashes, stop);
+                        }
+                        lock.lock();
+                        m_building = false;
+                        hashes.insert(hashes.end(), m_added_while_building.begin(), m_added_while_building.end());
+                        m_added_while_building.clear();
+
+                        // Room to double before the next rebuild
+                        auto* filter = new bloom_filter(std::max<std::size_t>(hashes.size() * 2, 4096));
+                        for(uint64 hash : hashes)
+                        {
+                            filter->insert(hash);
+                        }
+                        bloom_filter* old = m_filter.exchange(filter, std::memory_order_acq_rel);
+                        m_covered = mounts.size();
+                        m_stale = 0;
+                        if(old != nullptr)
+                        {
+                            // A whole filter is too big to leave sitting in a retire batch until 63 more things are
+                            // retired, so wait out the readers (they only hold a guard for one lookup) and free it
+                            lock.unlock();
+                            epoch::synchronize();
+                            delete old;
+                            lock.lock();
+                        }
+                    }
+                    m_ready.store(m_covered == m_mounts.size(), std::memory_order_release);
+                    if(!busy_locked())
+                    {
+                        m_idle.notify_all();
+                    }
+                }
+                m_idle.notify_all();
+            }
+
+            static void walk(const mounted& mount, std::vector<uint64>& into, std::stop_token stop)
+            {
+                add_with_parents(mount.mount_point, into);
+
+                std::error_code ec;
+                if(std::filesystem::is_directory(mount.real, ec))
+                {
+                    // Straight from the OS, so we don't sit on PhysFS's lock for the whole walk
+                    constexpr auto options = std::filesystem::directory_options::follow_directory_symlink |
+                                             std::filesystem::directory_options::skip_permission_denied;
+                    for(auto it = std::filesystem::recursive_directory_iterator(mount.real, options, ec);
+                        !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+                    {
+                        if(stop.stop_requested())
+                        {
+                            return;
+                        }
+                        if(it.depth() > 64)
+                        {
+                            // Symlink loop, most likely
+                            it.disable_recursion_pending();
+                        }
+                        const std::u8string relative = it->path().lexically_relative(mount.real).generic_u8string();
+                        const std::string virtual_path = join_virtual(
+                            mount.mount_point,
+                            std::string_view(reinterpret_cast<const char*>(relative.data()), relative.size()));
+                        if(auto hash = filter_hash(virtual_path))
+                        {
+                            into.push_back(*hash);
+                        }
+                    }
+                    return;
+                }
+
+                // An archive: ask PhysFS.  This sees every mount under the mount point, not just this one, which
+                // only adds false positives.
+                struct enumeration
+                {
+                    std::vector<uint64>& into;
+                    std::vector<std::string> directories;
+                    const std::stop_token& stop;
+                } state {into, {mount.mount_point}, stop};
+                while(!state.directories.empty() && !stop.stop_requested())
+                {
+                    const std::string directory = std::move(state.directories.back());
+                    state.directories.pop_back();
+                    PHYSFS_enumerate(
+                        directory.empty() ? "/" : directory.c_str(),
+                        [](void* data, const char* origdir, const char* fname) -> PHYSFS_EnumerateCallbackResult {
+                            auto& state = *static_cast<enumeration*>(data);
+                            std::string_view parent = origdir;
+                            while(!parent.empty() && parent.front() == '/')
+                            {
+                                parent.remove_prefix(1);
+                            }
+                            std::string child = join_virtual(parent, fname);
+                            if(auto hash = filter_hash(child))
+                            {
+                                state.into.push_back(*hash);
+                            }
+                            PHYSFS_Stat stats;
+                            if(PHYSFS_stat(child.c_str(), &stats) && stats.filetype == PHYSFS_FILETYPE_DIRECTORY)
+                            {
+                                state.directories.push_back(std::move(child));
+                            }
+                            return state.stop.stop_requested() ? PHYSFS_ENUM_STOP : PHYSFS_ENUM_OK;
+                        },
+                        &state);
+                }
+            }
+
+            std::atomic<bloom_filter*> m_filter = nullptr;
+            std::atomic<bool> m_ready = true;
+            std::atomic<bool> m_enabled = true;
+            std::atomic<std::shared_ptr<const write_mount>> m_write_mount;
+
+            std::mutex m_mutex;
+            std::condition_variable_any m_changed;
+            std::condition_variable_any m_idle;
+            std::vector<mounted> m_mounts;
+            std::size_t m_covered = 0;
+            std::size_t m_stale = 0;
+            bool m_full_rebuild = false;
+            bool m_building = false;
+            std::vector<uint64> m_added_while_building;
+            std::jthread m_worker;
+        };
+    }
+
     void init_fs(std::string arg0, std::filesystem::path base_path, std::string app_name, std::string org_name)
     {
         // initialize physfs
@@ -45,6 +504,7 @@ namespace raoe::fs
         {
             if(maybe_error(PHYSFS_setWriteDir(prefdir.c_str())))
             {
+                path_filter::get().set_write_mount(prefdir, "");
                 mount(prefdir, "", false);
             }
         }
@@ -57,7 +517,10 @@ namespace raoe::fs
 
     void mount(std::filesystem::path path, std::filesystem::path mount_point, bool append_to_search_path)
     {
-        maybe_error(PHYSFS_mount(path.c_str(), mount_point.c_str(), append_to_search_path));
+        if(maybe_error(PHYSFS_mount(path.c_str(), mount_point.c_str(), append_to_search_path)))
+        {
+            path_filter::get().add_mount(std::move(path), mount_point.generic_string());
+        }
     }
 
     void permit_symlinks(bool allow)
@@ -67,19 +530,76 @@ namespace raoe::fs
 
     void mkdir(const path& path)
     {
-        maybe_error(PHYSFS_mkdir(reinterpret_cast<const char*>(path.c_str())));
+        if(maybe_error(PHYSFS_mkdir(reinterpret_cast<const char*>(path.c_str()))))
+        {
+            path_filter::get().add_path(path.string_view());
+        }
     }
 
     void delete_path(const path& path)
     {
-        maybe_error(PHYSFS_delete(reinterpret_cast<const char*>(path.c_str())));
+        if(maybe_error(PHYSFS_delete(reinterpret_cast<const char*>(path.c_str()))))
+        {
+            path_filter::get().removed_path();
+        }
     }
 
     bool exists(const path& path)
     {
+        if(!path_filter::get().may_exist(path.string_view()))
+        {
+            return false;
+        }
         return !!PHYSFS_exists(reinterpret_cast<const char*>(path.c_str()));
     }
 
+    void unfiltered_write_dir(const path& directory)
+    {
+        path_filter::get().add_unfiltered_dir(directory.string_view());
+    }
+
+    void rebuild_path_filter()
+    {
+        path_filter::get().request_rebuild();
+    }
+
+    void wait_for_path_filter()
+    {
+        path_filter::get().wait();
+    }
+
+    void set_path_filter_enabled(bool enabled)
+    {
+        path_filter::get().set_enabled(enabled);
+    }
+
+    uint64 mount_fingerprint()
+    {
+        uint64 fingerprint = 0;
+        char** search_path = PHYSFS_getSearchPath();
+        for(char** dir = search_path; dir != nullptr && *dir != nullptr; dir++)
+        {
+            const char* mount_point = PHYSFS_getMountPoint(*dir);
+            std::error_code ec;
+            const auto modified = std::filesystem::last_write_time(*dir, ec);
+            fingerprint = stable_hash(*dir, fingerprint);
+            fingerprint = stable_hash(mount_point != nullptr ? mount_point : "", fingerprint);
+            fingerprint = distribute(fingerprint ^ static_cast<uint64>(ec ? 0 : modified.time_since_epoch().count()));
+        }
+        PHYSFS_freeList(search_path);
+        return fingerprint;
+    }
+
+    std::filesystem::path write_dir()
+    {
+        const char* dir = PHYSFS_getWriteDir();
+        if(dir == nullptr)
+        {
+            return std::filesystem::path();
+        }
+        return std::filesystem::path(dir);
+    }
+
     path_stats stat(const path& path)
     {
         PHYSFS_Stat stats;
@@ -149,6 +669,42 @@ namespace raoe::fs
             return (unsigned char)(*gptr());
         }
 
+        std::streamsize xsgetn(char* into, std::streamsize count) override
+        {
+            raoe::check_if(m_file != nullptr, "File is nullptr");
+
+            // Drain whatever is already buffered, then read large requests straight into the caller's memory instead of
+            // bouncing them through our small buffer.  Block readers (like raoe::stream::line_reader) hit this path.
+            std::streamsize total = 0;
+            while(total < count)
+            {
+                const std::streamsize buffered = std::min<std::streamsize>(count - total, egptr() - gptr());
+                if(buffered > 0)
+                {
+                    std::memcpy(into + total, gptr(), static_cast<std::size_t>(buffered));
+                    gbump(static_cast<int>(buffered));
+                    total += buffered;
+                    continue;
+                }
+
+                const std::streamsize remaining = count - total;
+                if(remaining >= static_cast<std::streamsize>(TBufferSize))
+                {
+                    const PHYSFS_sint64 bytes_read = PHYSFS_readBytes(m_file, into + total, remaining);
+                    if(bytes_read <= 0)
+                    {
+                        break;
+                    }
+                    total += bytes_read;
+                }
+                else if(traits_type::eq_int_type(underflow(), traits_type::eof()))
+                {
+                    break;
+                }
+            }
+            return total;
+        }
+
         pos_type seekoff(off_type pos, std::ios_base::seekdir dir, std::ios_base::openmode mode) override
         {
             raoe::check_if(m_file != nullptr, "File is nullptr");
@@ -237,6 +793,7 @@ namespace raoe::fs
                                  : PHYSFS_openAppend(reinterpret_cast<const char*>(in_path.c_str())))
         , std::ostream(new physfs_streambuf<>(m_file))
     {
+        path_filter::get().add_path(in_path.string_view());
     }
     ofstream::~ofstream()
     {
@@ -0,0 +1,59 @@
+/*
+Copyright 2022-2024 Roy Awesome's Open Engine (RAOE)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "fs/filesystem.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// PhysFS can only be set up once, so everything that needs it lives in here
+TEST_CASE("Filesystem - exists() finds files written around PhysFS", "[filesystem]")
+{
+    raoe::fs::init_fs("raoe_filesystem_test", {}, "filesystem_test", "raoe");
+    const std::filesystem::path real = raoe::fs::write_dir();
+    REQUIRE_FALSE(real.empty());
+    std::filesystem::remove_all(real / "outside");
+    std::filesystem::remove_all(real / "elsewhere");
+    raoe::fs::unfiltered_write_dir(std::string("outside"));
+    // Every mount is in the filter, so a miss is a miss
+    raoe::fs::rebuild_path_filter();
+    raoe::fs::wait_for_path_filter();
+    REQUIRE_FALSE(raoe::fs::exists(std::string("outside/made.txt")));
+
+    // Like chunk_store and journal do, straight into the write dir
+    std::filesystem::create_directories(real / "outside" / "saves");
+    std::ofstream(real / "outside" / "made.txt") << "hello";
+    REQUIRE(raoe::fs::exists(std::string("outside")));
+    REQUIRE(raoe::fs::exists(std::string("outside/made.txt")));
+    REQUIRE(raoe::fs::exists(std::string("/outside/saves/")));
+    REQUIRE_FALSE(raoe::fs::exists(std::string("outside/never_made.txt")));
+
+    // Nobody said anything about this one, so a miss there is trusted without going to disk
+    std::filesystem::create_directories(real / "elsewhere");
+    REQUIRE_FALSE(raoe::fs::exists(std::string("elsewhere")));
+
+    // And through PhysFS, which the filter hears about
+    raoe::fs::mkdir(std::string("inside"));
+    REQUIRE(raoe::fs::exists(std::string("inside")));
+
+    std::filesystem::remove_all(real / "outside");
+    std::filesystem::remove_all(real / "inside");
+    std::filesystem::remove_all(real / "elsewhere");
+    REQUIRE_FALSE(raoe::fs::exists(std::string("outside/made.txt")));
+}